@@ -6,13 +6,28 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
+#include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/table.h"
+#include "leveldb/table_builder.h"
+#include "leveldb/table_file_writer.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
@@ -22,23 +37,49 @@
 //   Actual benchmarks:
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
+//      fillingest    -- fillseq through table files of --max_file_size
+//                       written with a TableFileWriter and then ingested
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
+//      fillsyncscaling -- fillsync split over 1, 2, 4, ... --threads
+//                       threads; use --histogram for the p99 latency
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      readrandomtrace -- readrandom that also asks Get() for a LookupTrace
+//      readrandomscaling -- readrandom split over 1, 2, 4, ... --threads
+//                       threads; compare the MB/s of the rows
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
+//      readwhilecompacting -- readwhilewriting without and then with a
+//                       rate limit on flushes and compactions; prints the
+//                       read latency percentiles of both runs
+//      readhotscan   -- random reads of a hot set of every 1000th key, each
+//                       batch of them after a full scan; runs once with
+//                       each cache policy and prints the hit rate of reads
 //      seekrandom    -- N random seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      filterbuild   -- repeated construction of a filter of --num keys,
+//                       with each filter policy; prints the size per key
+//      filterprobe   -- N probes for missing keys in a filter of --num keys,
+//                       with each filter policy; prints the false
+//                       positive rate
+//      cachelookup   -- N lookups of random keys in a cache filled with
+//                       --num entries, with --threads threads and each
+//                       cache policy
+//      mergeseq      -- scan N keys merged from 1, 2, 4, ... --merge_width
+//                       overlapping tables, as when reading many L0 files
+//      mergecompact  -- mergeseq that also writes the merged keys into a
+//                       new table, as a compaction of those files does
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      cachestats  -- Print the block and row cache hits and misses so far
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -64,6 +105,10 @@ static int FLAGS_num = 1000000;
 // Number of read operations to do.  If negative, do FLAGS_num reads.
 static int FLAGS_reads = -1;
 
+// If positive, readrandom draws its keys from a Zipfian distribution with
+// this parameter (e.g. 0.99; must be less than 1) instead of uniformly.
+static double FLAGS_zipf_theta = 0;
+
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
@@ -85,6 +130,14 @@ static int FLAGS_write_buffer_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
 
+// Number of compactions that may run concurrently.
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Number of threads that work on one compaction (Options::max_subcompactions).
+// Compare "fillrandom,compact" with and without this flag.
+static int FLAGS_subcompactions = 1;
+
 // Approximate size of user data packed per block (before compression.
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
@@ -93,6 +146,21 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Eviction policy of the cache: "lru" (NewLRUCache), "2q" (New2QCache) or
+// "clock" (NewClockCache).
+static const char* FLAGS_cache_policy = "lru";
+
+// The cache is split into 2^cache_numshardbits independently locked shards.
+static int FLAGS_cache_numshardbits = 4;
+
+// Number of bytes of an LRU cache of key-value pairs read from table files
+// (Options::row_cache).  Zero means none.
+static int FLAGS_row_cache_size = 0;
+
+// Number of bytes of an LRU cache for blocks evicted from the block cache,
+// kept compressed (Options::compressed_block_cache).  Zero means none.
+static int FLAGS_compressed_cache_size = 0;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -100,6 +168,18 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Filter policy used with --bloom_bits: "bloom" (NewBloomFilterPolicy),
+// "blocked" (NewBlockedBloomFilterPolicy) or "fuse"
+// (NewBinaryFuseFilterPolicy).
+static const char* FLAGS_filter_policy = "bloom";
+
+// Layout of the bloom filters of a table: "block" (kBlockBasedFilter),
+// "full" (kFullFilter) or "partitioned" (kPartitionedFilter).
+static leveldb::FilterLayout FLAGS_filter_layout = leveldb::kBlockBasedFilter;
+
+// Keys per filter partition (Options::filter_partition_keys).
+static int FLAGS_filter_partition_keys = 4096;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -108,6 +188,32 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, give each data block a hash index (Options::data_block_hash_index).
+// Compare "fillrandom,readrandom" with and without this flag.
+static bool FLAGS_data_block_hash_index = false;
+
+// If true, build a hash index over each memtable (Options::with_hashmap).
+// Run e.g. "fillrandom,readrandom" with a large --write_buffer_size with
+// and without this flag to compare against plain skiplist lookups.
+static bool FLAGS_memtable_hash_index = false;
+
+// If true, writers insert their batches into the memtable in parallel
+// (Options::allow_concurrent_memtable_write).  Compare "fillrandom" with a
+// large --threads with and without this flag.
+static bool FLAGS_concurrent_memtable_write = false;
+
+// If true, log the next group of writes while the previous group is
+// applied to the memtable (Options::enable_pipelined_write).  Compare
+// "fillsyncscaling" with and without this flag.
+static bool FLAGS_pipelined_write = false;
+
+// If positive, limit the I/O of flushes and compactions to this many MB/s
+// (Options::rate_limiter).  "readwhilecompacting" uses 4 MB/s if unset.
+static int FLAGS_rate_limiter_mb = 0;
+
+// Largest number of overlapping tables merged by mergeseq/mergecompact.
+static int FLAGS_merge_width = 16;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -116,6 +222,139 @@ namespace leveldb {
 namespace {
 leveldb::Env* g_env = nullptr;
 
+// "entry_charge" is the expected charge of the entries, which the clock
+// cache sizes its tables by.
+Cache* NewCache(const char* policy, size_t capacity, size_t entry_charge) {
+  if (strcmp(policy, "2q") == 0) {
+    return New2QCache(capacity, FLAGS_cache_numshardbits);
+  }
+  if (strcmp(policy, "clock") == 0) {
+    return NewClockCache(capacity, FLAGS_cache_numshardbits, entry_charge);
+  }
+  return NewLRUCache(capacity, FLAGS_cache_numshardbits);
+}
+
+const FilterPolicy* NewFilterPolicy(const char* policy, int bits_per_key) {
+  if (strcmp(policy, "blocked") == 0) {
+    return NewBlockedBloomFilterPolicy(bits_per_key);
+  }
+  if (strcmp(policy, "fuse") == 0) {
+    return NewBinaryFuseFilterPolicy(bits_per_key);
+  }
+  return NewBloomFilterPolicy(bits_per_key);
+}
+
+// Draws indexes in [0, n) from a Zipfian distribution: index rank i is
+// drawn with a probability proportional to 1 / (i+1)^theta.  Uses the
+// method of Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases" (SIGMOD '94).  The ranks are hashed so that the popular keys
+// are spread over the key space instead of being adjacent.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta)
+      : n_(n), alpha_(1.0 / (1.0 - theta)), zetan_(0) {
+    for (uint64_t i = 1; i <= n; i++) {
+      zetan_ += 1.0 / pow(static_cast<double>(i), theta);
+    }
+    zeta2_ = 1.0 + 1.0 / pow(2.0, theta);
+    eta_ = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2_ / zetan_);
+  }
+
+  uint64_t Next(Random* rnd) const {
+    const double u = static_cast<double>(rnd->Next()) / 2147483647.0;
+    const double uz = u * zetan_;
+    uint64_t rank;
+    if (uz < 1.0) {
+      rank = 0;
+    } else if (uz < zeta2_) {
+      rank = 1;
+    } else {
+      rank = static_cast<uint64_t>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+    }
+    char buf[8];
+    EncodeFixed64(buf, std::min(rank, n_ - 1));
+    return Hash(buf, sizeof(buf), 0) % n_;
+  }
+
+ private:
+  const uint64_t n_;
+  const double alpha_;
+  double zetan_;
+  double zeta2_;
+  double eta_;
+};
+
+// Returns table files whose reads always copy into the caller's buffer.
+// Blocks read from mmap()ed files are not block cached, so without this
+// "readhotscan" would never touch the cache on a 64-bit POSIX system.
+class CopyingReadEnv : public EnvWrapper {
+ public:
+  explicit CopyingReadEnv(Env* target) : EnvWrapper(target) {}
+
+  Status NewRandomAccessFile(const std::string& fname,
+                             RandomAccessFile** result) override {
+    RandomAccessFile* file;
+    Status s = target()->NewRandomAccessFile(fname, &file);
+    *result = s.ok() ? new CopyingFile(file) : nullptr;
+    return s;
+  }
+
+ private:
+  class CopyingFile : public RandomAccessFile {
+   public:
+    explicit CopyingFile(RandomAccessFile* target) : target_(target) {}
+    ~CopyingFile() override { delete target_; }
+
+    Status Read(uint64_t offset, size_t n, Slice* result,
+                char* scratch) const override {
+      Status s = target_->Read(offset, n, result, scratch);
+      if (s.ok() && result->data() != scratch) {
+        memcpy(scratch, result->data(), result->size());
+        *result = Slice(scratch, result->size());
+      }
+      return s;
+    }
+
+   private:
+    RandomAccessFile* const target_;
+  };
+};
+
+// Forwards to another cache and counts the lookups that hit.
+class HitCountingCache : public Cache {
+ public:
+  explicit HitCountingCache(Cache* target)
+      : target_(target), lookups_(0), hits_(0) {}
+  ~HitCountingCache() override { delete target_; }
+
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return target_->Insert(key, value, charge, deleter);
+  }
+  Handle* Lookup(const Slice& key) override {
+    Handle* handle = target_->Lookup(key);
+    lookups_.fetch_add(1, std::memory_order_relaxed);
+    if (handle != nullptr) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return handle;
+  }
+  void Release(Handle* handle) override { target_->Release(handle); }
+  void* Value(Handle* handle) override { return target_->Value(handle); }
+  void Erase(const Slice& key) override { target_->Erase(key); }
+  uint64_t NewId() override { return target_->NewId(); }
+  void Prune() override { target_->Prune(); }
+  size_t TotalCharge() const override { return target_->TotalCharge(); }
+
+  int64_t lookups() const { return lookups_.load(std::memory_order_relaxed); }
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+ private:
+  Cache* const target_;
+  std::atomic<int64_t> lookups_;
+  std::atomic<int64_t> hits_;
+};
+
 // Helper for quickly generating random data.
 class RandomGenerator {
  private:
@@ -310,7 +549,17 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* lookup_cache_;  // Used by "cachelookup"
+  const FilterPolicy* probe_policy_;  // Used by "filterbuild", "filterprobe"
+  std::vector<Slice> probe_keys_;
+  std::string probe_filter_;
+  HitCountingCache* counting_cache_;  // Used by "readhotscan"
+  Cache* compressed_cache_;
+  BlockCacheStats block_cache_stats_;
+  HitCountingCache* row_cache_;
+  ZipfianGenerator* zipf_;  // Key distribution of readrandom, if not uniform
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -333,6 +582,8 @@ class Benchmark {
     fprintf(stdout, "FileSize:   %.1f MB (estimated)\n",
             (((kKeySize + FLAGS_value_size * FLAGS_compression_ratio) * num_) /
              1048576.0));
+    fprintf(stdout, "MemTable:   %s\n",
+            FLAGS_memtable_hash_index ? "skiplist + hash index" : "skiplist");
     PrintWarnings();
     fprintf(stdout, "------------------------------------------------\n");
   }
@@ -395,10 +646,31 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
+      : cache_(FLAGS_cache_size >= 0
+                   ? NewCache(FLAGS_cache_policy, FLAGS_cache_size,
+                              FLAGS_block_size)
+                   : nullptr),
+        lookup_cache_(nullptr),
+        probe_policy_(nullptr),
+        counting_cache_(nullptr),
+        compressed_cache_(FLAGS_compressed_cache_size > 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        row_cache_(FLAGS_row_cache_size > 0
+                       ? new HitCountingCache(NewLRUCache(FLAGS_row_cache_size))
+                       : nullptr),
+        zipf_(FLAGS_zipf_theta > 0
+                  ? new ZipfianGenerator(FLAGS_num, FLAGS_zipf_theta)
+                  : nullptr),
         filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                           ? NewFilterPolicy(FLAGS_filter_policy,
+                                             FLAGS_bloom_bits)
                            : nullptr),
+        rate_limiter_(FLAGS_rate_limiter_mb > 0
+                          ? NewGenericRateLimiter(
+                                static_cast<int64_t>(FLAGS_rate_limiter_mb)
+                                << 20)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -420,7 +692,11 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete row_cache_;
+    delete zipf_;
     delete filter_policy_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -457,6 +733,9 @@ class Benchmark {
       } else if (name == Slice("fillseq")) {
         fresh_db = true;
         method = &Benchmark::WriteSeq;
+      } else if (name == Slice("fillingest")) {
+        fresh_db = true;
+        method = &Benchmark::WriteIngest;
       } else if (name == Slice("fillbatch")) {
         fresh_db = true;
         entries_per_batch_ = 1000;
@@ -483,6 +762,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("readrandomtrace")) {
+        method = &Benchmark::ReadRandomTrace;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -499,6 +780,16 @@ class Benchmark {
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
+      } else if (name == Slice("readwhilecompacting")) {
+        ReadWhileCompacting();
+      } else if (name == Slice("readhotscan")) {
+        ReadHotScan();
+      } else if (name == Slice("cachelookup")) {
+        CacheLookupByPolicy();
+      } else if (name == Slice("filterbuild")) {
+        FilterBenchmarkByPolicy("filterbuild", &Benchmark::FilterBuild);
+      } else if (name == Slice("filterprobe")) {
+        FilterBenchmarkByPolicy("filterprobe", &Benchmark::FilterProbe);
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
@@ -507,12 +798,22 @@ class Benchmark {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
         method = &Benchmark::SnappyUncompress;
+      } else if (name == Slice("readrandomscaling")) {
+        ReadRandomScaling();
+      } else if (name == Slice("fillsyncscaling")) {
+        FillSyncScaling();
+      } else if (name == Slice("mergeseq")) {
+        MergeTables(false);
+      } else if (name == Slice("mergecompact")) {
+        MergeTables(true);
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("cachestats")) {
+        PrintCacheStats();
       } else {
         if (!name.empty()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -630,6 +931,100 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  void CacheLookup(ThreadState* thread) {
+    char key[8];
+    int64_t found = 0;
+    for (int i = 0; i < reads_; i++) {
+      EncodeFixed64(key, thread->rand.Next() % FLAGS_num);
+      Cache::Handle* handle = lookup_cache_->Lookup(Slice(key, sizeof(key)));
+      if (handle != nullptr) {
+        found++;
+        lookup_cache_->Release(handle);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%lld of %d found)",
+             static_cast<long long>(found), reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Run cachelookup on a cache of each policy that holds all the keys.
+  void CacheLookupByPolicy() {
+    for (const char* policy : {"lru", "2q", "clock"}) {
+      lookup_cache_ = NewCache(policy, FLAGS_num, 1);
+      char key[8];
+      for (int i = 0; i < FLAGS_num; i++) {
+        EncodeFixed64(key, i);
+        lookup_cache_->Release(lookup_cache_->Insert(
+            Slice(key, sizeof(key)), nullptr, 1,
+            [](const Slice& key, void* value) {}));
+      }
+      char name[100];
+      snprintf(name, sizeof(name), "cachelookup/%s", policy);
+      RunBenchmark(FLAGS_threads, name, &Benchmark::CacheLookup);
+      delete lookup_cache_;
+      lookup_cache_ = nullptr;
+    }
+  }
+
+  void FilterProbe(ThreadState* thread) {
+    // Odd numbers are missing.
+    char key[8];
+    int64_t matches = 0;
+    for (int i = 0; i < reads_; i++) {
+      EncodeFixed64(key, 2 * (thread->rand.Next() % FLAGS_num) + 1);
+      if (probe_policy_->KeyMayMatch(Slice(key, sizeof(key)), probe_filter_)) {
+        matches++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%.3f%% false positives)",
+             matches * 100.0 / reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterBuild(ThreadState* thread) {
+    // Build filters of at least 100M keys in total.
+    std::string filter;
+    int64_t keys = 0;
+    while (keys < 100 * 1000000) {
+      filter.clear();
+      probe_policy_->CreateFilter(probe_keys_.data(), FLAGS_num, &filter);
+      keys += FLAGS_num;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%.2f bits per key)",
+             filter.size() * 8.0 / FLAGS_num);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Run "method" on a filter of --num keys of each filter policy with
+  // --bloom_bits bits per key, or 10 if it is not set.
+  void FilterBenchmarkByPolicy(const char* name,
+                               void (Benchmark::*method)(ThreadState*)) {
+    const int bits_per_key = FLAGS_bloom_bits > 0 ? FLAGS_bloom_bits : 10;
+    // Keys of the filter are even numbers.
+    std::string keys(8 * FLAGS_num, '\0');
+    probe_keys_.clear();
+    for (int i = 0; i < FLAGS_num; i++) {
+      EncodeFixed64(&keys[8 * i], 2 * i);
+      probe_keys_.emplace_back(&keys[8 * i], 8);
+    }
+    for (const char* policy : {"bloom", "blocked", "fuse"}) {
+      probe_policy_ = NewFilterPolicy(policy, bits_per_key);
+      probe_filter_.clear();
+      probe_policy_->CreateFilter(probe_keys_.data(), FLAGS_num,
+                                  &probe_filter_);
+      RunBenchmark(FLAGS_threads, std::string(name) + "/" + policy, method);
+      delete probe_policy_;
+      probe_policy_ = nullptr;
+    }
+    probe_keys_.clear();
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -683,12 +1078,24 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.compressed_block_cache = compressed_cache_;
+    options.block_cache_stats = &block_cache_stats_;
+    options.row_cache = row_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_subcompactions;
     options.block_size = FLAGS_block_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.filter_layout = FLAGS_filter_layout;
+    options.filter_partition_keys = FLAGS_filter_partition_keys;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.with_hashmap = FLAGS_memtable_hash_index;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
+    options.enable_pipelined_write = FLAGS_pipelined_write;
+    options.rate_limiter = rate_limiter_;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -738,6 +1145,122 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void WriteIngest(ThreadState* thread) {
+    Options options;
+    options.env = g_env;
+    options.block_size = FLAGS_block_size;
+    options.filter_policy = filter_policy_;
+    options.filter_layout = FLAGS_filter_layout;
+    options.filter_partition_keys = FLAGS_filter_partition_keys;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+
+    RandomGenerator gen;
+    std::vector<std::string> paths;
+    TableFileWriter* writer = nullptr;
+    Status s;
+    int64_t bytes = 0;
+    for (int i = 0; i < num_ && s.ok(); i++) {
+      if (writer == nullptr) {
+        char fname[100];
+        snprintf(fname, sizeof(fname), "/ingest-%06d.ldb",
+                 static_cast<int>(paths.size()));
+        paths.push_back(std::string(FLAGS_db) + fname);
+        writer = new TableFileWriter(options);
+        s = writer->Open(paths.back());
+        if (!s.ok()) break;
+      }
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      s = writer->Put(key, gen.Generate(value_size_));
+      bytes += value_size_ + strlen(key);
+      thread->stats.FinishedSingleOp();
+      if (s.ok() &&
+          (writer->FileSize() >= static_cast<uint64_t>(FLAGS_max_file_size) ||
+           i + 1 == num_)) {
+        s = writer->Finish();
+        delete writer;
+        writer = nullptr;
+      }
+    }
+    delete writer;
+    if (s.ok()) {
+      s = db_->IngestExternalFiles(paths);
+    }
+    if (!s.ok()) {
+      fprintf(stderr, "ingest error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+    for (const std::string& path : paths) {
+      g_env->RemoveFile(path);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Ten rounds of a full scan of the DB with fill_cache set followed by
+  // random reads of a hot set of every 1000th key, as many reads as there
+  // are hot keys.  The hot keys are spread out so that each one is in a
+  // block of its own.  Reports the fraction of the cache lookups of the
+  // reads, not of the scans, that hit.
+  void ReadHotWhileScanning(ThreadState* thread) {
+    const int hot_keys = std::max(1, FLAGS_num / 1000);
+    const int rounds = 10;
+    int64_t lookups = 0;
+    int64_t hits = 0;
+    std::string value;
+    for (int round = 0; round < rounds; round++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      }
+      delete iter;
+
+      const int64_t lookups_before = counting_cache_->lookups();
+      const int64_t hits_before = counting_cache_->hits();
+      for (int i = 0; i < hot_keys; i++) {
+        char key[100];
+        const int k = (thread->rand.Next() % hot_keys) * 1000;
+        snprintf(key, sizeof(key), "%016d", k);
+        db_->Get(ReadOptions(), key, &value);
+        thread->stats.FinishedSingleOp();
+      }
+      lookups += counting_cache_->lookups() - lookups_before;
+      hits += counting_cache_->hits() - hits_before;
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(hit rate %.1f%%)",
+             lookups > 0 ? 100.0 * hits / lookups : 0.0);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Run ReadHotWhileScanning() with a block cache of each policy of
+  // --cache_size bytes (8MB if unset).  Run this after e.g. fillrandom
+  // with a DB several times larger than the cache.
+  void ReadHotScan() {
+    Cache* const configured = cache_;
+    Env* const env = g_env;
+    CopyingReadEnv copying_env(g_env);
+    g_env = &copying_env;
+    const size_t capacity =
+        FLAGS_cache_size >= 0 ? FLAGS_cache_size : 8 << 20;
+    for (const char* policy : {"lru", "2q", "clock"}) {
+      delete db_;
+      db_ = nullptr;
+      counting_cache_ = new HitCountingCache(
+          NewCache(policy, capacity, FLAGS_block_size));
+      cache_ = counting_cache_;
+      Open();
+      char name[100];
+      snprintf(name, sizeof(name), "readhotscan/%s", policy);
+      RunBenchmark(1, name, &Benchmark::ReadHotWhileScanning);
+      delete db_;
+      db_ = nullptr;
+      delete counting_cache_;
+      counting_cache_ = nullptr;
+    }
+    cache_ = configured;
+    g_env = env;
+    Open();
+  }
+
   void ReadSequential(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -764,22 +1287,72 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
-  void ReadRandom(ThreadState* thread) {
+  void ReadRandom(ThreadState* thread) { DoReadRandom(thread, false); }
+
+  void ReadRandomTrace(ThreadState* thread) { DoReadRandom(thread, true); }
+
+  void DoReadRandom(ThreadState* thread, bool with_trace) {
     ReadOptions options;
     std::string value;
+    LookupTrace trace;
     int found = 0;
+    int64_t bytes = 0;
     for (int i = 0; i < reads_; i++) {
       char key[100];
-      const int k = thread->rand.Next() % FLAGS_num;
+      const int k = zipf_ != nullptr ? zipf_->Next(&thread->rand)
+                                     : thread->rand.Next() % FLAGS_num;
       snprintf(key, sizeof(key), "%016d", k);
-      if (db_->Get(options, key, &value).ok()) {
+      Status s = with_trace ? db_->Get(options, key, &value, &trace)
+                           : db_->Get(options, key, &value);
+      if (s.ok()) {
         found++;
+        bytes += 16 + value.size();
       }
       thread->stats.FinishedSingleOp();
     }
     char msg[100];
     snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
     thread->stats.AddMessage(msg);
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Run readrandom with 1, 2, 4, ... up to --threads threads that share
+  // the reads.  The MB/s is over the elapsed time, so it shows how the
+  // throughput of concurrent reads scales.
+  void ReadRandomScaling() {
+    const int total_reads = reads_;
+    for (int n = 1; n <= std::max(FLAGS_threads, 1); n *= 2) {
+      reads_ = std::max(total_reads / n, 1);
+      char name[100];
+      snprintf(name, sizeof(name), "readrandom/%d", n);
+      RunBenchmark(n, name, &Benchmark::ReadRandom);
+    }
+    reads_ = total_reads;
+  }
+
+  // Run fillsync on a fresh database with 1, 2, 4, ... up to --threads
+  // threads that share the writes.  More writers form bigger groups that
+  // share each log sync, so the MB/s should grow with the thread count.
+  void FillSyncScaling() {
+    if (FLAGS_use_existing_db) {
+      fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+              "fillsyncscaling");
+      return;
+    }
+    const int total_writes = num_ / 1000;
+    write_options_.sync = true;
+    for (int n = 1; n <= std::max(FLAGS_threads, 1); n *= 2) {
+      delete db_;
+      db_ = nullptr;
+      DestroyDB(FLAGS_db, Options());
+      Open();
+      num_ = std::max(total_writes / n, 1);
+      char name[100];
+      snprintf(name, sizeof(name), "fillsync/%d", n);
+      RunBenchmark(n, name, &Benchmark::WriteRandom);
+    }
+    num_ = FLAGS_num;
+    write_options_ = WriteOptions();
   }
 
   void ReadMissing(ThreadState* thread) {
@@ -880,8 +1453,61 @@ class Benchmark {
     }
   }
 
+  // Run readwhilewriting on the current database once without and once
+  // with a rate limiter on flushes and compactions, and print the latency
+  // percentiles of the reads of both runs.  The overwrites keep flushes and
+  // compactions busy, so run this after e.g. fillrandom with a small
+  // --write_buffer_size.
+  void ReadWhileCompacting() {
+    const bool histogram = FLAGS_histogram;
+    FLAGS_histogram = true;
+    RateLimiter* const configured = rate_limiter_;
+    RateLimiter* limiter = NewGenericRateLimiter(
+        static_cast<int64_t>(FLAGS_rate_limiter_mb > 0 ? FLAGS_rate_limiter_mb
+                                                        : 4)
+        << 20);
+    for (RateLimiter* run : {static_cast<RateLimiter*>(nullptr), limiter}) {
+      delete db_;
+      db_ = nullptr;
+      rate_limiter_ = run;
+      Open();
+      char name[100];
+      if (run == nullptr) {
+        snprintf(name, sizeof(name), "readwhilecompacting/unlimited");
+      } else {
+        snprintf(name, sizeof(name), "readwhilecompacting/%dMB/s",
+                 static_cast<int>(run->GetBytesPerSecond() >> 20));
+      }
+      RunBenchmark(FLAGS_threads + 1, name, &Benchmark::ReadWhileWriting);
+    }
+    delete db_;
+    db_ = nullptr;
+    rate_limiter_ = configured;
+    Open();
+    delete limiter;
+    FLAGS_histogram = histogram;
+  }
+
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
+  void PrintCacheStats() {
+    const BlockCacheStats& s = block_cache_stats_;
+    fprintf(stdout,
+            "\nblock cache:       %llu hits, %llu misses\n"
+            "compressed cache:  %llu hits, %llu misses, %llu demotions\n",
+            static_cast<unsigned long long>(s.hits.load()),
+            static_cast<unsigned long long>(s.misses.load()),
+            static_cast<unsigned long long>(s.compressed_hits.load()),
+            static_cast<unsigned long long>(s.compressed_misses.load()),
+            static_cast<unsigned long long>(s.demotions.load()));
+    if (row_cache_ != nullptr) {
+      fprintf(stdout, "row cache:         %lld hits, %lld misses\n",
+              static_cast<long long>(row_cache_->hits()),
+              static_cast<long long>(row_cache_->lookups() -
+                                     row_cache_->hits()));
+    }
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -890,6 +1516,84 @@ class Benchmark {
     fprintf(stdout, "\n%s\n", stats.c_str());
   }
 
+  // Spread num_ keys round-robin over "width" in-memory tables and time a
+  // merging iterator over all of them.  The tables overlap across their
+  // whole key range, like freshly flushed level-0 files.
+  void MergeTables(bool compact) {
+    RandomGenerator gen;
+    for (int width = 1; width <= FLAGS_merge_width; width *= 2) {
+      Env* env = NewMemEnv(g_env);
+      Options options;
+      options.env = env;
+      options.block_size = FLAGS_block_size;
+
+      std::vector<RandomAccessFile*> files(width);
+      std::vector<Table*> tables(width);
+      std::vector<Iterator*> iters(width);
+      char fname[100];
+      for (int t = 0; t < width; t++) {
+        snprintf(fname, sizeof(fname), "/merge/%06d.ldb", t);
+        WritableFile* file;
+        Status s = env->NewWritableFile(fname, &file);
+        TableBuilder builder(options, file);
+        for (int i = t; i < num_; i += width) {
+          char key[100];
+          snprintf(key, sizeof(key), "%016d", i);
+          builder.Add(key, gen.Generate(value_size_));
+        }
+        if (s.ok()) s = builder.Finish();
+        if (s.ok()) s = file->Close();
+        delete file;
+        uint64_t size;
+        if (s.ok()) s = env->GetFileSize(fname, &size);
+        if (s.ok()) s = env->NewRandomAccessFile(fname, &files[t]);
+        if (s.ok()) s = Table::Open(options, files[t], size, &tables[t]);
+        if (!s.ok()) {
+          fprintf(stderr, "table error: %s\n", s.ToString().c_str());
+          exit(1);
+        }
+        iters[t] = tables[t]->NewIterator(ReadOptions());
+      }
+      Iterator* iter =
+          NewMergingIterator(BytewiseComparator(), iters.data(), width);
+
+      WritableFile* out_file = nullptr;
+      TableBuilder* out = nullptr;
+      if (compact) {
+        env->NewWritableFile("/merge/output.ldb", &out_file);
+        out = new TableBuilder(options, out_file);
+      }
+
+      Stats stats;
+      int64_t bytes = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        bytes += iter->key().size() + iter->value().size();
+        if (out != nullptr) {
+          out->Add(iter->key(), iter->value());
+        }
+        stats.FinishedSingleOp();
+      }
+      if (out != nullptr) {
+        out->Finish();
+        out_file->Close();
+      }
+      stats.AddBytes(bytes);
+      stats.Stop();
+      snprintf(fname, sizeof(fname), "%s/%d",
+               compact ? "mergecompact" : "mergeseq", width);
+      stats.Report(fname);
+
+      delete out;
+      delete out_file;
+      delete iter;
+      for (int t = 0; t < width; t++) {
+        delete tables[t];
+        delete files[t];
+      }
+      delete env;
+    }
+  }
+
   static void WriteToFile(void* arg, const char* buf, int n) {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
@@ -917,6 +1621,8 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
@@ -935,13 +1641,30 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--memtable_hash_index=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_memtable_hash_index = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &d, &junk) == 1 &&
+               d < 1) {
+      FLAGS_zipf_theta = d;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
@@ -950,14 +1673,47 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_subcompactions = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (strcmp(argv[i], "--cache_policy=lru") == 0 ||
+               strcmp(argv[i], "--cache_policy=2q") == 0 ||
+               strcmp(argv[i], "--cache_policy=clock") == 0) {
+      FLAGS_cache_policy = argv[i] + strlen("--cache_policy=");
+    } else if (sscanf(argv[i], "--cache_numshardbits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_numshardbits = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strcmp(argv[i], "--filter_policy=bloom") == 0 ||
+               strcmp(argv[i], "--filter_policy=blocked") == 0 ||
+               strcmp(argv[i], "--filter_policy=fuse") == 0) {
+      FLAGS_filter_policy = argv[i] + strlen("--filter_policy=");
+    } else if (strcmp(argv[i], "--filter_layout=block") == 0) {
+      FLAGS_filter_layout = leveldb::kBlockBasedFilter;
+    } else if (strcmp(argv[i], "--filter_layout=full") == 0) {
+      FLAGS_filter_layout = leveldb::kFullFilter;
+    } else if (strcmp(argv[i], "--filter_layout=partitioned") == 0) {
+      FLAGS_filter_layout = leveldb::kPartitionedFilter;
+    } else if (sscanf(argv[i], "--filter_partition_keys=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_filter_partition_keys = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--rate_limiter_mb=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limiter_mb = n;
+    } else if (sscanf(argv[i], "--merge_width=%d%c", &n, &junk) == 1) {
+      FLAGS_merge_width = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
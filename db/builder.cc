@@ -11,6 +11,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 // Copyright (c) 2011 The LevelDB Authors. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be
@@ -20,6 +21,7 @@
 #include "db/builder.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -53,30 +55,52 @@ std::string DecoderFromKV(const Slice& key, const Slice& value){
 
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
 
   std::vector<std::string>key_value;
 
-  if (iter->Valid()) {
+  if (iter->Valid() || (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != nullptr) {
+      file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                        Env::kHigh);
+    }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool empty = !iter->Valid();
+    if (!empty) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);//记录当前SSTable最大的Key
       builder->Add(key, iter->value());
       key_value.push_back(DecoderFromKV(key, iter->value())); // NOTE 将KV记录
     }
+    if (range_del_iter != nullptr) {
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        ExtendFileRange(options.comparator, range_del_iter->key(),
+                        range_del_iter->value(), &meta->smallest,
+                        &meta->largest, &empty);
+        meta->has_range_deletions = true;
+      }
+    }
 
     // Finish and check for builder errors
     s = builder->Finish();
@@ -128,6 +152,8 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
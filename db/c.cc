@@ -352,6 +352,9 @@ void leveldb_writebatch_iterate(const leveldb_writebatch_t* b, void* state,
     void Delete(const Slice& key) override {
       (*deleted_)(state_, key.data(), key.size());
     }
+    void DeleteRange(const Slice& begin, const Slice& end) override {
+      // Not reported: the C callbacks have no way to express a range.
+    }
   };
   H handler;
   handler.state_ = state;
@@ -0,0 +1,250 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/column_family.h"
+
+#include "db/db_impl.h"
+#include "db/memtable.h"
+#include "db/table_cache.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+const char kDefaultColumnFamilyName[] = "default";
+
+namespace {
+
+// Markers stored in a thread's local_sv_ slot instead of a SuperVersion.
+char sv_in_use_marker;
+char sv_obsolete_marker;
+void* const kSVInUse = &sv_in_use_marker;
+void* const kSVObsolete = &sv_obsolete_marker;
+
+// Releases the SuperVersion cached by an exiting thread.
+void UnrefThreadLocalSuperVersion(void* ptr) {
+  if (ptr != kSVObsolete) {
+    // A cached SuperVersion is the installed one, which holds a reference
+    // of its own, so this is never the last reference.
+    SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+    const bool last = sv->Unref();
+    assert(!last);
+    (void)last;
+  }
+}
+
+}  // namespace
+
+SuperVersion::SuperVersion(MemTable* mem, MemTable* imm, Version* current)
+    : mem(mem), imm(imm), current(current), refs_(1) {
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+}
+
+void SuperVersion::Cleanup() {
+  assert(refs_.load(std::memory_order_relaxed) == 0);
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+  delete this;
+}
+
+ColumnFamilyHandle::~ColumnFamilyHandle() = default;
+
+const std::string& ColumnFamilyHandleImpl::GetName() const {
+  return cfd_->name();
+}
+
+uint32_t ColumnFamilyHandleImpl::GetID() const { return cfd_->id(); }
+
+// Storage options are per family, but the family lives in the DB's
+// directory and shares its environment, info log and error handling.
+static Options ColumnFamilyOptions(const Options& db_options,
+                                   const Options& options) {
+  Options result = options;
+  result.env = db_options.env;
+  result.info_log = db_options.info_log;
+  result.paranoid_checks = db_options.paranoid_checks;
+  result.reuse_logs = db_options.reuse_logs;
+  result.allow_concurrent_memtable_write =
+      db_options.allow_concurrent_memtable_write;
+  result.rate_limiter = db_options.rate_limiter;
+  if (result.block_cache == nullptr) {
+    result.block_cache = db_options.block_cache;
+  }
+  if (result.compressed_block_cache == nullptr) {
+    result.compressed_block_cache = db_options.compressed_block_cache;
+  }
+  if (result.block_cache_stats == nullptr) {
+    result.block_cache_stats = db_options.block_cache_stats;
+  }
+  if (result.row_cache == nullptr) {
+    result.row_cache = db_options.row_cache;
+  }
+  return result;
+}
+
+ColumnFamilyData::ColumnFamilyData(const Options& options,
+                                   const InternalKeyComparator& icmp,
+                                   TableCache* table_cache)
+    : id_(0),
+      name_(kDefaultColumnFamilyName),
+      icmp_(icmp),
+      ipolicy_(nullptr),
+      options_(options),
+      owns_table_cache_(false),
+      table_cache_(table_cache),
+      handle_(this),
+      dummy_versions_(this),
+      current_(nullptr),
+      log_number_(0),
+      mem_(nullptr),
+      imm_(nullptr),
+      imm_log_number_(0),
+      super_version_(nullptr),
+      local_sv_(&UnrefThreadLocalSuperVersion),
+      flush_level_(-1) {
+  AppendVersion(new Version(this));
+}
+
+ColumnFamilyData::ColumnFamilyData(uint32_t id, const std::string& name,
+                                   const std::string& dbname,
+                                   const Options& db_options,
+                                   const Options& options)
+    : id_(id),
+      name_(name),
+      icmp_(options.comparator),
+      ipolicy_(options.filter_policy),
+      options_(SanitizeOptions(dbname, &icmp_, &ipolicy_,
+                               ColumnFamilyOptions(db_options, options))),
+      owns_table_cache_(true),
+      table_cache_(new TableCache(dbname, options_, TableCacheSize(options_))),
+      handle_(this),
+      dummy_versions_(this),
+      current_(nullptr),
+      log_number_(0),
+      mem_(nullptr),
+      imm_(nullptr),
+      imm_log_number_(0),
+      super_version_(nullptr),
+      local_sv_(&UnrefThreadLocalSuperVersion),
+      flush_level_(-1) {
+  AppendVersion(new Version(this));
+}
+
+ColumnFamilyData::~ColumnFamilyData() {
+  if (super_version_ != nullptr) {
+    std::vector<void*> cached;
+    local_sv_.Scrape(&cached, nullptr);
+    for (void* ptr : cached) {
+      UnrefThreadLocalSuperVersion(ptr);
+    }
+    if (super_version_->Unref()) {
+      super_version_->Cleanup();
+    }
+  }
+  current_->Unref();
+  assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  if (mem_ != nullptr) mem_->Unref();
+  if (imm_ != nullptr) imm_->Unref();
+  if (owns_table_cache_) {
+    delete table_cache_;
+  }
+}
+
+void ColumnFamilyData::AppendVersion(Version* v) {
+  // Make "v" current
+  assert(v->refs_ == 0);
+  assert(v != current_);
+  if (current_ != nullptr) {
+    current_->Unref();
+  }
+  current_ = v;
+  v->Ref();
+
+  // Append to linked list
+  v->prev_ = dummy_versions_.prev_;
+  v->next_ = &dummy_versions_;
+  v->prev_->next_ = v;
+  v->next_->prev_ = v;
+
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::SetMemTable(MemTable* mem) {
+  assert(mem_ == nullptr);
+  mem_ = mem;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::SwitchMemTable(MemTable* mem, uint64_t log_number) {
+  assert(imm_ == nullptr);
+  imm_ = mem_;
+  imm_log_number_ = log_number;
+  mem_ = mem;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::ClearImmutableMemTable() {
+  assert(imm_ != nullptr);
+  imm_->Unref();
+  imm_ = nullptr;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::InstallSuperVersion() {
+  if (mem_ == nullptr) {
+    // Not opened yet, so there are no readers.
+    return;
+  }
+  SuperVersion* old = super_version_;
+  super_version_ = new SuperVersion(mem_, imm_, current_);
+
+  // Make the threads fetch the new one on their next read.  A thread
+  // that is reading with its cached one releases it when it is done.
+  std::vector<void*> cached;
+  local_sv_.Scrape(&cached, kSVObsolete);
+  for (void* ptr : cached) {
+    if (ptr != kSVInUse && ptr != kSVObsolete) {
+      SuperVersion* sv = reinterpret_cast<SuperVersion*>(ptr);
+      if (sv->Unref()) {
+        sv->Cleanup();
+      }
+    }
+  }
+  if (old != nullptr && old->Unref()) {
+    old->Cleanup();
+  }
+}
+
+SuperVersion* ColumnFamilyData::GetThreadLocalSuperVersion(port::Mutex* mu) {
+  void* ptr = local_sv_.Swap(kSVInUse);
+  assert(ptr != kSVInUse);
+  if (ptr != nullptr && ptr != kSVObsolete) {
+    return reinterpret_cast<SuperVersion*>(ptr);
+  }
+  MutexLock l(mu);
+  super_version_->Ref();
+  return super_version_;
+}
+
+void ColumnFamilyData::ReturnThreadLocalSuperVersion(SuperVersion* sv,
+                                                      port::Mutex* mu) {
+  void* expected = kSVInUse;
+  if (local_sv_.CompareAndSwap(sv, &expected)) {
+    return;
+  }
+  // A newer SuperVersion was installed while "sv" was in use.
+  assert(expected == kSVObsolete);
+  if (sv->Unref()) {
+    MutexLock l(mu);
+    sv->Cleanup();
+  }
+}
+
+bool ColumnFamilyData::HasUnflushedData() const {
+  return imm_ != nullptr || (mem_ != nullptr && !mem_->IsEmpty());
+}
+
+}  // namespace leveldb
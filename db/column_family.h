@@ -0,0 +1,214 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A column family is an independent LSM tree inside a DB.  Each family
+// has its own memtables, table files, Versions and storage Options, and
+// is flushed and compacted on its own.  All families share the DB's
+// write-ahead log, MANIFEST, sequence numbers and snapshots, so a
+// WriteBatch that updates several families is applied atomically.
+//
+// ColumnFamilyData holds the state of one family.  Its mutable state is
+// protected by the DB mutex, except that the writer at the front of the
+// DB's writer queue may insert into mem() without holding it.  Reads get
+// the memtables and current version from a SuperVersion without the
+// mutex.
+
+#ifndef STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+#define STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/version_set.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+#include "port/port.h"
+#include "util/thread_local.h"
+
+namespace leveldb {
+
+class ColumnFamilyData;
+class MemTable;
+class TableCache;
+
+class ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  explicit ColumnFamilyHandleImpl(ColumnFamilyData* cfd) : cfd_(cfd) {}
+
+  const std::string& GetName() const override;
+  uint32_t GetID() const override;
+
+  ColumnFamilyData* cfd() const { return cfd_; }
+
+ private:
+  ColumnFamilyData* const cfd_;
+};
+
+// The memtables and current version of a column family at some point in
+// time.  A SuperVersion holds a reference to each of them and never
+// changes; ColumnFamilyData installs a new one whenever one of them does.
+class SuperVersion {
+ public:
+  SuperVersion(MemTable* mem, MemTable* imm, Version* current);
+
+  SuperVersion(const SuperVersion&) = delete;
+  SuperVersion& operator=(const SuperVersion&) = delete;
+
+  // Ref() and Unref() may be called without the DB mutex.  Unref()
+  // returns true when it drops the last reference, in which case the
+  // caller must call Cleanup() with the DB mutex held.
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  bool Unref() { return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+  // Release the memtables and version and delete this.
+  // REQUIRES: DB mutex held and no references left
+  void Cleanup();
+
+  MemTable* const mem;
+  MemTable* const imm;  // May be null
+  Version* const current;
+
+ private:
+  ~SuperVersion() = default;
+
+  std::atomic<int> refs_;
+};
+
+class ColumnFamilyData {
+ public:
+  ColumnFamilyData(const ColumnFamilyData&) = delete;
+  ColumnFamilyData& operator=(const ColumnFamilyData&) = delete;
+
+  ~ColumnFamilyData();
+
+  uint32_t id() const { return id_; }
+  const std::string& name() const { return name_; }
+
+  // The sanitized options of this family.  options().comparator orders
+  // internal keys the same way as internal_comparator().
+  const Options& options() const { return options_; }
+  const InternalKeyComparator& internal_comparator() const { return icmp_; }
+  const Comparator* user_comparator() const { return icmp_.user_comparator(); }
+
+  // The cache of open table files of this family.
+  TableCache* table_cache() const { return table_cache_; }
+
+  ColumnFamilyHandle* handle() { return &handle_; }
+
+  // Return the current version of this family.
+  Version* current() const { return current_; }
+
+  // Return the number of the oldest log file that may contain updates
+  // to this family that are not yet in its table files.
+  uint64_t log_number() const { return log_number_; }
+
+  // The memtable that receives new writes.  Null until the DB is opened.
+  MemTable* mem() const { return mem_; }
+
+  // The memtable being flushed, or null.
+  MemTable* imm() const { return imm_; }
+
+  // The log number this family can advance to once imm() is flushed:
+  // the log that was started when imm() stopped receiving writes.
+  uint64_t imm_log_number() const { return imm_log_number_; }
+
+  // Install "mem" as the active memtable, taking over the caller's
+  // reference.  REQUIRES: mem() == nullptr
+  void SetMemTable(MemTable* mem);
+
+  // Make the active memtable immutable and continue with "mem", whose
+  // updates all go to log files numbered "log_number" or higher.
+  // REQUIRES: imm() == nullptr
+  void SwitchMemTable(MemTable* mem, uint64_t log_number);
+
+  // Drop the immutable memtable once its contents are in table files.
+  void ClearImmutableMemTable();
+
+  // Returns true iff the family has updates that are not yet in its
+  // table files.
+  bool HasUnflushedData() const;
+
+  // Return a referenced SuperVersion for a read that does not hold the
+  // DB mutex "mu".  Normally this is the one cached by the calling thread
+  // and "mu" is not locked.  The caller must hand it back to
+  // ReturnThreadLocalSuperVersion() on the same thread.
+  SuperVersion* GetThreadLocalSuperVersion(port::Mutex* mu);
+
+  // Cache "sv" for the next read of the calling thread, or release it if
+  // a newer one was installed in the meantime.  REQUIRES: "mu" not held.
+  void ReturnThreadLocalSuperVersion(SuperVersion* sv, port::Mutex* mu);
+
+ private:
+  friend class Version;
+  friend class VersionSet;
+
+  // Create the default column family.  "options" must already be
+  // sanitized and "table_cache" is owned by the caller.
+  ColumnFamilyData(const Options& options, const InternalKeyComparator& icmp,
+                   TableCache* table_cache);
+
+  // Create the column family "name" with the given id.  Its storage
+  // options come from "options"; DB-wide settings such as the
+  // environment and info log come from "db_options".
+  ColumnFamilyData(uint32_t id, const std::string& name,
+                   const std::string& dbname, const Options& db_options,
+                   const Options& options);
+
+  void AppendVersion(Version* v);
+
+  // Publish mem(), imm() and current() to readers in a new SuperVersion.
+  void InstallSuperVersion();
+
+  const uint32_t id_;
+  const std::string name_;
+  const InternalKeyComparator icmp_;
+  const InternalFilterPolicy ipolicy_;
+  const Options options_;
+  const bool owns_table_cache_;
+  TableCache* const table_cache_;
+  ColumnFamilyHandleImpl handle_;
+
+  Version dummy_versions_;  // Head of circular doubly-linked list of versions.
+  Version* current_;        // == dummy_versions_.prev_
+
+  // Per-level key at which the next compaction at that level should start.
+  // Either an empty string, or a valid InternalKey.
+  std::string compact_pointer_[config::kNumLevels];
+
+  uint64_t log_number_;
+
+  MemTable* mem_;
+  MemTable* imm_;
+  uint64_t imm_log_number_;
+
+  // The SuperVersion of mem_, imm_ and current_, or null before the family
+  // has a memtable.  Each thread caches a referenced copy in local_sv_, or
+  // one of the markers kSVInUse while it is reading with it and
+  // kSVObsolete once a newer one was installed.
+  SuperVersion* super_version_;
+  ThreadLocalPtr local_sv_;
+
+  // The compactions of this family that are running.  Each one will add
+  // files to the key range [smallest,largest] of level()+1, and no other
+  // compaction or flush may add files there until it is done.
+  std::vector<Compaction*> running_compactions_;
+
+  // The level and key range of the table that a memtable flush is about
+  // to add above level 0, or level -1 if there is none.
+  int flush_level_;
+  InternalKey flush_smallest_;
+  InternalKey flush_largest_;
+
+  // The tables that an ingestion is about to add, with their levels.  No
+  // compaction or flush may add files that overlap one of them to its
+  // level or any level above it until the ingestion is done.
+  std::vector<std::pair<int, FileMetaData>> ingested_files_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
@@ -0,0 +1,268 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/db_impl.h"
+#include "leveldb/comparator.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+
+class ReverseComparator : public Comparator {
+ public:
+  const char* Name() const override { return "leveldb.ReverseComparator"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    return BytewiseComparator()->Compare(b, a);
+  }
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {}
+  void FindShortSuccessor(std::string* key) const override {}
+};
+
+}  // namespace
+
+class ColumnFamilyTest : public testing::Test {
+ public:
+  ColumnFamilyTest() : db_(nullptr) {
+    dbname_ = testing::TempDir() + "/column_family_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    EXPECT_LEVELDB_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~ColumnFamilyTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  DBImpl* dbfull() const { return reinterpret_cast<DBImpl*>(db_); }
+
+  ColumnFamilyHandle* Create(const std::string& name,
+                             const Options& options = Options()) {
+    ColumnFamilyHandle* handle = nullptr;
+    EXPECT_LEVELDB_OK(db_->CreateColumnFamily(options, name, &handle));
+    return handle;
+  }
+
+  // Reopen the DB with the given column families.  Stores their handles
+  // in handles_.
+  Status Reopen(const std::vector<ColumnFamilyDescriptor>& families) {
+    delete db_;
+    db_ = nullptr;
+    return DB::Open(options_, dbname_, families, &handles_, &db_);
+  }
+
+  std::string Get(ColumnFamilyHandle* cf, const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), cf, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Contents(ColumnFamilyHandle* cf) {
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions(), cf);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    delete iter;
+    return result;
+  }
+
+  int NumTableFiles(ColumnFamilyHandle* cf) {
+    int files = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::string property;
+      EXPECT_TRUE(db_->GetProperty(
+          cf, "leveldb.num-files-at-level" + std::to_string(level), &property));
+      files += std::stoi(property);
+    }
+    return files;
+  }
+
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+  std::vector<ColumnFamilyHandle*> handles_;
+};
+
+TEST_F(ColumnFamilyTest, Isolation) {
+  ColumnFamilyHandle* hot = Create("hot");
+  ASSERT_EQ("hot", hot->GetName());
+  ASSERT_EQ(kDefaultColumnFamilyName, db_->DefaultColumnFamily()->GetName());
+
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "k", "default"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), hot, "k", "hot"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), hot, "x", "1"));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "k"));
+  ASSERT_EQ("hot", Get(hot, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(db_->DefaultColumnFamily(), "x"));
+  ASSERT_EQ("k=default ", Contents(db_->DefaultColumnFamily()));
+  ASSERT_EQ("k=hot x=1 ", Contents(hot));
+
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), hot, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(hot, "k"));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "k"));
+
+  ColumnFamilyHandle* duplicate;
+  ASSERT_TRUE(db_->CreateColumnFamily(Options(), "hot", &duplicate)
+                  .IsInvalidArgument());
+  ASSERT_TRUE(db_->CreateColumnFamily(Options(), kDefaultColumnFamilyName,
+                                      &duplicate)
+                  .IsInvalidArgument());
+}
+
+TEST_F(ColumnFamilyTest, AtomicBatchSurvivesReopen) {
+  ColumnFamilyHandle* a = Create("a");
+  ColumnFamilyHandle* b = Create("b");
+  WriteBatch batch;
+  batch.Put(a, "key", "va");
+  batch.Put(b, "key", "vb");
+  batch.Put("key", "vdefault");
+  batch.Delete(a, "missing");
+  ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+
+  // Recovered from the log only.
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor("a", Options()),
+                            ColumnFamilyDescriptor("b", Options())}));
+  ASSERT_EQ(2, handles_.size());
+  ASSERT_EQ("va", Get(handles_[0], "key"));
+  ASSERT_EQ("vb", Get(handles_[1], "key"));
+  ASSERT_EQ("vdefault", Get(db_->DefaultColumnFamily(), "key"));
+}
+
+TEST_F(ColumnFamilyTest, OpenMustListEveryFamily) {
+  Create("a");
+  delete db_;
+  db_ = nullptr;
+  ASSERT_TRUE(DB::Open(options_, dbname_, &db_).IsInvalidArgument());
+  ASSERT_TRUE(Reopen({ColumnFamilyDescriptor("a", Options()),
+                      ColumnFamilyDescriptor("b", Options())})
+                  .IsInvalidArgument());
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor(),
+                            ColumnFamilyDescriptor("a", Options())}));
+  ASSERT_EQ(db_->DefaultColumnFamily(), handles_[0]);
+  ASSERT_EQ("a", handles_[1]->GetName());
+}
+
+TEST_F(ColumnFamilyTest, FlushAndCompactPerFamily) {
+  ColumnFamilyHandle* cf = Create("cf");
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(
+        db_->Put(WriteOptions(), cf, "key" + std::to_string(i), "v"));
+  }
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "default", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable(cf));
+  ASSERT_EQ(1, NumTableFiles(cf));
+  ASSERT_EQ(0, NumTableFiles(db_->DefaultColumnFamily()));
+
+  db_->CompactRange(cf, nullptr, nullptr);
+  ASSERT_EQ(1, NumTableFiles(cf));
+  ASSERT_EQ(0, NumTableFiles(db_->DefaultColumnFamily()));
+
+  // The default family's update is only in the log, which must have been
+  // kept while the other family was flushed.
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor("cf", Options())}));
+  ASSERT_EQ("v", Get(db_->DefaultColumnFamily(), "default"));
+  ASSERT_EQ("v", Get(handles_[0], "key42"));
+}
+
+TEST_F(ColumnFamilyTest, IdleFamilyKeepsItsLog) {
+  ColumnFamilyHandle* idle = Create("idle");
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), idle, "cold", "data"));
+
+  // Fill the default family so that it switches logs several times.
+  options_.write_buffer_size = 64 << 10;
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor("idle", Options())}));
+  idle = handles_[0];
+  const std::string big(1000, 'x');
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), std::to_string(i), big));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), idle, "warm", "data"));
+
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor("idle", Options())}));
+  ASSERT_EQ("data", Get(handles_[0], "warm"));
+  ASSERT_EQ("data", Get(handles_[0], "cold"));
+  ASSERT_EQ(big, Get(db_->DefaultColumnFamily(), "499"));
+}
+
+TEST_F(ColumnFamilyTest, ApproximateSizesPerFamily) {
+  Options uncompressed;
+  uncompressed.compression = kNoCompression;
+  ColumnFamilyHandle* cf = Create("cf", uncompressed);
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "%04d", i);
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), cf, key, value));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable(cf));
+
+  Range ranges[2] = {Range("0000", "0100"), Range("0000", "0050")};
+  uint64_t sizes[2];
+  db_->GetApproximateSizes(cf, ranges, 2, sizes);
+  ASSERT_GE(sizes[0], 100 * value.size());
+  ASSERT_LT(sizes[0], 110 * value.size());
+  ASSERT_GE(sizes[1], 45 * value.size());
+  ASSERT_LE(sizes[1], 55 * value.size());
+
+  // The default family holds no data.
+  db_->GetApproximateSizes(ranges, 2, sizes);
+  ASSERT_EQ(0, sizes[0]);
+  ASSERT_EQ(0, sizes[1]);
+  db_->GetApproximateSizes(db_->DefaultColumnFamily(), ranges, 2, sizes);
+  ASSERT_EQ(0, sizes[0]);
+  ASSERT_EQ(0, sizes[1]);
+}
+
+TEST_F(ColumnFamilyTest, PerFamilyOptions) {
+  ReverseComparator reverse;
+  Options reversed;
+  reversed.comparator = &reverse;
+  reversed.write_buffer_size = 100000;  // Small write buffer
+  ColumnFamilyHandle* cf = Create("reversed", reversed);
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 1000; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "%04d", i);
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), cf, key, value));
+  }
+  // Only the family with the small write buffer was flushed.
+  ASSERT_GT(NumTableFiles(cf), 0);
+  ASSERT_EQ(0, NumTableFiles(db_->DefaultColumnFamily()));
+
+  Iterator* iter = db_->NewIterator(ReadOptions(), cf);
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("0999", iter->key().ToString());
+  iter->SeekToLast();
+  ASSERT_EQ("0000", iter->key().ToString());
+  delete iter;
+
+  // The comparator of a family cannot change.
+  ASSERT_TRUE(Reopen({ColumnFamilyDescriptor("reversed", Options())})
+                  .IsInvalidArgument());
+  ASSERT_LEVELDB_OK(Reopen({ColumnFamilyDescriptor("reversed", reversed)}));
+  ASSERT_EQ(value, Get(handles_[0], "0500"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -9,20 +9,25 @@
 
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "db/builder.h"
+#include "db/column_family.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/index_iter.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -35,6 +40,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
@@ -43,21 +49,48 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), done(false), group(nullptr), cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteGroup* group;  // Set when the writer must insert its own batch
   port::CondVar cv;
 };
 
+// A group of writers whose batches are logged together by the leader
+// and then applied to the memtables.
+struct DBImpl::WriteGroup {
+  WriteGroup(Writer* leader, ColumnFamilyMemTables* memtables)
+      : leader(leader),
+        memtables(memtables),
+        batch(nullptr),
+        parallel(false),
+        last_sequence(0),
+        pending(0) {}
+
+  Writer* const leader;
+  ColumnFamilyMemTables* const memtables;
+  std::vector<Writer*> writers;  // In log order, starting with the leader
+
+  // The batch of the whole group, or nullptr if the batches of the writers
+  // are inserted one by one.
+  WriteBatch* batch;
+
+  bool parallel;  // If true, each writer inserts its own batch
+  SequenceNumber last_sequence;  // Sequence of the group's last update
+  int pending;    // Number of followers still inserting
+  Status status;  // First error of a follower
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -65,6 +98,8 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        has_output_lower_bound(false),
+        has_output_upper_bound(false),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -79,6 +114,23 @@ struct DBImpl::CompactionState {
 
   std::vector<Output> outputs;
 
+  // Range tombstones of the inputs that must be kept, sorted by begin key.
+  // Each output holds the parts of them that fall in its key range,
+  // which extends from output_lower_bound (or before all keys, if
+  // !has_output_lower_bound) to the first key of the next output.
+  std::vector<RangeTombstone> tombstones;
+  std::string output_lower_bound;
+  bool has_output_lower_bound;
+
+  // The user key at which the key range of this state ends, if it is one
+  // of several subcompactions and not the last one.  The range begins at
+  // the initial output_lower_bound.
+  std::string output_upper_bound;
+  bool has_output_upper_bound;
+
+  // Position of the scan over the keys of this state's range
+  Compaction::Cursor cursor;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
@@ -86,6 +138,29 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+// A subcompaction scheduled on the Env's low priority pool.  If no
+// thread of the pool has started it by the time the compaction has
+// merged its own part, the compaction runs it itself, so that it never
+// waits for a pool thread that is busy waiting in the same way.
+struct DBImpl::SubcompactionJob {
+  SubcompactionJob(DBImpl* db, CompactionState* compact,
+                   const Comparator* ucmp)
+      : db(db),
+        compact(compact),
+        range_del(ucmp, compact->smallest_snapshot),
+        started(false),
+        done(false),
+        refs(2) {}
+
+  DBImpl* const db;
+  CompactionState* const compact;
+  RangeDelAggregator range_del;  // Not thread-safe, so one per job
+  Status status;                 // Guarded by db->mutex_
+  bool started;                  // Guarded by db->mutex_
+  bool done;                     // Guarded by db->mutex_
+  int refs;  // The compaction and the scheduled call; guarded by db->mutex_
+};
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -103,6 +178,8 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -119,7 +196,7 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
-static int TableCacheSize(const Options& sanitized_options) {
+int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
@@ -137,26 +214,36 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
-      mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_flush_scheduled_(false),
+      background_compactions_scheduled_(0),
+      background_subcompactions_scheduled_(0),
+      flushing_memtable_(false),
+      manifest_write_in_progress_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)),
-      cf_index_("Index"),
-      cf_record_("Record") {}
+      stats_(1),
+      write_controller_(options_.delayed_write_rate),
+      has_secondary_indexes_(false) {
+  // Each compaction may keep max_subcompactions - 1 pool threads busy
+  // with its subcompactions besides its own.
+  env_->SetBackgroundThreads(
+      options_.max_background_compactions * options_.max_subcompactions,
+      Env::kLow);
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_flush_scheduled_ || background_compactions_scheduled_ > 0 ||
+         background_subcompactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -166,8 +253,6 @@ DBImpl::~DBImpl() {
   }
 
   delete versions_;
-  if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -235,6 +320,15 @@ void DBImpl::RemoveObsoleteFiles() {
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
 
+  // Log files are needed by the column families that have updates that
+  // are not yet in table files.
+  uint64_t min_log = logfile_number_;
+  for (ColumnFamilyData* cfd : versions_->column_families()) {
+    if (cfd->HasUnflushedData()) {
+      min_log = std::min(min_log, cfd->log_number());
+    }
+  }
+
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
   uint64_t number;
@@ -245,7 +339,7 @@ void DBImpl::RemoveObsoleteFiles() {
       bool keep = true;
       switch (type) {
         case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
+          keep = ((number >= min_log) ||
                   (number == versions_->PrevLogNumber()));
           break;
         case kDescriptorFile:
@@ -271,7 +365,9 @@ void DBImpl::RemoveObsoleteFiles() {
       if (!keep) {
         files_to_delete.push_back(std::move(filename));
         if (type == kTableFile) {
-          table_cache_->Evict(number);
+          for (ColumnFamilyData* cfd : versions_->column_families()) {
+            cfd->table_cache()->Evict(number);
+          }
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
             static_cast<unsigned long long>(number));
@@ -289,7 +385,9 @@ void DBImpl::RemoveObsoleteFiles() {
   mutex_.Lock();
 }
 
-Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
+Status DBImpl::Recover(
+    const std::map<std::string, Options>& column_family_options,
+    std::vector<VersionEdit>* edits, bool* save_manifest) {
   mutex_.AssertHeld();
 
   // Ignore error from CreateDir since the creation of the DB is
@@ -319,10 +417,12 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
     }
   }
 
-  s = versions_->Recover(save_manifest);
+  s = versions_->Recover(column_family_options, save_manifest);
   if (!s.ok()) {
     return s;
   }
+  edits->resize(versions_->column_families().size());
+  stats_.resize(versions_->column_families().size());
   SequenceNumber max_sequence(0);
 
   // Recover from all newer log files than the ones named in the
@@ -332,6 +432,9 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   // Note that PrevLogNumber() is no longer used, but we pay
   // attention to it in case we are recovering a database
   // produced by an older version of leveldb.
+  //
+  // Each column family only replays the logs it still needs; see
+  // RecoveryMemTables.
   const uint64_t min_log = versions_->LogNumber();
   const uint64_t prev_log = versions_->PrevLogNumber();
   std::vector<std::string> filenames;
@@ -361,7 +464,7 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   // Recover in the order in which the logs were generated
   std::sort(logs.begin(), logs.end());
   for (size_t i = 0; i < logs.size(); i++) {
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
+    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edits,
                        &max_sequence);
     if (!s.ok()) {
       return s;
@@ -380,8 +483,69 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
+namespace {
+
+// Collects the updates of one log file into a memtable per column family.
+// Updates to a column family are skipped if the log is older than the
+// oldest log that family still needs, since they are already in its
+// table files.
+class RecoveryMemTables : public ColumnFamilyMemTables {
+ public:
+  RecoveryMemTables(const std::vector<ColumnFamilyData*>& column_families,
+                    uint64_t log_number, uint64_t prev_log_number)
+      : column_families_(column_families),
+        log_number_(log_number),
+        prev_log_number_(prev_log_number),
+        mems_(column_families.size(), nullptr) {}
+
+  ~RecoveryMemTables() override {
+    for (MemTable* mem : mems_) {
+      if (mem != nullptr) mem->Unref();
+    }
+  }
+
+  MemTable* GetMemTable(uint32_t column_family_id) override {
+    if (column_family_id >= mems_.size()) {
+      return nullptr;
+    }
+    ColumnFamilyData* cfd = column_families_[column_family_id];
+    if (log_number_ < cfd->log_number() && log_number_ != prev_log_number_) {
+      return nullptr;
+    }
+    MemTable*& mem = mems_[column_family_id];
+    if (mem == nullptr) {
+      mem = new MemTable(cfd->internal_comparator(), cfd->options());
+      mem->Ref();
+    }
+    return mem;
+  }
+
+  // Return the recovered memtable of the column family with the given
+  // id, or nullptr if there is none.
+  MemTable* mem(uint32_t column_family_id) const {
+    return mems_[column_family_id];
+  }
+
+  // Hand over the recovered memtable of the column family with the given
+  // id, together with its reference, to the caller.
+  MemTable* Release(uint32_t column_family_id) {
+    MemTable* result = mems_[column_family_id];
+    mems_[column_family_id] = nullptr;
+    return result;
+  }
+
+ private:
+  const std::vector<ColumnFamilyData*>& column_families_;
+  const uint64_t log_number_;
+  const uint64_t prev_log_number_;
+  std::vector<MemTable*> mems_;  // Indexed by column family id
+};
+
+}  // anonymous namespace
+
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
+                              bool* save_manifest,
+                              std::vector<VersionEdit>* edits,
                               SequenceNumber* max_sequence) {
   struct LogReporter : public log::Reader::Reporter {
     Env* env;
@@ -421,12 +585,15 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
-  // Read all the records and add to a memtable
+  // Read all the records and add to the memtables
+  const std::vector<ColumnFamilyData*>& column_families =
+      versions_->column_families();
   std::string scratch;
   Slice record;
   WriteBatch batch;
   int compactions = 0;
-  MemTable* mem = nullptr;
+  RecoveryMemTables mems(column_families, log_number,
+                         versions_->PrevLogNumber());
   while (reader.ReadRecord(&record, &scratch) && status.ok()) {
     if (record.size() < 12) {
       reporter.Corruption(record.size(),
@@ -435,11 +602,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     }
     WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_, options_.with_hashmap);
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    status = WriteBatchInternal::InsertInto(&batch, &mems);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
@@ -450,16 +613,24 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-      mem->Unref();
-      mem = nullptr;
-      if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
-        break;
+    for (ColumnFamilyData* cfd : column_families) {
+      MemTable* mem = mems.mem(cfd->id());
+      if (mem != nullptr &&
+          mem->ApproximateMemoryUsage() > cfd->options().write_buffer_size) {
+        compactions++;
+        *save_manifest = true;
+        uint64_t number;
+        status = WriteLevel0Table(cfd, mem, &(*edits)[cfd->id()], false,
+                                  &number);
+        // No background work can remove the table before the DB applies
+        // the recovery edits.
+        pending_outputs_.erase(number);
+        mems.Release(cfd->id())->Unref();
+        if (!status.ok()) {
+          // Reflect errors immediately so that conditions like full
+          // file-systems cause the DB::Open() to fail.
+          break;
+        }
       }
     }
   }
@@ -470,51 +641,57 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
-    assert(mem_ == nullptr);
     uint64_t lfile_size;
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
       log_ = new log::Writer(logfile_, lfile_size);
       logfile_number_ = log_number;
-      if (mem != nullptr) {
-        mem_ = mem;
-        mem = nullptr;
-      } else {
-        // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_, options_.with_hashmap);
-        mem_->Ref();
+      // Column families without recovered updates get an empty memtable
+      // when the DB is opened.
+      for (ColumnFamilyData* cfd : column_families) {
+        assert(cfd->mem() == nullptr);
+        MemTable* mem = mems.Release(cfd->id());
+        if (mem != nullptr) {
+          cfd->SetMemTable(mem);
+        }
       }
     }
   }
 
-  if (mem != nullptr) {
-    // mem did not get reused; compact it.
-    if (status.ok()) {
+  // Compact the memtables that did not get reused.
+  for (ColumnFamilyData* cfd : column_families) {
+    MemTable* mem = mems.mem(cfd->id());
+    if (mem != nullptr && status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      status = WriteLevel0Table(cfd, mem, &(*edits)[cfd->id()], false, &number);
+      pending_outputs_.erase(number);
     }
-    mem->Unref();
   }
 
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                                VersionEdit* edit, bool flush,
+                                uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *number = meta.number;
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, cfd->options(), cfd->table_cache(), iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -522,7 +699,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -530,30 +707,36 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    if (flush) {
+      // Compactions may have changed the version while the table was
+      // being written.
+      level = cfd->current()->PickLevelForMemTableOutput(min_user_key,
+                                                         max_user_key);
+      if (level > 0) {
+        versions_->ReserveMemTableOutput(cfd, level, meta.smallest,
+                                         meta.largest);
+      }
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_deletions);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
-  stats_[level].Add(stats);
+  stats_[cfd->id()][level].Add(stats);
   return s;
 }
 
-void DBImpl::CompactMemTable() {
+void DBImpl::CompactMemTable(ColumnFamilyData* cfd) {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
+  assert(cfd->imm() != nullptr);
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  edit.SetColumnFamily(cfd->id());
+  uint64_t number;
+  Status s = WriteLevel0Table(cfd, cfd->imm(), &edit, true, &number);
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
@@ -562,48 +745,355 @@ void DBImpl::CompactMemTable() {
   // Replace immutable memtable with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Earlier logs are no longer needed by this column family
+    edit.SetLogNumber(cfd->imm_log_number());
+    s = LogAndApply(&edit);
   }
+  versions_->ReleaseMemTableOutput(cfd);
+  pending_outputs_.erase(number);
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    cfd->ClearImmutableMemTable();
+    UpdateHasImm();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
 }
 
+bool DBImpl::CompactAnyMemTable() {
+  mutex_.AssertHeld();
+  if (flushing_memtable_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  for (ColumnFamilyData* cfd : versions_->column_families()) {
+    if (cfd->imm() != nullptr) {
+      flushing_memtable_.store(true, std::memory_order_relaxed);
+      CompactMemTable(cfd);
+      flushing_memtable_.store(false, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void DBImpl::UpdateHasImm() {
+  mutex_.AssertHeld();
+  bool has_imm = false;
+  for (ColumnFamilyData* cfd : versions_->column_families()) {
+    if (cfd->imm() != nullptr) {
+      has_imm = true;
+      break;
+    }
+  }
+  has_imm_.store(has_imm, std::memory_order_release);
+}
+
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  CompactRange(DefaultColumnFamily(), begin, end);
+}
+
+void DBImpl::CompactRange(ColumnFamilyHandle* column_family,
+                          const Slice* begin, const Slice* end) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
-    Version* base = versions_->current();
+    Version* base = cfd->current();
     for (int level = 1; level < config::kNumLevels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
     }
   }
-  TEST_CompactMemTable();  // TODO(sanjay): Skip if memtable does not overlap
+  // TODO(sanjay): Skip if memtable does not overlap
+  TEST_CompactMemTable(column_family);
   for (int level = 0; level < max_level_with_files; level++) {
-    TEST_CompactRange(level, begin, end);
+    TEST_CompactRange(level, begin, end, column_family);
+  }
+}
+
+namespace {
+
+// Reads the key range of the table "fname" into *meta and checks that the
+// table was written by a TableFileWriter.
+Status ReadIngestedTable(const Options& options, const std::string& fname,
+                         FileMetaData* meta) {
+  Env* const env = options.env;
+  uint64_t file_size;
+  Status s = env->GetFileSize(fname, &file_size);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file;
+  s = env->NewRandomAccessFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  Table* table = nullptr;
+  s = Table::Open(options, file, file_size, &table);
+  if (s.ok()) {
+    Iterator* range_del_iter = table->NewRangeTombstoneIterator();
+    if (range_del_iter != nullptr) {
+      delete range_del_iter;
+      s = Status::InvalidArgument(fname, "table holds range tombstones");
+    }
+  }
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    ParsedInternalKey first, last;
+    iter->SeekToFirst();
+    if (iter->Valid() && ParseInternalKey(iter->key(), &first)) {
+      meta->smallest.DecodeFrom(iter->key());
+      iter->SeekToLast();
+      if (iter->Valid() && ParseInternalKey(iter->key(), &last) &&
+          first.sequence == 0 && last.sequence == 0) {
+        meta->largest.DecodeFrom(iter->key());
+      } else {
+        s = Status::InvalidArgument(fname, "not written by TableFileWriter");
+      }
+    } else {
+      s = Status::InvalidArgument(fname, "empty table");
+    }
+    if (!iter->status().ok()) {
+      s = iter->status();
+    }
+    delete iter;
+  }
+  delete table;
+  delete file;
+  meta->number = 0;
+  meta->file_size = file_size;
+  return s;
+}
+
+// Copies the file "src" to "dst" and syncs the copy.
+Status CopyFile(Env* env, const std::string& src, const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 64 << 10;
+  std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+  while (s.ok()) {
+    Slice chunk;
+    s = in->Read(kBufferSize, &chunk, buffer.get());
+    if (!s.ok() || chunk.empty()) {
+      break;
+    }
+    s = out->Append(chunk);
+  }
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  return s;
+}
+
+// Returns true iff "mem" may hold records, or range tombstones, for some
+// user key in [smallest,largest].
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(
+      InternalKey(smallest, kMaxSequenceNumber, kValueTypeForSeek).Encode());
+  bool overlaps =
+      iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+  if (range_del_iter != nullptr) {
+    for (range_del_iter->SeekToFirst(); !overlaps && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      overlaps =
+          ucmp->Compare(ExtractUserKey(range_del_iter->key()), largest) <= 0 &&
+          ucmp->Compare(range_del_iter->value(), smallest) > 0;
+    }
+    delete range_del_iter;
+  }
+  return overlaps;
+}
+
+}  // namespace
+
+Status DBImpl::IngestExternalFiles(const std::vector<std::string>& paths) {
+  return IngestExternalFiles(DefaultColumnFamily(), paths);
+}
+
+Status DBImpl::IngestExternalFiles(ColumnFamilyHandle* column_family,
+                                   const std::vector<std::string>& paths) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
+  if (!cfd->options().secondary_indexes.empty()) {
+    return Status::NotSupported("ingestion into an indexed column family");
+  }
+  if (paths.empty()) {
+    return Status::OK();
+  }
+  const Comparator* ucmp = cfd->user_comparator();
+
+  // Read the key ranges of the files, in key order, and check that they
+  // do not overlap.
+  std::vector<FileMetaData> files(paths.size());
+  Status s;
+  for (size_t i = 0; i < paths.size() && s.ok(); i++) {
+    s = ReadIngestedTable(cfd->options(), paths[i], &files[i]);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<size_t> order(paths.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return ucmp->Compare(files[a].smallest.user_key(),
+                         files[b].smallest.user_key()) < 0;
+  });
+  for (size_t i = 1; i < order.size(); i++) {
+    if (ucmp->Compare(files[order[i - 1]].largest.user_key(),
+                      files[order[i]].smallest.user_key()) >= 0) {
+      return Status::InvalidArgument("ingested files overlap",
+                                     paths[order[i]]);
+    }
+  }
+  const Slice smallest = files[order.front()].smallest.user_key();
+  const Slice largest = files[order.back()].largest.user_key();
+
+  // Copy the files into the DB under temporary names.  They are numbered
+  // as tables only once they are installed, since level-0 orders its
+  // files by number and flushes of older records may still come first.
+  std::vector<uint64_t> temp_numbers(paths.size());
+  {
+    MutexLock l(&mutex_);
+    for (size_t i = 0; i < paths.size(); i++) {
+      temp_numbers[i] = versions_->NewFileNumber();
+      pending_outputs_.insert(temp_numbers[i]);
+    }
   }
+  for (size_t i = 0; i < paths.size() && s.ok(); i++) {
+    s = CopyFile(env_, paths[i], TempFileName(dbname_, temp_numbers[i]));
+  }
+
+  MutexLock l(&mutex_);
+  if (s.ok()) {
+    // Take the front of the writer queue so that no write is assigned a
+    // sequence number or switches memtables until the files are installed.
+    Writer w(&mutex_);
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+      w.cv.Wait();
+    }
+    while (!memtable_groups_.empty()) {
+      background_work_finished_signal_.Wait();
+    }
+
+    // The records of the memtables are older than the files, so those
+    // that overlap the files must be flushed to levels above them first.
+    if (MemTableOverlaps(cfd->mem(), ucmp, smallest, largest)) {
+      s = MakeRoomForWrite(cfd);
+    }
+    while (s.ok() && cfd->imm() != nullptr &&
+           MemTableOverlaps(cfd->imm(), ucmp, smallest, largest)) {
+      if (!bg_error_.ok()) {
+        s = bg_error_;
+      } else {
+        background_work_finished_signal_.Wait();
+      }
+    }
+
+    // Give every record of the files the same new sequence number, and
+    // place each file at the deepest level that keeps it above all the
+    // records it overlaps.
+    if (s.ok()) {
+      const SequenceNumber seq = versions_->LastSequence() + 1;
+      VersionEdit edit;
+      edit.SetColumnFamily(cfd->id());
+      edit.SetLastSequence(seq);
+      for (size_t i : order) {
+        FileMetaData& f = files[i];
+        ParsedInternalKey first, last;
+        if (!ParseInternalKey(f.smallest.Encode(), &first) ||
+            !ParseInternalKey(f.largest.Encode(), &last)) {
+          s = Status::Corruption("bad key range of ingested file", paths[i]);
+          break;
+        }
+        f.number = versions_->NewFileNumber();
+        pending_outputs_.insert(f.number);
+        s = env_->RenameFile(TempFileName(dbname_, temp_numbers[i]),
+                             TableFileName(dbname_, f.number));
+        if (!s.ok()) {
+          break;
+        }
+        f.smallest = InternalKey(first.user_key, seq, first.type);
+        f.largest = InternalKey(last.user_key, seq, last.type);
+        f.global_seqno = seq;
+        const int level = cfd->current()->PickLevelForIngestedFile(
+            f.smallest.user_key(), f.largest.user_key());
+        versions_->ReserveIngestedFile(cfd, level, f);
+        edit.AddFile(level, f);
+        Log(options_.info_log, "Ingested table #%llu: %lld bytes at level %d",
+            static_cast<unsigned long long>(f.number),
+            static_cast<long long>(f.file_size), level);
+      }
+      if (s.ok()) {
+        s = LogAndApply(&edit);
+        if (!s.ok()) {
+          // The edit may or may not have reached the MANIFEST.
+          RecordBackgroundError(s);
+        }
+      }
+      versions_->ReleaseIngestedFiles(cfd);
+      if (s.ok()) {
+        versions_->SetLastSequence(seq);
+      }
+    }
+
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  }
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    pending_outputs_.erase(temp_numbers[i]);
+    pending_outputs_.erase(files[i].number);
+  }
+  if (s.ok()) {
+    MaybeScheduleCompaction();
+  } else {
+    // Delete the copies.
+    RemoveObsoleteFiles();
+  }
+  return s;
 }
 
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
-                               const Slice* end) {
+                               const Slice* end,
+                               ColumnFamilyHandle* column_family) {
   assert(level >= 0);
   assert(level + 1 < config::kNumLevels);
 
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
+  manual.cfd = GetColumnFamilyData(column_family);
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -627,22 +1117,30 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
       background_work_finished_signal_.Wait();
     }
   }
+  // A background thread may still be running part of it after an error
+  // elsewhere.
+  while (manual.in_progress) {
+    background_work_finished_signal_.Wait();
+  }
   if (manual_compaction_ == &manual) {
     // Cancel my manual compaction since we aborted early for some reason.
     manual_compaction_ = nullptr;
   }
 }
 
-Status DBImpl::TEST_CompactMemTable() {
+Status DBImpl::TEST_CompactMemTable(ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
   // nullptr batch means just wait for earlier writes to be done
-  Status s = Write(WriteOptions(), nullptr);
+  Status s = WriteImpl(WriteOptions(), nullptr, cfd);
   if (s.ok()) {
-    // Wait until the compaction completes
+    // Wait until the compaction completes, including the flush job's
+    // removal of obsolete files.
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while ((cfd->imm() != nullptr || background_flush_scheduled_) &&
+           bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (cfd->imm() != nullptr) {
       s = bg_error_;
     }
   }
@@ -659,58 +1157,103 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    background_compaction_scheduled_ = true;
+    return;
+  }
+
+  // Memtable flushes run in the high priority pool so that writers are
+  // not stalled behind long compactions.
+  if (!background_flush_scheduled_ &&
+      has_imm_.load(std::memory_order_relaxed)) {
+    background_flush_scheduled_ = true;
+    env_->ScheduleWithPriority(&DBImpl::BGFlush, this, Env::kHigh);
+  }
+
+  while (background_compactions_scheduled_ <
+             options_.max_background_compactions &&
+         ((manual_compaction_ != nullptr && !manual_compaction_->in_progress) ||
+          (manual_compaction_ == nullptr && versions_->NeedsCompaction()))) {
+    // A job that finds nothing to pick because of the running ones does
+    // not reschedule itself, so this cannot spin.
+    background_compactions_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
+    if (manual_compaction_ != nullptr) {
+      // One job is enough for a manual compaction.
+      break;
+    }
   }
 }
 
+void DBImpl::BGFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  while (!shutting_down_.load(std::memory_order_acquire) && bg_error_.ok() &&
+         CompactAnyMemTable()) {
+    // Wake up MakeRoomForWrite() if necessary.
+    background_work_finished_signal_.SignalAll();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may need compaction, and another memtable may
+  // have filled up in the meantime.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A job that could not
+  // pick anything leaves it to the jobs still running.
+  if (made_progress || background_compactions_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable(); 
-    return;
-  }
-
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
+    if (m->in_progress) {
+      return false;
+    }
+    c = versions_->CompactRange(m->cfd, m->level, m->begin, m->end);
+    if (c != nullptr && !versions_->ReserveCompaction(c)) {
+      // Conflicts with a running compaction; retry once it is done.
+      delete c;
+      return false;
+    }
+    m->in_progress = true;
     m->done = (c == nullptr);
     if (c != nullptr) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
@@ -722,6 +1265,9 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
   }
 
   Status status;
@@ -732,9 +1278,8 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -742,7 +1287,9 @@ void DBImpl::BackgroundCompaction() {
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number), c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
-        status.ToString().c_str(), versions_->LevelSummary(&tmp));
+        status.ToString().c_str(),
+        versions_->LevelSummary(c->column_family(), &tmp));
+    versions_->ReleaseCompaction(c);
   } else {
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
@@ -750,6 +1297,8 @@ void DBImpl::BackgroundCompaction() {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    // Must come before ReleaseInputs(), which may free the input files.
+    versions_->ReleaseCompaction(c);
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
@@ -774,8 +1323,10 @@ void DBImpl::BackgroundCompaction() {
       m->tmp_storage = manual_end;
       m->begin = &m->tmp_storage;
     }
+    m->in_progress = false;
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -807,6 +1358,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -815,13 +1367,69 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    const Options& options = compact->compaction->column_family()->options();
+    if (options.rate_limiter != nullptr) {
+      compact->outfile = NewRateLimitedWritableFile(
+          compact->outfile, options.rate_limiter, Env::kLow);
+    }
+    compact->builder = new TableBuilder(options, compact->outfile);
   }
   return s;
 }
 
+void DBImpl::AddOutputRangeTombstones(CompactionState* compact,
+                                      const Slice* limit) {
+  ColumnFamilyData* const cfd = compact->compaction->column_family();
+  const Comparator* const ucmp = cfd->user_comparator();
+  CompactionState::Output* out = compact->current_output();
+
+  std::vector<RangeTombstone> fragments;
+  for (const RangeTombstone& t : compact->tombstones) {
+    if (limit != nullptr && ucmp->Compare(t.begin, *limit) >= 0) {
+      break;
+    }
+    RangeTombstone fragment = t;
+    if (compact->has_output_lower_bound &&
+        ucmp->Compare(fragment.begin, compact->output_lower_bound) < 0) {
+      fragment.begin = compact->output_lower_bound;
+    }
+    if (limit != nullptr && ucmp->Compare(fragment.end, *limit) > 0) {
+      fragment.end = limit->ToString();
+    }
+    if (ucmp->Compare(fragment.begin, fragment.end) < 0) {
+      fragments.push_back(fragment);
+    }
+  }
+
+  // Tombstones are stored in internal key order.
+  std::sort(fragments.begin(), fragments.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              int r = ucmp->Compare(a.begin, b.begin);
+              return r < 0 || (r == 0 && a.seq > b.seq);
+            });
+  bool empty = (compact->builder->NumEntries() == 0);
+  for (size_t i = 0; i < fragments.size(); i++) {
+    const RangeTombstone& f = fragments[i];
+    if (i > 0 && f.seq == fragments[i - 1].seq &&
+        ucmp->Compare(f.begin, fragments[i - 1].begin) == 0) {
+      continue;  // Same tombstone read from two inputs
+    }
+    InternalKey begin(f.begin, f.seq, kTypeRangeDeletion);
+    compact->builder->AddRangeTombstone(begin.Encode(), f.end);
+    ExtendFileRange(&cfd->internal_comparator(), begin.Encode(), f.end,
+                    &out->smallest, &out->largest, &empty);
+    out->has_range_deletions = true;
+  }
+
+  if (limit != nullptr) {
+    compact->output_lower_bound.assign(limit->data(), limit->size());
+    compact->has_output_lower_bound = true;
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* limit) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
@@ -833,6 +1441,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
+    AddOutputRangeTombstones(compact, limit);
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
@@ -853,10 +1462,13 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() &&
+      (current_entries > 0 || compact->current_output()->has_range_deletions)) {
     // Verify that the table is usable
+    TableCache* table_cache =
+        compact->compaction->column_family()->table_cache();
     Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+        table_cache->NewIterator(ReadOptions(), output_number, current_bytes);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -882,21 +1494,33 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+                                         out.smallest, out.largest,
+                                         out.has_range_deletions);
+  }
+  return LogAndApply(compact->compaction->edit());
+}
+
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // VersionSet::LogAndApply() releases mutex_ while it writes the
+  // MANIFEST and must not run concurrently with itself.
+  while (manifest_write_in_progress_) {
+    background_work_finished_signal_.Wait();
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  background_work_finished_signal_.SignalAll();
+  return s;
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
-
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+  int64_t imm_micros = 0;  // Micros spent doing imm compactions
+  ColumnFamilyData* const cfd = compact->compaction->column_family();
+  const Comparator* const ucmp = cfd->user_comparator();
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(cfd->current()->NumFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
   if (snapshots_.empty()) {
@@ -905,52 +1529,229 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Entries deleted by a range tombstone that every snapshot sees are
+  // dropped, as are whole input files lying inside such a tombstone.
+  RangeDelAggregator range_del(ucmp, compact->smallest_snapshot);
+  Status status =
+      versions_->AddCompactionTombstones(compact->compaction, &range_del);
+
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+      compact->compaction->num_input_files(0), compact->compaction->level(),
+      compact->compaction->num_input_files(1),
+      compact->compaction->level() + 1);
+  if (compact->compaction->num_covered_files() > 0) {
+    Log(options_.info_log, "Dropping %d@%d files covered by range deletions",
+        compact->compaction->num_covered_files(),
+        compact->compaction->level() + 1);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
-  Status status;
-  ParsedInternalKey ikey;
-  std::string current_user_key;
-  bool has_current_user_key = false;
-  SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != nullptr) {
-        CompactMemTable();
-        // Wake up MakeRoomForWrite() if necessary.
-        background_work_finished_signal_.SignalAll();
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+  // A tombstone that every snapshot sees is obsolete once no deeper
+  // level holds data in its range.
+  for (const RangeTombstone& t : range_del.tombstones()) {
+    if (t.seq > compact->smallest_snapshot ||
+        !compact->compaction->IsBaseLevelForRange(t.begin, t.end)) {
+      compact->tombstones.push_back(t);
     }
-
-    Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
-      }
+  }
+  std::sort(compact->tombstones.begin(), compact->tombstones.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              return ucmp->Compare(a.begin, b.begin) < 0;
+            });
+
+  // Split the key range between subcompactions.  This thread merges the
+  // first part and every other part is scheduled on the low priority
+  // pool.
+  std::vector<std::string> boundaries;
+  if (status.ok() && options_.max_subcompactions > 1) {
+    versions_->GetSubcompactionBoundaries(
+        compact->compaction, options_.max_subcompactions, &boundaries);
+  }
+  std::vector<SubcompactionJob*> jobs;
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    sub->tombstones = compact->tombstones;
+    sub->output_lower_bound = boundaries[i];
+    sub->has_output_lower_bound = true;
+    if (i + 1 < boundaries.size()) {
+      sub->output_upper_bound = boundaries[i + 1];
+      sub->has_output_upper_bound = true;
     }
-
-    // Handle key/value, add to state, etc.
-    bool drop = false;
-    if (!ParseInternalKey(key, &ikey)) {
-      // Do not hide error keys
-      current_user_key.clear();
+    SubcompactionJob* job = new SubcompactionJob(this, sub, ucmp);
+    for (const RangeTombstone& t : range_del.tombstones()) {
+      job->range_del.AddTombstone(t);
+    }
+    jobs.push_back(job);
+  }
+  if (!jobs.empty()) {
+    mutex_.Lock();
+    background_subcompactions_scheduled_ += static_cast<int>(jobs.size());
+    for (SubcompactionJob* job : jobs) {
+      env_->ScheduleWithPriority(&DBImpl::BGSubcompaction, job, Env::kLow);
+    }
+    mutex_.Unlock();
+  }
+  if (!boundaries.empty()) {
+    compact->output_upper_bound = boundaries[0];
+    compact->has_output_upper_bound = true;
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(boundaries.size() + 1));
+  }
+
+  if (status.ok()) {
+    status = ProcessCompactionRange(compact, &range_del, &imm_micros);
+  }
+
+  mutex_.Lock();
+  for (SubcompactionJob* job : jobs) {
+    if (!job->started) {
+      RunSubcompaction(job);
+    }
+  }
+  for (SubcompactionJob* job : jobs) {
+    while (!job->done) {
+      background_work_finished_signal_.Wait();
+    }
+    if (status.ok()) {
+      status = job->status;
+    }
+    // The outputs of the subcompactions follow each other in key order.
+    CompactionState* sub = job->compact;
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    sub->outputs.clear();
+    CleanupCompaction(sub);
+    if (--job->refs == 0) {
+      delete job;
+    }
+  }
+  mutex_.Unlock();
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[cfd->id()][compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s",
+      versions_->LevelSummary(cfd, &tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompaction(void* job) {
+  SubcompactionJob* j = reinterpret_cast<SubcompactionJob*>(job);
+  DBImpl* db = j->db;
+  MutexLock l(&db->mutex_);
+  if (!j->started) {
+    db->RunSubcompaction(j);
+  }
+  if (--j->refs == 0) {
+    delete j;
+  }
+  db->background_subcompactions_scheduled_--;
+  db->background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::RunSubcompaction(SubcompactionJob* job) {
+  mutex_.AssertHeld();
+  job->started = true;
+  mutex_.Unlock();
+  Status s = ProcessCompactionRange(job->compact, &job->range_del, nullptr);
+  mutex_.Lock();
+  job->status = s;
+  job->done = true;
+  background_work_finished_signal_.SignalAll();
+}
+
+Status DBImpl::ProcessCompactionRange(CompactionState* compact,
+                                      RangeDelAggregator* range_del,
+                                      int64_t* imm_micros) {
+  const Comparator* const ucmp =
+      compact->compaction->column_family()->user_comparator();
+  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  if (compact->has_output_lower_bound) {
+    InternalKey start(compact->output_lower_bound, kMaxSequenceNumber,
+                      kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
+
+  Status status;
+  ParsedInternalKey ikey;
+  std::string current_user_key;
+  bool has_current_user_key = false;
+  SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  bool stop_before_next_user_key = false;
+  while (status.ok() && input->Valid() &&
+         !shutting_down_.load(std::memory_order_acquire)) {
+    // Prioritize immutable compaction work unless another thread is
+    // already flushing.
+    if (imm_micros != nullptr && has_imm_.load(std::memory_order_relaxed) &&
+        !flushing_memtable_.load(std::memory_order_relaxed)) {
+      const uint64_t imm_start = env_->NowMicros();
+      mutex_.Lock();
+      if (CompactAnyMemTable()) {
+        // Wake up MakeRoomForWrite() if necessary.
+        background_work_finished_signal_.SignalAll();
+      }
+      mutex_.Unlock();
+      *imm_micros += (env_->NowMicros() - imm_start);
+    }
+
+    Slice key = input->key();
+    if (compact->has_output_upper_bound && key.size() >= 8 &&
+        ucmp->Compare(ExtractUserKey(key), compact->output_upper_bound) >= 0) {
+      // The rest of the keys belong to the next subcompaction.
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
+        compact->builder != nullptr) {
+      stop_before_next_user_key = true;
+    }
+
+    // Handle key/value, add to state, etc.
+    bool drop = false;
+    if (!ParseInternalKey(key, &ikey)) {
+      // Do not hide error keys
+      current_user_key.clear();
       has_current_user_key = false;
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
-        // First occurrence of this user key
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
+        // First occurrence of this user key.  Outputs are only switched
+        // here so that the range tombstones can be split between them by
+        // user key.
+        if (compact->builder != nullptr &&
+            (stop_before_next_user_key ||
+             compact->builder->FileSize() >=
+                 compact->compaction->MaxOutputFileSize())) {
+          status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
+          if (!status.ok()) {
+            break;
+          }
+        }
+        stop_before_next_user_key = false;
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
@@ -959,9 +1760,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (!range_del->empty() &&
+                 range_del->ShouldDelete(ikey.user_key, ikey.sequence)) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -980,7 +1786,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -997,15 +1804,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
       compact->current_output()->largest.DecodeFrom(key);
       compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
-      }
     }
 
     input->Next();
@@ -1014,37 +1812,29 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  // The last output holds the tombstones past the last entry, if any.
+  const Slice upper_bound(compact->output_upper_bound);
+  const Slice* limit =
+      compact->has_output_upper_bound ? &upper_bound : nullptr;
+  if (status.ok() && compact->builder == nullptr) {
+    for (const RangeTombstone& t : compact->tombstones) {
+      if (limit != nullptr && ucmp->Compare(t.begin, *limit) >= 0) {
+        break;
+      }
+      if (!compact->has_output_lower_bound ||
+          ucmp->Compare(t.end, compact->output_lower_bound) > 0) {
+        status = OpenCompactionOutputFile(compact);
+        break;
+      }
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, limit);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1052,57 +1842,112 @@ namespace {
 
 struct IterState {
   port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  SuperVersion* const sv;
+
+  // The iterate bounds of the ReadOptions, as internal keys.
+  std::string lower_bound;
+  std::string upper_bound;
+  Slice lower_bound_slice;
+  Slice upper_bound_slice;
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
+  IterState(port::Mutex* mutex, SuperVersion* sv) : mu(mutex), sv(sv) {}
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
+  if (state->sv->Unref()) {
+    MutexLock l(state->mu);
+    state->sv->Cleanup();
+  }
   delete state;
 }
 
 }  // anonymous namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      ColumnFamilyData* cfd,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  mutex_.Lock();
+                                      uint32_t* seed,
+                                      RangeDelAggregator** range_del) {
+  // The iterator keeps its own reference to the SuperVersion, so the
+  // thread's cached one can be handed back right away.
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
+  sv->Ref();
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
+  MemTable* const mem = sv->mem;
+  MemTable* const imm = sv->imm;
+  Version* const current = sv->current;
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
-  }
-  versions_->current()->AddIterators(options, &list);
-  Iterator* internal_iter =
-      NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  list.push_back(mem->NewIterator());
+  if (imm != nullptr) {
+    list.push_back(imm->NewIterator());
+  }
+  IterState* cleanup = new IterState(&mutex_, sv);
+
+  // Table iterators compare the bounds with internal keys.  The smallest
+  // internal key of a user key orders after exactly the entries of the
+  // smaller user keys.
+  ReadOptions table_options = options;
+  if (options.iterate_lower_bound != nullptr) {
+    AppendInternalKey(&cleanup->lower_bound,
+                      ParsedInternalKey(*options.iterate_lower_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+    cleanup->lower_bound_slice = cleanup->lower_bound;
+    table_options.iterate_lower_bound = &cleanup->lower_bound_slice;
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    AppendInternalKey(&cleanup->upper_bound,
+                      ParsedInternalKey(*options.iterate_upper_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+    cleanup->upper_bound_slice = cleanup->upper_bound;
+    table_options.iterate_upper_bound = &cleanup->upper_bound_slice;
+  }
+  current->AddIterators(table_options, &list);
+  Iterator* internal_iter = NewMergingIterator(&cfd->internal_comparator(),
+                                               &list[0], list.size());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
-  *seed = ++seed_;
-  mutex_.Unlock();
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  if (range_del != nullptr) {
+    *range_del = nullptr;
+    SequenceNumber snapshot =
+        (options.snapshot != nullptr
+             ? static_cast<const SnapshotImpl*>(options.snapshot)
+                   ->sequence_number()
+             : *latest_snapshot);
+    std::unique_ptr<RangeDelAggregator> tombstones(
+        new RangeDelAggregator(cfd->user_comparator(), snapshot));
+    Status s;
+    for (MemTable* m : {mem, imm}) {
+      Iterator* iter = (m == nullptr ? nullptr : m->NewRangeTombstoneIterator());
+      if (iter != nullptr) {
+        s = tombstones->AddTombstones(iter);
+        delete iter;
+      }
+    }
+    if (s.ok()) {
+      s = current->AddRangeTombstones(tombstones.get());
+    }
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    if (!tombstones->empty()) {
+      *range_del = tombstones.release();
+    }
+  }
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+  return NewInternalIterator(ReadOptions(), versions_->default_column_family(),
+                             &ignored, &ignored_seed);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1110,10 +1955,40 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+ColumnFamilyData* DBImpl::GetColumnFamilyData(
+    ColumnFamilyHandle* column_family) const {
+  if (column_family == nullptr) {
+    return versions_->default_column_family();
+  }
+  return static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   std::string* value) {
+  return GetImpl(options, versions_->default_column_family(), key, value,
+                 nullptr);
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   std::string* value, LookupTrace* trace) {
+  return GetImpl(options, versions_->default_column_family(), key, value,
+                 trace);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family, const Slice& key,
                    std::string* value) {
+  return GetImpl(options, GetColumnFamilyData(column_family), key, value,
+                 nullptr);
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, ColumnFamilyData* cfd,
+                       const Slice& key, std::string* value,
+                       LookupTrace* trace) {
   Status s;
-  MutexLock l(&mutex_);
+  // Take the SuperVersion before the sequence number: a write that
+  // completed before this read also installed any memtable it went to.
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1122,45 +1997,67 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
-    }
-    mutex_.Lock();
+  // First look in the memtable, then in the immutable memtable (if any).
+  LookupKey lkey(key, snapshot);
+  if (trace != nullptr) {
+    *trace = LookupTrace();
+  }
+  SequenceNumber max_covering_tombstone_seq = 0;
+  if (sv->mem->Get(lkey, value, &s, &max_covering_tombstone_seq, trace)) {
+    // Done
+    if (trace != nullptr) trace->source = LookupTrace::kMemTable;
+  } else if (sv->imm != nullptr && sv->imm->Get(lkey, value, &s,
+                                                &max_covering_tombstone_seq,
+                                                trace)) {
+    // Done
+    if (trace != nullptr) trace->source = LookupTrace::kImmutableMemTable;
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats, trace);
+    have_stat_update = true;
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (have_stat_update && sv->current->ChargeSeek(stats)) {
+    RecordSeekCompaction(sv->current, stats.seek_file,
+                         stats.seek_file_level);
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
   return s;
 }
 
-Status DBImpl::GetWithPosition(const ReadOptions& options, const Slice& key,
-                   std::string* value, std::string* position) {
-  Status s;
+void DBImpl::RecordSeekCompaction(Version* v, FileMetaData* f, int level) {
+  Version::GetStats stats;
+  stats.seek_file = f;
+  stats.seek_file_level = level;
   MutexLock l(&mutex_);
+  if (v->UpdateStats(stats)) {
+    MaybeScheduleCompaction();
+  }
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  MultiGet(options, DefaultColumnFamily(), keys, values, statuses);
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      ColumnFamilyHandle* column_family,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
+  const size_t n = keys.size();
+  values->assign(n, std::string());
+  statuses->assign(n, Status());
+  if (n == 0) {
+    return;
+  }
+
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1169,85 +2066,112 @@ Status DBImpl::GetWithPosition(const ReadOptions& options, const Slice& key,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
+  // Look the keys up in sorted order so that the keys that fall in the
+  // same table file are handed to it together.
+  const Comparator* ucmp = cfd->user_comparator();
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  });
+
+  std::vector<std::unique_ptr<LookupKey>> lkeys(n);
+  std::vector<Version::MultiGetKey> table_keys;
+  for (size_t i : order) {
+    lkeys[i].reset(new LookupKey(keys[i], snapshot));
+    std::string* value = &(*values)[i];
+    Status* s = &(*statuses)[i];
     // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {  // NOTE: 先从active memtable里找
+    SequenceNumber max_covering_tombstone_seq = 0;
+    if (sv->mem->Get(*lkeys[i], value, s, &max_covering_tombstone_seq)) {
       // Done
-      const uint64_t tag = DecodeFixed64(s.GetMsg().data());
-      const uint64_t ver = tag >> 8;
-      std::string ans = "'" + key.ToString() + "' @ " + std::to_string(ver);
-      switch (tag & 0xff) {
-        case 1: {
-          ans += " : val => '" + *value + "'";
-          break;
-        }
-        case 0:
-          ans += " : del => ''";
-      }
-      ans += ", Active memtable";
-      *position = ans;
-    } else if (imm != nullptr &&
-               imm->Get(lkey, value, &s)) {  // NOTE: active memtable里没找到就从immtable里找
+    } else if (sv->imm != nullptr &&
+               sv->imm->Get(*lkeys[i], value, s,
+                            &max_covering_tombstone_seq)) {
       // Done
-      const uint64_t tag = DecodeFixed64(s.GetMsg().data());
-      const uint64_t ver = tag >> 8;
-      std::string ans = "'" + key.ToString() + "' @ " + std::to_string(ver);
-      switch (tag & 0xff) {
-        case 1: {
-          ans += " : val => '" + *value + "'";
-          break;
-        }
-        case 0:
-          ans += " : del => ''";
-      }
-      ans += ", Immutable memtable";
-      *position = ans;
     } else {
-      s = current->Get(options, lkey, value, &stats);  // NOTE: memtable没找到就从SSTable里找
-      have_stat_update = true;
-      *position = stats.s.GetMsg();
+      table_keys.push_back(Version::MultiGetKey{lkeys[i].get(), value, s});
     }
-    mutex_.Lock();
   }
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (!table_keys.empty()) {
+    sv->current->MultiGet(options, table_keys, &stats);
+    have_stat_update = true;
+  }
+
+  if (have_stat_update && sv->current->ChargeSeek(stats)) {
+    RecordSeekCompaction(sv->current, stats.seek_file,
+                         stats.seek_file_level);
+  }
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
+}
+
+Status DBImpl::GetWithPosition(const ReadOptions& options, const Slice& key,
+                               std::string* value, std::string* position) {
+  LookupTrace trace;
+  Status s = Get(options, key, value, &trace);
+  if (trace.source == LookupTrace::kNone) {
+    return s;
+  }
+
+  std::string ans =
+      "'" + key.ToString() + "' @ " + NumberToString(trace.sequence);
+  if (trace.deleted) {
+    ans += " : del => ''";
+  } else {
+    ans += " : val => '" + *value + "'";
+  }
+  switch (trace.source) {
+    case LookupTrace::kMemTable:
+      ans += ", Active memtable";
+      break;
+    case LookupTrace::kImmutableMemTable:
+      ans += ", Immutable memtable";
+      break;
+    case LookupTrace::kTable:
+      ans += ", SSTable => '" + NumberToString(trace.level) + "', '" +
+             NumberToString(trace.file_number) + "'";
+      break;
+    case LookupTrace::kNone:
+      break;
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
+  *position = ans;
   return s;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIterator(options, DefaultColumnFamily());
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  RangeDelAggregator* range_del;
+  Iterator* iter =
+      NewInternalIterator(options, cfd, &latest_snapshot, &seed, &range_del);
+  return NewDBIterator(this, cfd, cfd->user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options.iterate_lower_bound,
+                       options.iterate_upper_bound, range_del);
 }
 
-void DBImpl::RecordReadSample(Slice key) {
-  MutexLock l(&mutex_);
-  if (versions_->current()->RecordReadSample(key)) {
-    MaybeScheduleCompaction();
+void DBImpl::RecordReadSample(ColumnFamilyData* cfd, Slice key) {
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
+  Version::GetStats stats;
+  if (sv->current->RecordReadSample(key, &stats)) {
+    RecordSeekCompaction(sv->current, stats.seek_file,
+                         stats.seek_file_level);
   }
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1269,7 +2193,216 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  return DB::DeleteRange(options, begin, end);
+}
+
+Status DBImpl::Put(const WriteOptions& o, ColumnFamilyHandle* column_family,
+                   const Slice& key, const Slice& val) {
+  return DB::Put(o, column_family, key, val);
+}
+
+Status DBImpl::Delete(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice& key) {
+  return DB::Delete(options, column_family, key);
+}
+
+Status DBImpl::DeleteRange(const WriteOptions& options,
+                           ColumnFamilyHandle* column_family,
+                           const Slice& begin, const Slice& end) {
+  return DB::DeleteRange(options, column_family, begin, end);
+}
+
+namespace {
+
+// Routes the updates of a write batch to the active memtables of the
+// column families, as they were when the batch group was formed.
+class ActiveMemTables : public ColumnFamilyMemTables {
+ public:
+  explicit ActiveMemTables(
+      const std::vector<ColumnFamilyData*>& column_families) {
+    mems_.reserve(column_families.size());
+    for (ColumnFamilyData* cfd : column_families) {
+      mems_.push_back(cfd->mem());
+    }
+  }
+
+  // Returns true iff every memtable may be written by several threads.
+  bool SupportConcurrentAdd() const {
+    for (MemTable* mem : mems_) {
+      if (!mem->SupportsConcurrentAdd()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Updates to unknown column families are dropped.
+  MemTable* GetMemTable(uint32_t column_family_id) override {
+    return (column_family_id < mems_.size()) ? mems_[column_family_id]
+                                             : nullptr;
+  }
+
+ private:
+  std::vector<MemTable*> mems_;
+};
+
+}  // anonymous namespace
+
+// Collects the index entries to add and remove for the updates of a write
+// batch.  Each update is compared with the value the record has before
+// it: either the value left by an earlier update in the same batch, or
+// the value stored in the DB.
+class DBImpl::IndexUpdater : public WriteBatch::Handler {
+ public:
+  IndexUpdater(DBImpl* db, WriteBatch* index_updates)
+      : db_(db), index_updates_(index_updates), updates_indexed_(false) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    Update(0, key, &value);
+  }
+  void Delete(const Slice& key) override { Update(0, key, nullptr); }
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    Update(column_family_id, key, &value);
+    return Status::OK();
+  }
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    Update(column_family_id, key, nullptr);
+    return Status::OK();
+  }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    DeleteRangeCF(0, begin, end);
+  }
+  Status DeleteRangeCF(uint32_t column_family_id, const Slice& begin,
+                       const Slice& end) override {
+    // The index entries of the deleted records are not known without
+    // scanning the range, so range deletions of indexed families are
+    // rejected.
+    if (status_.ok() && db_->indexed_column_families_.count(column_family_id)) {
+      status_ = Status::NotSupported(
+          "DeleteRange on a column family with secondary indexes");
+    }
+    return Status::OK();
+  }
+
+  // Returns true iff the batch updates a column family with indexes.
+  bool updates_indexed() const { return updates_indexed_; }
+
+  Status status() const { return status_; }
+
+ private:
+  // The value of a record, if it exists.
+  struct Record {
+    bool exists;
+    std::string value;
+  };
+
+  void Update(uint32_t column_family_id, const Slice& key, const Slice* value)
+      EXCLUSIVE_LOCKS_REQUIRED(db_->index_mutex_) {
+    std::map<uint32_t, IndexedColumnFamily>::const_iterator family =
+        db_->indexed_column_families_.find(column_family_id);
+    if (family == db_->indexed_column_families_.end() || !status_.ok()) {
+      return;
+    }
+    updates_indexed_ = true;
+    ColumnFamilyData* cfd = family->second.cfd;
+
+    std::pair<uint32_t, std::string> record_key(column_family_id,
+                                                key.ToString());
+    std::map<std::pair<uint32_t, std::string>, Record>::iterator it =
+        records_.find(record_key);
+    if (it == records_.end()) {
+      Record old;
+      Status s = db_->GetImpl(ReadOptions(), cfd, key, &old.value, nullptr);
+      old.exists = s.ok();
+      if (!s.ok() && !s.IsNotFound()) {
+        status_ = s;
+        return;
+      }
+      it = records_.insert(std::make_pair(record_key, old)).first;
+    }
+    Record* record = &it->second;
+
+    const std::vector<const SecondaryIndex*>& indexes =
+        cfd->options().secondary_indexes;
+    for (size_t i = 0; i < indexes.size(); i++) {
+      old_index_key_.clear();
+      new_index_key_.clear();
+      bool had_entry = record->exists &&
+                       indexes[i]->Extract(key, record->value, &old_index_key_);
+      bool has_entry = value != nullptr &&
+                       indexes[i]->Extract(key, *value, &new_index_key_);
+      if (had_entry && has_entry && old_index_key_ == new_index_key_) {
+        continue;
+      }
+      ColumnFamilyHandle* index = family->second.indexes[i]->handle();
+      if (had_entry) {
+        entry_key_.clear();
+        AppendIndexEntryKey(&entry_key_, old_index_key_, key);
+        index_updates_->Delete(index, entry_key_);
+      }
+      if (has_entry) {
+        entry_key_.clear();
+        AppendIndexEntryKey(&entry_key_, new_index_key_, key);
+        index_updates_->Put(index, entry_key_, Slice());
+      }
+    }
+
+    record->exists = (value != nullptr);
+    if (value != nullptr) {
+      record->value.assign(value->data(), value->size());
+    } else {
+      record->value.clear();
+    }
+  }
+
+  DBImpl* const db_;
+  WriteBatch* const index_updates_;
+  bool updates_indexed_;
+  Status status_;
+  // Records updated so far in the batch, keyed by column family id and key.
+  std::map<std::pair<uint32_t, std::string>, Record> records_;
+
+  // Scratch space.
+  std::string old_index_key_;
+  std::string new_index_key_;
+  std::string entry_key_;
+};
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (!has_secondary_indexes_.load(std::memory_order_acquire)) {
+    return WriteImpl(options, updates, versions_->default_column_family());
+  }
+
+  index_mutex_.Lock();
+  WriteBatch index_updates;
+  IndexUpdater updater(this, &index_updates);
+  Status s = updates->Iterate(&updater);
+  if (s.ok()) {
+    s = updater.status();
+  }
+  if (!s.ok() || !updater.updates_indexed()) {
+    index_mutex_.Unlock();
+    if (!s.ok()) {
+      return s;
+    }
+    return WriteImpl(options, updates, versions_->default_column_family());
+  }
+
+  // Write the records and their index entries atomically.  index_mutex_
+  // is held until the write is applied, so the next indexed write sees
+  // the records written here.
+  WriteBatch combined(*updates);
+  WriteBatchInternal::Append(&combined, &index_updates);
+  s = WriteImpl(options, &combined, versions_->default_column_family());
+  index_mutex_.Unlock();
+  return s;
+}
+
+Status DBImpl::WriteImpl(const WriteOptions& options, WriteBatch* updates,
+                         ColumnFamilyData* force) {
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1277,7 +2410,24 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  // With pipelined writes, a logged writer has left writers_ and waits
+  // for its group to be applied.
+  while (!w.done && (writers_.empty() || &w != writers_.front())) {
+    if (w.group != nullptr) {
+      // The leader has logged our batch; insert it alongside the others.
+      WriteGroup* group = w.group;
+      w.group = nullptr;
+      mutex_.Unlock();
+      Status s = WriteBatchInternal::InsertInto(w.batch, group->memtables);
+      mutex_.Lock();
+      if (!s.ok() && group->status.ok()) {
+        group->status = s;
+      }
+      if (--group->pending == 0) {
+        group->leader->cv.Signal();
+      }
+      continue;
+    }
     w.cv.Wait();
   }
   if (w.done) {
@@ -1285,18 +2435,50 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   }
 
   // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  Status status = MakeRoomForWrite(updates == nullptr ? force : nullptr);
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+    uint64_t last_sequence = versions_->LastSequence();
+    if (!memtable_groups_.empty()) {
+      // The sequence numbers of groups still being applied are not yet
+      // published.
+      last_sequence = memtable_groups_.back()->last_sequence;
+    }
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    ActiveMemTables memtables(versions_->column_families());
+    WriteGroup group(&w, &memtables);
+    for (Writer* writer : writers_) {
+      group.writers.push_back(writer);
+      if (writer == last_writer) break;
+    }
+
+    // If the group has several batches and the memtables allow it, every
+    // writer inserts its own batch.  A pipelined group cannot insert
+    // tmp_batch_ either, since the next group reuses it.  Either way the
+    // batches are numbered as they are in the log record.
+    const bool pipelined = options_.enable_pipelined_write;
+    group.parallel = write_batch == tmp_batch_ &&
+                     options_.allow_concurrent_memtable_write &&
+                     memtables.SupportConcurrentAdd();
+    if (write_batch == tmp_batch_ && (group.parallel || pipelined)) {
+      SequenceNumber sequence = last_sequence + 1;
+      for (Writer* writer : group.writers) {
+        if (writer->batch != nullptr) {
+          WriteBatchInternal::SetSequence(writer->batch, sequence);
+          sequence += WriteBatchInternal::Count(writer->batch);
+        }
+      }
+    } else {
+      group.batch = write_batch;
+    }
     last_sequence += WriteBatchInternal::Count(write_batch);
+    group.last_sequence = last_sequence;
 
-    // Add to log and apply to memtable.  We can release the lock
-    // during this phase since &w is currently responsible for logging
-    // and protects against concurrent loggers and concurrent writes
-    // into mem_.
+    // Add to log.  We can release the lock during this phase since &w is
+    // currently responsible for logging and protects against concurrent
+    // loggers.
     {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
@@ -1307,9 +2489,6 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(write_batch, mem_);
-      }
       mutex_.Lock();
       if (sync_error) {
         // The state of the log file is indeterminate: the log record we
@@ -1318,9 +2497,53 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
-    if (write_batch == tmp_batch_) tmp_batch_->Clear();
+
+    if (pipelined) {
+      // Hand the log over to the next group, then wait until the groups
+      // logged before this one have been applied.  Groups are applied
+      // one at a time and in log order, so that sequence numbers are
+      // published in order even if this group failed.
+      if (write_batch == tmp_batch_) tmp_batch_->Clear();
+      memtable_groups_.push_back(&group);
+      while (writers_.front() != last_writer) {
+        writers_.pop_front();
+      }
+      writers_.pop_front();
+      if (!writers_.empty()) {
+        writers_.front()->cv.Signal();
+      }
+      while (memtable_groups_.front() != &group) {
+        w.cv.Wait();
+      }
+    }
+
+    // Apply to memtables.  &w protects against concurrent writes into the
+    // memtables: it is at the front of writers_, or, for a pipelined
+    // group, of memtable_groups_.
+    if (status.ok()) {
+      status = ApplyWriteGroup(&group);
+    }
+    if (!pipelined && write_batch == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
+
+    if (pipelined) {
+      memtable_groups_.pop_front();
+      if (!memtable_groups_.empty()) {
+        memtable_groups_.front()->leader->cv.Signal();
+      } else {
+        // MakeRoomForWrite() may be waiting to switch memtables.
+        background_work_finished_signal_.SignalAll();
+      }
+      for (Writer* writer : group.writers) {
+        if (writer != &w) {
+          writer->status = status;
+          writer->done = true;
+          writer->cv.Signal();
+        }
+      }
+      return status;
+    }
   }
 
   while (true) {
@@ -1342,6 +2565,46 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// REQUIRES: group->leader is responsible for writing the memtables
+Status DBImpl::ApplyWriteGroup(WriteGroup* group) {
+  mutex_.AssertHeld();
+  Status status;
+  if (group->parallel) {
+    for (Writer* writer : group->writers) {
+      if (writer != group->leader && writer->batch != nullptr) {
+        writer->group = group;
+        group->pending++;
+        writer->cv.Signal();
+      }
+    }
+    mutex_.Unlock();
+    status =
+        WriteBatchInternal::InsertInto(group->leader->batch, group->memtables);
+    mutex_.Lock();
+    while (group->pending > 0) {
+      group->leader->cv.Wait();
+    }
+    if (status.ok()) {
+      status = group->status;
+    }
+  } else {
+    mutex_.Unlock();
+    if (group->batch != nullptr) {
+      status = WriteBatchInternal::InsertInto(group->batch, group->memtables);
+    } else {
+      for (Writer* writer : group->writers) {
+        if (writer->batch != nullptr) {
+          status =
+              WriteBatchInternal::InsertInto(writer->batch, group->memtables);
+          if (!status.ok()) break;
+        }
+      }
+    }
+    mutex_.Lock();
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1371,22 +2634,25 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == nullptr) {
+      // Memtable flushes and ingestions need the front of the queue.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1394,71 +2660,152 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(ColumnFamilyData* force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
+  uint32_t stalled = 0;
   Status s;
   while (true) {
+    // Pick a column family whose memtable has to be switched: the forced
+    // one, or else one whose memtable is full.
+    ColumnFamilyData* cfd = force;
+    if (cfd == nullptr) {
+      for (ColumnFamilyData* candidate : versions_->column_families()) {
+        if (candidate->mem()->ApproximateMemoryUsage() >
+            candidate->options().write_buffer_size) {
+          cfd = candidate;
+          break;
+        }
+      }
+    }
+
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
-    } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
-      // There is room in current memtable
+    } else if (cfd == nullptr) {
+      // There is room in every memtable
       break;
-    } else if (imm_ != nullptr) {
+    } else if (cfd->imm() != nullptr) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
-      // There are too many level-0 files.
+      WaitForWriteStall(kStallMemTableFull, &stalled);
+    } else if (cfd->current()->NumFiles(0) >= config::kL0_StopWritesTrigger) {
+      // There are too many level-0 files.  DelayWrite() slows writes down
+      // well before this point, so that we rarely get here.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      WaitForWriteStall(kStallLevel0Stop, &stalled);
+    } else if (!memtable_groups_.empty()) {
+      // Pipelined write groups are still being applied to the memtable
+      // that would be switched.
       background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
-      assert(versions_->PrevLogNumber() == 0);
-      uint64_t new_log_number = versions_->NewFileNumber();
-      WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = SwitchMemTable(cfd);
       if (!s.ok()) {
-        // Avoid chewing through file number space in a tight loop.
-        versions_->ReuseFileNumber(new_log_number);
         break;
       }
-      delete log_;
-      delete logfile_;
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_, options_.with_hashmap);
-      mem_->Ref();
-      force = false;  // Do not force another compaction if have room
+      force = nullptr;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
   }
   return s;
 }
 
+Status DBImpl::SwitchMemTable(ColumnFamilyData* cfd) {
+  mutex_.AssertHeld();
+  assert(versions_->PrevLogNumber() == 0);
+  uint64_t new_log_number = versions_->NewFileNumber();
+  WritableFile* lfile = nullptr;
+  Status s =
+      env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+  if (!s.ok()) {
+    // Avoid chewing through file number space in a tight loop.
+    versions_->ReuseFileNumber(new_log_number);
+    return s;
+  }
+  delete log_;
+  delete logfile_;
+  logfile_ = lfile;
+  logfile_number_ = new_log_number;
+  log_ = new log::Writer(lfile);
+  MemTable* mem = new MemTable(cfd->internal_comparator(), cfd->options());
+  mem->Ref();
+  cfd->SwitchMemTable(mem, new_log_number);
+  has_imm_.store(true, std::memory_order_release);
+  return s;
+}
+
+void DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  double score = 0;
+  for (ColumnFamilyData* cfd : versions_->column_families()) {
+    score = std::max(score, cfd->current()->compaction_score());
+  }
+  write_controller_.Update(score, MaxLevel0Files());
+}
+
+// REQUIRES: this thread is currently at the front of the writer queue
+void DBImpl::DelayWrite(uint64_t num_bytes) {
+  mutex_.AssertHeld();
+  UpdateWriteController();
+  uint64_t delay = write_controller_.GetDelay(env_->NowMicros(), num_bytes);
+  if (delay == 0) {
+    return;
+  }
+  WriteStallStats* stats =
+      &write_stalls_[write_controller_.delay_reason() ==
+                             WriteController::kLevel0Slowdown
+                         ? kStallLevel0Slowdown
+                         : kStallCompactionDebt];
+  const uint64_t start_micros = env_->NowMicros();
+
+  // Sleep in small steps and stop early once compactions have caught up.
+  // The sleep also hands over some CPU to the compaction threads in case
+  // they share the same core as the writer.
+  const uint64_t kDelayStepMicros = 1000;
+  while (delay > 0 && write_controller_.IsDelayed()) {
+    const uint64_t step = std::min(delay, kDelayStepMicros);
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(static_cast<int>(step));
+    mutex_.Lock();
+    delay -= step;
+    UpdateWriteController();
+  }
+  stats->count++;
+  stats->micros += env_->NowMicros() - start_micros;
+}
+
+void DBImpl::WaitForWriteStall(WriteStallReason reason, uint32_t* stalled) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  background_work_finished_signal_.Wait();
+  write_stalls_[reason].micros += env_->NowMicros() - start_micros;
+  if ((*stalled & (1u << reason)) == 0) {
+    *stalled |= 1u << reason;
+    write_stalls_[reason].count++;
+  }
+}
+
+int DBImpl::MaxLevel0Files() {
+  mutex_.AssertHeld();
+  int result = 0;
+  for (ColumnFamilyData* cfd : versions_->column_families()) {
+    result = std::max(result, cfd->current()->NumFiles(0));
+  }
+  return result;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  return GetProperty(DefaultColumnFamily(), property, value);
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const Slice& property, std::string* value) {
   value->clear();
 
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
   MutexLock l(&mutex_);
   Slice in = property;
   Slice prefix("leveldb.");
@@ -1474,11 +2821,13 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "%d",
-               versions_->NumLevelFiles(static_cast<int>(level)));
+               cfd->current()->NumFiles(static_cast<int>(level)));
       *value = buf;
       return true;
     }
   } else if (in == "stats") {
+    const std::array<CompactionStats, config::kNumLevels>& stats =
+        stats_[cfd->id()];
     char buf[200];
     snprintf(buf, sizeof(buf),
              "                               Compactions\n"
@@ -1486,27 +2835,46 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              "--------------------------------------------------\n");
     value->append(buf);
     for (int level = 0; level < config::kNumLevels; level++) {
-      int files = versions_->NumLevelFiles(level);
-      if (stats_[level].micros > 0 || files > 0) {
+      int files = cfd->current()->NumFiles(level);
+      if (stats[level].micros > 0 || files > 0) {
         snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n", level,
-                 files, versions_->NumLevelBytes(level) / 1048576.0,
-                 stats_[level].micros / 1e6,
-                 stats_[level].bytes_read / 1048576.0,
-                 stats_[level].bytes_written / 1048576.0);
+                 files, versions_->NumLevelBytes(cfd, level) / 1048576.0,
+                 stats[level].micros / 1e6,
+                 stats[level].bytes_read / 1048576.0,
+                 stats[level].bytes_written / 1048576.0);
         value->append(buf);
       }
     }
+
+    // Write stalls are counted for the whole DB.
+    static const char* const kStallReasons[kNumWriteStallReasons] = {
+        "level0-slowdown", "compaction-debt", "memtable-full", "level0-stop"};
+    snprintf(buf, sizeof(buf),
+             "\n           Write stalls\n"
+             "Reason             Count Time(sec)\n"
+             "----------------------------------\n");
+    value->append(buf);
+    for (int reason = 0; reason < kNumWriteStallReasons; reason++) {
+      snprintf(buf, sizeof(buf), "%-16s %7lld %9.3f\n", kStallReasons[reason],
+               static_cast<long long>(write_stalls_[reason].count),
+               write_stalls_[reason].micros / 1e6);
+      value->append(buf);
+    }
+    snprintf(buf, sizeof(buf), "Delayed write rate: %.1f MB/s%s\n",
+             write_controller_.delayed_write_rate() / 1048576.0,
+             write_controller_.IsDelayed() ? " (active)" : "");
+    value->append(buf);
     return true;
   } else if (in == "sstables") {
-    *value = versions_->current()->DebugString();
+    *value = cfd->current()->DebugString();
     return true;
   } else if (in == "approximate-memory-usage") {
-    size_t total_usage = options_.block_cache->TotalCharge();
-    if (mem_) {
-      total_usage += mem_->ApproximateMemoryUsage();
+    size_t total_usage = cfd->options().block_cache->TotalCharge();
+    if (cfd->mem()) {
+      total_usage += cfd->mem()->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    if (cfd->imm()) {
+      total_usage += cfd->imm()->ApproximateMemoryUsage();
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
@@ -1519,9 +2887,15 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
 }
 
 void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
+  GetApproximateSizes(DefaultColumnFamily(), range, n, sizes);
+}
+
+void DBImpl::GetApproximateSizes(ColumnFamilyHandle* column_family,
+                                 const Range* range, int n, uint64_t* sizes) {
   // TODO(opt): better implementation
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
   MutexLock l(&mutex_);
-  Version* v = versions_->current();
+  Version* v = cfd->current();
   v->Ref();
 
   for (int i = 0; i < n; i++) {
@@ -1536,51 +2910,171 @@ void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
   v->Unref();
 }
 
-Status DBImpl::CreateColumnFamily(const std::string cf_name,
-                                  ColumnFamilyHandle& cf) {
-  ColumnFamilyHandle cf_t(cf_name);
-  cf = cf_t;
-  return Status::OK();
+Status DBImpl::CreateColumnFamily(const Options& options,
+                                  const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = nullptr;
+  if (IsIndexColumnFamilyName(name)) {
+    return Status::InvalidArgument(name, "name is reserved for indexes");
+  }
+  ColumnFamilyData* cfd;
+  Status s = CreateColumnFamilyImpl(options, name, &cfd);
+  if (s.ok()) {
+    s = OpenIndexes(cfd);
+  }
+  if (s.ok()) {
+    *handle = cfd->handle();
+  }
+  return s;
 }
 
-Status DBImpl::Put(const WriteOptions& options, ColumnFamilyHandle& cf,
-                   const Slice& key, const Slice& value) {
-  return Put(options, cf.GetPrefix()+key.ToString(), value);
-}
+Status DBImpl::CreateColumnFamilyImpl(const Options& options,
+                                      const std::string& name,
+                                      ColumnFamilyData** cfd) {
+  *cfd = nullptr;
+  MutexLock l(&mutex_);
+  // VersionSet::LogAndApply() must not run concurrently with the
+  // background threads, so take the MANIFEST slot while the family is
+  // created.
+  while (manifest_write_in_progress_) {
+    background_work_finished_signal_.Wait();
+  }
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+  if (versions_->GetColumnFamily(name) != nullptr) {
+    return Status::InvalidArgument(name, "column family already exists");
+  }
+  manifest_write_in_progress_ = true;
 
-Status DBImpl::Get(const ReadOptions& options, ColumnFamilyHandle& cf,
-                   const Slice& key, std::string* value) {
-  return Get(options, cf.GetPrefix()+key.ToString(), value);
+  Status s = versions_->CreateColumnFamily(name, options, logfile_number_,
+                                           &mutex_, cfd);
+  if (s.ok()) {
+    MemTable* mem =
+        new MemTable((*cfd)->internal_comparator(), (*cfd)->options());
+    mem->Ref();
+    (*cfd)->SetMemTable(mem);
+    stats_.resize(versions_->column_families().size());
+  }
+
+  manifest_write_in_progress_ = false;
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+  return s;
 }
 
-Iterator* DBImpl::NewColumnFamilyIterator(const ReadOptions& options,
-                                       ColumnFamilyHandle& cf) {
-  return new ColumnFamilyIterator(cf, NewIterator(options));
+// Index entries are ordered bytewise and do not need the indexes of the
+// family they index.
+static Options IndexColumnFamilyOptions(const Options& options) {
+  Options result = options;
+  result.comparator = BytewiseComparator();
+  result.secondary_indexes.clear();
+  return result;
 }
 
-Status DBImpl::PutWithIndex(const WriteOptions& options, const Slice& key,
-                            const Slice& value) {
-  // 这里的Key Value都为固定的8字节长度
-  char value_key[18] = "00000000_00000000";
-  for(int i=0;i<key.size();i++){
-    value_key[16-i] = key[key.size()-1-i];
+Status DBImpl::OpenIndexes(ColumnFamilyData* cfd) {
+  const std::vector<const SecondaryIndex*>& indexes =
+      cfd->options().secondary_indexes;
+  if (indexes.empty()) {
+    return Status::OK();
+  }
+
+  MutexLock l(&index_mutex_);
+  IndexedColumnFamily family;
+  family.cfd = cfd;
+  Status s;
+  std::set<std::string> names;
+  for (size_t i = 0; s.ok() && i < indexes.size(); i++) {
+    if (!names.insert(indexes[i]->Name()).second) {
+      return Status::InvalidArgument(indexes[i]->Name(),
+                                     "duplicate secondary index name");
+    }
+    const std::string name =
+        IndexColumnFamilyName(cfd->name(), indexes[i]->Name());
+    mutex_.Lock();
+    ColumnFamilyData* index_cfd = versions_->GetColumnFamily(name);
+    mutex_.Unlock();
+    if (index_cfd == nullptr) {
+      s = CreateColumnFamilyImpl(IndexColumnFamilyOptions(cfd->options()),
+                                 name, &index_cfd);
+    }
+    if (s.ok()) {
+      // The index column family holds the empty key once it has been
+      // filled; it orders before every index entry.
+      std::string ignored;
+      s = GetImpl(ReadOptions(), index_cfd, Slice(), &ignored, nullptr);
+      if (s.IsNotFound()) {
+        s = BuildIndex(cfd, indexes[i], index_cfd);
+      }
+    }
+    family.indexes.push_back(index_cfd);
   }
-  for(int i=0;i<value.size();i++){
-    value_key[7-i] = value[value.size()-1-i];
+  if (s.ok()) {
+    indexed_column_families_[cfd->id()] = family;
+    has_secondary_indexes_.store(true, std::memory_order_release);
   }
-  // 插入记录
-  Put(options, cf_record_, Slice(value_key+9, 8), Slice(value_key, 8));
+  return s;
+}
 
-  // 插入索引
-  Put(options, cf_index_, Slice(value_key, 17), "");
-  
-  return Status::OK();
+Status DBImpl::BuildIndex(ColumnFamilyData* cfd, const SecondaryIndex* index,
+                          ColumnFamilyData* index_cfd) {
+  // Bound the size of the batches written while filling the index.
+  static const size_t kBuildIndexBatchBytes = 1 << 20;
+
+  Iterator* iter = NewIterator(ReadOptions(), cfd->handle());
+  WriteBatch batch;
+  std::string index_key;
+  std::string entry_key;
+  Status s;
+  for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+    index_key.clear();
+    if (index->Extract(iter->key(), iter->value(), &index_key)) {
+      entry_key.clear();
+      AppendIndexEntryKey(&entry_key, index_key, iter->key());
+      batch.Put(index_cfd->handle(), entry_key, Slice());
+      if (batch.ApproximateSize() >= kBuildIndexBatchBytes) {
+        s = WriteImpl(WriteOptions(), &batch,
+                      versions_->default_column_family());
+        batch.Clear();
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  if (s.ok()) {
+    batch.Put(index_cfd->handle(), Slice(), Slice());
+    s = WriteImpl(WriteOptions(), &batch, versions_->default_column_family());
+  }
+  return s;
 }
 
- Iterator* DBImpl::NewIndexIterator(const ReadOptions& options) {
-   return new IndexIterator(NewIterator(options));
- }
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() const {
+  return versions_->default_column_family()->handle();
+}
 
+IndexIterator* DBImpl::NewIndexIterator(const ReadOptions& options,
+                                        ColumnFamilyHandle* column_family,
+                                        const Slice& index_name) {
+  ColumnFamilyData* cfd = GetColumnFamilyData(column_family);
+  MutexLock l(&index_mutex_);
+  std::map<uint32_t, IndexedColumnFamily>::const_iterator family =
+      indexed_column_families_.find(cfd->id());
+  if (family != indexed_column_families_.end()) {
+    const std::vector<const SecondaryIndex*>& indexes =
+        cfd->options().secondary_indexes;
+    for (size_t i = 0; i < indexes.size(); i++) {
+      if (index_name == indexes[i]->Name()) {
+        return leveldb::NewIndexIterator(this, cfd->handle(),
+                                         family->second.indexes[i]->handle(),
+                                         options);
+      }
+    }
+  }
+  return NewErrorIndexIterator(
+      Status::InvalidArgument(index_name, "no such secondary index"));
+}
 
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
@@ -1596,46 +3090,135 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt,
+                       ColumnFamilyHandle* column_family, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(column_family, begin, end);
+  return Write(opt, &batch);
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
+  std::vector<ColumnFamilyHandle*> handles;
+  return Open(options, dbname, std::vector<ColumnFamilyDescriptor>(), &handles,
+              dbptr);
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
   *dbptr = nullptr;
+  handles->clear();
+
+  std::map<std::string, Options> column_family_options;
+  for (const ColumnFamilyDescriptor& cf : column_families) {
+    if (cf.name != kDefaultColumnFamilyName) {
+      column_family_options[cf.name] = cf.options;
+    }
+  }
+  // The index column families are opened along with the families they
+  // index.
+  std::map<std::string, Options> index_options;
+  for (const SecondaryIndex* index : options.secondary_indexes) {
+    index_options[IndexColumnFamilyName(kDefaultColumnFamilyName,
+                                        index->Name())] =
+        IndexColumnFamilyOptions(options);
+  }
+  for (const auto& cf : column_family_options) {
+    for (const SecondaryIndex* index : cf.second.secondary_indexes) {
+      index_options[IndexColumnFamilyName(cf.first, index->Name())] =
+          IndexColumnFamilyOptions(cf.second);
+    }
+  }
+  column_family_options.insert(index_options.begin(), index_options.end());
 
   DBImpl* impl = new DBImpl(options, dbname);
   impl->mutex_.Lock();
-  VersionEdit edit;
+  std::vector<VersionEdit> edits;
   // Recover handles create_if_missing, error_if_exists
   bool save_manifest = false;
-  Status s = impl->Recover(&edit, &save_manifest);
-  if (s.ok() && impl->mem_ == nullptr) {
-    // Create new log and a corresponding memtable.
-    uint64_t new_log_number = impl->versions_->NewFileNumber();
+  Status s = impl->Recover(column_family_options, &edits, &save_manifest);
+  VersionSet* const versions = impl->versions_;
+  for (size_t i = 0; s.ok() && i < column_families.size(); i++) {
+    ColumnFamilyData* cfd = versions->GetColumnFamily(column_families[i].name);
+    if (cfd == nullptr) {
+      s = Status::InvalidArgument(column_families[i].name,
+                                  "column family does not exist");
+    } else {
+      handles->push_back(cfd->handle());
+    }
+  }
+  if (s.ok() && impl->log_ == nullptr) {
+    // Create new log.
+    uint64_t new_log_number = versions->NewFileNumber();
     WritableFile* lfile;
     s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
                                      &lfile);
     if (s.ok()) {
-      edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_, options.with_hashmap);
-      impl->mem_->Ref();
+    }
+  }
+  if (s.ok()) {
+    // Give every column family without recovered updates a memtable.
+    for (ColumnFamilyData* cfd : versions->column_families()) {
+      if (cfd->mem() == nullptr) {
+        MemTable* mem =
+            new MemTable(cfd->internal_comparator(), cfd->options());
+        mem->Ref();
+        cfd->SetMemTable(mem);
+      }
     }
   }
   if (s.ok() && save_manifest) {
-    edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
-    edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    for (ColumnFamilyData* cfd : versions->column_families()) {
+      VersionEdit* edit = &edits[cfd->id()];
+      edit->SetColumnFamily(cfd->id());
+      edit->SetPrevLogNumber(0);  // No older logs needed after recovery.
+      edit->SetLogNumber(impl->logfile_number_);
+      s = versions->LogAndApply(edit, &impl->mutex_);
+      if (!s.ok()) {
+        break;
+      }
+    }
   }
   if (s.ok()) {
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
+  std::vector<ColumnFamilyData*> recovered = versions->column_families();
   impl->mutex_.Unlock();
+  for (size_t i = 0; s.ok() && i < recovered.size(); i++) {
+    s = impl->OpenIndexes(recovered[i]);
+  }
   if (s.ok()) {
-    assert(impl->mem_ != nullptr);
     *dbptr = impl;
   } else {
+    handles->clear();
     delete impl;
   }
   return s;
@@ -1643,6 +3226,41 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
 
 Snapshot::~Snapshot() = default;
 
+std::string LookupTrace::ToString() const {
+  std::string r;
+  switch (source) {
+    case kNone:
+      r = "not found";
+      break;
+    case kMemTable:
+      r = "memtable";
+      break;
+    case kImmutableMemTable:
+      r = "immutable memtable";
+      break;
+    case kTable:
+      r = "level-" + NumberToString(level) + " #" +
+          NumberToString(file_number);
+      if (from_row_cache) {
+        r += " row cache";
+      } else {
+        r += " block@" + NumberToString(block_offset);
+      }
+      break;
+  }
+  if (source != kNone) {
+    r += deleted ? " del" : " val";
+    r += " seq=" + NumberToString(sequence);
+  }
+  char buf[100];
+  snprintf(buf, sizeof(buf),
+           "; files probed=%d filtered=%d block cache hits=%d"
+           " row cache hits=%d",
+           files_probed, filter_rejections, block_cache_hits, row_cache_hits);
+  r.append(buf);
+  return r;
+}
+
 Status DestroyDB(const std::string& dbname, const Options& options) {
   Env* env = options.env;
   std::vector<std::string> filenames;
@@ -5,14 +5,18 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -20,7 +24,10 @@
 
 namespace leveldb {
 
+class ColumnFamilyData;
+struct FileMetaData;
 class MemTable;
+class RangeDelAggregator;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -39,39 +46,67 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key, std::string* value,
+             LookupTrace* trace) override;
   Status GetWithPosition(const ReadOptions& options, const Slice& key,
                         std::string* value, std::string* position) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
-
-  Status CreateColumnFamily(std::string cf_name, ColumnFamilyHandle& cf) override;
-
-  Status Put(const WriteOptions& options, ColumnFamilyHandle& cf, const Slice& key,
-                     const Slice& value) override;
-
-  Status Get(const ReadOptions& options, ColumnFamilyHandle& cf,const Slice& key,
-                     std::string* value) override;
-
-  Iterator* NewColumnFamilyIterator(const ReadOptions& options, ColumnFamilyHandle &cf) override;
-
-  Status PutWithIndex(const WriteOptions& options, const Slice& key, const Slice& value) override;
-
-  Iterator* NewIndexIterator(const ReadOptions& options) override;
+  Status IngestExternalFiles(const std::vector<std::string>& paths) override;
+
+  Status CreateColumnFamily(const Options& options, const std::string& name,
+                            ColumnFamilyHandle** handle) override;
+  ColumnFamilyHandle* DefaultColumnFamily() const override;
+  Status Put(const WriteOptions&, ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value) override;
+  Status Delete(const WriteOptions&, ColumnFamilyHandle* column_family,
+                const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, ColumnFamilyHandle* column_family,
+                     const Slice& begin, const Slice& end) override;
+  Status Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+             const Slice& key, std::string* value) override;
+  void MultiGet(const ReadOptions& options, ColumnFamilyHandle* column_family,
+                const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
+  Iterator* NewIterator(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family) override;
+  bool GetProperty(ColumnFamilyHandle* column_family, const Slice& property,
+                   std::string* value) override;
+  void GetApproximateSizes(ColumnFamilyHandle* column_family,
+                           const Range* range, int n,
+                           uint64_t* sizes) override;
+  void CompactRange(ColumnFamilyHandle* column_family, const Slice* begin,
+                    const Slice* end) override;
+  Status IngestExternalFiles(ColumnFamilyHandle* column_family,
+                             const std::vector<std::string>& paths) override;
+
+  IndexIterator* NewIndexIterator(const ReadOptions& options,
+                                  ColumnFamilyHandle* column_family,
+                                  const Slice& index_name) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
-  // Compact any files in the named level that overlap [*begin,*end]
-  void TEST_CompactRange(int level, const Slice* begin, const Slice* end);
+  // Compact any files in the named level that overlap [*begin,*end].
+  // Operates on the default column family if "column_family" is null.
+  void TEST_CompactRange(int level, const Slice* begin, const Slice* end,
+                         ColumnFamilyHandle* column_family = nullptr);
 
-  // Force current memtable contents to be compacted.
-  Status TEST_CompactMemTable();
+  // Force current memtable contents of the column family (by default the
+  // default one) to be compacted.
+  Status TEST_CompactMemTable(ColumnFamilyHandle* column_family = nullptr);
 
   // Return an internal iterator over the current state of the database.
   // The keys of this iterator are internal keys (see format.h).
@@ -82,20 +117,33 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
-  // Record a sample of bytes read at the specified internal key.
-  // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.
-  void RecordReadSample(Slice key);
+  // Record a sample of bytes read at the specified internal key of the
+  // specified column family.  Samples are taken approximately once every
+  // config::kReadBytesPeriod bytes.
+  void RecordReadSample(ColumnFamilyData* cfd, Slice key);
 
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionJob;
   struct Writer;
+  struct WriteGroup;
+  class IndexUpdater;
+
+  // The secondary indexes of a column family.
+  struct IndexedColumnFamily {
+    ColumnFamilyData* cfd;
+    // The column families of the indexes, in the order of
+    // cfd->options().secondary_indexes.
+    std::vector<ColumnFamilyData*> indexes;
+  };
 
   // Information for a manual compaction
   struct ManualCompaction {
+    ColumnFamilyData* cfd;
     int level;
     bool done;
+    bool in_progress;          // A background thread is running it
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
     InternalKey tmp_storage;   // Used to keep track of compaction progress
@@ -117,16 +165,53 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
+  // Reasons for which writes are held back.  The first two delay writes,
+  // the others stop them.
+  enum WriteStallReason {
+    kStallLevel0Slowdown,  // Too many level-0 files
+    kStallCompactionDebt,  // Some level is far above its target size
+    kStallMemTableFull,    // The previous memtable is still being flushed
+    kStallLevel0Stop,      // Far too many level-0 files
+    kNumWriteStallReasons
+  };
+
+  // Per-reason statistics about write stalls
+  struct WriteStallStats {
+    WriteStallStats() : count(0), micros(0) {}
+
+    int64_t count;   // Number of writes held back
+    int64_t micros;  // Time spent holding them back
+  };
+
+  Status GetImpl(const ReadOptions& options, ColumnFamilyData* cfd,
+                 const Slice& key, std::string* value, LookupTrace* trace);
+
+  // Called by a read whose seek used up the allowed seeks of file "f" at
+  // "level" of "v" (see Version::ChargeSeek()).
+  void RecordSeekCompaction(Version* v, FileMetaData* f, int level)
+      LOCKS_EXCLUDED(mutex_);
+
+  // If "range_del" is non-null, stores in *range_del the range tombstones
+  // visible to the returned iterator, or null if there are none.  The
+  // caller owns the result.
+  Iterator* NewInternalIterator(const ReadOptions&, ColumnFamilyData* cfd,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelAggregator** range_del = nullptr);
+
+  // Return the column family of "column_family", or the default column
+  // family if it is null.
+  ColumnFamilyData* GetColumnFamilyData(ColumnFamilyHandle* column_family) const;
 
   Status NewDB();
 
-  // Recover the descriptor from persistent storage.  May do a significant
-  // amount of work to recover recently logged updates.  Any changes to
-  // be made to the descriptor are added to *edit.
-  Status Recover(VersionEdit* edit, bool* save_manifest)
+  // Recover the descriptor from persistent storage.  Column families other
+  // than the default one are opened with their entry in
+  // "column_family_options".  May do a significant amount of work to
+  // recover recently logged updates.  Any changes to be made to the
+  // descriptor are added to (*edits)[id] of the affected column family.
+  Status Recover(const std::map<std::string, Options>& column_family_options,
+                 std::vector<VersionEdit>* edits, bool* save_manifest)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void MaybeIgnoreError(Status* s) const;
@@ -134,36 +219,118 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
-  // Errors are recorded in bg_error_.
-  void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compact the immutable memtable of "cfd" to disk and write a new
+  // descriptor iff successful.  Errors are recorded in bg_error_.
+  void CompactMemTable(ColumnFamilyData* cfd) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Compact the immutable memtable of some column family, if any.
+  // Returns true iff there was one and no other thread was flushing.
+  bool CompactAnyMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Recompute has_imm_ from the column families.
+  void UpdateHasImm() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
-                        VersionEdit* edit, SequenceNumber* max_sequence)
+                        std::vector<VersionEdit>* edits,
+                        SequenceNumber* max_sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write "mem" to a new table of "cfd" and add it to *edit.  The table
+  // goes to level 0 unless "flush", in which case it may go to a higher
+  // level, whose key range stays reserved until the caller calls
+  // VersionSet::ReleaseMemTableOutput().  The table number is stored in
+  // *number and stays in pending_outputs_ until the caller removes it
+  // once *edit is applied.
+  Status WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                          VersionEdit* edit, bool flush, uint64_t* number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Apply *edit through versions_, waiting for any other thread that is
+  // writing to the MANIFEST first.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Same as Write(), but a null "updates" forces the memtable of "force"
+  // to be compacted instead.
+  Status WriteImpl(const WriteOptions& options, WriteBatch* updates,
+                   ColumnFamilyData* force);
+
+  // Create the column family "name" and store it in *cfd.
+  Status CreateColumnFamilyImpl(const Options& options,
+                                const std::string& name,
+                                ColumnFamilyData** cfd) LOCKS_EXCLUDED(mutex_);
+
+  // Create the index column families of "cfd" that do not exist yet, fill
+  // the indexes that have not been filled from the records of "cfd", and
+  // start maintaining them.
+  Status OpenIndexes(ColumnFamilyData* cfd) LOCKS_EXCLUDED(mutex_);
+
+  // Add an index entry to "index_cfd" for every record of "cfd" that
+  // belongs in "index".
+  Status BuildIndex(ColumnFamilyData* cfd, const SecondaryIndex* index,
+                    ColumnFamilyData* index_cfd)
+      EXCLUSIVE_LOCKS_REQUIRED(index_mutex_);
+
+  // Make sure every column family has room for the next write.  If
+  // "force" is non-null, also switch its memtable even if there is room.
+  Status MakeRoomForWrite(ColumnFamilyData* force)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
+  // Switch to a new log file and give "cfd" a new memtable, making the
+  // current one immutable.
+  Status SwitchMemTable(ColumnFamilyData* cfd) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the largest number of level-0 files in any column family.
+  int MaxLevel0Files() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Tell write_controller_ how far compactions are behind.
+  void UpdateWriteController() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Delay a write of "num_bytes" bytes as write_controller_ asks.
+  void DelayWrite(uint64_t num_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait for background work to finish while writes are stopped for
+  // "reason".  *stalled records the reasons already counted for the
+  // current write.
+  void WaitForWriteStall(WriteStallReason reason, uint32_t* stalled)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status ApplyWriteGroup(WriteGroup* group) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlush(void* db);
+  void BackgroundFlushCall();
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Run one compaction.  Returns false if there was none to run that
+  // does not conflict with the running ones.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGSubcompaction(void* job);
+  // Merge the part of "job" while not holding mutex_.
+  void RunSubcompaction(SubcompactionJob* job)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the inputs of the compaction of "compact" that fall in its key
+  // range into its outputs, dropping the entries deleted by the
+  // tombstones of *range_del.  If "imm_micros" is non-null, also flush
+  // the immutable memtables that are waiting, adding the time it takes
+  // to *imm_micros.
+  Status ProcessCompactionRange(CompactionState* compact,
+                                RangeDelAggregator* range_del,
+                                int64_t* imm_micros);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Add to the current output the parts of the range tombstones kept by
+  // the compaction that fall in its key range.  "limit", if non-null, is
+  // the user key at which the next output begins.
+  void AddOutputRangeTombstones(CompactionState* compact, const Slice* limit);
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* limit);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -190,16 +357,18 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
-  MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Memtables live in the column families (see ColumnFamilyData).
+  std::atomic<bool> has_imm_;  // So bg thread can detect a non-null imm()
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // Groups that have been logged and wait to be applied to the memtables,
+  // in log order.  Only used with Options::enable_pipelined_write.
+  std::deque<WriteGroup*> memtable_groups_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
@@ -208,8 +377,23 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Has a memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of background compactions scheduled or running.  At most
+  // options_.max_background_compactions.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of subcompactions scheduled on the low priority pool whose
+  // call has not returned yet.
+  int background_subcompactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some thread writing an immutable memtable to a table?  Only
+  // written with mutex_ held.
+  std::atomic<bool> flushing_memtable_;
+
+  // Is some thread in VersionSet::LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -218,10 +402,21 @@ class DBImpl : public DB {
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
-  CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
-
-  ColumnFamilyHandle cf_index_;
-  ColumnFamilyHandle cf_record_;
+  // Indexed by column family id.
+  std::vector<std::array<CompactionStats, config::kNumLevels>> stats_
+      GUARDED_BY(mutex_);
+
+  WriteController write_controller_ GUARDED_BY(mutex_);
+  WriteStallStats write_stalls_[kNumWriteStallReasons] GUARDED_BY(mutex_);
+
+  // Serializes the writes that update secondary indexes, so that each sees
+  // the records left by the previous ones.  Acquired before mutex_.
+  port::Mutex index_mutex_ ACQUIRED_BEFORE(mutex_);
+  // Keyed by column family id.
+  std::map<uint32_t, IndexedColumnFamily> indexed_column_families_
+      GUARDED_BY(index_mutex_);
+  // So writes to databases without indexes can skip index_mutex_.
+  std::atomic<bool> has_secondary_indexes_;
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -231,6 +426,10 @@ Options SanitizeOptions(const std::string& db,
                         const InternalFilterPolicy* ipolicy,
                         const Options& src);
 
+// Return the number of table files a TableCache may keep open under the
+// sanitized options "sanitized_options".
+int TableCacheSize(const Options& sanitized_options);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
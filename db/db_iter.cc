@@ -7,6 +7,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -45,12 +46,18 @@ class DBIter : public Iterator {
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, ColumnFamilyData* cfd, const Comparator* cmp,
+         Iterator* iter, SequenceNumber s, uint32_t seed,
+         const Slice* lower_bound, const Slice* upper_bound,
+         RangeDelAggregator* range_del)
       : db_(db),
+        cfd_(cfd),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
+        range_del_(range_del),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
@@ -59,7 +66,10 @@ class DBIter : public Iterator {
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_del_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
@@ -88,6 +98,20 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+  // Returns true iff "ikey" is deleted by a range tombstone.
+  bool RangeDeleted(const ParsedInternalKey& ikey) const {
+    return range_del_ != nullptr &&
+           range_del_->ShouldDelete(ikey.user_key, ikey.sequence);
+  }
+  bool PastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -107,9 +131,13 @@ class DBIter : public Iterator {
   }
 
   DBImpl* db_;
+  ColumnFamilyData* const cfd_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const lower_bound_;  // May be null
+  const Slice* const upper_bound_;  // May be null
+  RangeDelAggregator* const range_del_;  // May be null
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -125,7 +153,7 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   size_t bytes_read = k.size() + iter_->value().size();
   while (bytes_until_read_sampling_ < bytes_read) {
     bytes_until_read_sampling_ += RandomCompactionPeriod();
-    db_->RecordReadSample(k);
+    db_->RecordReadSample(cfd_, k);
   }
   assert(bytes_until_read_sampling_ >= bytes_read);
   bytes_until_read_sampling_ -= bytes_read;
@@ -181,6 +209,10 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (PastUpperBound(ikey.user_key)) {
+        // All remaining entries are out of bounds.
+        break;
+      }
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -192,12 +224,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (RangeDeleted(ikey)) {
+            // The newest entry for this key is deleted, and so are the
+            // older ones.
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          break;  // Range tombstones are not part of the entries
       }
     }
     iter_->Next();
@@ -241,12 +280,19 @@ void DBIter::FindPrevUserEntry() {
     do {
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+        if (BeforeLowerBound(ikey.user_key)) {
+          // All remaining entries are out of bounds.
+          break;
+        }
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
         value_type = ikey.type;
+        if (value_type == kTypeValue && RangeDeleted(ikey)) {
+          value_type = kTypeDeletion;
+        }
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -280,7 +326,9 @@ void DBIter::Seek(const Slice& target) {
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+                    ParsedInternalKey(BeforeLowerBound(target) ? *lower_bound_
+                                                               : target,
+                                      sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -290,6 +338,10 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  if (lower_bound_ != nullptr) {
+    Seek(*lower_bound_);
+    return;
+  }
   direction_ = kForward;
   ClearSavedValue();
   iter_->SeekToFirst();
@@ -303,16 +355,34 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ == nullptr) {
+    iter_->SeekToLast();
+  } else {
+    // Position at the last entry whose user key is before the bound.
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  }
   FindPrevUserEntry();
 }
 
 }  // anonymous namespace
 
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+Iterator* NewDBIterator(DBImpl* db, ColumnFamilyData* cfd,
+                        const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, const Slice* lower_bound,
+                        const Slice* upper_bound,
+                        RangeDelAggregator* range_del) {
+  return new DBIter(db, cfd, user_key_comparator, internal_iter, sequence,
+                    seed, lower_bound, upper_bound, range_del);
 }
 
 }  // namespace leveldb
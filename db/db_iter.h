@@ -12,14 +12,23 @@
 
 namespace leveldb {
 
+class ColumnFamilyData;
 class DBImpl;
+class RangeDelAggregator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+// into appropriate user keys.  Read samples are recorded against the
+// column family "cfd".  If non-null, only user keys >= *lower_bound and
+// < *upper_bound are yielded.  If non-null, the entries deleted by the
+// tombstones of "range_del" are skipped; the iterator takes ownership of
+// it.
+Iterator* NewDBIterator(DBImpl* db, ColumnFamilyData* cfd,
+                        const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, const Slice* lower_bound,
+                        const Slice* upper_bound,
+                        RangeDelAggregator* range_del = nullptr);
 
 }  // namespace leveldb
 
@@ -5,7 +5,11 @@
 #include "leveldb/db.h"
 
 #include <atomic>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
@@ -15,7 +19,9 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/table.h"
+#include "leveldb/table_file_writer.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/hash.h"
@@ -31,6 +37,12 @@ static std::string RandomString(Random* rnd, int len) {
   return r;
 }
 
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
 static std::string RandomKey(Random* rnd) {
   int len =
       (rnd->OneIn(3) ? 1  // Short sometimes to encourage collisions
@@ -236,6 +248,7 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    row_cache_ = NewLRUCache(1 << 20);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -247,6 +260,7 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete row_cache_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -275,6 +289,33 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kMemTableHashIndex:
+        options.with_hashmap = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kSubcompactions:
+        options.max_subcompactions = 4;
+        break;
+      case kRowCache:
+        options.row_cache = row_cache_;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kFullFilterLayout:
+        options.filter_policy = filter_policy_;
+        options.filter_layout = kFullFilter;
+        break;
+      case kPartitionedFilterLayout:
+        options.filter_policy = filter_policy_;
+        options.filter_layout = kPartitionedFilter;
+        options.filter_partition_keys = 16;
+        break;
       default:
         break;
     }
@@ -389,6 +430,8 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              break;
           }
         }
         iter->Next();
@@ -531,9 +574,24 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kMemTableHashIndex,
+    kConcurrentMemTableWrite,
+    kPipelinedWrite,
+    kSubcompactions,
+    kRowCache,
+    kDataBlockHashIndex,
+    kFullFilterLayout,
+    kPartitionedFilterLayout,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  Cache* row_cache_;
   int option_config_;
 };
 
@@ -614,6 +672,165 @@ TEST_F(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetLookupTrace) {
+  do {
+    std::string value;
+    LookupTrace trace;
+    ASSERT_TRUE(db_->Get(ReadOptions(), "foo", &value, &trace).IsNotFound());
+    ASSERT_EQ(LookupTrace::kNone, trace.source);
+
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value, &trace));
+    ASSERT_EQ("v1", value);
+    ASSERT_EQ(LookupTrace::kMemTable, trace.source);
+    ASSERT_EQ(1, trace.sequence);
+    ASSERT_TRUE(!trace.deleted);
+
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value, &trace));
+    ASSERT_EQ(LookupTrace::kTable, trace.source);
+    ASSERT_EQ(1, trace.sequence);
+    ASSERT_LE(0, trace.level);
+    ASSERT_NE(0, trace.file_number);
+    ASSERT_EQ(1, trace.files_probed);
+    ASSERT_EQ(0, trace.filter_rejections);
+
+    ASSERT_LEVELDB_OK(Delete("foo"));
+    ASSERT_TRUE(db_->Get(ReadOptions(), "foo", &value, &trace).IsNotFound());
+    ASSERT_EQ(LookupTrace::kMemTable, trace.source);
+    ASSERT_EQ(2, trace.sequence);
+    ASSERT_TRUE(trace.deleted);
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, LookupTraceTableWork) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Two overlapping table files in different levels.
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("c", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(Put("c", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, TotalTableFiles());
+
+  std::string value;
+  LookupTrace trace;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "b", &value, &trace).IsNotFound());
+  ASSERT_EQ(LookupTrace::kNone, trace.source);
+  ASSERT_EQ(2, trace.files_probed);
+  ASSERT_EQ(2, trace.filter_rejections);
+  ASSERT_EQ(0, trace.block_cache_hits);
+
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "a", &value, &trace));
+  ASSERT_EQ("v2", value);
+  ASSERT_EQ(LookupTrace::kTable, trace.source);
+  ASSERT_EQ(1, trace.files_probed);
+  ASSERT_EQ(0, trace.filter_rejections);
+  ASSERT_EQ(0, trace.block_offset);
+  ASSERT_NE(std::string::npos, trace.ToString().find("files probed=1"));
+
+  Close();
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, RowCache) {
+  Cache* row_cache = NewLRUCache(1 << 20);
+  Options options = CurrentOptions();
+  options.row_cache = row_cache;
+  Reopen(&options);
+
+  std::string value;
+  LookupTrace trace;
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // The first lookup reads the table and caches the newest entry.
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "a", &value, &trace));
+  ASSERT_EQ("v2", value);
+  ASSERT_EQ(0, trace.row_cache_hits);
+  ASSERT_TRUE(!trace.from_row_cache);
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "a", &value, &trace));
+  ASSERT_EQ("v2", value);
+  ASSERT_EQ(1, trace.row_cache_hits);
+  ASSERT_EQ(LookupTrace::kTable, trace.source);
+  ASSERT_EQ(2, trace.sequence);
+  ASSERT_TRUE(trace.from_row_cache);
+  ASSERT_EQ(0, trace.block_offset);
+  ASSERT_NE(std::string::npos, trace.ToString().find(" row cache "))
+      << trace.ToString();
+  ASSERT_EQ(std::string::npos, trace.ToString().find("block@"));
+
+  // A snapshot older than the cached entry reads the table.
+  ReadOptions at_snapshot;
+  at_snapshot.snapshot = snapshot;
+  ASSERT_LEVELDB_OK(db_->Get(at_snapshot, "a", &value, &trace));
+  ASSERT_EQ("v1", value);
+  ASSERT_EQ(0, trace.row_cache_hits);
+  db_->ReleaseSnapshot(snapshot);
+
+  // A key missing from the file is not cached.
+  ASSERT_TRUE(db_->Get(ReadOptions(), "c", &value, &trace).IsNotFound());
+  ASSERT_TRUE(db_->Get(ReadOptions(), "c", &value, &trace).IsNotFound());
+  ASSERT_EQ(0, trace.row_cache_hits);
+
+  // Deletions are cached too.  The new file has a new number, so the
+  // cached entry of the old file is not used for it.
+  ASSERT_LEVELDB_OK(Delete("a"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value, &trace).IsNotFound());
+  ASSERT_EQ(0, trace.row_cache_hits);
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value, &trace).IsNotFound());
+  ASSERT_EQ(1, trace.row_cache_hits);
+  ASSERT_TRUE(trace.deleted);
+
+  // A hit after reading a block of a newer file reports no block.
+  ASSERT_LEVELDB_OK(Put("e", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("e"));
+  ASSERT_LEVELDB_OK(Put("d", std::string(10000, 'x')));
+  ASSERT_LEVELDB_OK(Put("f", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "e", &value, &trace));
+  ASSERT_EQ("v1", value);
+  ASSERT_EQ(1, trace.row_cache_hits);
+  ASSERT_TRUE(trace.from_row_cache);
+  ASSERT_EQ(0, trace.block_offset);
+
+  // After a compaction, the entry is read from the output file.
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v2", Get("b"));
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "b", &value, &trace));
+  ASSERT_EQ("v2", value);
+  ASSERT_EQ(1, trace.row_cache_hits);
+
+  // MultiGet() reads and fills the row cache as Get() does.
+  ASSERT_LEVELDB_OK(Put("d", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), {"b", "d"}, &values, &statuses);
+  ASSERT_LEVELDB_OK(statuses[0]);
+  ASSERT_LEVELDB_OK(statuses[1]);
+  ASSERT_EQ("v2", values[0]);
+  ASSERT_EQ("v1", values[1]);
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "d", &value, &trace));
+  ASSERT_EQ("v1", value);
+  ASSERT_EQ(1, trace.row_cache_hits);
+
+  Close();
+  delete row_cache;
+}
+
 TEST_F(DBTest, GetMemUsage) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -772,6 +989,162 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over deeper levels, level-0 files and the memtable,
+    // with values large enough for each table to have several blocks.
+    Random rnd(301);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    Compact(Key(0), Key(99));
+    for (int i = 0; i < 100; i += 3) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v2_" + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 100; i += 5) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 100; i += 7) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "v3_" + Key(i)));
+    }
+
+    // Unsorted, with duplicates and keys that do not exist.
+    std::vector<std::string> key_strings = {"", "a", "zzz", Key(50) + "x"};
+    for (int i = 99; i >= 0; i -= 2) key_strings.push_back(Key(i));
+    for (int i = 0; i < 100; i += 2) key_strings.push_back(Key(i));
+    key_strings.push_back(Key(21));
+    std::vector<Slice> keys(key_strings.begin(), key_strings.end());
+
+    for (const Snapshot* s : {static_cast<const Snapshot*>(nullptr),
+                              snapshot}) {
+      ReadOptions options;
+      options.snapshot = s;
+      std::vector<std::string> values;
+      std::vector<Status> statuses;
+      db_->MultiGet(options, keys, &values, &statuses);
+      ASSERT_EQ(keys.size(), values.size());
+      ASSERT_EQ(keys.size(), statuses.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        std::string result;
+        if (statuses[i].IsNotFound()) {
+          result = "NOT_FOUND";
+        } else if (statuses[i].ok()) {
+          result = values[i];
+        } else {
+          result = statuses[i].ToString();
+        }
+        ASSERT_EQ(Get(key_strings[i], s), result) << key_strings[i];
+      }
+    }
+    db_->ReleaseSnapshot(snapshot);
+
+    std::vector<std::string> values = {"stale"};
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), std::vector<Slice>(), &values, &statuses);
+    ASSERT_TRUE(values.empty());
+    ASSERT_TRUE(statuses.empty());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    // The end key is exclusive; an empty range deletes nothing.
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "e", "a"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)(e->ve)", Contents());
+    ASSERT_EQ("vb", Get("b", snapshot));
+
+    // Tombstones survive flushes, compactions and reopening.
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vb", Get("b", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "c", "e"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("(a->va)(e->ve)", Contents());
+    Reopen();
+    ASSERT_EQ("(a->va)(e->ve)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+
+    std::vector<Slice> keys = {"a", "b", "c", "d", "e"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ("va", values[0]);
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_TRUE(statuses[2].IsNotFound());
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    ASSERT_EQ("ve", values[4]);
+
+    snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("c", "vc3"));
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->va)(c->vc3)(e->ve)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("c", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Once no snapshot needs them, compactions drop covered entries and
+    // the tombstones themselves.
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("[ vc3 ]", AllEntriesFor("c"));
+    ASSERT_EQ("[ ]", AllEntriesFor("d"));
+    ASSERT_EQ("(a->va)(c->vc3)(e->ve)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 10000)));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  const int files = TotalTableFiles();
+  ASSERT_GT(files, 2);
+
+  // A tombstone over most of the keys deletes the files it covers when
+  // it is compacted into their level, without them being rewritten.
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(10), Key(190)));
+  ASSERT_LEVELDB_OK(Put(Key(100), "v"));
+  const uint64_t before = Size("", Key(999));
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_LT(TotalTableFiles(), files);
+  ASSERT_LT(Size("", Key(999)), before / 4);
+
+  ASSERT_NE("NOT_FOUND", Get(Key(9)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(10)));
+  ASSERT_EQ("v", Get(Key(100)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(189)));
+  ASSERT_NE("NOT_FOUND", Get(Key(190)));
+  int count = 0;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(10 + 1 + 10, count);
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -963,6 +1336,62 @@ TEST_F(DBTest, IterMultiWithDelete) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, IterBounds) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    ASSERT_LEVELDB_OK(Put("f", "vf"));
+
+    Slice lower("b"), upper("e");
+    ReadOptions options;
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(options);
+
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Seek("e");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("c");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    delete iter;
+
+    // A bound between the keys of a table file.
+    upper = "bb";
+    iter = db_->NewIterator(options);
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, Recover) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1022,12 +1451,6 @@ TEST_F(DBTest, RecoverDuringMemtableCompaction) {
   } while (ChangeOptions());
 }
 
-static std::string Key(int i) {
-  char buf[100];
-  snprintf(buf, sizeof(buf), "key%06d", i);
-  return std::string(buf);
-}
-
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1103,6 +1526,339 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_file_size = 50000;       // Many files per level
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 20000; i++) {
+    const std::string key = Key(rnd.Uniform(5000));
+    const std::string value = RandomString(&rnd, 100);
+    ASSERT_LEVELDB_OK(Put(key, value));
+    model[key] = value;
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto expected = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_TRUE(expected != model.end());
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == model.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, PipelinedConcurrentWrites) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Switch memtables while writing
+  options.enable_pipelined_write = true;
+  options.allow_concurrent_memtable_write = true;
+  Reopen(&options);
+
+  const int kWriters = 4;
+  const int kKeysPerWriter = 2000;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kWriters; t++) {
+    writers.emplace_back([&, t] {
+      for (int i = 0; i < kKeysPerWriter; i++) {
+        WriteBatch batch;
+        batch.Put(Key(t * kKeysPerWriter + i), std::string(100, 'a' + t));
+        if (i % 3 == 0) {
+          batch.Put("last" + std::to_string(t), Key(i));
+        }
+        ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+      }
+    });
+  }
+
+  // Each writer's keys become visible in the order they were written.
+  std::thread reader([&] {
+    Random rnd(301);
+    std::string value;
+    while (!done.load(std::memory_order_acquire)) {
+      const int t = rnd.Uniform(kWriters);
+      const int i = 1 + rnd.Uniform(kKeysPerWriter - 1);
+      ReadOptions read_options;
+      read_options.snapshot = db_->GetSnapshot();
+      if (db_->Get(read_options, Key(t * kKeysPerWriter + i), &value).ok()) {
+        ASSERT_LEVELDB_OK(
+            db_->Get(read_options, Key(t * kKeysPerWriter + i - 1), &value));
+      }
+      db_->ReleaseSnapshot(read_options.snapshot);
+    }
+  });
+
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  done.store(true, std::memory_order_release);
+  reader.join();
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int t = 0; t < kWriters; t++) {
+      for (int i = 0; i < kKeysPerWriter; i++) {
+        ASSERT_EQ(std::string(100, 'a' + t), Get(Key(t * kKeysPerWriter + i)));
+      }
+      ASSERT_EQ(Key((kKeysPerWriter - 1) / 3 * 3),
+                Get("last" + std::to_string(t)));
+    }
+    Reopen(&options);
+  }
+}
+
+namespace {
+
+// Blocks a background thread until Release() is called.
+struct BackgroundBlocker {
+  BackgroundBlocker() : cv(&mu), released(false) {}
+
+  static void Block(void* arg) {
+    BackgroundBlocker* blocker = reinterpret_cast<BackgroundBlocker*>(arg);
+    MutexLock l(&blocker->mu);
+    while (!blocker->released) {
+      blocker->cv.Wait();
+    }
+  }
+
+  void Release() {
+    MutexLock l(&mu);
+    released = true;
+    cv.SignalAll();
+  }
+
+  port::Mutex mu;
+  port::CondVar cv;
+  bool released;
+};
+
+}  // namespace
+
+TEST_F(DBTest, WriteStallStats) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Hold every compaction thread, so that flushes (which run on the high
+  // priority pool) pile up files in level-0.
+  BackgroundBlocker blocker;
+  for (int i = 0; i < 16; i++) {
+    env_->ScheduleWithPriority(&BackgroundBlocker::Block, &blocker,
+                               Env::kLow);
+  }
+
+  // Every memtable covers the same keys, so that its table stays in
+  // level-0.
+  Random rnd(301);
+  for (int i = 0;
+       NumTableFilesAtLevel(0) < config::kL0_SlowdownWritesTrigger + 1; i++) {
+    ASSERT_LT(i, 10000);
+    ASSERT_LEVELDB_OK(Put(Key(i % 100), RandomString(&rnd, 10000)));
+  }
+  ASSERT_LEVELDB_OK(Put("delayed", "v"));
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &stats));
+  long long count;
+  double seconds;
+  const size_t pos = stats.find("level0-slowdown");
+  ASSERT_NE(std::string::npos, pos) << stats;
+  ASSERT_EQ(2, sscanf(stats.c_str() + pos, "level0-slowdown %lld %lf", &count,
+                      &seconds))
+      << stats;
+  ASSERT_GT(count, 0) << stats;
+  ASSERT_NE(std::string::npos, stats.find("(active)")) << stats;
+
+  blocker.Release();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("v", Get("delayed"));
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Hold every compaction thread, so that level-0 piles up files that
+  // are then compacted together.
+  BackgroundBlocker blocker;
+  for (int i = 0; i < 16; i++) {
+    env_->ScheduleWithPriority(&BackgroundBlocker::Block, &blocker,
+                               Env::kLow);
+  }
+
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  const Snapshot* snapshot = nullptr;
+  std::string snapshot_key, snapshot_value;
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j < 500; j++) {
+      const std::string key = Key(rnd.Uniform(2000));
+      const std::string value = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+    if (i == 2) {
+      snapshot = db_->GetSnapshot();
+      snapshot_key = model.begin()->first;
+      snapshot_value = model.begin()->second;
+      ASSERT_LEVELDB_OK(Delete(snapshot_key));
+      model.erase(model.begin());
+    }
+    if (i == 4) {
+      ASSERT_LEVELDB_OK(
+          db_->DeleteRange(WriteOptions(), Key(500), Key(1500)));
+      model.erase(model.lower_bound(Key(500)), model.lower_bound(Key(1500)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_GT(NumTableFilesAtLevel(0), 1);
+
+  blocker.Release();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  // All of the data fits in one file, so the outputs are those of the
+  // subcompactions.
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  ASSERT_EQ(snapshot_value, Get(snapshot_key, snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(snapshot_key));
+  db_->ReleaseSnapshot(snapshot);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto expected = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_TRUE(expected != model.end());
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == model.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, RateLimiter) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(100 << 20));
+  Options options = CurrentOptions();
+  options.rate_limiter = limiter.get();
+  Reopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  const int64_t flushed = limiter->GetTotalBytesThrough(Env::kHigh);
+  ASSERT_GT(flushed, 100 * 1000);
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kLow));
+
+  // Reads are not limited.
+  for (int i = 0; i < 100; i++) {
+    Get(Key(i));
+  }
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kLow));
+
+  // A compaction is charged for both the blocks it reads and the table it
+  // writes.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  const int64_t flushed_twice = limiter->GetTotalBytesThrough(Env::kHigh);
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(limiter->GetTotalBytesThrough(Env::kLow), 2 * 100 * 1000);
+  ASSERT_EQ(flushed_twice, limiter->GetTotalBytesThrough(Env::kHigh));
+
+  // The limiter must outlive the DB.
+  Close();
+}
+
+TEST_F(DBTest, IngestExternalFiles) {
+  const std::string file1 = dbname_ + "_ingest1";
+  const std::string file2 = dbname_ + "_ingest2";
+  do {
+    Options options = CurrentOptions();
+    ASSERT_LEVELDB_OK(Put("a", "old"));
+    ASSERT_LEVELDB_OK(Put("c", "old"));
+    ASSERT_LEVELDB_OK(Put("x", "old"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    {
+      TableFileWriter writer(options);
+      ASSERT_LEVELDB_OK(writer.Open(file1));
+      ASSERT_LEVELDB_OK(writer.Put("b", "new"));
+      ASSERT_LEVELDB_OK(writer.Put("c", "new"));
+      ASSERT_LEVELDB_OK(writer.Delete("d"));
+      ASSERT_TRUE(writer.Put("c", "again").IsInvalidArgument());
+      ASSERT_LEVELDB_OK(writer.Finish());
+      ASSERT_EQ(3u, writer.NumEntries());
+    }
+    {
+      TableFileWriter writer(options);
+      ASSERT_LEVELDB_OK(writer.Open(file2));
+      ASSERT_LEVELDB_OK(writer.Put("m", "new"));
+      ASSERT_LEVELDB_OK(writer.Delete("x"));
+      ASSERT_LEVELDB_OK(writer.Finish());
+    }
+    ASSERT_TRUE(db_->IngestExternalFiles({file1, file1}).IsInvalidArgument());
+    ASSERT_FALSE(db_->IngestExternalFiles({dbname_ + "_missing"}).ok());
+    ASSERT_LEVELDB_OK(db_->IngestExternalFiles({file2, file1}));
+
+    // The ingested records are newer than the ones written before, and
+    // invisible to older snapshots.
+    ASSERT_EQ("(a->old)(b->new)(c->new)(m->new)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("x"));
+    ASSERT_EQ("old", Get("c", snapshot));
+    ASSERT_EQ("NOT_FOUND", Get("b", snapshot));
+    ASSERT_EQ("old", Get("x", snapshot));
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->Seek("b");
+    ASSERT_EQ("c->old", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("x->old", IterStatus(iter));
+    delete iter;
+    ASSERT_LEVELDB_OK(Put("b", "newer"));
+    ASSERT_EQ("newer", Get("b"));
+    db_->ReleaseSnapshot(snapshot);
+
+    // A file that overlaps nothing goes to the last level.
+    {
+      TableFileWriter writer(options);
+      ASSERT_LEVELDB_OK(writer.Open(file1));
+      ASSERT_LEVELDB_OK(writer.Put("z", "new"));
+      ASSERT_LEVELDB_OK(writer.Finish());
+    }
+    ASSERT_EQ(0, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_LEVELDB_OK(db_->IngestExternalFiles({file1}));
+    ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_EQ("new", Get("z"));
+
+    Reopen();
+    ASSERT_EQ("(a->old)(b->newer)(c->new)(m->new)(z->new)", Contents());
+    ASSERT_LEVELDB_OK(Put("z", "newer"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->old)(b->newer)(c->new)(m->new)(z->newer)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("x"));
+  } while (ChangeOptions());
+  env_->RemoveFile(file1);
+  env_->RemoveFile(file2);
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1874,50 +2630,60 @@ TEST_F(DBTest, FilesDeletedAfterCompaction) {
 }
 
 TEST_F(DBTest, BloomFilter) {
-  env_->count_random_reads_ = true;
-  Options options = CurrentOptions();
-  options.env = env_;
-  options.block_cache = NewLRUCache(0);  // Prevent cache hits
-  options.filter_policy = NewBloomFilterPolicy(10);
-  Reopen(&options);
+  for (FilterLayout layout :
+       {kBlockBasedFilter, kFullFilter, kPartitionedFilter}) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.filter_layout = layout;
+    options.filter_partition_keys = 1000;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
 
-  // Populate multiple layers
-  const int N = 10000;
-  for (int i = 0; i < N; i++) {
-    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
-  }
-  Compact("a", "z");
-  for (int i = 0; i < N; i += 100) {
-    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
-  }
-  dbfull()->TEST_CompactMemTable();
+    // Populate multiple layers
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
 
-  // Prevent auto compactions triggered by seeks
-  env_->delay_data_sync_.store(true, std::memory_order_release);
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.store(true, std::memory_order_release);
 
-  // Lookup present keys.  Should rarely read from small sstable.
-  env_->random_read_counter_.Reset();
-  for (int i = 0; i < N; i++) {
-    ASSERT_EQ(Key(i), Get(Key(i)));
-  }
-  int reads = env_->random_read_counter_.Read();
-  fprintf(stderr, "%d present => %d reads\n", N, reads);
-  ASSERT_GE(reads, N);
-  ASSERT_LE(reads, N + 2 * N / 100);
+    // Without cache hits, a lookup reads the filter partition of the key
+    // in each sstable it consults.
+    const int partition_reads = layout == kPartitionedFilter ? 2 * N : 0;
 
-  // Lookup present keys.  Should rarely read from either sstable.
-  env_->random_read_counter_.Reset();
-  for (int i = 0; i < N; i++) {
-    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
-  }
-  reads = env_->random_read_counter_.Read();
-  fprintf(stderr, "%d missing => %d reads\n", N, reads);
-  ASSERT_LE(reads, 3 * N / 100);
+    // Lookup present keys.  Should rarely read from small sstable.
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "layout %d: %d present => %d reads\n", layout, N, reads);
+    ASSERT_GE(reads, N + partition_reads - N / 100);
+    ASSERT_LE(reads, N + partition_reads + 2 * N / 100);
 
-  env_->delay_data_sync_.store(false, std::memory_order_release);
-  Close();
-  delete options.block_cache;
-  delete options.filter_policy;
+    // Lookup present keys.  Should rarely read from either sstable.
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "layout %d: %d missing => %d reads\n", layout, N, reads);
+    ASSERT_LE(reads, partition_reads + 3 * N / 100);
+
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
 }
 
 // Multi-threaded test:
@@ -2036,11 +2802,20 @@ class ModelDB : public DB {
   Status Delete(const WriteOptions& o, const Slice& key) override {
     return DB::Delete(o, key);
   }
+  Status DeleteRange(const WriteOptions& o, const Slice& begin,
+                     const Slice& end) override {
+    return DB::DeleteRange(o, begin, end);
+  }
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override {
     assert(false);  // Not implemented
     return Status::NotFound(key);
   }
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override {
+    assert(false);  // Not implemented
+  }
   Iterator* NewIterator(const ReadOptions& options) override {
     if (options.snapshot == nullptr) {
       KVMap* saved = new KVMap;
@@ -2069,6 +2844,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2084,6 +2865,73 @@ class ModelDB : public DB {
     }
   }
   void CompactRange(const Slice* start, const Slice* end) override {}
+  Status IngestExternalFiles(const std::vector<std::string>& paths) override {
+    return Status::NotSupported("ingestion");
+  }
+
+  Status Get(const ReadOptions& options, const Slice& key, std::string* value,
+             LookupTrace* trace) override {
+    assert(false);  // Not implemented
+    return Status::NotFound(key);
+  }
+  Status GetWithPosition(const ReadOptions& options, const Slice& key,
+                         std::string* value, std::string* position) override {
+    assert(false);  // Not implemented
+    return Status::NotFound(key);
+  }
+  Status CreateColumnFamily(const Options& options, const std::string& name,
+                            ColumnFamilyHandle** handle) override {
+    return Status::NotSupported("column families");
+  }
+  ColumnFamilyHandle* DefaultColumnFamily() const override { return nullptr; }
+  Status Put(const WriteOptions& o, ColumnFamilyHandle* cf, const Slice& k,
+             const Slice& v) override {
+    return Status::NotSupported("column families");
+  }
+  Status Delete(const WriteOptions& o, ColumnFamilyHandle* cf,
+                const Slice& key) override {
+    return Status::NotSupported("column families");
+  }
+  Status DeleteRange(const WriteOptions& o, ColumnFamilyHandle* cf,
+                     const Slice& begin, const Slice& end) override {
+    return Status::NotSupported("column families");
+  }
+  Status Get(const ReadOptions& options, ColumnFamilyHandle* cf,
+             const Slice& key, std::string* value) override {
+    assert(false);  // Not implemented
+    return Status::NotFound(key);
+  }
+  void MultiGet(const ReadOptions& options, ColumnFamilyHandle* cf,
+                const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override {
+    assert(false);  // Not implemented
+  }
+  Iterator* NewIterator(const ReadOptions& options,
+                        ColumnFamilyHandle* cf) override {
+    return NewErrorIterator(Status::NotSupported("column families"));
+  }
+  bool GetProperty(ColumnFamilyHandle* cf, const Slice& property,
+                   std::string* value) override {
+    return false;
+  }
+  void GetApproximateSizes(ColumnFamilyHandle* cf, const Range* r, int n,
+                           uint64_t* sizes) override {
+    for (int i = 0; i < n; i++) {
+      sizes[i] = 0;
+    }
+  }
+  void CompactRange(ColumnFamilyHandle* cf, const Slice* start,
+                    const Slice* end) override {}
+  Status IngestExternalFiles(ColumnFamilyHandle* cf,
+                             const std::vector<std::string>& paths) override {
+    return Status::NotSupported("ingestion");
+  }
+  IndexIterator* NewIndexIterator(const ReadOptions& options,
+                                  ColumnFamilyHandle* cf,
+                                  const Slice& index_name) override {
+    return NewErrorIndexIterator(Status::NotSupported("secondary index"));
+  }
 
  private:
   class ModelIter : public Iterator {
@@ -2184,11 +3032,17 @@ TEST_F(DBTest, Randomized) {
         ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
         ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
 
-      } else if (p < 90) {  // Delete
+      } else if (p < 88) {  // Delete
         k = RandomKey(&rnd);
         ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
         ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
 
+      } else if (p < 90) {  // DeleteRange
+        k = RandomKey(&rnd);
+        v = RandomKey(&rnd);
+        ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), k, v));
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), k, v));
+
       } else {  // Multi-element batch
         WriteBatch b;
         const int num = rnd.Uniform(8);
@@ -2260,7 +3114,7 @@ void BM_LogAndApply(int iters, int num_base_files) {
   Options options;
   VersionSet vset(dbname, &options, nullptr, &cmp);
   bool save_manifest;
-  ASSERT_LEVELDB_OK(vset.Recover(&save_manifest));
+  ASSERT_LEVELDB_OK(vset.Recover({}, &save_manifest));
   VersionEdit vbase;
   uint64_t fnum = 1;
   for (int i = 0; i < num_base_files; i++) {
@@ -33,6 +33,11 @@ static const int kL0_SlowdownWritesTrigger = 8;
 // Maximum number of level-0 files.  We stop writes at this point.
 static const int kL0_StopWritesTrigger = 12;
 
+// Compaction score (see VersionSet::Finalize) at which we slow down writes
+// even though level-0 is below kL0_SlowdownWritesTrigger: some level holds
+// this many times its target size.
+static const double kSlowdownCompactionScore = 2.0;
+
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -51,14 +56,24 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+//
+// kTypeRangeDeletion marks a range tombstone, which deletes every entry
+// with a smaller sequence number whose user key is in [begin,end).  Its
+// internal key is (begin, sequence, kTypeRangeDeletion) and its value is
+// "end".  Range tombstones are kept apart from point entries: in their
+// own skiplist in a memtable and in a meta block of a table.
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -177,7 +192,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeRangeDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -201,6 +216,9 @@ class LookupKey {
   // Return the user key
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // Return the sequence number the lookup is made at.
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_
@@ -88,6 +88,47 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    std::string r = "  cf ";
+    AppendNumberTo(&r, column_family_id);
+    r += " put '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+    return Status::OK();
+  }
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    std::string r = "  cf ";
+    AppendNumberTo(&r, column_family_id);
+    r += " del '";
+    AppendEscapedStringTo(&r, key);
+    r += "'\n";
+    dst_->Append(r);
+    return Status::OK();
+  }
+  Status DeleteRangeCF(uint32_t column_family_id, const Slice& begin,
+                       const Slice& end) override {
+    std::string r = "  cf ";
+    AppendNumberTo(&r, column_family_id);
+    r += " delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+    return Status::OK();
+  }
 
   WritableFile* dst_;
 };
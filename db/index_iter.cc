@@ -0,0 +1,356 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/index_iter.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+static const char kIndexColumnFamilyPrefix[] = "__index/";
+
+void AppendIndexEntryKeyPrefix(std::string* dst, const Slice& index_key) {
+  for (size_t i = 0; i < index_key.size(); i++) {
+    dst->push_back(index_key[i]);
+    if (index_key[i] == '\0') {
+      dst->push_back('\xff');
+    }
+  }
+  dst->push_back('\0');
+  dst->push_back('\x01');
+}
+
+void AppendIndexEntryKey(std::string* dst, const Slice& index_key,
+                         const Slice& primary_key) {
+  AppendIndexEntryKeyPrefix(dst, index_key);
+  dst->append(primary_key.data(), primary_key.size());
+}
+
+bool ParseIndexEntryKey(const Slice& entry_key, std::string* index_key,
+                        Slice* primary_key) {
+  index_key->clear();
+  const char* p = entry_key.data();
+  const char* limit = p + entry_key.size();
+  while (p < limit) {
+    if (*p != '\0') {
+      index_key->push_back(*p++);
+    } else if (p + 1 < limit && p[1] == '\xff') {
+      index_key->push_back('\0');
+      p += 2;
+    } else if (p + 1 < limit && p[1] == '\x01') {
+      *primary_key = Slice(p + 2, limit - (p + 2));
+      return true;
+    } else {
+      return false;
+    }
+  }
+  return false;
+}
+
+std::string IndexColumnFamilyName(const std::string& column_family_name,
+                                  const std::string& index_name) {
+  return kIndexColumnFamilyPrefix + column_family_name + "/" + index_name;
+}
+
+bool IsIndexColumnFamilyName(const Slice& name) {
+  return name.starts_with(kIndexColumnFamilyPrefix);
+}
+
+SecondaryIndex::~SecondaryIndex() = default;
+
+namespace {
+
+// Number of index entries whose records are fetched together.  Batches
+// start small so that short scans do not read records they never yield,
+// and double up to the maximum for long scans.
+static const size_t kMinFetchBatch = 8;
+static const size_t kMaxFetchBatch = 256;
+
+class IndexIter : public IndexIterator {
+ public:
+  // Which way did iter_ move past the entries in entries_?
+  // (1) kForward: iter_ is positioned just after the last entry
+  // (2) kReverse: iter_ is positioned just before the first entry
+  enum Direction { kForward, kReverse };
+
+  IndexIter(DB* db, ColumnFamilyHandle* primary, ColumnFamilyHandle* index,
+            const ReadOptions& options);
+
+  IndexIter(const IndexIter&) = delete;
+  IndexIter& operator=(const IndexIter&) = delete;
+
+  ~IndexIter() override;
+
+  bool Valid() const override { return pos_ < entries_.size(); }
+  Slice key() const override {
+    assert(Valid());
+    return entries_[pos_].index_key;
+  }
+  Slice value() const override {
+    assert(Valid());
+    return entries_[pos_].value;
+  }
+  Slice primary_key() const override {
+    assert(Valid());
+    return entries_[pos_].primary_key;
+  }
+  Status status() const override {
+    if (status_.ok()) {
+      return iter_->status();
+    } else {
+      return status_;
+    }
+  }
+
+  void Next() override;
+  void Prev() override;
+  void Seek(const Slice& target) override;
+  void SeekToFirst() override;
+  void SeekToLast() override;
+
+ private:
+  struct Entry {
+    std::string entry_key;  // Key of the index entry
+    std::string index_key;
+    std::string primary_key;
+    std::string value;
+  };
+
+  // Replace entries_ with the next batch of entries in "direction" from
+  // the position of iter_, and position at the first of them.
+  void Fill(Direction direction);
+
+  // Look up the records of entries_, dropping the entries whose record
+  // does not exist.
+  void FetchRecords();
+
+  DB* const db_;
+  ColumnFamilyHandle* const primary_;
+  const Snapshot* owned_snapshot_;  // Released on deletion; may be null
+  ReadOptions read_options_;        // For looking up the records
+
+  // Encoded iterate bounds of iter_.
+  std::string lower_bound_;
+  std::string upper_bound_;
+  Slice lower_bound_slice_;
+  Slice upper_bound_slice_;
+
+  Iterator* iter_;  // Over the index entries
+  Direction direction_;
+  size_t batch_size_;
+  std::vector<Entry> entries_;  // In index order
+  size_t pos_;
+  Status status_;
+};
+
+IndexIter::IndexIter(DB* db, ColumnFamilyHandle* primary,
+                     ColumnFamilyHandle* index, const ReadOptions& options)
+    : db_(db),
+      primary_(primary),
+      owned_snapshot_(nullptr),
+      read_options_(options),
+      iter_(nullptr),
+      direction_(kForward),
+      batch_size_(kMinFetchBatch),
+      pos_(0) {
+  if (options.snapshot == nullptr) {
+    // The index entries and the records must be read as of the same
+    // sequence number.
+    owned_snapshot_ = db_->GetSnapshot();
+    read_options_.snapshot = owned_snapshot_;
+  }
+  read_options_.iterate_lower_bound = nullptr;
+  read_options_.iterate_upper_bound = nullptr;
+
+  // Always bound from below so that the empty key, which marks the index
+  // as built, is never visited.
+  ReadOptions index_options = read_options_;
+  AppendIndexEntryKeyPrefix(&lower_bound_,
+                            options.iterate_lower_bound != nullptr
+                                ? *options.iterate_lower_bound
+                                : Slice());
+  lower_bound_slice_ = lower_bound_;
+  index_options.iterate_lower_bound = &lower_bound_slice_;
+  if (options.iterate_upper_bound != nullptr) {
+    AppendIndexEntryKeyPrefix(&upper_bound_, *options.iterate_upper_bound);
+    upper_bound_slice_ = upper_bound_;
+    index_options.iterate_upper_bound = &upper_bound_slice_;
+  }
+  iter_ = db_->NewIterator(index_options, index);
+}
+
+IndexIter::~IndexIter() {
+  delete iter_;
+  if (owned_snapshot_ != nullptr) {
+    db_->ReleaseSnapshot(owned_snapshot_);
+  }
+}
+
+void IndexIter::Fill(Direction direction) {
+  direction_ = direction;
+  entries_.clear();
+  pos_ = 0;
+  while (entries_.empty() && iter_->Valid() && status_.ok()) {
+    while (iter_->Valid() && entries_.size() < batch_size_) {
+      entries_.emplace_back();
+      Entry* e = &entries_.back();
+      e->entry_key = iter_->key().ToString();
+      Slice primary_key;
+      if (!ParseIndexEntryKey(e->entry_key, &e->index_key, &primary_key)) {
+        status_ = Status::Corruption("malformed index entry");
+        entries_.clear();
+        return;
+      }
+      e->primary_key = primary_key.ToString();
+      if (direction == kForward) {
+        iter_->Next();
+      } else {
+        iter_->Prev();
+      }
+    }
+    if (batch_size_ < kMaxFetchBatch) {
+      batch_size_ *= 2;
+    }
+    if (direction == kReverse) {
+      std::reverse(entries_.begin(), entries_.end());
+    }
+    FetchRecords();
+  }
+  if (direction == kReverse && !entries_.empty()) {
+    pos_ = entries_.size() - 1;
+  }
+}
+
+void IndexIter::FetchRecords() {
+  // Look the whole batch up at once; MultiGet() sorts the keys so that
+  // each table is opened and each of its blocks read at most once.
+  std::vector<Slice> keys;
+  keys.reserve(entries_.size());
+  for (const Entry& e : entries_) {
+    keys.push_back(e.primary_key);
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(read_options_, primary_, keys, &values, &statuses);
+
+  std::vector<bool> found(entries_.size(), false);
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (statuses[i].ok()) {
+      entries_[i].value.swap(values[i]);
+      found[i] = true;
+    } else if (!statuses[i].IsNotFound()) {
+      status_ = statuses[i];
+      entries_.clear();
+      return;
+    }
+  }
+
+  // Index entries are written atomically with their records, so a
+  // missing record means the entry is stale; skip it.
+  size_t live = 0;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (found[i]) {
+      if (live != i) {
+        std::swap(entries_[live], entries_[i]);
+      }
+      live++;
+    }
+  }
+  entries_.resize(live);
+}
+
+void IndexIter::Next() {
+  assert(Valid());
+  if (pos_ + 1 < entries_.size()) {
+    pos_++;
+    return;
+  }
+  if (direction_ == kReverse) {
+    // Move iter_ past the entries we have already yielded.
+    iter_->Seek(entries_.back().entry_key);
+    if (iter_->Valid()) iter_->Next();
+  }
+  Fill(kForward);
+}
+
+void IndexIter::Prev() {
+  assert(Valid());
+  if (pos_ > 0) {
+    pos_--;
+    return;
+  }
+  if (direction_ == kForward) {
+    // Move iter_ before the entries we have already yielded.
+    iter_->Seek(entries_.front().entry_key);
+    if (iter_->Valid()) iter_->Prev();
+  }
+  Fill(kReverse);
+}
+
+void IndexIter::Seek(const Slice& target) {
+  std::string entry_key;
+  AppendIndexEntryKeyPrefix(&entry_key, target);
+  iter_->Seek(entry_key);
+  batch_size_ = kMinFetchBatch;
+  Fill(kForward);
+}
+
+void IndexIter::SeekToFirst() {
+  iter_->SeekToFirst();
+  batch_size_ = kMinFetchBatch;
+  Fill(kForward);
+}
+
+void IndexIter::SeekToLast() {
+  iter_->SeekToLast();
+  batch_size_ = kMinFetchBatch;
+  Fill(kReverse);
+}
+
+class EmptyIndexIterator : public IndexIterator {
+ public:
+  EmptyIndexIterator(const Status& s) : status_(s) {}
+  ~EmptyIndexIterator() override = default;
+
+  bool Valid() const override { return false; }
+  void Seek(const Slice& target) override {}
+  void SeekToFirst() override {}
+  void SeekToLast() override {}
+  void Next() override { assert(false); }
+  void Prev() override { assert(false); }
+  Slice key() const override {
+    assert(false);
+    return Slice();
+  }
+  Slice value() const override {
+    assert(false);
+    return Slice();
+  }
+  Slice primary_key() const override {
+    assert(false);
+    return Slice();
+  }
+  Status status() const override { return status_; }
+
+ private:
+  Status status_;
+};
+
+}  // anonymous namespace
+
+IndexIterator* NewIndexIterator(DB* db, ColumnFamilyHandle* primary,
+                                ColumnFamilyHandle* index,
+                                const ReadOptions& options) {
+  return new IndexIter(db, primary, index, options);
+}
+
+IndexIterator* NewErrorIndexIterator(const Status& status) {
+  return new EmptyIndexIterator(status);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_INDEX_ITER_H_
+#define STORAGE_LEVELDB_DB_INDEX_ITER_H_
+
+#include <string>
+
+#include "leveldb/db.h"
+#include "leveldb/secondary_index.h"
+
+namespace leveldb {
+
+// The entries of a secondary index are stored in its column family under
+// keys of the form
+//    escaped index key + "\x00\x01" + primary key
+// with empty values, where the escaped index key is the index key with
+// every 0x00 byte replaced by "\x00\xff".  Comparing two such keys
+// bytewise orders them by index key and then by primary key.
+
+// Append the key of the index entry for (index_key, primary_key) to *dst.
+void AppendIndexEntryKey(std::string* dst, const Slice& index_key,
+                         const Slice& primary_key);
+
+// Append to *dst the smallest index entry key for "index_key".  All the
+// entries for smaller index keys order before it and all the entries for
+// equal or larger index keys order at or after it.
+void AppendIndexEntryKeyPrefix(std::string* dst, const Slice& index_key);
+
+// Decode an index entry key.  Returns false if "entry_key" is malformed.
+// On success, *primary_key points into "entry_key".
+bool ParseIndexEntryKey(const Slice& entry_key, std::string* index_key,
+                        Slice* primary_key);
+
+// Return the name of the column family that holds the entries of the
+// index "index_name" of the column family "column_family_name".
+std::string IndexColumnFamilyName(const std::string& column_family_name,
+                                  const std::string& index_name);
+
+// Returns true iff "name" is reserved for index column families.
+bool IsIndexColumnFamilyName(const Slice& name);
+
+// Return a new iterator over the records of the column family "primary"
+// of "db" in the order of their entries in the index column family
+// "index".  The iterate bounds of "options" are index keys.
+IndexIterator* NewIndexIterator(DB* db, ColumnFamilyHandle* primary,
+                                ColumnFamilyHandle* index,
+                                const ReadOptions& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_INDEX_ITER_H_
@@ -4,10 +4,13 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/memtable_hash_index.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,15 +22,45 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      concurrent_add_(false),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      index_(nullptr),
+      num_range_deletions_(0),
+      range_del_list_size_(0) {}
 
-MemTable::MemTable(const InternalKeyComparator& comparator, bool with_hashmap)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_, with_hashmap) {}
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const Options& options)
+    : comparator_(comparator),
+      concurrent_add_(options.allow_concurrent_memtable_write &&
+                      !options.with_hashmap),
+      refs_(0),
+      arena_(concurrent_add_),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      index_(options.with_hashmap
+                 ? new MemTableHashIndex(&arena_, options.write_buffer_size)
+                 : nullptr),
+      num_range_deletions_(0),
+      range_del_list_size_(0) {}
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete index_;
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
+bool MemTable::IsEmpty() const {
+  Table::Iterator iter(&table_);
+  iter.SeekToFirst();
+  Table::Iterator range_del_iter(&range_del_table_);
+  range_del_iter.SeekToFirst();
+  return !iter.Valid() && !range_del_iter.Valid();
+}
+
 int MemTable::KeyComparator::operator()(const char* aptr,
                                         const char* bptr) const {
   // Internal keys are encoded as length-prefixed strings.
@@ -76,6 +109,15 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  if (!iter.Valid()) {
+    return nullptr;
+  }
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
   // Format of an entry is concatenation of:
@@ -83,6 +125,10 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   //  key bytes    : char[internal_key.size()]
   //  value_size   : varint32 of value.size()
   //  value bytes  : char[value.size()]
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;  // An empty range deletes nothing
+  }
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
@@ -98,13 +144,67 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    if (concurrent_add_) {
+      range_del_table_.InsertConcurrently(buf);
+    } else {
+      range_del_table_.Insert(buf);
+    }
+    num_range_deletions_.fetch_add(1, std::memory_order_release);
+    return;
+  }
+  if (concurrent_add_) {
+    table_.InsertConcurrently(buf);
+    return;
+  }
+  Table::Position pos = table_.Insert(buf);
+  if (index_ != nullptr) {
+    index_->Insert(Slice(buf + VarintLength(internal_key_size), key_size), s,
+                   pos);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+std::shared_ptr<const FragmentedRangeTombstoneList>
+MemTable::RangeTombstoneList() {
+  // Every tombstone counted here is in range_del_table_; the list may
+  // also get some added since, which is harmless.
+  const int size = num_range_deletions_.load(std::memory_order_acquire);
+  MutexLock l(&range_del_mutex_);
+  if (range_del_list_size_ < size) {
+    MemTableIterator iter(&range_del_table_);
+    range_del_list_ = std::make_shared<const FragmentedRangeTombstoneList>(
+        comparator_.comparator.user_comparator(), &iter);
+    range_del_list_size_ = size;
+  }
+  return range_del_list_;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   SequenceNumber* max_covering_tombstone_seq,
+                   LookupTrace* trace) {
+  if (num_range_deletions_.load(std::memory_order_acquire) > 0) {
+    SequenceNumber seq = RangeTombstoneList()->MaxCoveringSequence(
+        key.user_key(), key.sequence());
+    if (seq > *max_covering_tombstone_seq) {
+      *max_covering_tombstone_seq = seq;
+    }
+  }
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data(), true);
+  if (index_ != nullptr) {
+    // The index points at the newest entry for the user key; skip entries
+    // that are newer than the lookup sequence number.
+    Table::Position pos = index_->Lookup(key.user_key());
+    if (pos != nullptr) {
+      iter.SeekToPosition(pos);
+      while (iter.Valid() && comparator_(iter.key(), memkey.data()) < 0) {
+        iter.Next();
+      }
+    }
+  } else {
+    iter.Seek(memkey.data());
+  }
   if (iter.Valid()) {
     // entry format is:
     //    klength  varint32
@@ -122,8 +222,15 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
             Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      s->SetMsg(std::string(key_ptr + key_length - 8, 8)); // NOTE: 在Status内记录版本号和tag
-      switch (static_cast<ValueType>(tag & 0xff)) {
+      ValueType type = static_cast<ValueType>(tag & 0xff);
+      if ((tag >> 8) < *max_covering_tombstone_seq) {
+        type = kTypeDeletion;  // Deleted by a range tombstone
+      }
+      if (trace != nullptr) {
+        trace->sequence = tag >> 8;
+        trace->deleted = (type == kTypeDeletion);
+      }
+      switch (type) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
           value->assign(v.data(), v.size());
@@ -132,9 +239,20 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
         case kTypeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeRangeDeletion:
+          break;  // Never stored in table_
       }
     }
   }
+  if (*max_covering_tombstone_seq > 0) {
+    // The tombstone hides every older source.
+    if (trace != nullptr) {
+      trace->sequence = *max_covering_tombstone_seq;
+      trace->deleted = true;
+    }
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
@@ -5,16 +5,22 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class FragmentedRangeTombstoneList;
 class InternalKeyComparator;
+class MemTableHashIndex;
 class MemTableIterator;
 
 class MemTable {
@@ -23,7 +29,11 @@ class MemTable {
   // is zero and the caller must call Ref() at least once.
   explicit MemTable(const InternalKeyComparator& comparator);
 
-  explicit MemTable(const InternalKeyComparator& comparator, bool with_hashmap);
+  // If options.with_hashmap is set, the memtable also maintains a hash
+  // index from user key to the newest entry so that Get() need not search
+  // the skiplist.  Otherwise, if options.allow_concurrent_memtable_write
+  // is set, Add() may be called from several threads at once.
+  MemTable(const InternalKeyComparator& comparator, const Options& options);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -44,6 +54,13 @@ class MemTable {
   // data structure. It is safe to call when MemTable is being modified.
   size_t ApproximateMemoryUsage();
 
+  // Returns true iff no entry has been added to the memtable.  It is safe
+  // to call when MemTable is being modified.
+  bool IsEmpty() const;
+
+  // Returns true iff Add() may be called concurrently with itself.
+  bool SupportsConcurrentAdd() const { return concurrent_add_; }
+
   // Return an iterator that yields the contents of the memtable.
   //
   // The caller must ensure that the underlying MemTable remains live
@@ -52,9 +69,18 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable (see
+  // db/range_del.h), or nullptr if it has none.  The same liveness rules
+  // as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key is the start of the deleted range and
+  // value its (exclusive) end.
+  //
+  // REQUIRES: external synchronization unless SupportsConcurrentAdd().
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
@@ -62,7 +88,18 @@ class MemTable {
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // If "trace" is non-null and true is returned, the sequence number and
+  // type of the matching entry are stored in *trace.
+  //
+  // *max_covering_tombstone_seq is the sequence number of the newest
+  // range tombstone covering key found so far in newer sources.  It is
+  // raised to account for the tombstones of this memtable, and an entry
+  // older than it counts as a deletion.  If it is non-zero and the
+  // memtable has no newer entry for key, a NotFound() error is stored in
+  // *status and true is returned.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           SequenceNumber* max_covering_tombstone_seq,
+           LookupTrace* trace = nullptr);
 
  private:
   friend class MemTableIterator;
@@ -78,10 +115,28 @@ class MemTable {
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  // Returns the fragmented range tombstones of the memtable, rebuilding
+  // them if tombstones were added since they were last built.
+  // REQUIRES: num_range_deletions_ > 0
+  std::shared_ptr<const FragmentedRangeTombstoneList> RangeTombstoneList();
+
   KeyComparator comparator_;
+  const bool concurrent_add_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, keyed by their start
+  MemTableHashIndex* const index_;  // nullptr unless options.with_hashmap
+
+  // Number of tombstones in range_del_table_, raised after each insert.
+  std::atomic<int> num_range_deletions_;
+
+  // Built lazily by Get(), and shared with the lookups that use it while
+  // it is replaced.
+  port::Mutex range_del_mutex_;
+  std::shared_ptr<const FragmentedRangeTombstoneList> range_del_list_
+      GUARDED_BY(range_del_mutex_);
+  int range_del_list_size_ GUARDED_BY(range_del_mutex_);  // Tombstones in it
 };
 
 }  // namespace leveldb
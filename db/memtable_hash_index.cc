@@ -0,0 +1,90 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtable_hash_index.h"
+
+#include <cstring>
+#include <new>
+
+#include "util/arena.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+struct MemTableHashIndex::Entry {
+  const char* key_data;
+  uint32_t key_size;
+  uint32_t hash;
+  uint64_t seq;  // Only accessed by the writer
+  std::atomic<Position> position;
+  Entry* next;  // Immutable once the entry is published
+
+  Slice key() const { return Slice(key_data, key_size); }
+};
+
+static uint32_t HashUserKey(const Slice& user_key) {
+  return Hash(user_key.data(), user_key.size(), 0x9ae16a3b);
+}
+
+MemTableHashIndex::MemTableHashIndex(Arena* arena, size_t expected_bytes)
+    : arena_(arena) {
+  // Assume ~256 bytes of memtable data per distinct key; the chains stay
+  // short for smaller entries since each bucket may hold several keys.
+  uint32_t buckets = 256;
+  while (buckets < (1u << 20) && buckets < expected_bytes / 256) {
+    buckets <<= 1;
+  }
+  bucket_mask_ = buckets - 1;
+  char* mem = arena_->AllocateAligned(sizeof(std::atomic<Entry*>) * buckets);
+  buckets_ = reinterpret_cast<std::atomic<Entry*>*>(mem);
+  for (uint32_t i = 0; i < buckets; i++) {
+    new (&buckets_[i]) std::atomic<Entry*>(nullptr);
+  }
+}
+
+MemTableHashIndex::Entry* MemTableHashIndex::FindEntry(const Slice& user_key,
+                                                       uint32_t hash) const {
+  Entry* e = buckets_[hash & bucket_mask_].load(std::memory_order_acquire);
+  while (e != nullptr) {
+    if (e->hash == hash && e->key() == user_key) {
+      return e;
+    }
+    e = e->next;
+  }
+  return nullptr;
+}
+
+void MemTableHashIndex::Insert(const Slice& user_key, uint64_t seq,
+                               Position pos) {
+  const uint32_t hash = HashUserKey(user_key);
+  Entry* e = FindEntry(user_key, hash);
+  if (e != nullptr) {
+    if (seq > e->seq) {
+      e->seq = seq;
+      e->position.store(pos, std::memory_order_release);
+    }
+    return;
+  }
+
+  char* mem = arena_->AllocateAligned(sizeof(Entry));
+  e = new (mem) Entry;
+  e->key_data = user_key.data();
+  e->key_size = static_cast<uint32_t>(user_key.size());
+  e->hash = hash;
+  e->seq = seq;
+  e->position.store(pos, std::memory_order_relaxed);
+  std::atomic<Entry*>* bucket = &buckets_[hash & bucket_mask_];
+  e->next = bucket->load(std::memory_order_relaxed);
+  // Publish the fully initialized entry.
+  bucket->store(e, std::memory_order_release);
+}
+
+MemTableHashIndex::Position MemTableHashIndex::Lookup(
+    const Slice& user_key) const {
+  Entry* e = FindEntry(user_key, HashUserKey(user_key));
+  return (e == nullptr) ? nullptr
+                        : e->position.load(std::memory_order_acquire);
+}
+
+}  // namespace leveldb
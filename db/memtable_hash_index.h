@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// MemTableHashIndex maps a user key to the skiplist node holding the newest
+// memtable entry for that key, so that point lookups in the memtable do not
+// have to search the skiplist.
+//
+// Thread safety
+// -------------
+//
+// Insert() requires external synchronization, exactly like
+// SkipList::Insert().  Lookup() needs no synchronization and may run
+// concurrently with Insert():
+//
+// (1) All memory (bucket array and entries) comes from the memtable's
+// Arena, so nothing is ever freed while the memtable is alive.
+//
+// (2) An entry is fully initialized before it is published into a bucket
+// with a release-store; readers acquire-load bucket heads.
+//
+// (3) Once published, only the "position" of an entry changes, and it is
+// updated with a release-store to point at a node that is already linked
+// into the skiplist.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLE_HASH_INDEX_H_
+#define STORAGE_LEVELDB_DB_MEMTABLE_HASH_INDEX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+class MemTableHashIndex {
+ public:
+  // An opaque skiplist position (see SkipList::Position).
+  typedef const void* Position;
+
+  // Create an index sized for roughly "expected_bytes" of memtable data.
+  // The bucket array is allocated from "*arena" immediately.
+  MemTableHashIndex(Arena* arena, size_t expected_bytes);
+
+  MemTableHashIndex(const MemTableHashIndex&) = delete;
+  MemTableHashIndex& operator=(const MemTableHashIndex&) = delete;
+
+  // Record that the entry for "user_key" with sequence number "seq" lives
+  // at "pos".  The index keeps the position of the entry with the largest
+  // sequence number seen for each user key.
+  //
+  // "user_key" is not copied: it must point into memory that outlives the
+  // index (i.e. into the memtable's arena).
+  void Insert(const Slice& user_key, uint64_t seq, Position pos);
+
+  // Return the position of the newest entry for "user_key", or nullptr if
+  // the memtable holds no entry for it.
+  Position Lookup(const Slice& user_key) const;
+
+ private:
+  struct Entry;
+
+  Entry* FindEntry(const Slice& user_key, uint32_t hash) const;
+
+  Arena* const arena_;
+  uint32_t bucket_mask_;
+  std::atomic<Entry*>* buckets_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLE_HASH_INDEX_H_
@@ -0,0 +1,198 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+
+namespace leveldb {
+
+FragmentedRangeTombstoneList::FragmentedRangeTombstoneList(
+    const Comparator* ucmp, Iterator* iter)
+    : ucmp_(ucmp) {
+  std::vector<RangeTombstone> tombstones;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      status_ = Status::Corruption("corrupted range tombstone");
+      return;
+    }
+    tombstones.push_back(
+        RangeTombstone(begin.user_key, iter->value(), begin.sequence));
+  }
+  status_ = iter->status();
+  if (!status_.ok()) {
+    return;
+  }
+
+  // Sweep over the tombstone boundaries in key order, keeping the
+  // sequence numbers of the tombstones that cover the current position.
+  struct Event {
+    const std::string* key;
+    SequenceNumber seq;
+    bool start;
+  };
+  std::vector<Event> events;
+  for (const RangeTombstone& t : tombstones) {
+    if (ucmp_->Compare(t.begin, t.end) < 0) {
+      events.push_back(Event{&t.begin, t.seq, true});
+      events.push_back(Event{&t.end, t.seq, false});
+    }
+  }
+  std::sort(events.begin(), events.end(),
+            [this](const Event& a, const Event& b) {
+              return ucmp_->Compare(*a.key, *b.key) < 0;
+            });
+
+  std::multiset<SequenceNumber> active;
+  size_t i = 0;
+  while (i < events.size()) {
+    const std::string* key = events[i].key;
+    for (; i < events.size() && ucmp_->Compare(*events[i].key, *key) == 0;
+         i++) {
+      if (events[i].start) {
+        active.insert(events[i].seq);
+      } else {
+        active.erase(active.find(events[i].seq));
+      }
+    }
+    if (active.empty()) {
+      continue;
+    }
+    // Some active tombstone ends later, so events[i] exists.
+    Fragment f;
+    f.begin = *key;
+    f.end = *events[i].key;
+    f.seq_begin = seqs_.size();
+    for (auto seq = active.rbegin(); seq != active.rend(); ++seq) {
+      if (seqs_.size() == f.seq_begin || seqs_.back() != *seq) {
+        seqs_.push_back(*seq);
+      }
+    }
+    f.seq_end = seqs_.size();
+    fragments_.push_back(std::move(f));
+  }
+}
+
+SequenceNumber FragmentedRangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  // Find the last fragment that begins at or before user_key.
+  auto iter = std::upper_bound(
+      fragments_.begin(), fragments_.end(), user_key,
+      [this](const Slice& key, const Fragment& f) {
+        return ucmp_->Compare(key, f.begin) < 0;
+      });
+  if (iter == fragments_.begin()) {
+    return 0;
+  }
+  --iter;
+  if (ucmp_->Compare(user_key, iter->end) >= 0) {
+    return 0;
+  }
+  // The newest of the fragment's tombstones visible at the snapshot.
+  auto end = seqs_.begin() + iter->seq_end;
+  auto seq = std::lower_bound(seqs_.begin() + iter->seq_begin, end, snapshot,
+                              std::greater<SequenceNumber>());
+  return seq == end ? 0 : *seq;
+}
+
+void ExtendFileRange(const Comparator* icmp, const Slice& begin,
+                     const Slice& end, InternalKey* smallest,
+                     InternalKey* largest, bool* empty) {
+  InternalKey limit(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (*empty) {
+    smallest->DecodeFrom(begin);
+    *largest = limit;
+    *empty = false;
+    return;
+  }
+  if (icmp->Compare(begin, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(begin);
+  }
+  if (icmp->Compare(limit.Encode(), largest->Encode()) > 0) {
+    *largest = limit;
+  }
+}
+
+RangeDelAggregator::RangeDelAggregator(const Comparator* ucmp,
+                                       SequenceNumber snapshot)
+    : ucmp_(ucmp), snapshot_(snapshot), fragments_valid_(true) {}
+
+Status RangeDelAggregator::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    AddTombstone(RangeTombstone(begin.user_key, iter->value(), begin.sequence));
+  }
+  return iter->status();
+}
+
+void RangeDelAggregator::AddTombstone(const RangeTombstone& tombstone) {
+  tombstones_.push_back(tombstone);
+  fragments_valid_ = false;
+}
+
+void RangeDelAggregator::BuildFragments() {
+  // Sweep over the tombstone boundaries in key order, keeping the
+  // sequence numbers of the tombstones that cover the current position.
+  struct Event {
+    const std::string* key;
+    SequenceNumber seq;
+    bool start;
+  };
+  std::vector<Event> events;
+  for (const RangeTombstone& t : tombstones_) {
+    if (t.seq <= snapshot_ && ucmp_->Compare(t.begin, t.end) < 0) {
+      events.push_back(Event{&t.begin, t.seq, true});
+      events.push_back(Event{&t.end, t.seq, false});
+    }
+  }
+  std::sort(events.begin(), events.end(),
+            [this](const Event& a, const Event& b) {
+              return ucmp_->Compare(*a.key, *b.key) < 0;
+            });
+
+  fragments_.clear();
+  std::multiset<SequenceNumber> active;
+  size_t i = 0;
+  while (i < events.size()) {
+    const std::string* key = events[i].key;
+    for (; i < events.size() && ucmp_->Compare(*events[i].key, *key) == 0;
+         i++) {
+      if (events[i].start) {
+        active.insert(events[i].seq);
+      } else {
+        active.erase(active.find(events[i].seq));
+      }
+    }
+    SequenceNumber seq = active.empty() ? 0 : *active.rbegin();
+    if (fragments_.empty() || fragments_.back().seq != seq) {
+      fragments_.push_back(Fragment{*key, seq});
+    }
+  }
+  fragments_valid_ = true;
+}
+
+SequenceNumber RangeDelAggregator::MaxCoveringSequence(const Slice& user_key) {
+  if (!fragments_valid_) {
+    BuildFragments();
+  }
+  // Find the last fragment that begins at or before user_key.
+  auto iter = std::upper_bound(
+      fragments_.begin(), fragments_.end(), user_key,
+      [this](const Slice& key, const Fragment& f) {
+        return ucmp_->Compare(key, f.begin) < 0;
+      });
+  if (iter == fragments_.begin()) {
+    return 0;
+  }
+  --iter;
+  return iter->seq;
+}
+
+}  // namespace leveldb
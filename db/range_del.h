@@ -0,0 +1,149 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone deletes every entry with a smaller sequence number
+// whose user key falls in [begin,end).  Memtables and tables hand out
+// their range tombstones through iterators whose keys are the internal
+// keys (begin, sequence, kTypeRangeDeletion) and whose values are the
+// user keys "end", sorted by internal key.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct RangeTombstone {
+  RangeTombstone() : seq(0) {}
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), seq(s) {}
+
+  std::string begin;  // Inclusive
+  std::string end;    // Exclusive
+  SequenceNumber seq;
+};
+
+// The range tombstones of one memtable or table, split at their
+// boundaries into disjoint fragments that each list the sequence numbers
+// of the tombstones covering them.  The tombstones covering a key are
+// then found by a binary search, at any snapshot.
+//
+// Immutable once built, so it may be shared between threads.
+class FragmentedRangeTombstoneList {
+ public:
+  // Fragments the tombstones yielded by "iter", which must yield them in
+  // the format described at the top of this file.  Does not take
+  // ownership of "iter".  Check status() for a malformed tombstone.
+  FragmentedRangeTombstoneList(const Comparator* ucmp, Iterator* iter);
+
+  FragmentedRangeTombstoneList(const FragmentedRangeTombstoneList&) = delete;
+  FragmentedRangeTombstoneList& operator=(
+      const FragmentedRangeTombstoneList&) = delete;
+
+  ~FragmentedRangeTombstoneList() = default;
+
+  const Status& status() const { return status_; }
+
+  bool empty() const { return fragments_.empty(); }
+
+  // Return the largest sequence number not above "snapshot" of the
+  // tombstones that cover "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  // Covers [begin,end) with the tombstones seqs_[seq_begin,seq_end),
+  // which are sorted from newest to oldest.
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    size_t seq_begin;
+    size_t seq_end;
+  };
+
+  const Comparator* const ucmp_;
+  Status status_;
+  std::vector<Fragment> fragments_;  // Sorted by begin
+  std::vector<SequenceNumber> seqs_;
+};
+
+// Widen the key range [*smallest,*largest] of a table file so that it
+// covers the range tombstone whose internal key is "begin" and whose end
+// is the user key "end".  "icmp" orders internal keys.  If *empty, the
+// range is first set to the tombstone's and *empty is cleared.
+//
+// A file's range must cover its tombstones so that lookups and
+// compactions that overlap the tombstones consider the file.  The
+// largest key becomes (end, kMaxSequenceNumber, kTypeRangeDeletion),
+// which sorts before every entry for "end" since "end" is exclusive.
+void ExtendFileRange(const Comparator* icmp, const Slice& begin,
+                     const Slice& end, InternalKey* smallest,
+                     InternalKey* largest, bool* empty);
+
+// Collects the range tombstones of several memtables and tables and
+// answers whether they delete an entry, as seen by a reader at a fixed
+// snapshot.
+//
+// Not thread-safe.
+class RangeDelAggregator {
+ public:
+  // Tombstones with sequence numbers above "snapshot" are kept (see
+  // tombstones()) but delete nothing.
+  RangeDelAggregator(const Comparator* ucmp, SequenceNumber snapshot);
+
+  RangeDelAggregator(const RangeDelAggregator&) = delete;
+  RangeDelAggregator& operator=(const RangeDelAggregator&) = delete;
+
+  ~RangeDelAggregator() = default;
+
+  // Add the tombstones yielded by "iter".  Does not take ownership.
+  Status AddTombstones(Iterator* iter);
+
+  void AddTombstone(const RangeTombstone& tombstone);
+
+  // Return the largest sequence number of the tombstones visible at the
+  // snapshot that cover "user_key", or zero if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key);
+
+  // Returns true iff the entry for "user_key" at sequence number "seq"
+  // is deleted by a tombstone visible at the snapshot.
+  bool ShouldDelete(const Slice& user_key, SequenceNumber seq) {
+    return seq < MaxCoveringSequence(user_key);
+  }
+
+  bool empty() const { return tombstones_.empty(); }
+
+  SequenceNumber snapshot() const { return snapshot_; }
+
+  // Every tombstone added so far, in the order of addition.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+ private:
+  // The visible tombstones flattened into disjoint fragments.  Fragment
+  // i covers [fragments_[i].begin, fragments_[i+1].begin) and deletes
+  // entries below fragments_[i].seq; zero means it deletes nothing.
+  struct Fragment {
+    std::string begin;
+    SequenceNumber seq;
+  };
+
+  void BuildFragments();
+
+  const Comparator* const ucmp_;
+  const SequenceNumber snapshot_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;
+  bool fragments_valid_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -0,0 +1,163 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include "gtest/gtest.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+TEST(RangeDelAggregatorTest, Empty) {
+  RangeDelAggregator agg(BytewiseComparator(), kMaxSequenceNumber);
+  ASSERT_TRUE(agg.empty());
+  ASSERT_EQ(0, agg.MaxCoveringSequence("a"));
+  ASSERT_TRUE(!agg.ShouldDelete("a", 0));
+}
+
+TEST(RangeDelAggregatorTest, OverlappingTombstones) {
+  RangeDelAggregator agg(BytewiseComparator(), 100);
+  agg.AddTombstone(RangeTombstone("b", "f", 10));
+  agg.AddTombstone(RangeTombstone("d", "h", 20));
+  agg.AddTombstone(RangeTombstone("e", "g", 5));
+  agg.AddTombstone(RangeTombstone("x", "x", 50));  // Empty
+  ASSERT_EQ(0, agg.MaxCoveringSequence("a"));
+  ASSERT_EQ(10, agg.MaxCoveringSequence("b"));
+  ASSERT_EQ(10, agg.MaxCoveringSequence("c"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("d"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("e"));
+  ASSERT_EQ(20, agg.MaxCoveringSequence("g"));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("h"));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("x"));
+
+  ASSERT_TRUE(agg.ShouldDelete("c", 9));
+  ASSERT_TRUE(!agg.ShouldDelete("c", 10));
+  ASSERT_TRUE(!agg.ShouldDelete("c", 11));
+  ASSERT_TRUE(agg.ShouldDelete("e", 19));
+
+  // Adding a tombstone after a lookup rebuilds the fragments.
+  agg.AddTombstone(RangeTombstone("a", "z", 30));
+  ASSERT_EQ(30, agg.MaxCoveringSequence("a"));
+  ASSERT_EQ(30, agg.MaxCoveringSequence("e"));
+  ASSERT_EQ(0, agg.MaxCoveringSequence("z"));
+}
+
+TEST(RangeDelAggregatorTest, Snapshot) {
+  RangeDelAggregator agg(BytewiseComparator(), 15);
+  agg.AddTombstone(RangeTombstone("a", "m", 10));
+  agg.AddTombstone(RangeTombstone("c", "e", 20));  // Not visible
+  ASSERT_EQ(10, agg.MaxCoveringSequence("d"));
+  ASSERT_TRUE(agg.ShouldDelete("d", 5));
+  ASSERT_TRUE(!agg.ShouldDelete("d", 12));
+  ASSERT_EQ(2, agg.tombstones().size());
+}
+
+TEST(RangeDelAggregatorTest, MemTableTombstones) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  mem->Add(5, kTypeValue, "c", "v");
+  mem->Add(10, kTypeRangeDeletion, "b", "d");
+  mem->Add(11, kTypeRangeDeletion, "e", "e");  // Empty, not stored
+  mem->Add(12, kTypeRangeDeletion, "a", "c");
+
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  ASSERT_TRUE(iter != nullptr);
+  FragmentedRangeTombstoneList list(BytewiseComparator(), iter);
+  ASSERT_TRUE(list.status().ok());
+  ASSERT_EQ(10, list.MaxCoveringSequence("c", kMaxSequenceNumber));
+  ASSERT_EQ(12, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("b", 11));
+  ASSERT_EQ(0, list.MaxCoveringSequence("e", kMaxSequenceNumber));
+
+  RangeDelAggregator agg(BytewiseComparator(), kMaxSequenceNumber);
+  ASSERT_TRUE(agg.AddTombstones(iter).ok());
+  ASSERT_EQ(2, agg.tombstones().size());
+  delete iter;
+
+  std::string value;
+  Status s;
+  SequenceNumber max_covering = 0;
+  ASSERT_TRUE(mem->Get(LookupKey("c", kMaxSequenceNumber), &value, &s,
+                       &max_covering));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(10, max_covering);
+
+  s = Status::OK();
+  max_covering = 0;
+  ASSERT_TRUE(mem->Get(LookupKey("c", 9), &value, &s, &max_covering));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("v", value);
+
+  // A tombstone added after a lookup is seen by the next one.
+  mem->Add(13, kTypeRangeDeletion, "c", "f");
+  s = Status::OK();
+  max_covering = 0;
+  ASSERT_TRUE(mem->Get(LookupKey("e", kMaxSequenceNumber), &value, &s,
+                       &max_covering));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(13, max_covering);
+  mem->Unref();
+}
+
+TEST(FragmentedRangeTombstoneListTest, Fragments) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  mem->Add(10, kTypeRangeDeletion, "b", "f");
+  mem->Add(20, kTypeRangeDeletion, "d", "h");
+  mem->Add(5, kTypeRangeDeletion, "e", "g");
+  mem->Add(30, kTypeRangeDeletion, "m", "p");
+  mem->Add(40, kTypeRangeDeletion, "m", "n");
+
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  FragmentedRangeTombstoneList list(BytewiseComparator(), iter);
+  delete iter;
+  ASSERT_TRUE(list.status().ok());
+  ASSERT_TRUE(!list.empty());
+  ASSERT_EQ(0, list.MaxCoveringSequence("a", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("c", kMaxSequenceNumber));
+  ASSERT_EQ(20, list.MaxCoveringSequence("e", kMaxSequenceNumber));
+  ASSERT_EQ(10, list.MaxCoveringSequence("e", 19));
+  ASSERT_EQ(5, list.MaxCoveringSequence("e", 9));
+  ASSERT_EQ(0, list.MaxCoveringSequence("e", 4));
+  ASSERT_EQ(20, list.MaxCoveringSequence("g", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("g", 19));
+  ASSERT_EQ(0, list.MaxCoveringSequence("h", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("k", kMaxSequenceNumber));
+  ASSERT_EQ(40, list.MaxCoveringSequence("m", kMaxSequenceNumber));
+  ASSERT_EQ(30, list.MaxCoveringSequence("m", 39));
+  ASSERT_EQ(30, list.MaxCoveringSequence("n", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("p", kMaxSequenceNumber));
+  mem->Unref();
+}
+
+TEST(RangeDelTest, ExtendFileRange) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  InternalKey smallest, largest;
+  bool empty = true;
+  InternalKey begin("d", 7, kTypeRangeDeletion);
+  ExtendFileRange(&icmp, begin.Encode(), "f", &smallest, &largest, &empty);
+  ASSERT_TRUE(!empty);
+  ASSERT_EQ("d", smallest.user_key().ToString());
+  ASSERT_EQ("f", largest.user_key().ToString());
+
+  // The end key is exclusive, so the range stays before entries for it.
+  ASSERT_LT(icmp.Compare(largest, InternalKey("f", 100, kTypeValue)), 0);
+
+  smallest = InternalKey("e", 3, kTypeValue);
+  largest = InternalKey("z", 3, kTypeValue);
+  ExtendFileRange(&icmp, begin.Encode(), "f", &smallest, &largest, &empty);
+  ASSERT_EQ("d", smallest.user_key().ToString());
+  ASSERT_EQ("z", largest.user_key().ToString());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -203,8 +204,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -281,6 +285,32 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The file must also cover its range tombstones.
+    t.meta.has_range_deletions = false;
+    if (status.ok()) {
+      iter = table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                     t.meta.file_size);
+      if (iter != nullptr) {
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          if (!ParseInternalKey(iter->key(), &parsed)) {
+            status = Status::Corruption("unparsable range tombstone");
+            break;
+          }
+          counter++;
+          ExtendFileRange(&icmp_, iter->key(), iter->value(),
+                          &t.meta.smallest, &t.meta.largest, &empty);
+          t.meta.has_range_deletions = true;
+          if (parsed.sequence > t.max_sequence) {
+            t.max_sequence = parsed.sequence;
+          }
+        }
+        if (status.ok() && !iter->status().ok()) {
+          status = iter->status();
+        }
+        delete iter;
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +342,17 @@ class Repairer {
       counter++;
     }
     delete iter;
+    if (t.meta.has_range_deletions) {
+      iter = table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                     t.meta.file_size);
+      if (iter != nullptr) {
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          builder->AddRangeTombstone(iter->key(), iter->value());
+          counter++;
+        }
+        delete iter;
+      }
+    }
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -369,7 +410,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_deletions);
     }
 
     // fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -0,0 +1,285 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_index.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/index_iter.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+
+// Indexes every record with a non-empty value by its value.
+class ValueIndex : public SecondaryIndex {
+ public:
+  const char* Name() const override { return "value"; }
+  bool Extract(const Slice& key, const Slice& value,
+               std::string* index_key) const override {
+    if (value.empty()) {
+      return false;
+    }
+    index_key->assign(value.data(), value.size());
+    return true;
+  }
+};
+
+// Indexes every record by the first byte of its value.
+class FirstByteIndex : public SecondaryIndex {
+ public:
+  const char* Name() const override { return "first"; }
+  bool Extract(const Slice& key, const Slice& value,
+               std::string* index_key) const override {
+    if (value.empty()) {
+      return false;
+    }
+    index_key->assign(value.data(), 1);
+    return true;
+  }
+};
+
+std::string EntryKey(const Slice& index_key, const Slice& primary_key) {
+  std::string result;
+  AppendIndexEntryKey(&result, index_key, primary_key);
+  return result;
+}
+
+}  // namespace
+
+TEST(IndexEntryKeyTest, OrderAndParse) {
+  const std::string zero(1, '\0');
+  const std::vector<std::string> index_keys = {
+      "", zero, zero + zero, zero + "a", "a", "a" + zero, "a" + zero + "b",
+      "ab", "b", "\xff"};
+  for (size_t i = 0; i < index_keys.size(); i++) {
+    for (size_t j = 0; j < index_keys.size(); j++) {
+      std::string a = EntryKey(index_keys[i], "zz");
+      std::string b = EntryKey(index_keys[j], "");
+      ASSERT_EQ(i < j, Slice(a).compare(b) < 0) << i << " " << j;
+    }
+
+    std::string index_key;
+    Slice primary_key;
+    std::string entry = EntryKey(index_keys[i], zero + "pk");
+    ASSERT_TRUE(ParseIndexEntryKey(entry, &index_key, &primary_key));
+    ASSERT_EQ(index_keys[i], index_key);
+    ASSERT_EQ(zero + "pk", primary_key.ToString());
+  }
+
+  std::string index_key;
+  Slice primary_key;
+  ASSERT_TRUE(!ParseIndexEntryKey("", &index_key, &primary_key));
+  ASSERT_TRUE(!ParseIndexEntryKey("abc", &index_key, &primary_key));
+  ASSERT_TRUE(!ParseIndexEntryKey(zero + "x", &index_key, &primary_key));
+}
+
+class SecondaryIndexTest : public testing::Test {
+ public:
+  SecondaryIndexTest() : db_(nullptr) {
+    dbname_ = testing::TempDir() + "/secondary_index_test";
+    DestroyDB(dbname_, Options());
+    options_.create_if_missing = true;
+    options_.secondary_indexes.push_back(&value_index_);
+    EXPECT_LEVELDB_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~SecondaryIndexTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  Status Reopen(const Options& options) {
+    delete db_;
+    db_ = nullptr;
+    return DB::Open(options, dbname_, &db_);
+  }
+
+  Status Put(const std::string& k, const std::string& v) {
+    return db_->Put(WriteOptions(), k, v);
+  }
+
+  // Return "index_key:primary_key=value" for every record in index order.
+  std::string Scan(const ReadOptions& options,
+                   const std::string& index = "value",
+                   ColumnFamilyHandle* cf = nullptr) {
+    std::string result;
+    IndexIterator* iter = db_->NewIndexIterator(
+        options, cf == nullptr ? db_->DefaultColumnFamily() : cf, index);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += Entry(iter) + " ";
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    return result;
+  }
+
+  std::string Scan() { return Scan(ReadOptions()); }
+
+  static std::string Entry(IndexIterator* iter) {
+    return iter->key().ToString() + ":" + iter->primary_key().ToString() +
+           "=" + iter->value().ToString();
+  }
+
+  ValueIndex value_index_;
+  FirstByteIndex first_byte_index_;
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+};
+
+TEST_F(SecondaryIndexTest, MaintainedOnOverwriteAndDelete) {
+  ASSERT_LEVELDB_OK(Put("k1", "b"));
+  ASSERT_LEVELDB_OK(Put("k2", "a"));
+  ASSERT_LEVELDB_OK(Put("k3", "b"));
+  ASSERT_EQ("a:k2=a b:k1=b b:k3=b ", Scan());
+
+  ASSERT_LEVELDB_OK(Put("k1", "c"));
+  ASSERT_LEVELDB_OK(Put("k3", "b"));
+  ASSERT_EQ("a:k2=a b:k3=b c:k1=c ", Scan());
+
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "k2"));
+  ASSERT_LEVELDB_OK(Put("k3", ""));  // No longer indexed
+  ASSERT_EQ("c:k1=c ", Scan());
+
+  // Several updates of the same record in one batch.
+  WriteBatch batch;
+  batch.Put("k4", "x");
+  batch.Put("k4", "y");
+  batch.Delete("k1");
+  batch.Put("k1", "z");
+  ASSERT_LEVELDB_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("y:k4=y z:k1=z ", Scan());
+
+  ASSERT_LEVELDB_OK(Reopen(options_));
+  ASSERT_EQ("y:k4=y z:k1=z ", Scan());
+}
+
+TEST_F(SecondaryIndexTest, SnapshotAndUnknownIndex) {
+  ASSERT_LEVELDB_OK(Put("k1", "a"));
+  ReadOptions options;
+  options.snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("k1", "b"));
+  ASSERT_EQ("a:k1=a ", Scan(options));
+  ASSERT_EQ("b:k1=b ", Scan());
+  db_->ReleaseSnapshot(options.snapshot);
+
+  IndexIterator* iter = db_->NewIndexIterator(
+      ReadOptions(), db_->DefaultColumnFamily(), "missing");
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsInvalidArgument());
+  delete iter;
+}
+
+TEST_F(SecondaryIndexTest, IterateAcrossBatches) {
+  // Enough records for several fetch batches.
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    char key[20], value[20];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    std::snprintf(value, sizeof(value), "v%04d", kNum - 1 - i);
+    ASSERT_LEVELDB_OK(Put(key, value));
+  }
+
+  IndexIterator* iter = db_->NewIndexIterator(
+      ReadOptions(), db_->DefaultColumnFamily(), "value");
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    char expected[40];
+    std::snprintf(expected, sizeof(expected), "v%04d:k%04d=v%04d", count,
+                  kNum - 1 - count, count);
+    ASSERT_EQ(expected, Entry(iter));
+    count++;
+  }
+  ASSERT_EQ(kNum, count);
+
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(kNum, count);
+
+  // Change directions in the middle of a batch and at its edges.
+  iter->Seek("v0500");
+  ASSERT_EQ("v0500:k0499=v0500", Entry(iter));
+  for (int i = 0; i < 300; i++) iter->Next();
+  ASSERT_EQ("v0800:k0199=v0800", Entry(iter));
+  for (int i = 0; i < 600; i++) iter->Prev();
+  ASSERT_EQ("v0200:k0799=v0200", Entry(iter));
+  iter->Next();
+  ASSERT_EQ("v0201:k0798=v0201", Entry(iter));
+  delete iter;
+
+  Slice lower("v0010"), upper("v0013");
+  ReadOptions options;
+  options.iterate_lower_bound = &lower;
+  options.iterate_upper_bound = &upper;
+  ASSERT_EQ("v0010:k0989=v0010 v0011:k0988=v0011 v0012:k0987=v0012 ",
+            Scan(options));
+}
+
+TEST_F(SecondaryIndexTest, BuiltForExistingRecords) {
+  ASSERT_LEVELDB_OK(Put("k1", "banana"));
+  ASSERT_LEVELDB_OK(Put("k2", "apple"));
+  ASSERT_LEVELDB_OK(Put("k3", "blueberry"));
+
+  options_.secondary_indexes.push_back(&first_byte_index_);
+  ASSERT_LEVELDB_OK(Reopen(options_));
+  ASSERT_EQ("a:k2=apple b:k1=banana b:k3=blueberry ",
+            Scan(ReadOptions(), "first"));
+
+  ASSERT_LEVELDB_OK(Put("k2", "cherry"));
+  ASSERT_EQ("b:k1=banana b:k3=blueberry c:k2=cherry ",
+            Scan(ReadOptions(), "first"));
+  ASSERT_EQ("banana:k1=banana blueberry:k3=blueberry cherry:k2=cherry ",
+            Scan());
+
+  // An index that exists must be supplied when opening the database.
+  Options without_index;
+  without_index.secondary_indexes.push_back(&value_index_);
+  ASSERT_TRUE(Reopen(without_index).IsInvalidArgument());
+  ASSERT_LEVELDB_OK(Reopen(options_));
+  ASSERT_EQ("b:k1=banana b:k3=blueberry c:k2=cherry ",
+            Scan(ReadOptions(), "first"));
+}
+
+TEST_F(SecondaryIndexTest, ColumnFamily) {
+  Options options;
+  options.secondary_indexes.push_back(&first_byte_index_);
+  ColumnFamilyHandle* cf;
+  ASSERT_LEVELDB_OK(db_->CreateColumnFamily(options, "people", &cf));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), cf, "alice", "xyz"));
+  ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), cf, "bob", "abc"));
+  ASSERT_LEVELDB_OK(Put("carol", "xyz"));
+  ASSERT_EQ("a:bob=abc x:alice=xyz ", Scan(ReadOptions(), "first", cf));
+  ASSERT_EQ("xyz:carol=xyz ", Scan());
+
+  ColumnFamilyHandle* reserved;
+  ASSERT_TRUE(db_->CreateColumnFamily(Options(), "__index/people/other",
+                                      &reserved)
+                  .IsInvalidArgument());
+
+  std::vector<ColumnFamilyHandle*> handles;
+  delete db_;
+  db_ = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(options_, dbname_,
+                             {ColumnFamilyDescriptor("people", options)},
+                             &handles, &db_));
+  ASSERT_EQ("a:bob=abc x:alice=xyz ",
+            Scan(ReadOptions(), "first", handles[0]));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,10 +8,12 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
-// Reads require a guarantee that the SkipList will not be destroyed
-// while the read is in progress.  Apart from that, reads progress
-// without any internal locking or synchronization.
+// Insert() requires external synchronization, most likely a mutex.
+// InsertConcurrently() may run concurrently with other calls to itself,
+// but not with Insert(), and needs an arena that allows concurrent
+// allocation.  Reads require a guarantee that the SkipList will not be
+// destroyed while the read is in progress.  Apart from that, reads
+// progress without any internal locking or synchronization.
 //
 // Invariants:
 //
@@ -30,9 +32,6 @@
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
-#include <iostream>
-#include <string>
-#include <unordered_map>
 
 #include "util/arena.h"
 #include "util/random.h"
@@ -52,22 +51,27 @@ class SkipList {
   // must remain allocated for the lifetime of the skiplist object.
   explicit SkipList(Comparator cmp, Arena* arena);
 
-  explicit SkipList(Comparator cmp, Arena* arena, bool with_hashmap);
-
   SkipList(const SkipList&) = delete;
   SkipList& operator=(const SkipList&) = delete;
 
-  // Insert key into the list.
+  // An opaque reference to the node holding an inserted key.  Nodes are
+  // never deleted, so a Position stays valid for the lifetime of the list
+  // and can be handed to Iterator::SeekToPosition() to skip the search.
+  typedef const void* Position;
+
+  // Insert key into the list and return the position of the new node.
   // REQUIRES: nothing that compares equal to key is currently in the list.
-  void Insert(const Key& key);
+  Position Insert(const Key& key);
+
+  // Like Insert(), but links the new node with compare-and-swap so that
+  // several threads may insert at once.
+  // REQUIRES: nothing that compares equal to key is in or being inserted
+  // into the list.
+  Position InsertConcurrently(const Key& key);
 
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
-  void PrintTable();
-
-  std::string MyDecoder(const char* p);
-
   // Iteration over the contents of a skip list
   class Iterator {
    public:
@@ -91,7 +95,11 @@ class SkipList {
     void Prev();
 
     // Advance to the first entry with a key >= target
-    void Seek(const Key& target, bool point_get=false);
+    void Seek(const Key& target);
+
+    // Position at the node returned by an earlier Insert() into this list.
+    // REQUIRES: pos != nullptr
+    void SeekToPosition(Position pos);
 
     // Position at the first entry in list.
     // Final state of iterator is Valid() iff list is not empty.
@@ -116,6 +124,7 @@ class SkipList {
 
   Node* NewNode(const Key& key, int height);
   int RandomHeight();
+  static int RandomHeight(Random* rnd);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -128,6 +137,12 @@ class SkipList {
   // node at "level" for every level in [0..max_height_-1].
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
+  // Starting at "before", which must precede key at "level", find the
+  // adjacent nodes *prev < key <= *next at that level.  "after", if
+  // non-null, is a node known to follow key at "level".
+  void FindSpliceForLevel(const Key& key, Node* before, Node* after,
+                          int level, Node** prev, Node** next) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
@@ -140,17 +155,14 @@ class SkipList {
   Comparator const compare_;
   Arena* const arena_;  // Arena used for allocations of nodes
 
-  Node* const head_;  // skiplist的前置哨兵节点
+  Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
-  std::atomic<int>
-      max_height_;  // Height of the entire list//记录当前skiplist使用的最高高度
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
+  std::atomic<int> max_height_;  // Height of the entire list
 
   // Read/written only by Insert().
   Random rnd_;
-  bool with_hashmap_;
-  std::unordered_map<std::string, Node*>hashmap_;
 };
 
 // Implementation details follow
@@ -159,7 +171,6 @@ struct SkipList<Key, Comparator>::Node {
   explicit Node(const Key& k) : key(k) {}
 
   Key const key;
-  int height;
 
   // Accessors/mutators for links.  Wrapped in methods so we can
   // add the appropriate barriers as necessary.
@@ -187,6 +198,15 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Link x after this node at level n if the link still points at
+  // "expected".  A successful swap publishes x like SetNext().
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
@@ -197,9 +217,7 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
     const Key& key, int height) {
   char* const node_memory = arena_->AllocateAligned(
       sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
-  Node* ans = new (node_memory) Node(key);
-  ans->height = height;
-  return  ans;
+  return new (node_memory) Node(key);
 }
 
 template <typename Key, class Comparator>
@@ -237,26 +255,16 @@ inline void SkipList<Key, Comparator>::Iterator::Prev() {
 }
 
 template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::Seek(const Key& target, bool point_get) {
-  if(list_->with_hashmap_){
-    uint32_t key_length;
-    const char *key_t = GetVarint32Ptr((char*)target, (char*)target + 5, &key_length);
-    std::string map_key(key_t, key_length-8);
-//    std::unordered_map<std::string, Node*>::iterator* it = list_->hashmap_.find(map_key);
-    Node* t=nullptr;
-    auto it = list_->hashmap_.find(map_key);
-    if(it !=list_->hashmap_.end()){
-      t = it->second;
-      while (list_->compare_(t->key, target) < 0){
-        t = t->Next(0);
-      }
-    }
-    node_ = t;
-    if(point_get || node_ != nullptr) return;
-  }
+inline void SkipList<Key, Comparator>::Iterator::Seek(const Key& target) {
   node_ = list_->FindGreaterOrEqual(target, nullptr);
 }
 
+template <typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::SeekToPosition(Position pos) {
+  assert(pos != nullptr);
+  node_ = const_cast<Node*>(reinterpret_cast<const Node*>(pos));
+}
+
 template <typename Key, class Comparator>
 inline void SkipList<Key, Comparator>::Iterator::SeekToFirst() {
   node_ = list_->head_->Next(0);
@@ -273,10 +281,15 @@ inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
 template <typename Key, class Comparator>
 int SkipList<Key, Comparator>::
     RandomHeight() {  //利用随机数实现每次有4分之一的概率增长高度。
+  return RandomHeight(&rnd_);
+}
+
+template <typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeight(Random* rnd) {
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
+  while (height < kMaxHeight && ((rnd->Next() % kBranching) == 0)) {
     height++;
   }
   assert(height > 0);
@@ -314,6 +327,22 @@ SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key,
+                                                   Node* before, Node* after,
+                                                   int level, Node** prev,
+                                                   Node** next) const {
+  while (true) {
+    Node* x = before->Next(level);
+    if (x == after || !KeyIsAfterNode(key, x)) {
+      *prev = before;
+      *next = x;
+      return;
+    }
+    before = x;
+  }
+}
+
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node*
 SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
@@ -355,37 +384,21 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
   }
 }
 
-template <typename Key, class Comparator>
-SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena, bool with_hashmap)
-    : compare_(cmp),
-      arena_(arena),
-      head_(NewNode(0 /* any key will do */, kMaxHeight)),
-      max_height_(1),
-      rnd_(0xdeadbeef),
-      with_hashmap_(with_hashmap),
-      hashmap_() {
-  for (int i = 0; i < kMaxHeight; i++) {
-    head_->SetNext(i, nullptr);
-  }
-}
-
-
 template <typename Key, class Comparator>
 SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(1),
-      rnd_(0xdeadbeef),
-      with_hashmap_(false),
-      hashmap_() {
+      rnd_(0xdeadbeef) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, nullptr);
   }
 }
 
 template <typename Key, class Comparator>
-void SkipList<Key, Comparator>::Insert(const Key& key) {
+typename SkipList<Key, Comparator>::Position
+SkipList<Key, Comparator>::Insert(const Key& key) {
   // TODO(opt): We can use a barrier-free variant of FindGreaterOrEqual()
   // here since Insert() is externally synchronized.
   Node* prev[kMaxHeight];
@@ -415,16 +428,58 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
     // NoBarrier_SetNext() suffices since we will add a barrier when
     // we publish a pointer to "x" in prev[i].
     x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));  // set next of x
-    prev[i]->SetNext(i, x);                               // set pre of x
+    prev[i]->SetNext(i, x);
+  }
+  return x;
+}
+
+template <typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Position
+SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+  // rnd_ is not thread-safe, so each thread draws heights from its own
+  // generator.
+  static std::atomic<uint32_t> next_seed(0xdeadbeef);
+  static thread_local Random rnd(
+      next_seed.fetch_add(0x9e3779b9, std::memory_order_relaxed));
+  const int height = RandomHeight(&rnd);
+
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    // On failure max_height is reloaded.  A reader that sees the new
+    // height before the links below is fine, as explained in Insert().
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      max_height = height;
+      break;
+    }
+  }
+
+  // Find the splice at every level, from the top down.  A splice stays
+  // usable while other nodes are inserted: it only gets stale, and a
+  // failed CAS below recomputes it from prev[i], which still precedes key.
+  Node* prev[kMaxHeight + 1];
+  Node* next[kMaxHeight + 1];
+  prev[max_height] = head_;
+  next[max_height] = nullptr;
+  for (int i = max_height - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, prev[i + 1], next[i + 1], i, &prev[i], &next[i]);
   }
 
-  if(with_hashmap_){
-    uint32_t key_length;
-    const char *key_t = GetVarint32Ptr((char*)key, (char*)key + 5, &key_length);
-    std::string map_key(key_t, key_length-8);
-    hashmap_[map_key] = x; 
+  Node* x = NewNode(key, height);
+  // Link the levels bottom up, so that a node reachable at some level is
+  // also reachable at all levels below it.
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      assert(next[i] == nullptr || !Equal(key, next[i]->key));
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      // Another node was linked after prev[i] in the meantime.
+      FindSpliceForLevel(key, prev[i], nullptr, i, &prev[i], &next[i]);
+    }
   }
-//  PrintTable();
+  return x;
 }
 
 template <typename Key, class Comparator>
@@ -437,98 +492,6 @@ bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   }
 }
 
-template <typename Key, class Comparator>
-std::string SkipList<Key, Comparator>::MyDecoder(const char* p){
-  enum ValueType1 { keyTypeDeletion = 0x0, keyTypeValue = 0x1 };
-  std::string ans = "Key: ";
-  std::string key;
-  uint32_t keylength;
-  uint32_t valuelength;
-  uint64_t tag;
-  uint64_t seq;
-
-  p = GetVarint32Ptr(p, p + 5, &keylength);
-  keylength -= 8;
-  key = std::string(p, keylength);
-  ans += key;
-  tag = DecodeFixed64(p + keylength);
-  seq = tag >> 8;
-  ans += ", sequence: " + std::to_string(seq);
-
-  switch (static_cast<ValueType>(tag & 0xff)) {
-    case kTypeValue: {
-      p += keylength + 8;
-      p = GetVarint32Ptr(p, p + 5, &valuelength);
-      std::string value = std::string(p, valuelength);
-      ans += ", Value: " + value;
-      break;
-    }
-    case kTypeDeletion:
-      ans += ", Delete";
-  }
-  return ans;
-}
-
-template <typename Key, class Comparator>
-void SkipList<Key, Comparator>::PrintTable() {
-  Node* x = head_;
-  while (x->Next(0) != nullptr) {
-    x = x->Next(0);
-    std::cout << MyDecoder((char*)x->key) <<", height:"<<x->height<< std::endl;
-  }
-  std::cout << "------------------------PRINT------------------------\n";
-}
-
-// template<typename Key, class Comparator>
-// void SkipList<Key, Comparator>::PrintTable(){
-//
-//    int level = GetMaxHeight() - 1;
-//    for(int i = level; i >= 0; i--){
-//        Node* next = head_->NoBarrier_Next(i);
-//        if(next == nullptr)
-//            continue;
-//        while(true){
-//            // entry format is:
-//            //    internal-keylength = keylength + 8 varint32
-//            //    key  char[klength]
-//            //    tag      uint64   seqnumber + valuetype
-//            //    vlength  varint32
-//            //    value    char[vlength]
-//
-//            //printf key
-//            const char* p = (char*)next->key;
-//            uint32_t keylength;
-//            p = GetVarint32Ptr(p, p + 5, &keylength);//get internal key size
-//            keylength -= 8;
-//            std::string key = std::string(p, keylength);
-//            std::cout << "key: " << key << "\t";
-//
-//            //printf value
-//            const uint64_t tag = DecodeFixed64(p + keylength);//get seq number
-//            and value type switch (static_cast<ValueType1>(tag & 0xff))
-//            {//static_cast相当于强制转换，把tag转换为valuetype类型
-//                case 1: {
-//                    uint32_t valuelength;
-//                    p += keylength + 8;
-//                    p = GetVarint32Ptr(p, p + 5, &valuelength);//get value
-//                    size std::string value = std::string(p, valuelength);
-//                    std::cout << "value: " << value << "\t->\t";
-//                    break;
-//                }
-//                case 0:
-//                    std::cout << "del" << "\t->\t";
-//                    break;
-//            }
-//            next = next->NoBarrier_Next(i);
-//            if(next == nullptr){
-//                std::cout << "NULL\n";
-//                break;
-//            }
-//        }
-//    }
-//    std::cout << "------------------------PRINT------------------------\n";
-//}
-
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_SKIPLIST_H_
@@ -6,6 +6,8 @@
 
 #include <atomic>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
@@ -125,6 +127,50 @@ TEST(SkipTest, InsertAndLookup) {
   }
 }
 
+TEST(SkipTest, InsertConcurrently) {
+  const int kThreads = 4;
+  const int N = 5000;
+  Arena arena(true);
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      // Interleave the keys of the threads.
+      for (int i = 0; i < N; i++) {
+        list.InsertConcurrently(static_cast<Key>(i) * kThreads + t);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < static_cast<Key>(N) * kThreads; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+
+  // Every level is sorted, so searches that use the upper levels work.
+  for (Key k = 0; k < static_cast<Key>(N) * kThreads; k += 7) {
+    ASSERT_TRUE(list.Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Prev();
+    if (k == 0) {
+      ASSERT_TRUE(!iter.Valid());
+    } else {
+      ASSERT_TRUE(iter.Valid());
+      ASSERT_EQ(k - 1, iter.key());
+    }
+  }
+}
+
 // We want to make sure that with a single writer and multiple
 // concurrent readers (with no synchronization other than when a
 // reader's iterator is created), the reader always observes all the
@@ -4,6 +4,9 @@
 
 #include "db/table_cache.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -11,6 +14,142 @@
 
 namespace leveldb {
 
+namespace {
+
+// The keys of an ingested table are stored at sequence number 0.  Rewrites
+// a stored internal key so that it carries sequence number "seq" instead.
+void SetSequence(const Slice& stored, SequenceNumber seq, std::string* dst) {
+  assert(stored.size() >= 8);
+  const uint64_t tag = DecodeFixed64(stored.data() + stored.size() - 8);
+  dst->assign(stored.data(), stored.size() - 8);
+  PutFixed64(dst, (seq << 8) | (tag & 0xff));
+}
+
+// Presents the entries of an ingested table with their sequence numbers
+// set to the table's global sequence number.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, const Comparator* user_comparator,
+                      SequenceNumber global_seqno)
+      : iter_(iter), user_comparator_(user_comparator), seq_(global_seqno) {}
+  ~GlobalSeqnoIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Seek(const Slice& target) override {
+    // The stored entry for the target's user key, if any, sorts before the
+    // target when its rewritten sequence number is newer than the target's.
+    const Slice user_key = ExtractUserKey(target);
+    std::string stored;
+    AppendInternalKey(&stored,
+                      ParsedInternalKey(user_key, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    iter_->Seek(stored);
+    Update();
+    if (Valid() &&
+        user_comparator_->Compare(ExtractUserKey(key_), user_key) == 0 &&
+        DecodeFixed64(key_.data() + key_.size() - 8) >
+            DecodeFixed64(target.data() + target.size() - 8)) {
+      Next();
+    }
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return key_;
+  }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      SetSequence(iter_->key(), seq_, &key_);
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const user_comparator_;
+  const SequenceNumber seq_;
+  std::string key_;
+};
+
+// Forwards the result of a lookup in an ingested table to the caller's
+// handler with the key's sequence number set to the global one.
+struct GlobalSeqnoSaver {
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+  SequenceNumber seq;
+};
+
+void SaveWithGlobalSeqno(void* arg, const Slice& k, const Slice& v) {
+  GlobalSeqnoSaver* saver = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  std::string key;
+  SetSequence(k, saver->seq, &key);
+  (*saver->handle_result)(saver->arg, key, v);
+}
+
+// The value of a row cache entry: the newest entry of a key in a file.
+struct CachedRow {
+  std::string internal_key;
+  std::string value;
+};
+
+void DeleteCachedRow(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedRow*>(value);
+}
+
+// Captures the entry found by a lookup if it is one of "user_key".
+struct RowSaver {
+  const Comparator* ucmp;
+  Slice user_key;
+  CachedRow* row;  // nullptr until found
+};
+
+void SaveRow(void* arg, const Slice& ikey, const Slice& v) {
+  RowSaver* saver = reinterpret_cast<RowSaver*>(arg);
+  if (saver->ucmp->Compare(ExtractUserKey(ikey), saver->user_key) == 0) {
+    saver->row = new CachedRow;
+    saver->row->internal_key.assign(ikey.data(), ikey.size());
+    saver->row->value.assign(v.data(), v.size());
+  }
+}
+
+SequenceNumber TagSequence(const Slice& internal_key) {
+  return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+}
+
+// Returns the key to look up in an ingested table in place of "k", or
+// false if every entry of the table is newer than "k" and thus invisible.
+bool StoredLookupKey(const Slice& k, SequenceNumber global_seqno,
+                     std::string* stored) {
+  const uint64_t tag = DecodeFixed64(k.data() + k.size() - 8);
+  if ((tag >> 8) < global_seqno) {
+    return false;
+  }
+  stored->clear();
+  AppendInternalKey(stored, ParsedInternalKey(ExtractUserKey(k),
+                                              kMaxSequenceNumber,
+                                              kValueTypeForSeek));
+  return true;
+}
+
+}  // namespace
+
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
@@ -34,7 +173,9 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries)),
+      row_cache_(options.row_cache),
+      row_cache_id_(row_cache_ != nullptr ? row_cache_->NewId() : 0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
@@ -77,7 +218,8 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr,
+                                  SequenceNumber global_seqno) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
@@ -90,6 +232,12 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
+  if (global_seqno != 0) {
+    const InternalKeyComparator* icmp =
+        static_cast<const InternalKeyComparator*>(options_.comparator);
+    result = new GlobalSeqnoIterator(result, icmp->user_comparator(),
+                                     global_seqno);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -97,15 +245,267 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewRangeTombstoneIterator(uint64_t file_number,
+                                                uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator();
+  if (result == nullptr) {
+    cache_->Release(handle);
+  } else {
+    result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  }
+  return result;
+}
+
+Status TableCache::MaxCoveringTombstoneSequences(
+    uint64_t file_number, uint64_t file_size, const Slice* user_keys, size_t n,
+    SequenceNumber snapshot, SequenceNumber* seqs) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    for (size_t i = 0; i < n; i++) {
+      seqs[i] = t->MaxCoveringTombstoneSequence(user_keys[i], snapshot);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       LookupTrace* trace, SequenceNumber global_seqno) {
+  if (row_cache_ == nullptr) {
+    return GetFromTable(options, file_number, file_size, k, arg, handle_result,
+                        trace, global_seqno);
+  }
+
+  const Slice user_key = ExtractUserKey(k);
+  const SequenceNumber snapshot = TagSequence(k);
+  std::string row_key;
+  PutFixed64(&row_key, row_cache_id_);
+  PutFixed64(&row_key, file_number);
+  row_key.append(user_key.data(), user_key.size());
+
+  // The row cache holds the newest entry of the key in the file, which is
+  // what a lookup finds unless its snapshot predates that entry.
+  Cache::Handle* handle = row_cache_->Lookup(row_key);
+  if (handle != nullptr) {
+    const CachedRow* row =
+        reinterpret_cast<CachedRow*>(row_cache_->Value(handle));
+    const bool visible = TagSequence(row->internal_key) <= snapshot;
+    if (visible) {
+      (*handle_result)(arg, row->internal_key, row->value);
+      if (trace != nullptr) {
+        trace->row_cache_hits++;
+        trace->from_row_cache = true;
+      }
+    }
+    row_cache_->Release(handle);
+    return visible ? Status::OK()
+                   : GetFromTable(options, file_number, file_size, k, arg,
+                                  handle_result, trace, global_seqno);
+  }
+
+  std::string newest;
+  AppendInternalKey(&newest, ParsedInternalKey(user_key, kMaxSequenceNumber,
+                                               kValueTypeForSeek));
+  RowSaver saver = {
+      static_cast<const InternalKeyComparator*>(options_.comparator)
+          ->user_comparator(),
+      user_key, nullptr};
+  Status s = GetFromTable(options, file_number, file_size, newest, &saver,
+                          &SaveRow, trace, global_seqno);
+  if (!s.ok() || saver.row == nullptr) {
+    delete saver.row;
+    return s;
+  }
+  CachedRow* row = saver.row;
+  if (TagSequence(row->internal_key) <= snapshot) {
+    (*handle_result)(arg, row->internal_key, row->value);
+  } else {
+    s = GetFromTable(options, file_number, file_size, k, arg, handle_result,
+                     trace, global_seqno);
+  }
+  if (options.fill_cache) {
+    const size_t charge =
+        sizeof(CachedRow) + row->internal_key.size() + row->value.size();
+    row_cache_->Release(
+        row_cache_->Insert(row_key, row, charge, &DeleteCachedRow));
+  } else {
+    delete row;
+  }
+  return s;
+}
+
+Status TableCache::GetFromTable(const ReadOptions& options,
+                                uint64_t file_number, uint64_t file_size,
+                                const Slice& k, void* arg,
+                                void (*handle_result)(void*, const Slice&,
+                                                      const Slice&),
+                                LookupTrace* trace,
+                                SequenceNumber global_seqno) {
+  std::string stored;
+  if (global_seqno != 0 && !StoredLookupKey(k, global_seqno, &stored)) {
+    return Status::OK();
+  }
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno != 0) {
+      GlobalSeqnoSaver saver = {arg, handle_result, global_seqno};
+      s = t->InternalGet(options, stored, &saver, &SaveWithGlobalSeqno, trace);
+    } else {
+      s = t->InternalGet(options, k, arg, handle_result, trace);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, const Slice* keys,
+                            void* const* args, size_t n,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&),
+                            SequenceNumber global_seqno) {
+  if (row_cache_ == nullptr) {
+    return MultiGetFromTable(options, file_number, file_size, keys, args, n,
+                             handle_result, global_seqno);
+  }
+
+  // As in Get(): answer what the row cache can, then look up the newest
+  // entries of the remaining keys, in one batch, and cache them.  Keys
+  // whose snapshot predates the newest entry are looked up as given.
+  std::vector<std::string> row_keys(n);
+  std::vector<std::string> newest(n);
+  std::vector<size_t> misses;
+  std::vector<size_t> older;
+  for (size_t i = 0; i < n; i++) {
+    const Slice user_key = ExtractUserKey(keys[i]);
+    PutFixed64(&row_keys[i], row_cache_id_);
+    PutFixed64(&row_keys[i], file_number);
+    row_keys[i].append(user_key.data(), user_key.size());
+    Cache::Handle* handle = row_cache_->Lookup(row_keys[i]);
+    if (handle == nullptr) {
+      AppendInternalKey(&newest[i], ParsedInternalKey(user_key,
+                                                      kMaxSequenceNumber,
+                                                      kValueTypeForSeek));
+      misses.push_back(i);
+      continue;
+    }
+    const CachedRow* row =
+        reinterpret_cast<CachedRow*>(row_cache_->Value(handle));
+    if (TagSequence(row->internal_key) <= TagSequence(keys[i])) {
+      (*handle_result)(args[i], row->internal_key, row->value);
+    } else {
+      older.push_back(i);
+    }
+    row_cache_->Release(handle);
+  }
+
+  Status s;
+  if (!misses.empty()) {
+    const Comparator* ucmp =
+        static_cast<const InternalKeyComparator*>(options_.comparator)
+            ->user_comparator();
+    std::vector<Slice> newest_keys;
+    std::vector<RowSaver> savers;
+    std::vector<void*> saver_args;
+    newest_keys.reserve(misses.size());
+    savers.reserve(misses.size());
+    saver_args.reserve(misses.size());
+    for (size_t i : misses) {
+      newest_keys.push_back(newest[i]);
+      savers.push_back(RowSaver{ucmp, ExtractUserKey(keys[i]), nullptr});
+      saver_args.push_back(&savers.back());
+    }
+    s = MultiGetFromTable(options, file_number, file_size, newest_keys.data(),
+                          saver_args.data(), misses.size(), &SaveRow,
+                          global_seqno);
+    for (size_t j = 0; j < misses.size(); j++) {
+      CachedRow* row = savers[j].row;
+      if (!s.ok() || row == nullptr) {
+        delete row;
+        continue;
+      }
+      const size_t i = misses[j];
+      if (TagSequence(row->internal_key) <= TagSequence(keys[i])) {
+        (*handle_result)(args[i], row->internal_key, row->value);
+      } else {
+        older.push_back(i);
+      }
+      if (options.fill_cache) {
+        const size_t charge =
+            sizeof(CachedRow) + row->internal_key.size() + row->value.size();
+        row_cache_->Release(
+            row_cache_->Insert(row_keys[i], row, charge, &DeleteCachedRow));
+      } else {
+        delete row;
+      }
+    }
+  }
+
+  if (s.ok() && !older.empty()) {
+    std::sort(older.begin(), older.end());
+    std::vector<Slice> older_keys;
+    std::vector<void*> older_args;
+    older_keys.reserve(older.size());
+    older_args.reserve(older.size());
+    for (size_t i : older) {
+      older_keys.push_back(keys[i]);
+      older_args.push_back(args[i]);
+    }
+    s = MultiGetFromTable(options, file_number, file_size, older_keys.data(),
+                          older_args.data(), older.size(), handle_result,
+                          global_seqno);
+  }
+  return s;
+}
+
+Status TableCache::MultiGetFromTable(
+    const ReadOptions& options, uint64_t file_number, uint64_t file_size,
+    const Slice* keys, void* const* args, size_t n,
+    void (*handle_result)(void*, const Slice&, const Slice&),
+    SequenceNumber global_seqno) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    if (global_seqno == 0) {
+      s = t->InternalMultiGet(options, keys, args, n, handle_result);
+    } else {
+      // Look up only the keys that can see the table, by their stored keys.
+      std::vector<std::string> stored(n);
+      std::vector<Slice> stored_keys;
+      std::vector<GlobalSeqnoSaver> savers;
+      std::vector<void*> saver_args;
+      stored_keys.reserve(n);
+      savers.reserve(n);
+      saver_args.reserve(n);
+      for (size_t i = 0; i < n; i++) {
+        if (StoredLookupKey(keys[i], global_seqno, &stored[i])) {
+          stored_keys.push_back(stored[i]);
+          savers.push_back(GlobalSeqnoSaver{args[i], handle_result,
+                                            global_seqno});
+          saver_args.push_back(&savers.back());
+        }
+      }
+      if (!stored_keys.empty()) {
+        s = t->InternalMultiGet(options, stored_keys.data(),
+                                saver_args.data(), stored_keys.size(),
+                                &SaveWithGlobalSeqno);
+      }
+    }
     cache_->Release(handle);
   }
   return s;
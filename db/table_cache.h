@@ -32,14 +32,49 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // A non-zero "global_seqno" is the sequence number of an ingested file
+  // (see FileMetaData::global_seqno): NewIterator(), Get() and MultiGet()
+  // then present its keys as if they carried that sequence number.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, Table** tableptr = nullptr,
+                        SequenceNumber global_seqno = 0);
+
+  // Return an iterator over the range tombstones of the specified file,
+  // or nullptr if it has none.  Returns an error iterator if the file
+  // cannot be opened.
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number,
+                                      uint64_t file_size);
+
+  // Store in seqs[i] the largest sequence number not above "snapshot" of
+  // the range tombstones of the specified file that cover user_keys[i],
+  // or zero if there is none, for each of the n keys.
+  Status MaxCoveringTombstoneSequences(uint64_t file_number,
+                                       uint64_t file_size,
+                                       const Slice* user_keys, size_t n,
+                                       SequenceNumber snapshot,
+                                       SequenceNumber* seqs);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  If "trace" is
+  // non-null, the work done in the file is recorded in *trace.
+  //
+  // With a row cache (Options::row_cache), (*handle_result) is only
+  // called for an entry of the user key of "k", and it may be given the
+  // entry from the cache instead of reading the file.
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             LookupTrace* trace = nullptr, SequenceNumber global_seqno = 0);
+
+  // Same as calling Get() for each of the n keys, which must be sorted,
+  // with the matching element of "args", but the table is looked up in
+  // the cache once and each of its blocks is read at most once.
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, const Slice* keys, void* const* args,
+                  size_t n,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  SequenceNumber global_seqno = 0);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -47,10 +82,27 @@ class TableCache {
  private:
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 
+  // Get() without the row cache.
+  Status GetFromTable(const ReadOptions& options, uint64_t file_number,
+                      uint64_t file_size, const Slice& k, void* arg,
+                      void (*handle_result)(void*, const Slice&,
+                                            const Slice&),
+                      LookupTrace* trace, SequenceNumber global_seqno);
+
+  // MultiGet() without the row cache.
+  Status MultiGetFromTable(const ReadOptions& options, uint64_t file_number,
+                           uint64_t file_size, const Slice* keys,
+                           void* const* args, size_t n,
+                           void (*handle_result)(void*, const Slice&,
+                                                 const Slice&),
+                           SequenceNumber global_seqno);
+
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  Cache* const row_cache_;
+  const uint64_t row_cache_id_;  // Prefix of our keys in row_cache_
 };
 
 }  // namespace leveldb
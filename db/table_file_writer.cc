@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// The table stores every record under an internal key with sequence
+// number 0.  The DB gives all of them one fresh sequence number when the
+// table is ingested (see FileMetaData::global_seqno).
+struct TableFileWriter::Rep {
+  explicit Rep(const Options& user_options)
+      : icmp(user_options.comparator),
+        ipolicy(user_options.filter_policy),
+        options(user_options),
+        file(nullptr),
+        builder(nullptr),
+        finished(false) {
+    options.comparator = &icmp;
+    options.filter_policy =
+        (user_options.filter_policy != nullptr) ? &ipolicy : nullptr;
+  }
+
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // User key of the last record added
+  bool finished;
+};
+
+TableFileWriter::TableFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+TableFileWriter::~TableFileWriter() {
+  if (rep_->builder != nullptr && !rep_->finished) {
+    rep_->builder->Abandon();
+  }
+  delete rep_->builder;
+  delete rep_->file;
+  delete rep_;
+}
+
+Status TableFileWriter::Open(const std::string& fname) {
+  assert(rep_->file == nullptr);
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+  }
+  return s;
+}
+
+Status TableFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status TableFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status TableFileWriter::Add(const Slice& key, const Slice& value,
+                            bool deletion) {
+  Rep* r = rep_;
+  assert(r->builder != nullptr && !r->finished);
+  if (r->builder->NumEntries() > 0 &&
+      r->icmp.user_comparator()->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in increasing order",
+                                   key);
+  }
+  Status s = r->builder->status();
+  if (!s.ok()) {
+    return s;
+  }
+  r->last_key.assign(key.data(), key.size());
+  InternalKey ikey(key, 0, deletion ? kTypeDeletion : kTypeValue);
+  r->builder->Add(ikey.Encode(), value);
+  return r->builder->status();
+}
+
+Status TableFileWriter::Finish() {
+  Rep* r = rep_;
+  assert(r->builder != nullptr && !r->finished);
+  r->finished = true;
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  return s;
+}
+
+uint64_t TableFileWriter::NumEntries() const {
+  return rep_->builder == nullptr ? 0 : rep_->builder->NumEntries();
+}
+
+uint64_t TableFileWriter::FileSize() const {
+  return rep_->builder == nullptr ? 0 : rep_->builder->FileSize();
+}
+
+}  // namespace leveldb
@@ -20,7 +20,14 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kColumnFamily = 10,
+  kColumnFamilyAdd = 11,
+  // Same as kNewFile, for a table that holds range tombstones
+  kNewFileWithRangeDeletions = 12,
+  // Same as kNewFile (with a range deletion flag), followed by the global
+  // sequence number of an ingested table
+  kNewIngestedFile = 13
 };
 
 void VersionEdit::Clear() {
@@ -34,11 +41,24 @@ void VersionEdit::Clear() {
   has_prev_log_number_ = false;
   has_next_file_number_ = false;
   has_last_sequence_ = false;
+  column_family_ = 0;
+  is_column_family_add_ = false;
+  column_family_name_.clear();
   deleted_files_.clear();
   new_files_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
+  // Edits for the default column family carry no column family tag so
+  // that they stay readable by older versions.
+  if (column_family_ != 0) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, column_family_);
+  }
+  if (is_column_family_add_) {
+    PutVarint32(dst, kColumnFamilyAdd);
+    PutLengthPrefixedSlice(dst, column_family_name_);
+  }
   if (has_comparator_) {
     PutVarint32(dst, kComparator);
     PutLengthPrefixedSlice(dst, comparator_);
@@ -74,12 +94,21 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    if (f.global_seqno != 0) {
+      PutVarint32(dst, kNewIngestedFile);
+    } else {
+      PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDeletions
+                                             : kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint32(dst, f.has_range_deletions ? 1 : 0);
+      PutVarint64(dst, f.global_seqno);
+    }
   }
 }
 
@@ -107,6 +136,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   Slice input = src;
   const char* msg = nullptr;
   uint32_t tag;
+  uint32_t flags;
 
   // Temporary storage for parsing
   int level;
@@ -126,6 +156,21 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kColumnFamily:
+        if (!GetVarint32(&input, &column_family_)) {
+          msg = "column family id";
+        }
+        break;
+
+      case kColumnFamilyAdd:
+        if (GetLengthPrefixedSlice(&input, &str)) {
+          column_family_name_ = str.ToString();
+          is_column_family_add_ = true;
+        } else {
+          msg = "column family name";
+        }
+        break;
+
       case kLogNumber:
         if (GetVarint64(&input, &log_number_)) {
           has_log_number_ = true;
@@ -175,6 +220,8 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDeletions:
+        f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
@@ -185,6 +232,21 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewIngestedFile:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint32(&input, &flags) && flags <= 1 &&
+            GetVarint64(&input, &f.global_seqno) && f.global_seqno != 0) {
+          f.has_range_deletions = (flags == 1);
+          new_files_.push_back(std::make_pair(level, f));
+          f.global_seqno = 0;
+        } else {
+          msg = "ingested-file entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -205,6 +267,14 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
 std::string VersionEdit::DebugString() const {
   std::string r;
   r.append("VersionEdit {");
+  if (column_family_ != 0) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, column_family_);
+  }
+  if (is_column_family_add_) {
+    r.append("\n  AddColumnFamily: ");
+    r.append(column_family_name_);
+  }
   if (has_comparator_) {
     r.append("\n  Comparator: ");
     r.append(comparator_);
@@ -249,6 +319,14 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
+    if (f.global_seqno != 0) {
+      r.append(" (global seqno ");
+      AppendNumberTo(&r, f.global_seqno);
+      r.append(")");
+    }
   }
   r.append("\n}\n");
   return r;
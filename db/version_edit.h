@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 #define STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 
+#include <atomic>
 #include <set>
 #include <utility>
 #include <vector>
@@ -16,14 +17,46 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        has_range_deletions(false),
+        global_seqno(0),
+        being_compacted(false) {}
+
+  FileMetaData(const FileMetaData& f) { *this = f; }
+  FileMetaData& operator=(const FileMetaData& f) {
+    refs = f.refs;
+    allowed_seeks.store(f.allowed_seeks.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    number = f.number;
+    file_size = f.file_size;
+    smallest = f.smallest;
+    largest = f.largest;
+    has_range_deletions = f.has_range_deletions;
+    global_seqno = f.global_seqno;
+    being_compacted = f.being_compacted;
+    return *this;
+  }
 
   int refs;
-  int allowed_seeks;  // Seeks allowed until compaction
+  // Seeks allowed until compaction.  Charged by reads without the DB mutex.
+  std::atomic<int> allowed_seeks;
   uint64_t number;
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  // Whether the table holds range tombstones.  If so, [smallest,largest]
+  // also spans the ranges they delete.
+  bool has_range_deletions;
+  // If non-zero, the file was ingested from outside the DB with all of its
+  // keys stored at sequence number 0, and they are read as if they carried
+  // this sequence number instead.  smallest and largest already do.
+  SequenceNumber global_seqno;
+  // Whether the file is an input of a running compaction.  Protected by
+  // the DB mutex; not persisted.
+  bool being_compacted;
 };
 
 class VersionEdit {
@@ -57,19 +90,42 @@ class VersionEdit {
     compact_pointers_.push_back(std::make_pair(level, key));
   }
 
+  // Apply this edit to the column family with the given id.  Edits that
+  // do not name a column family apply to the default column family (0).
+  void SetColumnFamily(uint32_t column_family) {
+    column_family_ = column_family;
+  }
+  uint32_t column_family() const { return column_family_; }
+
+  // Record the creation of the column family named "name".  The id of
+  // the new family is set with SetColumnFamily().
+  void AddColumnFamily(const Slice& name) {
+    is_column_family_add_ = true;
+    column_family_name_ = name.ToString();
+  }
+
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add a copy of the persistent fields of "f" at the specified level.
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest,
+            f.has_range_deletions);
+    new_files_.back().second.global_seqno = f.global_seqno;
+  }
+
   // Delete the specified "file" from the specified "level".
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -96,6 +152,10 @@ class VersionEdit {
   bool has_next_file_number_;
   bool has_last_sequence_;
 
+  uint32_t column_family_;
+  bool is_column_family_add_;
+  std::string column_family_name_;
+
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector<std::pair<int, FileMetaData>> new_files_;
@@ -38,6 +38,76 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, RangeDeletions) {
+  VersionEdit edit;
+  edit.AddFile(1, 5, 100, InternalKey("a", 10, kTypeRangeDeletion),
+               InternalKey("m", kMaxSequenceNumber, kTypeRangeDeletion),
+               true);
+  edit.AddFile(2, 6, 100, InternalKey("n", 3, kTypeValue),
+               InternalKey("z", 4, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  Status s = parsed.DecodeFrom(encoded);
+  ASSERT_TRUE(s.ok()) << s.ToString();
+  std::string debug = parsed.DebugString();
+  ASSERT_NE(std::string::npos,
+            debug.find(" : 2 (range deletions)\n  AddFile: 2 6"))
+      << debug;
+  ASSERT_NE(std::string::npos, debug.find("'z' @ 4 : 1\n}")) << debug;
+}
+
+TEST(VersionEditTest, IngestedFile) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 200;
+  f.smallest = InternalKey("b", 42, kTypeValue);
+  f.largest = InternalKey("y", 42, kTypeDeletion);
+  f.global_seqno = 42;
+  edit.AddFile(6, f);
+  edit.AddFile(1, 8, 100, InternalKey("a", 3, kTypeValue),
+               InternalKey("c", 4, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  Status s = parsed.DecodeFrom(encoded);
+  ASSERT_TRUE(s.ok()) << s.ToString();
+  std::string debug = parsed.DebugString();
+  ASSERT_NE(std::string::npos,
+            debug.find(" : 0 (global seqno 42)\n  AddFile: 1 8"))
+      << debug;
+}
+
+TEST(VersionEditTest, ColumnFamily) {
+  VersionEdit edit;
+  edit.SetColumnFamily(3);
+  edit.AddColumnFamily("hot");
+  edit.SetComparatorName("foo");
+  edit.SetLogNumber(7);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_EQ(3, parsed.column_family());
+
+  // Edits for the default family keep the original encoding.
+  VersionEdit plain, defaulted;
+  plain.SetLogNumber(7);
+  defaulted.SetLogNumber(7);
+  defaulted.SetColumnFamily(0);
+  std::string e1, e2;
+  plain.EncodeTo(&e1);
+  defaulted.EncodeTo(&e2);
+  ASSERT_EQ(e1, e2);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -8,10 +8,12 @@
 
 #include <algorithm>
 
+#include "db/column_family.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -159,8 +161,8 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
@@ -195,6 +197,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
@@ -204,35 +207,49 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8), nullptr,
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(cfd_->icmp_, &files_[level]), &GetFileIterator,
+      cfd_->table_cache_, options, &cfd_->icmp_);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
-  // Merge all level zero files together since they may overlap
+  // Merge all level zero files together since they may overlap.  Files
+  // that lie entirely outside the iterate bounds are not opened.
+  const InternalKeyComparator& icmp = cfd_->icmp_;
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    const FileMetaData* f = files_[0][i];
+    if ((options.iterate_upper_bound != nullptr &&
+         icmp.Compare(f->smallest.Encode(), *options.iterate_upper_bound) >=
+             0) ||
+        (options.iterate_lower_bound != nullptr &&
+         icmp.Compare(f->largest.Encode(), *options.iterate_lower_bound) <
+             0)) {
+      continue;
+    }
+    iters->push_back(
+        cfd_->table_cache_->NewIterator(options, f->number, f->file_size,
+                                        nullptr, f->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -245,6 +262,32 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+// Add the range tombstones of "f", if any, to *range_del.
+static Status AddFileTombstones(TableCache* table_cache, const FileMetaData* f,
+                                RangeDelAggregator* range_del) {
+  if (!f->has_range_deletions) {
+    return Status::OK();
+  }
+  Status s;
+  Iterator* iter = table_cache->NewRangeTombstoneIterator(f->number,
+                                                          f->file_size);
+  if (iter != nullptr) {
+    s = range_del->AddTombstones(iter);
+    delete iter;
+  }
+  return s;
+}
+
+Status Version::AddRangeTombstones(RangeDelAggregator* range_del) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      s = AddFileTombstones(cfd_->table_cache_, files_[level][i], range_del);
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -269,9 +312,9 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->seq = parsed_key.sequence;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
-        s->seq = parsed_key.sequence;
       }
     }
   }
@@ -283,7 +326,7 @@ static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
 
 void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
                                  bool (*func)(void*, int, FileMetaData*)) {
-  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Comparator* ucmp = cfd_->icmp_.user_comparator();
 
   // Search level-0 in order from newest to oldest.
   std::vector<FileMetaData*> tmp;
@@ -310,7 +353,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     if (num_files == 0) continue;
 
     // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+    uint32_t index = FindFile(cfd_->icmp_, files_[level], internal_key);
     if (index < num_files) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
@@ -325,21 +368,26 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats, LookupTrace* trace) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
   struct State {
     Saver saver;//保存结果
     GetStats* stats;
+    LookupTrace* trace;
     const ReadOptions* options;
     Slice ikey;
     FileMetaData* last_file_read;// meta信息
     int last_file_read_level;//
 
-    VersionSet* vset;
+    TableCache* table_cache;
     Status s;
     bool found;
+    // Newest range tombstone covering the key in the files read so far.
+    // Every entry in the files not yet read is older than it.
+    SequenceNumber max_covering_tombstone_seq;
+    SequenceNumber snapshot;
 
     static bool Match(void* arg, int level, FileMetaData* f) {
       State* state = reinterpret_cast<State*>(arg);
@@ -354,13 +402,41 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      if (f->has_range_deletions) {
+        SequenceNumber seq;
+        state->s = state->table_cache->MaxCoveringTombstoneSequences(
+            f->number, f->file_size, &state->saver.user_key, 1,
+            state->snapshot, &seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+        if (seq > state->max_covering_tombstone_seq) {
+          state->max_covering_tombstone_seq = seq;
+        }
+      }
+
+      if (state->trace != nullptr) {
+        // Only the block of the file that answers the lookup is reported.
+        state->trace->files_probed++;
+        state->trace->block_offset = 0;
+        state->trace->from_row_cache = false;
+      }
+      state->s = state->table_cache->Get(
+          *state->options, f->number, f->file_size, state->ikey,
+          &state->saver, SaveValue, state->trace, f->global_seqno);
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
+      if (state->max_covering_tombstone_seq > 0 &&
+          (state->saver.state == kNotFound ||
+           (state->saver.state == kFound &&
+            state->saver.seq < state->max_covering_tombstone_seq))) {
+        // Deleted by a range tombstone
+        state->saver.state = kDeleted;
+        state->saver.seq = state->max_covering_tombstone_seq;
+      }
       switch (state->saver.state) {
         case kNotFound:
           return true;  // Keep searching in other files
@@ -385,57 +461,236 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   State state;
   state.found = false;
   state.stats = stats;
+  state.trace = trace;
   state.last_file_read = nullptr;
   state.last_file_read_level = -1;
 
   state.options = &options;
   state.ikey = k.internal_key();
-  state.vset = vset_;
+  state.table_cache = cfd_->table_cache_;
+  state.max_covering_tombstone_seq = 0;
+  state.snapshot = k.sequence();
 
   state.saver.state = kNotFound;
-  state.saver.ucmp = vset_->icmp_.user_comparator();
+  state.saver.ucmp = cfd_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
-  if(state.found){
-    std::string ans = "'"+k.user_key().ToString()+"' @ ";
-    ans += std::to_string(state.saver.seq);
-    switch (state.saver.state) {
-      case kFound: {
-        ans += " : val => '" + *value + "'";
-        break;
+  if (trace != nullptr &&
+      (state.saver.state == kFound || state.saver.state == kDeleted)) {
+    trace->source = LookupTrace::kTable;
+    trace->sequence = state.saver.seq;
+    trace->deleted = (state.saver.state == kDeleted);
+    trace->level = state.last_file_read_level;
+    trace->file_number = state.last_file_read->number;
+  }
+
+  return state.found ? state.s : Status::NotFound(Slice());
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<MultiGetKey>& keys,
+                       GetStats* stats) {
+  stats->seek_file = nullptr;
+  stats->seek_file_level = -1;
+
+  const Comparator* ucmp = cfd_->icmp_.user_comparator();
+  const size_t n = keys.size();
+  std::vector<Saver> savers(n);
+  // The first file read for each key, charged if it needs another read.
+  std::vector<FileMetaData*> first_file(n, nullptr);
+  std::vector<int> first_file_level(n, -1);
+  std::vector<size_t> pending;  // Unresolved keys, in key order
+  pending.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    savers[i].state = kNotFound;
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = keys[i].key->user_key();
+    savers[i].value = keys[i].value;
+    *keys[i].status = Status::NotFound(Slice());
+    pending.push_back(i);
+  }
+
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  std::vector<Slice> batch_user_keys;
+  std::vector<SequenceNumber> batch_seqs;
+  std::vector<bool> resolved(n, false);
+  // Newest range tombstone covering each key in the files read so far.
+  std::vector<SequenceNumber> max_covering_tombstone_seq(n, 0);
+
+  // Look up the keys pending[begin,end) in file f.
+  auto probe = [&](size_t begin, size_t end, int level, FileMetaData* f) {
+    if (f->has_range_deletions) {
+      batch_user_keys.clear();
+      for (size_t p = begin; p < end; p++) {
+        batch_user_keys.push_back(savers[pending[p]].user_key);
+      }
+      batch_seqs.resize(end - begin);
+      // All the keys are looked up at the same snapshot.
+      Status s = cfd_->table_cache_->MaxCoveringTombstoneSequences(
+          f->number, f->file_size, batch_user_keys.data(),
+          batch_user_keys.size(), keys[pending[begin]].key->sequence(),
+          batch_seqs.data());
+      for (size_t p = begin; p < end; p++) {
+        size_t i = pending[p];
+        if (!s.ok()) {
+          *keys[i].status = s;
+          resolved[i] = true;
+        } else {
+          max_covering_tombstone_seq[i] =
+              std::max(max_covering_tombstone_seq[i], batch_seqs[p - begin]);
+        }
+      }
+      if (!s.ok()) {
+        return;
       }
-      case kDeleted:
-        ans += " : del => ''";
-      case kNotFound:
-        break;
-      case kCorrupt:
-        break;
     }
-    ans += ", SSTable => '" + std::to_string(state.last_file_read_level)
-           + "', '" + std::to_string(state.last_file_read->number)+"'";
-    stats->s.SetMsg(ans);
+
+    batch_keys.clear();
+    batch_args.clear();
+    for (size_t p = begin; p < end; p++) {
+      size_t i = pending[p];
+      if (first_file[i] == nullptr) {
+        first_file[i] = f;
+        first_file_level[i] = level;
+      } else if (stats->seek_file == nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        stats->seek_file = first_file[i];
+        stats->seek_file_level = first_file_level[i];
+      }
+      batch_keys.push_back(keys[i].key->internal_key());
+      batch_args.push_back(&savers[i]);
+    }
+    Status s = cfd_->table_cache_->MultiGet(
+        options, f->number, f->file_size, batch_keys.data(), batch_args.data(),
+        batch_keys.size(), SaveValue, f->global_seqno);
+    for (size_t p = begin; p < end; p++) {
+      size_t i = pending[p];
+      if (!s.ok()) {
+        *keys[i].status = s;
+        resolved[i] = true;
+        continue;
+      }
+      if (max_covering_tombstone_seq[i] > 0 &&
+          (savers[i].state == kNotFound ||
+           (savers[i].state == kFound &&
+            savers[i].seq < max_covering_tombstone_seq[i]))) {
+        savers[i].state = kDeleted;  // Deleted by a range tombstone
+      }
+      switch (savers[i].state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          *keys[i].status = Status::OK();
+          resolved[i] = true;
+          break;
+        case kDeleted:
+          resolved[i] = true;
+          break;
+        case kCorrupt:
+          *keys[i].status =
+              Status::Corruption("corrupted key for ", savers[i].user_key);
+          resolved[i] = true;
+          break;
+      }
+    }
+  };
+
+  // Drop the keys resolved by the files probed so far from pending.
+  auto compact_pending = [&]() {
+    size_t live = 0;
+    for (size_t p = 0; p < pending.size(); p++) {
+      if (!resolved[pending[p]]) {
+        pending[live++] = pending[p];
+      }
+    }
+    pending.resize(live);
+  };
+
+  // Search level-0 in order from newest to oldest.  The pending keys in
+  // the range of a file are contiguous since pending is in key order.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (size_t t = 0; t < tmp.size() && !pending.empty(); t++) {
+    FileMetaData* f = tmp[t];
+    size_t begin = 0;
+    while (begin < pending.size() &&
+           ucmp->Compare(savers[pending[begin]].user_key,
+                         f->smallest.user_key()) < 0) {
+      begin++;
+    }
+    size_t end = begin;
+    while (end < pending.size() &&
+           ucmp->Compare(savers[pending[end]].user_key,
+                         f->largest.user_key()) <= 0) {
+      end++;
+    }
+    if (begin < end) {
+      probe(begin, end, 0, f);
+      compact_pending();
+    }
   }
 
-  return state.found ? state.s : Status::NotFound(Slice());
+  // Search other levels.  The files of a level are disjoint and sorted,
+  // so the pending keys split into runs that fall in the same file.
+  for (int level = 1; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    size_t p = 0;
+    while (p < pending.size()) {
+      uint32_t index = FindFile(cfd_->icmp_, files,
+                                keys[pending[p]].key->internal_key());
+      if (index >= files.size()) {
+        break;  // The remaining keys are past the last file
+      }
+      FileMetaData* f = files[index];
+      size_t begin = p;
+      while (p < pending.size() &&
+             cfd_->icmp_.Compare(keys[pending[p]].key->internal_key(),
+                                 f->largest.Encode()) <= 0) {
+        p++;
+      }
+      // Skip the keys that are before the start of "f".
+      while (begin < p && ucmp->Compare(savers[pending[begin]].user_key,
+                                        f->smallest.user_key()) < 0) {
+        begin++;
+      }
+      if (begin < p) {
+        probe(begin, p, level, f);
+      }
+    }
+    compact_pending();
+  }
+}
+
+bool Version::ChargeSeek(const GetStats& stats) {
+  FileMetaData* f = stats.seek_file;
+  if (f == nullptr) {
+    return false;
+  }
+  const int remaining =
+      f->allowed_seeks.fetch_sub(1, std::memory_order_relaxed) - 1;
+  return remaining <= 0 &&
+         file_to_compact_.load(std::memory_order_relaxed) == nullptr;
 }
 
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != nullptr) {
-    f->allowed_seeks--;
-    if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
-      file_to_compact_ = f;
-      file_to_compact_level_ = stats.seek_file_level;
-      return true;
-    }
+  if (f != nullptr && f->allowed_seeks.load(std::memory_order_relaxed) <= 0 &&
+      file_to_compact_.load(std::memory_order_relaxed) == nullptr) {
+    file_to_compact_level_ = stats.seek_file_level;
+    file_to_compact_.store(f, std::memory_order_relaxed);
+    return true;
   }
   return false;
 }
 
-bool Version::RecordReadSample(Slice internal_key) {
+bool Version::RecordReadSample(Slice internal_key, GetStats* stats) {
   ParsedInternalKey ikey;
   if (!ParseInternalKey(internal_key, &ikey)) {
     return false;
@@ -468,7 +723,8 @@ bool Version::RecordReadSample(Slice internal_key) {
   // finding such files?
   if (state.matches >= 2) {
     // 1MB cost is about 1 seek (see comment in Builder::Apply).
-    return UpdateStats(state.stats);
+    *stats = state.stats;
+    return ChargeSeek(*stats);
   }
   return false;
 }
@@ -476,7 +732,7 @@ bool Version::RecordReadSample(Slice internal_key) {
 void Version::Ref() { ++refs_; }
 
 void Version::Unref() {
-  assert(this != &vset_->dummy_versions_);
+  assert(this != &cfd_->dummy_versions_);
   assert(refs_ >= 1);
   --refs_;
   if (refs_ == 0) {
@@ -486,28 +742,32 @@ void Version::Unref() {
 
 bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
                              const Slice* largest_user_key) {
-  return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level],
+  return SomeFileOverlapsRange(cfd_->icmp_, (level > 0), files_[level],
                                smallest_user_key, largest_user_key);
 }
 
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
-  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key) &&
+      !VersionSet::OutputRangeReserved(cfd_, 0, smallest_user_key,
+                                       largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
     while (level < config::kMaxMemCompactLevel) {
-      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key) ||
+          VersionSet::OutputRangeReserved(cfd_, level + 1, smallest_user_key,
+                                          largest_user_key)) {
         break;
       }
       if (level + 2 < config::kNumLevels) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
         const int64_t sum = TotalFileSize(overlaps);
-        if (sum > MaxGrandParentOverlapBytes(vset_->options_)) {
+        if (sum > MaxGrandParentOverlapBytes(&cfd_->options_)) {
           break;
         }
       }
@@ -517,6 +777,25 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+int Version::PickLevelForIngestedFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  // The file's keys are newer than any key in the version, so it must lie
+  // above every file it overlaps, and above the outputs of the running
+  // compactions and flushes that overlap it.
+  int level = 0;
+  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key) &&
+      !VersionSet::OutputRangeReserved(cfd_, 0, smallest_user_key,
+                                       largest_user_key)) {
+    while (level + 1 < config::kNumLevels &&
+           !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key) &&
+           !VersionSet::OutputRangeReserved(cfd_, level + 1, smallest_user_key,
+                                            largest_user_key)) {
+      level++;
+    }
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -531,7 +810,7 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
   if (end != nullptr) {
     user_end = end->user_key();
   }
-  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  const Comparator* user_cmp = cfd_->icmp_.user_comparator();
   for (size_t i = 0; i < files_[level].size();) {
     FileMetaData* f = files_[level][i++];
     const Slice file_start = f->smallest.user_key();
@@ -612,16 +891,16 @@ class VersionSet::Builder {
     FileSet* added_files;
   };
 
-  VersionSet* vset_;
+  ColumnFamilyData* cfd_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
 
  public:
-  // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  // Initialize a builder with the files from *base and other info from *cfd
+  Builder(ColumnFamilyData* cfd, Version* base) : cfd_(cfd), base_(base) {
     base_->Ref();
     BySmallestKey cmp;
-    cmp.internal_comparator = &vset_->icmp_;
+    cmp.internal_comparator = &cfd_->icmp_;
     for (int level = 0; level < config::kNumLevels; level++) {
       levels_[level].added_files = new FileSet(cmp);
     }
@@ -653,7 +932,7 @@ class VersionSet::Builder {
     // Update compaction pointers
     for (size_t i = 0; i < edit->compact_pointers_.size(); i++) {
       const int level = edit->compact_pointers_[i].first;
-      vset_->compact_pointer_[level] =
+      cfd_->compact_pointer_[level] =
           edit->compact_pointers_[i].second.Encode().ToString();
     }
 
@@ -694,7 +973,7 @@ class VersionSet::Builder {
   // Save the current state in *v.
   void SaveTo(Version* v) {
     BySmallestKey cmp;
-    cmp.internal_comparator = &vset_->icmp_;
+    cmp.internal_comparator = &cfd_->icmp_;
     for (int level = 0; level < config::kNumLevels; level++) {
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
@@ -725,7 +1004,7 @@ class VersionSet::Builder {
         for (uint32_t i = 1; i < v->files_[level].size(); i++) {
           const InternalKey& prev_end = v->files_[level][i - 1]->largest;
           const InternalKey& this_begin = v->files_[level][i]->smallest;
-          if (vset_->icmp_.Compare(prev_end, this_begin) >= 0) {
+          if (cfd_->icmp_.Compare(prev_end, this_begin) >= 0) {
             fprintf(stderr, "overlapping ranges in same level %s vs. %s\n",
                     prev_end.DebugString().c_str(),
                     this_begin.DebugString().c_str());
@@ -744,8 +1023,8 @@ class VersionSet::Builder {
       std::vector<FileMetaData*>* files = &v->files_[level];
       if (level > 0 && !files->empty()) {
         // Must not overlap
-        assert(vset_->icmp_.Compare((*files)[files->size() - 1]->largest,
-                                    f->smallest) < 0);
+        assert(cfd_->icmp_.Compare((*files)[files->size() - 1]->largest,
+                                   f->smallest) < 0);
       }
       f->refs++;
       files->push_back(f);
@@ -759,50 +1038,61 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      table_cache_(table_cache),
-      icmp_(*cmp),
       next_file_number_(2),
       manifest_file_number_(0),  // Filled by Recover()
       last_sequence_(0),
-      log_number_(0),
       prev_log_number_(0),
       descriptor_file_(nullptr),
-      descriptor_log_(nullptr),
-      dummy_versions_(this),
-      current_(nullptr) {
-  AppendVersion(new Version(this));
+      descriptor_log_(nullptr) {
+  column_families_.push_back(new ColumnFamilyData(*options, *cmp, table_cache));
 }
 
 VersionSet::~VersionSet() {
-  current_->Unref();
-  assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  for (ColumnFamilyData* cfd : column_families_) {
+    delete cfd;
+  }
   delete descriptor_log_;
   delete descriptor_file_;
 }
 
-void VersionSet::AppendVersion(Version* v) {
-  // Make "v" current
-  assert(v->refs_ == 0);
-  assert(v != current_);
-  if (current_ != nullptr) {
-    current_->Unref();
+Version* VersionSet::current() const {
+  return column_families_[0]->current_;
+}
+
+ColumnFamilyData* VersionSet::GetColumnFamily(uint32_t id) const {
+  return (id < column_families_.size()) ? column_families_[id] : nullptr;
+}
+
+ColumnFamilyData* VersionSet::GetColumnFamily(const std::string& name) const {
+  for (ColumnFamilyData* cfd : column_families_) {
+    if (cfd->name_ == name) {
+      return cfd;
+    }
   }
-  current_ = v;
-  v->Ref();
+  return nullptr;
+}
 
-  // Append to linked list
-  v->prev_ = dummy_versions_.prev_;
-  v->next_ = &dummy_versions_;
-  v->prev_->next_ = v;
-  v->next_->prev_ = v;
+uint64_t VersionSet::LogNumber() const {
+  uint64_t result = column_families_[0]->log_number_;
+  for (ColumnFamilyData* cfd : column_families_) {
+    result = std::min(result, cfd->log_number_);
+  }
+  return result;
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  ColumnFamilyData* cfd = GetColumnFamily(edit->column_family_);
+  assert(cfd != nullptr);
+  return LogAndApply(cfd, edit, mu);
+}
+
+Status VersionSet::LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit,
+                               port::Mutex* mu) {
   if (edit->has_log_number_) {
-    assert(edit->log_number_ >= log_number_);
+    assert(edit->log_number_ >= cfd->log_number_);
     assert(edit->log_number_ < next_file_number_);
   } else {
-    edit->SetLogNumber(log_number_);
+    edit->SetLogNumber(cfd->log_number_);
   }
 
   if (!edit->has_prev_log_number_) {
@@ -810,11 +1100,15 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  // An ingestion records the sequence number of its tables before it
+  // publishes it.
+  if (!edit->has_last_sequence_ || edit->last_sequence_ < LastSequence()) {
+    edit->SetLastSequence(LastSequence());
+  }
 
-  Version* v = new Version(this);
+  Version* v = new Version(cfd);
   {
-    Builder builder(this, current_);
+    Builder builder(cfd, cfd->current_);
     builder.Apply(edit);
     builder.SaveTo(v);
   }
@@ -865,8 +1159,8 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
 
   // Install the new version
   if (s.ok()) {
-    AppendVersion(v);
-    log_number_ = edit->log_number_;
+    cfd->AppendVersion(v);
+    cfd->log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
   } else {
     delete v;
@@ -882,7 +1176,32 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   return s;
 }
 
-Status VersionSet::Recover(bool* save_manifest) {
+Status VersionSet::CreateColumnFamily(const std::string& name,
+                                      const Options& options,
+                                      uint64_t log_number, port::Mutex* mu,
+                                      ColumnFamilyData** result) {
+  const uint32_t id = static_cast<uint32_t>(column_families_.size());
+  ColumnFamilyData* cfd =
+      new ColumnFamilyData(id, name, dbname_, *options_, options);
+
+  VersionEdit edit;
+  edit.SetColumnFamily(id);
+  edit.AddColumnFamily(name);
+  edit.SetComparatorName(cfd->user_comparator()->Name());
+  edit.SetLogNumber(log_number);
+  Status s = LogAndApply(cfd, &edit, mu);
+  if (s.ok()) {
+    column_families_.push_back(cfd);
+    *result = cfd;
+  } else {
+    delete cfd;
+  }
+  return s;
+}
+
+Status VersionSet::Recover(
+    const std::map<std::string, Options>& column_family_options,
+    bool* save_manifest) {
   struct LogReporter : public log::Reader::Reporter {
     Status* status;
     void Corruption(size_t bytes, const Status& s) override {
@@ -918,9 +1237,11 @@ Status VersionSet::Recover(bool* save_manifest) {
   bool have_last_sequence = false;
   uint64_t next_file = 0;
   uint64_t last_sequence = 0;
-  uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+  // One builder per column family, indexed by column family id.
+  std::vector<Builder*> builders;
+  ColumnFamilyData* default_cfd = column_families_[0];
+  builders.push_back(new Builder(default_cfd, default_cfd->current_));
 
   {
     LogReporter reporter;
@@ -932,22 +1253,48 @@ Status VersionSet::Recover(bool* save_manifest) {
     while (reader.ReadRecord(&record, &scratch) && s.ok()) {
       VersionEdit edit;
       s = edit.DecodeFrom(record);
+      if (s.ok() && edit.is_column_family_add_) {
+        std::map<std::string, Options>::const_iterator it =
+            column_family_options.find(edit.column_family_name_);
+        if (edit.column_family_ != column_families_.size()) {
+          s = Status::Corruption("bad column family id in descriptor",
+                                 edit.column_family_name_);
+        } else if (it == column_family_options.end()) {
+          s = Status::InvalidArgument(edit.column_family_name_,
+                                      "column family not opened");
+        } else {
+          ColumnFamilyData* cfd = new ColumnFamilyData(
+              edit.column_family_, edit.column_family_name_, dbname_,
+              *options_, it->second);
+          column_families_.push_back(cfd);
+          builders.push_back(new Builder(cfd, cfd->current_));
+        }
+      }
+
+      ColumnFamilyData* cfd = nullptr;
+      if (s.ok()) {
+        cfd = GetColumnFamily(edit.column_family_);
+        if (cfd == nullptr) {
+          s = Status::Corruption("unknown column family in descriptor");
+        }
+      }
+
       if (s.ok()) {
         if (edit.has_comparator_ &&
-            edit.comparator_ != icmp_.user_comparator()->Name()) {
+            edit.comparator_ != cfd->user_comparator()->Name()) {
           s = Status::InvalidArgument(
               edit.comparator_ + " does not match existing comparator ",
-              icmp_.user_comparator()->Name());
+              cfd->user_comparator()->Name());
         }
       }
 
       if (s.ok()) {
-        builder.Apply(&edit);
+        builders[cfd->id_]->Apply(&edit);
       }
 
-      if (edit.has_log_number_) {
-        log_number = edit.log_number_;
-        have_log_number = true;
+      if (edit.has_log_number_ && cfd != nullptr) {
+        cfd->log_number_ = edit.log_number_;
+        have_log_number |= (cfd->id_ == 0);
       }
 
       if (edit.has_prev_log_number_) {
@@ -961,7 +1308,9 @@ Status VersionSet::Recover(bool* save_manifest) {
       }
 
       if (edit.has_last_sequence_) {
-        last_sequence = edit.last_sequence_;
+        // Edits logged concurrently with an ingestion may record an older
+        // sequence number after it.
+        last_sequence = std::max(last_sequence, edit.last_sequence_);
         have_last_sequence = true;
       }
     }
@@ -983,19 +1332,22 @@ Status VersionSet::Recover(bool* save_manifest) {
     }
 
     MarkFileNumberUsed(prev_log_number);
-    MarkFileNumberUsed(log_number);
+    for (ColumnFamilyData* cfd : column_families_) {
+      MarkFileNumberUsed(cfd->log_number_);
+    }
   }
 
   if (s.ok()) {
-    Version* v = new Version(this);
-    builder.SaveTo(v);
-    // Install recovered version
-    Finalize(v);
-    AppendVersion(v);
+    // Install recovered versions
+    for (ColumnFamilyData* cfd : column_families_) {
+      Version* v = new Version(cfd);
+      builders[cfd->id_]->SaveTo(v);
+      Finalize(v);
+      cfd->AppendVersion(v);
+    }
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
-    log_number_ = log_number;
+    SetLastSequence(last_sequence);
     prev_log_number_ = prev_log_number;
 
     // See if we can reuse the existing MANIFEST file.
@@ -1006,6 +1358,9 @@ Status VersionSet::Recover(bool* save_manifest) {
     }
   }
 
+  for (Builder* builder : builders) {
+    delete builder;
+  }
   return s;
 }
 
@@ -1052,28 +1407,7 @@ void VersionSet::Finalize(Version* v) {
   double best_score = -1;
 
   for (int level = 0; level < config::kNumLevels - 1; level++) {
-    double score;
-    if (level == 0) {
-      // We treat level-0 specially by bounding the number of files
-      // instead of number of bytes for two reasons:
-      //
-      // (1) With larger write-buffer sizes, it is nice not to do too
-      // many level-0 compactions.
-      //
-      // (2) The files in level-0 are merged on every read and
-      // therefore we wish to avoid too many files when the individual
-      // file size is small (perhaps because of a small write-buffer
-      // setting, or very high compression ratios, or lots of
-      // overwrites/deletions).
-      score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
-    } else {
-      // Compute the ratio of current size to size limit.
-      const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
-    }
-
+    const double score = LevelScore(v, level);
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1084,62 +1418,116 @@ void VersionSet::Finalize(Version* v) {
   v->compaction_score_ = best_score;
 }
 
+double VersionSet::LevelScore(const Version* v, int level) const {
+  if (level == 0) {
+    // We treat level-0 specially by bounding the number of files
+    // instead of number of bytes for two reasons:
+    //
+    // (1) With larger write-buffer sizes, it is nice not to do too
+    // many level-0 compactions.
+    //
+    // (2) The files in level-0 are merged on every read and
+    // therefore we wish to avoid too many files when the individual
+    // file size is small (perhaps because of a small write-buffer
+    // setting, or very high compression ratios, or lots of
+    // overwrites/deletions).
+    return v->files_[level].size() /
+           static_cast<double>(config::kL0_CompactionTrigger);
+  } else {
+    // Compute the ratio of current size to size limit.
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+    return static_cast<double>(level_bytes) /
+           MaxBytesForLevel(&v->cfd_->options_, level);
+  }
+}
+
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
 
-  // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  // One record per column family, in id order so that recovery sees the
+  // families in the order they were created.
+  for (ColumnFamilyData* cfd : column_families_) {
+    // Save metadata
+    VersionEdit edit;
+    edit.SetColumnFamily(cfd->id_);
+    if (cfd->id_ != 0) {
+      edit.AddColumnFamily(cfd->name_);
+    }
+    edit.SetComparatorName(cfd->user_comparator()->Name());
+    edit.SetLogNumber(cfd->log_number_);
 
-  // Save compaction pointers
-  for (int level = 0; level < config::kNumLevels; level++) {
-    if (!compact_pointer_[level].empty()) {
-      InternalKey key;
-      key.DecodeFrom(compact_pointer_[level]);
-      edit.SetCompactPointer(level, key);
+    // Save compaction pointers
+    for (int level = 0; level < config::kNumLevels; level++) {
+      if (!cfd->compact_pointer_[level].empty()) {
+        InternalKey key;
+        key.DecodeFrom(cfd->compact_pointer_[level]);
+        edit.SetCompactPointer(level, key);
+      }
     }
-  }
 
-  // Save files
-  for (int level = 0; level < config::kNumLevels; level++) {
-    const std::vector<FileMetaData*>& files = current_->files_[level];
-    for (size_t i = 0; i < files.size(); i++) {
-      const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+    // Save files
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const std::vector<FileMetaData*>& files = cfd->current_->files_[level];
+      for (size_t i = 0; i < files.size(); i++) {
+        const FileMetaData* f = files[i];
+        edit.AddFile(level, *f);
+      }
     }
-  }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+    std::string record;
+    edit.EncodeTo(&record);
+    Status s = log->AddRecord(record);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
 }
 
 int VersionSet::NumLevelFiles(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
-  return current_->files_[level].size();
+  return current()->files_[level].size();
 }
 
-const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
+const char* VersionSet::LevelSummary(const ColumnFamilyData* cfd,
+                                     LevelSummaryStorage* scratch) const {
   // Update code if kNumLevels changes
   static_assert(config::kNumLevels == 7, "");
+  const Version* current = cfd->current_;
   snprintf(scratch->buffer, sizeof(scratch->buffer),
-           "files[ %d %d %d %d %d %d %d ]", int(current_->files_[0].size()),
-           int(current_->files_[1].size()), int(current_->files_[2].size()),
-           int(current_->files_[3].size()), int(current_->files_[4].size()),
-           int(current_->files_[5].size()), int(current_->files_[6].size()));
+           "files[ %d %d %d %d %d %d %d ]", int(current->files_[0].size()),
+           int(current->files_[1].size()), int(current->files_[2].size()),
+           int(current->files_[3].size()), int(current->files_[4].size()),
+           int(current->files_[5].size()), int(current->files_[6].size()));
   return scratch->buffer;
 }
 
+// Return the approximate offset of "ikey" within the table "f".
+static uint64_t ApproximateOffsetInFile(TableCache* table_cache,
+                                        const FileMetaData* f,
+                                        const InternalKey& ikey) {
+  uint64_t result = 0;
+  Table* tableptr;
+  Iterator* iter = table_cache->NewIterator(ReadOptions(), f->number,
+                                            f->file_size, &tableptr);
+  if (tableptr != nullptr) {
+    result = tableptr->ApproximateOffsetOf(ikey.Encode());
+  }
+  delete iter;
+  return result;
+}
+
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
+  const InternalKeyComparator& icmp = v->cfd_->icmp_;
   uint64_t result = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
-      if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
+      if (icmp.Compare(files[i]->largest, ikey) <= 0) {
         // Entire file is before "ikey", so just add the file size
         result += files[i]->file_size;
-      } else if (icmp_.Compare(files[i]->smallest, ikey) > 0) {
+      } else if (icmp.Compare(files[i]->smallest, ikey) > 0) {
         // Entire file is after "ikey", so ignore
         if (level > 0) {
           // Files other than level 0 are sorted by meta->smallest, so
@@ -1150,13 +1538,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
       } else {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
-        Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
-        if (tableptr != nullptr) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
-        }
-        delete iter;
+        result += ApproximateOffsetInFile(v->cfd_->table_cache_, files[i],
+                                          ikey);
       }
     }
   }
@@ -1164,31 +1547,45 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
 }
 
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
-  for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
-       v = v->next_) {
-    for (int level = 0; level < config::kNumLevels; level++) {
-      const std::vector<FileMetaData*>& files = v->files_[level];
-      for (size_t i = 0; i < files.size(); i++) {
-        live->insert(files[i]->number);
+  for (ColumnFamilyData* cfd : column_families_) {
+    for (Version* v = cfd->dummy_versions_.next_; v != &cfd->dummy_versions_;
+         v = v->next_) {
+      for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& files = v->files_[level];
+        for (size_t i = 0; i < files.size(); i++) {
+          live->insert(files[i]->number);
+        }
       }
     }
   }
 }
 
-int64_t VersionSet::NumLevelBytes(int level) const {
+int64_t VersionSet::NumLevelBytes(const ColumnFamilyData* cfd,
+                                  int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
-  return TotalFileSize(current_->files_[level]);
+  return TotalFileSize(cfd->current_->files_[level]);
+}
+
+bool VersionSet::NeedsCompaction() const {
+  for (ColumnFamilyData* cfd : column_families_) {
+    Version* v = cfd->current_;
+    if (v->compaction_score_ >= 1 ||
+        v->file_to_compact_.load(std::memory_order_relaxed) != nullptr) {
+      return true;
+    }
+  }
+  return false;
 }
 
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
+  Version* v = current();
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
   for (int level = 1; level < config::kNumLevels - 1; level++) {
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      const FileMetaData* f = current_->files_[level][i];
-      current_->GetOverlappingInputs(level + 1, &f->smallest, &f->largest,
-                                     &overlaps);
+    for (size_t i = 0; i < v->files_[level].size(); i++) {
+      const FileMetaData* f = v->files_[level][i];
+      v->GetOverlappingInputs(level + 1, &f->smallest, &f->largest, &overlaps);
       const int64_t sum = TotalFileSize(overlaps);
       if (sum > result) {
         result = sum;
@@ -1201,7 +1598,8 @@ int64_t VersionSet::MaxNextLevelOverlappingBytes() {
 // Stores the minimal range that covers all entries in inputs in
 // *smallest, *largest.
 // REQUIRES: inputs is not empty
-void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
+void VersionSet::GetRange(const InternalKeyComparator& icmp,
+                          const std::vector<FileMetaData*>& inputs,
                           InternalKey* smallest, InternalKey* largest) {
   assert(!inputs.empty());
   smallest->Clear();
@@ -1212,10 +1610,10 @@ void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
       *smallest = f->smallest;
       *largest = f->largest;
     } else {
-      if (icmp_.Compare(f->smallest, *smallest) < 0) {
+      if (icmp.Compare(f->smallest, *smallest) < 0) {
         *smallest = f->smallest;
       }
-      if (icmp_.Compare(f->largest, *largest) > 0) {
+      if (icmp.Compare(f->largest, *largest) > 0) {
         *largest = f->largest;
       }
     }
@@ -1225,18 +1623,64 @@ void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
 // Stores the minimal range that covers all entries in inputs1 and inputs2
 // in *smallest, *largest.
 // REQUIRES: inputs is not empty
-void VersionSet::GetRange2(const std::vector<FileMetaData*>& inputs1,
+void VersionSet::GetRange2(const InternalKeyComparator& icmp,
+                           const std::vector<FileMetaData*>& inputs1,
                            const std::vector<FileMetaData*>& inputs2,
                            InternalKey* smallest, InternalKey* largest) {
   std::vector<FileMetaData*> all = inputs1;
   all.insert(all.end(), inputs2.begin(), inputs2.end());
-  GetRange(all, smallest, largest);
+  GetRange(icmp, all, smallest, largest);
+}
+
+Status VersionSet::AddCompactionTombstones(Compaction* c,
+                                           RangeDelAggregator* range_del) {
+  ColumnFamilyData* cfd = c->column_family();
+  const Comparator* ucmp = cfd->user_comparator();
+  Status s;
+  for (size_t i = 0; i < c->inputs_[0].size() && s.ok(); i++) {
+    s = AddFileTombstones(cfd->table_cache_, c->inputs_[0][i], range_del);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  // By the level invariant, every entry of a file at level+1 in the range
+  // of a tombstone at level is older than the tombstone.
+  std::vector<std::pair<std::string, InternalKey>> ranges;  // (begin, limit)
+  for (const RangeTombstone& t : range_del->tombstones()) {
+    if (t.seq <= range_del->snapshot()) {
+      ranges.emplace_back(t.begin,
+                          InternalKey(t.end, kMaxSequenceNumber,
+                                      kTypeRangeDeletion));
+    }
+  }
+  std::vector<FileMetaData*> remaining;
+  for (FileMetaData* f : c->inputs_[1]) {
+    bool covered = false;
+    for (size_t i = 0; i < ranges.size() && !covered; i++) {
+      covered = ucmp->Compare(f->smallest.user_key(), ranges[i].first) >= 0 &&
+                cfd->icmp_.Compare(f->largest, ranges[i].second) <= 0;
+    }
+    if (covered) {
+      c->covered_.push_back(f);
+    } else {
+      remaining.push_back(f);
+      s = AddFileTombstones(cfd->table_cache_, f, range_del);
+      if (!s.ok()) {
+        break;
+      }
+    }
+  }
+  c->inputs_[1].swap(remaining);
+  return s;
 }
 
 Iterator* VersionSet::MakeInputIterator(Compaction* c) {
+  ColumnFamilyData* cfd = c->column_family();
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.rate_limited = true;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1249,77 +1693,280 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = cfd->table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size, nullptr,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(cfd->icmp_, &c->inputs_[which]),
+            &GetFileIterator, cfd->table_cache_, options, &cfd->icmp_);
       }
     }
   }
   assert(num <= space);
-  Iterator* result = NewMergingIterator(&icmp_, list, num);
+  Iterator* result = NewMergingIterator(&cfd->icmp_, list, num);
   delete[] list;
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+void VersionSet::GetSubcompactionBoundaries(
+    Compaction* c, int max_subcompactions,
+    std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  ColumnFamilyData* cfd = c->column_family();
+  const Comparator* ucmp = cfd->user_comparator();
+  const InternalKeyComparator& icmp = cfd->internal_comparator();
 
-  // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  // Every input file begins and ends at a candidate split point.
+  std::vector<Slice> keys;
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      keys.push_back(f->smallest.user_key());
+      keys.push_back(f->largest.user_key());
+    }
+  }
+  std::sort(keys.begin(), keys.end(), [ucmp](const Slice& a, const Slice& b) {
+    return ucmp->Compare(a, b) < 0;
+  });
+  keys.erase(std::unique(keys.begin(), keys.end(),
+                         [ucmp](const Slice& a, const Slice& b) {
+                           return ucmp->Compare(a, b) == 0;
+                         }),
+             keys.end());
+  if (max_subcompactions <= 1 || keys.size() < 3) {
+    return;
+  }
+
+  // offsets[i] is the amount of input data before keys[i].
+  std::vector<uint64_t> offsets(keys.size(), 0);
+  for (size_t i = 0; i < keys.size(); i++) {
+    InternalKey ikey(keys[i], kMaxSequenceNumber, kValueTypeForSeek);
+    for (int which = 0; which < 2; which++) {
+      for (FileMetaData* f : c->inputs_[which]) {
+        if (icmp.Compare(f->largest, ikey) <= 0) {
+          offsets[i] += f->file_size;
+        } else if (icmp.Compare(f->smallest, ikey) < 0) {
+          offsets[i] += ApproximateOffsetInFile(cfd->table_cache(), f, ikey);
+        }
+      }
+    }
+  }
+
+  // Split at the first key past each multiple of the share of data of
+  // one subcompaction.  The first and last keys bound the whole range,
+  // so they never split it.
+  const uint64_t total = offsets.back();
+  const uint64_t share = total / max_subcompactions;
+  if (share == 0) {
+    return;
+  }
+  uint64_t next = share;
+  for (size_t i = 1; i + 1 < keys.size(); i++) {
+    if (offsets[i] >= next) {
+      boundaries->push_back(keys[i].ToString());
+      if (static_cast<int>(boundaries->size()) + 1 >= max_subcompactions) {
         break;
       }
+      next = (offsets[i] / share + 1) * share;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+}
+
+Compaction* VersionSet::PickCompaction() {
+  // We prefer compactions triggered by too much data in a level over
+  // the compactions triggered by seeks.  The levels that need a size
+  // compaction are tried from the highest score down, since the best
+  // one may conflict with the compactions that are already running.
+  struct Candidate {
+    double score;
+    ColumnFamilyData* cfd;
+    int level;
+  };
+  std::vector<Candidate> candidates;
+  for (ColumnFamilyData* cfd : column_families_) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      const double score = LevelScore(cfd->current_, level);
+      if (score >= 1) {
+        candidates.push_back(Candidate{score, cfd, level});
+      }
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate& a, const Candidate& b) {
+                     return a.score > b.score;
+                   });
+  for (const Candidate& candidate : candidates) {
+    Compaction* c = PickSizeCompaction(candidate.cfd, candidate.level);
+    if (c != nullptr) {
+      return c;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
-  c->input_version_ = current_;
+  for (ColumnFamilyData* cfd : column_families_) {
+    Version* current = cfd->current_;
+    FileMetaData* f =
+        current->file_to_compact_.load(std::memory_order_relaxed);
+    if (f != nullptr && !f->being_compacted) {
+      Compaction* c =
+          CompactionForFile(cfd, current->file_to_compact_level_, f);
+      if (ReserveCompaction(c)) {
+        return c;
+      }
+      delete c;
+    }
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::PickSizeCompaction(ColumnFamilyData* cfd, int level) {
+  const std::vector<FileMetaData*>& files = cfd->current_->files_[level];
+  const InternalKeyComparator& icmp = cfd->icmp_;
+
+  // Start with the first file that comes after compact_pointer_[level],
+  // wrapping around to the beginning of the key space.
+  size_t start = 0;
+  if (!cfd->compact_pointer_[level].empty()) {
+    while (start < files.size() &&
+           icmp.Compare(files[start]->largest.Encode(),
+                        cfd->compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    if (start == files.size()) {
+      start = 0;
+    }
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    // SetupOtherInputs() advances the compact pointer, which must not
+    // move past a file that is not compacted after all.
+    const std::string compact_pointer = cfd->compact_pointer_[level];
+    Compaction* c = CompactionForFile(cfd, level, f);
+    if (ReserveCompaction(c)) {
+      return c;
+    }
+    delete c;
+    cfd->compact_pointer_[level] = compact_pointer;
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::CompactionForFile(ColumnFamilyData* cfd, int level,
+                                          FileMetaData* f) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Version* current = cfd->current_;
+  Compaction* c = new Compaction(&cfd->options_, level);
+  c->inputs_[0].push_back(f);
+  c->cfd_ = cfd;
+  c->input_version_ = current;
   c->input_version_->Ref();
+  c->edit_.SetColumnFamily(cfd->id_);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
     InternalKey smallest, largest;
-    GetRange(c->inputs_[0], &smallest, &largest);
+    GetRange(cfd->icmp_, c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
     // c->inputs_[0] earlier and replace it with an overlapping set
     // which will include the picked file.
-    current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+    current->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
     assert(!c->inputs_[0].empty());
   }
 
   SetupOtherInputs(c);
-
   return c;
 }
 
+bool VersionSet::OutputRangeReserved(const ColumnFamilyData* cfd, int level,
+                                     const Slice& smallest_user_key,
+                                     const Slice& largest_user_key) {
+  const Comparator* ucmp = cfd->user_comparator();
+  auto overlaps = [&](const InternalKey& smallest, const InternalKey& largest) {
+    return ucmp->Compare(smallest_user_key, largest.user_key()) <= 0 &&
+           ucmp->Compare(smallest.user_key(), largest_user_key) <= 0;
+  };
+  for (const Compaction* c : cfd->running_compactions_) {
+    if (c->level() + 1 == level && overlaps(c->smallest_, c->largest_)) {
+      return true;
+    }
+  }
+  for (const auto& ingested : cfd->ingested_files_) {
+    if (level <= ingested.first &&
+        overlaps(ingested.second.smallest, ingested.second.largest)) {
+      return true;
+    }
+  }
+  return cfd->flush_level_ == level &&
+         overlaps(cfd->flush_smallest_, cfd->flush_largest_);
+}
+
+bool VersionSet::ReserveCompaction(Compaction* c) {
+  ColumnFamilyData* cfd = c->column_family();
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      if (f->being_compacted) {
+        return false;
+      }
+    }
+  }
+  // Two compactions whose inputs are disjoint may still write to
+  // overlapping key ranges of the same level, e.g. when one range spans
+  // a gap in the level in which the other one moves a file.
+  if (OutputRangeReserved(cfd, c->level() + 1, c->smallest_.user_key(),
+                          c->largest_.user_key())) {
+    return false;
+  }
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = true;
+    }
+  }
+  cfd->running_compactions_.push_back(c);
+  return true;
+}
+
+void VersionSet::ReleaseCompaction(Compaction* c) {
+  ColumnFamilyData* cfd = c->column_family();
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = false;
+    }
+  }
+  for (FileMetaData* f : c->covered_) {
+    f->being_compacted = false;
+  }
+  std::vector<Compaction*>& running = cfd->running_compactions_;
+  running.erase(std::find(running.begin(), running.end(), c));
+}
+
+void VersionSet::ReserveMemTableOutput(ColumnFamilyData* cfd, int level,
+                                       const InternalKey& smallest,
+                                       const InternalKey& largest) {
+  assert(level > 0);
+  assert(cfd->flush_level_ < 0);
+  cfd->flush_level_ = level;
+  cfd->flush_smallest_ = smallest;
+  cfd->flush_largest_ = largest;
+}
+
+void VersionSet::ReleaseMemTableOutput(ColumnFamilyData* cfd) {
+  cfd->flush_level_ = -1;
+}
+
+void VersionSet::ReserveIngestedFile(ColumnFamilyData* cfd, int level,
+                                     const FileMetaData& f) {
+  cfd->ingested_files_.push_back(std::make_pair(level, f));
+}
+
+void VersionSet::ReleaseIngestedFiles(ColumnFamilyData* cfd) {
+  cfd->ingested_files_.clear();
+}
+
 // Finds the largest key in a vector of files. Returns true if files it not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1400,35 +2047,38 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
 }
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
+  ColumnFamilyData* cfd = c->column_family();
+  Version* current = cfd->current_;
+  const InternalKeyComparator& icmp = cfd->icmp_;
   const int level = c->level();
   InternalKey smallest, largest;
 
-  AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
-  GetRange(c->inputs_[0], &smallest, &largest);
+  AddBoundaryInputs(icmp, current->files_[level], &c->inputs_[0]);
+  GetRange(icmp, c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+  current->GetOverlappingInputs(level + 1, &smallest, &largest,
                                  &c->inputs_[1]);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
-  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  GetRange2(icmp, c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
   // changing the number of "level+1" files we pick up.
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
-    current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
-    AddBoundaryInputs(icmp_, current_->files_[level], &expanded0);
+    current->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
+    AddBoundaryInputs(icmp, current->files_[level], &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(&cfd->options_)) {
       InternalKey new_start, new_limit;
-      GetRange(expanded0, &new_start, &new_limit);
+      GetRange(icmp, expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+      current->GetOverlappingInputs(level + 1, &new_start, &new_limit,
                                      &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
@@ -1440,15 +2090,19 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
         largest = new_limit;
         c->inputs_[0] = expanded0;
         c->inputs_[1] = expanded1;
-        GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+        GetRange2(icmp, c->inputs_[0], c->inputs_[1], &all_start,
+                  &all_limit);
       }
     }
   }
 
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+    current->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
@@ -1456,14 +2110,15 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // We update this immediately instead of waiting for the VersionEdit
   // to be applied so that if the compaction fails, we will try a different
   // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
+  cfd->compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
 }
 
-Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
+Compaction* VersionSet::CompactRange(ColumnFamilyData* cfd, int level,
+                                     const InternalKey* begin,
                                      const InternalKey* end) {
   std::vector<FileMetaData*> inputs;
-  current_->GetOverlappingInputs(level, begin, end, &inputs);
+  cfd->current_->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
     return nullptr;
   }
@@ -1473,7 +2128,7 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   // and we must not pick one file and drop another older file if the
   // two files overlap.
   if (level > 0) {
-    const uint64_t limit = MaxFileSizeForLevel(options_, level);
+    const uint64_t limit = MaxFileSizeForLevel(&cfd->options_, level);
     uint64_t total = 0;
     for (size_t i = 0; i < inputs.size(); i++) {
       uint64_t s = inputs[i]->file_size;
@@ -1485,9 +2140,11 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
     }
   }
 
-  Compaction* c = new Compaction(options_, level);
-  c->input_version_ = current_;
+  Compaction* c = new Compaction(&cfd->options_, level);
+  c->cfd_ = cfd;
+  c->input_version_ = cfd->current_;
   c->input_version_->Ref();
+  c->edit_.SetColumnFamily(cfd->id_);
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
   return c;
@@ -1496,12 +2153,13 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      cfd_(nullptr),
+      input_version_(nullptr) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
@@ -1512,13 +2170,13 @@ Compaction::~Compaction() {
 }
 
 bool Compaction::IsTrivialMove() const {
-  const VersionSet* vset = input_version_->vset_;
+  const ColumnFamilyData* cfd = column_family();
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
   return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
-              MaxGrandParentOverlapBytes(vset->options_));
+              MaxGrandParentOverlapBytes(&cfd->options()));
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
@@ -1527,15 +2185,19 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (size_t i = 0; i < covered_.size(); i++) {
+    edit->RemoveFile(level_ + 1, covered_[i]->number);
+  }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) {
   // Maybe use binary search to find right entry instead of linear search?
-  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  const Comparator* user_cmp = column_family()->user_comparator();
+  size_t* const level_ptrs = cursor->level_ptrs;
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1544,30 +2206,41 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      level_ptrs[lvl]++;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
-  const VersionSet* vset = input_version_->vset_;
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) {
+  const ColumnFamilyData* cfd = column_family();
   // Scan to find earliest grandparent file that contains key.
-  const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  const InternalKeyComparator* icmp = &cfd->internal_comparator();
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(&cfd->options())) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
@@ -6,8 +6,9 @@
 // newest version is called "current".  Older versions may be kept
 // around to provide a consistent view to live iterators.
 //
-// Each Version keeps track of a set of Table files per level.  The
-// entire set of versions is maintained in a VersionSet.
+// Each Version keeps track of a set of Table files per level of one
+// column family.  The versions of all column families are maintained in
+// a VersionSet, which also owns the MANIFEST they are recorded in.
 //
 // Version,VersionSet are thread-compatible, but require external
 // synchronization on all accesses.
@@ -15,6 +16,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -30,9 +32,12 @@ namespace log {
 class Writer;
 }
 
+class ColumnFamilyData;
 class Compaction;
 class Iterator;
+struct LookupTrace;
 class MemTable;
+class RangeDelAggregator;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -65,27 +70,56 @@ class Version {
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
-    Status s;
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  The
+  // iterate bounds in the options, if any, are internal keys.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of the files of this Version to *range_del.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  Status AddRangeTombstones(RangeDelAggregator* range_del);
+
+  // If "trace" is non-null, record in *trace the entry that matched and
+  // the work done to find it.
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, LookupTrace* trace = nullptr);
+
+  // A key looked up by MultiGet() and where to store its result.
+  struct MultiGetKey {
+    const LookupKey* key;
+    std::string* value;
+    Status* status;
+  };
 
-  // Adds "stats" into the current state.  Returns true if a new
-  // compaction may need to be triggered, false otherwise.
+  // Look up each of "keys" as Get() does, storing the value and status
+  // of each key through its pointers.  The keys that fall in the same
+  // table are looked up together.  Fills *stats.
+  // REQUIRES: keys are sorted by user key
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<MultiGetKey>& keys,
+                GetStats* stats);
+
+  // Charge the seek recorded in "stats", if any, to its file.  Returns
+  // true if the file has run out of allowed seeks and this version has no
+  // seek compaction yet, in which case the caller should pass "stats" to
+  // UpdateStats().  Reads charge their seeks without the DB mutex and only
+  // take it on the rare exhausted file.
+  bool ChargeSeek(const GetStats& stats);
+
+  // Make the exhausted file of "stats" the next seek compaction of this
+  // version unless it already has one.  Returns true if a new compaction
+  // may need to be triggered, false otherwise.
   // REQUIRES: lock is held
   bool UpdateStats(const GetStats& stats);
 
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.  Returns true if a new compaction may need to be triggered.
-  // REQUIRES: lock is held
-  bool RecordReadSample(Slice key);
+  // bytes.  Returns true if the caller should pass *stats to
+  // UpdateStats(), as for ChargeSeek().
+  bool RecordReadSample(Slice key, GetStats* stats);
 
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
@@ -110,19 +144,30 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the deepest level at which a table ingested with a sequence
+  // number newer than all the keys of this version may be placed if it
+  // covers the range [smallest_user_key,largest_user_key].
+  int PickLevelForIngestedFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // The highest ratio of a level's size to its target, as computed by
+  // VersionSet::Finalize().  A score of 1 or more calls for a compaction.
+  double compaction_score() const { return compaction_score_; }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
  private:
+  friend class ColumnFamilyData;
   friend class Compaction;
   friend class VersionSet;
 
   class LevelFileNumIterator;
 
-  explicit Version(VersionSet* vset)
-      : vset_(vset),
+  explicit Version(ColumnFamilyData* cfd)
+      : cfd_(cfd),
         next_(this),
         prev_(this),
         refs_(0),
@@ -146,16 +191,17 @@ class Version {
   void ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
-  VersionSet* vset_;  // VersionSet to which this Version belongs
-  Version* next_;     // Next version in linked list
-  Version* prev_;     // Previous version in linked list
-  int refs_;          // Number of live refs to this version
+  ColumnFamilyData* cfd_;  // Column family to which this Version belongs
+  Version* next_;          // Next version in linked list
+  Version* prev_;          // Previous version in linked list
+  int refs_;               // Number of live refs to this version
 
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
-  // Next file to compact based on seek stats.
-  FileMetaData* file_to_compact_;
+  // Next file to compact based on seek stats.  Written with the DB mutex
+  // held but read by ChargeSeek() without it.
+  std::atomic<FileMetaData*> file_to_compact_;
   int file_to_compact_level_;
 
   // Level that should be compacted next and its compaction score.
@@ -167,6 +213,7 @@ class Version {
 
 class VersionSet {
  public:
+  // "options" and "table_cache" describe the default column family.
   VersionSet(const std::string& dbname, const Options* options,
              TableCache* table_cache, const InternalKeyComparator*);
   VersionSet(const VersionSet&) = delete;
@@ -174,19 +221,47 @@ class VersionSet {
 
   ~VersionSet();
 
-  // Apply *edit to the current version to form a new descriptor that
-  // is both saved to persistent state and installed as the new
-  // current version.  Will release *mu while actually writing to the file.
+  // Apply *edit to the current version of the column family named by
+  // edit->column_family() to form a new descriptor that is both saved to
+  // persistent state and installed as the new current version of that
+  // family.  Will release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
   // REQUIRES: no other thread concurrently calls LogAndApply()
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
-  // Recover the last saved descriptor from persistent storage.
-  Status Recover(bool* save_manifest);
+  // Recover the last saved descriptor from persistent storage.  Column
+  // families other than the default one are opened with their entry in
+  // "column_family_options"; it is an error if a family has no entry.
+  Status Recover(const std::map<std::string, Options>& column_family_options,
+                 bool* save_manifest);
+
+  // Create a column family named "name" that stores its data according
+  // to "options" and record it in the MANIFEST.  "log_number" is the
+  // first log file that may hold updates for the new family.  On success
+  // stores the new family in *result.
+  // REQUIRES: Same as LogAndApply().
+  Status CreateColumnFamily(const std::string& name, const Options& options,
+                            uint64_t log_number, port::Mutex* mu,
+                            ColumnFamilyData** result)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  // Return the column family with the specified id or name, or nullptr
+  // if there is no such family.
+  ColumnFamilyData* GetColumnFamily(uint32_t id) const;
+  ColumnFamilyData* GetColumnFamily(const std::string& name) const;
 
-  // Return the current version.
-  Version* current() const { return current_; }
+  ColumnFamilyData* default_column_family() const {
+    return column_families_[0];
+  }
+
+  // All column families, indexed by id.
+  const std::vector<ColumnFamilyData*>& column_families() const {
+    return column_families_;
+  }
+
+  // Return the current version of the default column family.
+  Version* current() const;
 
   // Return the current manifest file number
   uint64_t ManifestFileNumber() const { return manifest_file_number_; }
@@ -203,60 +278,111 @@ class VersionSet {
     }
   }
 
-  // Return the number of Table files at the specified level.
+  // Return the number of Table files at the specified level of the
+  // default column family.
   int NumLevelFiles(int level) const;
 
-  // Return the combined file size of all files at the specified level.
-  int64_t NumLevelBytes(int level) const;
+  // Return the combined file size of all files at the specified level of
+  // the specified column family.
+  int64_t NumLevelBytes(const ColumnFamilyData* cfd, int level) const;
+  int64_t NumLevelBytes(int level) const {
+    return NumLevelBytes(default_column_family(), level);
+  }
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the last sequence number.  May be called without the DB mutex;
+  // all entries up to it are then visible in the memtables.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
   void MarkFileNumberUsed(uint64_t number);
 
-  // Return the current log file number.
-  uint64_t LogNumber() const { return log_number_; }
+  // Return the oldest log file number that any column family may still
+  // need to recover from.
+  uint64_t LogNumber() const;
 
   // Return the log file number for the log file that is currently
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
-  // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // Pick a column family, level and inputs for a new compaction that
+  // does not conflict with the running ones.  Returns nullptr if there
+  // is no such compaction to be done.  Otherwise returns a pointer to a
+  // heap-allocated object that describes the compaction, already
+  // reserved as by ReserveCompaction().  Caller should release the
+  // reservation and delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
-  // the specified level.  Returns nullptr if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
-  Compaction* CompactRange(int level, const InternalKey* begin,
-                           const InternalKey* end);
+  // the specified level of the specified column family.  Returns nullptr
+  // if there is nothing in that level that overlaps the specified range.
+  // The result is not reserved.  Caller should delete the result.
+  Compaction* CompactRange(ColumnFamilyData* cfd, int level,
+                           const InternalKey* begin, const InternalKey* end);
+
+  // Mark the inputs of "*c" as being compacted and reserve the key range
+  // its outputs cover at level c->level()+1, so that compactions picked
+  // while "*c" runs neither read its inputs nor write into that range.
+  // Returns false, and changes nothing, if "*c" conflicts with a running
+  // compaction or a memtable flush in progress.
+  bool ReserveCompaction(Compaction* c);
+
+  // Undo ReserveCompaction(c) once "*c" is installed or abandoned.
+  void ReleaseCompaction(Compaction* c);
+
+  // Reserve the key range [smallest,largest] of "level" of "cfd" for the
+  // table of a memtable flush until ReleaseMemTableOutput(cfd) is called
+  // once that table is installed or abandoned.  Only one flush of "cfd"
+  // may hold a reservation at a time.
+  // REQUIRES: level > 0
+  void ReserveMemTableOutput(ColumnFamilyData* cfd, int level,
+                             const InternalKey& smallest,
+                             const InternalKey& largest);
+  void ReleaseMemTableOutput(ColumnFamilyData* cfd);
+
+  // Reserve the key range of the ingested table "f" at "level" and every
+  // level above it until ReleaseIngestedFiles(cfd) is called once the
+  // ingestion is installed or abandoned.
+  void ReserveIngestedFile(ColumnFamilyData* cfd, int level,
+                           const FileMetaData& f);
+  void ReleaseIngestedFiles(ColumnFamilyData* cfd);
 
   // Return the maximum overlapping data (in bytes) at next level for any
-  // file at a level >= 1.
+  // file at a level >= 1 of the default column family.
   int64_t MaxNextLevelOverlappingBytes();
 
+  // Add the range tombstones of the compaction inputs for "*c" to
+  // *range_del.  The inputs at level c->level()+1 that lie entirely
+  // inside a tombstone of an input at c->level() visible at the snapshot
+  // of *range_del hold nothing that any reader can see; they are moved
+  // out of the inputs so that the compaction deletes them without
+  // reading them.
+  // REQUIRES: MakeInputIterator(c) has not been called yet
+  Status AddCompactionTombstones(Compaction* c, RangeDelAggregator* range_del);
+
   // Create an iterator that reads over the compaction inputs for "*c".
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
-  // Returns true iff some level needs a compaction.
-  bool NeedsCompaction() const {
-    Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
-  }
+  // Store in *boundaries up to max_subcompactions-1 sorted user keys that
+  // split the key range of "*c" into parts holding roughly the same
+  // amount of input data.  The split points are taken from the bounds of
+  // the input files.  Leaves *boundaries empty if "*c" cannot be split.
+  void GetSubcompactionBoundaries(Compaction* c, int max_subcompactions,
+                                  std::vector<std::string>* boundaries);
+
+  // Returns true iff some level of some column family needs a compaction.
+  bool NeedsCompaction() const;
 
-  // Add all files listed in any live version to *live.
-  // May also mutate some internal state.
+  // Add all files listed in any live version of any column family to
+  // *live.  May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
   // Return the approximate offset in the database of the data for
@@ -264,11 +390,15 @@ class VersionSet {
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
   // Return a human-readable short (single-line) summary of the number
-  // of files per level.  Uses *scratch as backing store.
+  // of files per level of "cfd".  Uses *scratch as backing store.
   struct LevelSummaryStorage {
     char buffer[100];
   };
-  const char* LevelSummary(LevelSummaryStorage* scratch) const;
+  const char* LevelSummary(const ColumnFamilyData* cfd,
+                           LevelSummaryStorage* scratch) const;
+  const char* LevelSummary(LevelSummaryStorage* scratch) const {
+    return LevelSummary(default_column_family(), scratch);
+  }
 
  private:
   class Builder;
@@ -276,44 +406,63 @@ class VersionSet {
   friend class Compaction;
   friend class Version;
 
+  // Apply *edit to "cfd", which need not be registered yet.
+  Status LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit, port::Mutex* mu)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
 
   void Finalize(Version* v);
 
-  void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
+  // Return the compaction score of "level" in "v".  Score >= 1 means the
+  // level needs a compaction.
+  double LevelScore(const Version* v, int level) const;
+
+  // Returns true iff a running compaction, memtable flush or ingestion of
+  // "cfd" will add files to "level" that may overlap the user keys
+  // [smallest_user_key,largest_user_key].
+  static bool OutputRangeReserved(const ColumnFamilyData* cfd, int level,
+                                  const Slice& smallest_user_key,
+                                  const Slice& largest_user_key);
+
+  // Return a compaction of "f" at "level" of "cfd" together with the
+  // files it must be merged with.  The result is not reserved.
+  Compaction* CompactionForFile(ColumnFamilyData* cfd, int level,
+                                FileMetaData* f);
+
+  // Return a reserved compaction of some file of "level" of "cfd", trying
+  // the files from compact_pointer_[level] on, or nullptr if each one
+  // conflicts with the running compactions.
+  Compaction* PickSizeCompaction(ColumnFamilyData* cfd, int level);
+
+  void GetRange(const InternalKeyComparator& icmp,
+                const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
-  void GetRange2(const std::vector<FileMetaData*>& inputs1,
+  void GetRange2(const InternalKeyComparator& icmp,
+                 const std::vector<FileMetaData*>& inputs1,
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
   void SetupOtherInputs(Compaction* c);
 
-  // Save current contents to *log
+  // Save current contents of all column families to *log
   Status WriteSnapshot(log::Writer* log);
 
-  void AppendVersion(Version* v);
-
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
-  TableCache* const table_cache_;
-  const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
-  uint64_t log_number_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
   // Opened lazily
   WritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
-  Version dummy_versions_;  // Head of circular doubly-linked list of versions.
-  Version* current_;        // == dummy_versions_.prev_
 
-  // Per-level key at which the next compaction at that level should start.
-  // Either an empty string, or a valid InternalKey.
-  std::string compact_pointer_[config::kNumLevels];
+  // Indexed by column family id; the default family has id 0.
+  std::vector<ColumnFamilyData*> column_families_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -335,6 +484,10 @@ class Compaction {
   // Return the ith input file at "level()+which" ("which" must be 0 or 1).
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
+  // Number of files at "level()+1" that are deleted without being read
+  // because a range tombstone covers them.
+  int num_covered_files() const { return covered_.size(); }
+
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
@@ -345,19 +498,46 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // The position of a scan over the keys of the compaction, kept by
+  // ShouldStopBefore() and IsBaseLevelForKey().  A compaction that is
+  // split into subcompactions keeps a cursor for each of them.  The keys
+  // passed with one cursor must be increasing.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor);
+
+  // Same as IsBaseLevelForKey(), but for the user keys in [begin,end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor);
 
   // Release the input version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
 
+  // Return the column family whose files are being compacted.
+  ColumnFamilyData* column_family() const { return cfd_; }
+
  private:
   friend class Version;
   friend class VersionSet;
@@ -366,27 +546,22 @@ class Compaction {
 
   int level_;
   uint64_t max_output_file_size_;
+  ColumnFamilyData* cfd_;
   Version* input_version_;
   VersionEdit edit_;
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files at level_+1 deleted without being read
+  std::vector<FileMetaData*> covered_;
+
+  // The key range spanned by the inputs, and so by the outputs
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Files at level_ + 2 that overlap the key range of the compaction
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
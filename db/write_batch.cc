@@ -8,7 +8,11 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeColumnFamilyValue varint32 varstring varstring |
+//    kTypeColumnFamilyDeletion varint32 varstring |
+//    kTypeColumnFamilyRangeDeletion varint32 varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -26,12 +30,54 @@ namespace leveldb {
 // WriteBatch header has an 8-byte sequence number followed by a 4-byte count.
 static const size_t kHeader = 12;
 
+// Record tags for updates to a column family other than the default one;
+// the tag is followed by the column family id.  They only appear in
+// WriteBatch contents, never in internal keys.
+enum ColumnFamilyRecordType {
+  kTypeColumnFamilyDeletion = 0x4,
+  kTypeColumnFamilyValue = 0x5,
+  kTypeColumnFamilyRangeDeletion = 0x6
+};
+
 WriteBatch::WriteBatch() { Clear(); }
 
 WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+Status WriteBatch::Handler::PutCF(uint32_t column_family_id, const Slice& key,
+                                  const Slice& value) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument(
+        "non-default column family and PutCF not implemented");
+  }
+  Put(key, value);
+  return Status::OK();
+}
+
+Status WriteBatch::Handler::DeleteCF(uint32_t column_family_id,
+                                     const Slice& key) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument(
+        "non-default column family and DeleteCF not implemented");
+  }
+  Delete(key);
+  return Status::OK();
+}
+
+Status WriteBatch::Handler::DeleteRangeCF(uint32_t column_family_id,
+                                          const Slice& begin,
+                                          const Slice& end) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument(
+        "non-default column family and DeleteRangeCF not implemented");
+  }
+  DeleteRange(begin, end);
+  return Status::OK();
+}
+
+ColumnFamilyMemTables::~ColumnFamilyMemTables() = default;
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -47,6 +93,8 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(kHeader);
   Slice key, value;
+  uint32_t column_family;
+  Status s;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -68,6 +116,49 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeColumnFamilyValue:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->PutCF(column_family, key, value);
+          if (!s.ok()) {
+            return s;
+          }
+        } else {
+          return Status::Corruption("bad WriteBatch Put");
+        }
+        break;
+      case kTypeColumnFamilyDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key)) {
+          s = handler->DeleteCF(column_family, key);
+          if (!s.ok()) {
+            return s;
+          }
+        } else {
+          return Status::Corruption("bad WriteBatch Delete");
+        }
+        break;
+      case kTypeColumnFamilyRangeDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->DeleteRangeCF(column_family, key, value);
+          if (!s.ok()) {
+            return s;
+          }
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,31 +199,125 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Put(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyValue));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Delete(key);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyDeletion));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const Slice& begin, const Slice& end) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    DeleteRange(begin, end);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyRangeDeletion));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 void WriteBatch::Append(const WriteBatch& source) {
   WriteBatchInternal::Append(this, &source);
 }
 
 namespace {
+// Routes every column family to a single memtable for the default family.
+class DefaultMemTable : public ColumnFamilyMemTables {
+ public:
+  explicit DefaultMemTable(MemTable* mem) : mem_(mem) {}
+
+  MemTable* GetMemTable(uint32_t column_family_id) override {
+    return (column_family_id == 0) ? mem_ : nullptr;
+  }
+
+ private:
+  MemTable* const mem_;
+};
+
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
-  MemTable* mem_;
+  ColumnFamilyMemTables* memtables_;
 
   void Put(const Slice& key, const Slice& value) override {
-    mem_->Add(sequence_, kTypeValue, key, value);
+    PutCF(0, key, value);
+  }
+  void Delete(const Slice& key) override { DeleteCF(0, key); }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    DeleteRangeCF(0, begin, end);
+  }
+
+  // Skipped records still consume a sequence number so that the numbers
+  // assigned to the remaining records do not depend on what was skipped.
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    MemTable* mem = memtables_->GetMemTable(column_family_id);
+    if (mem != nullptr) {
+      mem->Add(sequence_, kTypeValue, key, value);
+    }
+    sequence_++;
+    return Status::OK();
+  }
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    MemTable* mem = memtables_->GetMemTable(column_family_id);
+    if (mem != nullptr) {
+      mem->Add(sequence_, kTypeDeletion, key, Slice());
+    }
     sequence_++;
+    return Status::OK();
   }
-  void Delete(const Slice& key) override {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+  Status DeleteRangeCF(uint32_t column_family_id, const Slice& begin,
+                       const Slice& end) override {
+    MemTable* mem = memtables_->GetMemTable(column_family_id);
+    if (mem != nullptr) {
+      mem->Add(sequence_, kTypeRangeDeletion, begin, end);
+    }
     sequence_++;
+    return Status::OK();
   }
 };
 }  // namespace
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable) {
+  DefaultMemTable memtables(memtable);
+  return InsertInto(b, &memtables);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      ColumnFamilyMemTables* memtables) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
-  inserter.mem_ = memtable;
+  inserter.memtables_ = memtables;
   return b->Iterate(&inserter);
 }
 
@@ -12,6 +12,17 @@ namespace leveldb {
 
 class MemTable;
 
+// Maps the column family named by each WriteBatch record to the memtable
+// the record should be inserted into.
+class ColumnFamilyMemTables {
+ public:
+  virtual ~ColumnFamilyMemTables();
+
+  // Return the memtable for "column_family_id", or nullptr if updates to
+  // that column family should be skipped.
+  virtual MemTable* GetMemTable(uint32_t column_family_id) = 0;
+};
+
 // WriteBatchInternal provides static methods for manipulating a
 // WriteBatch that we don't want in the public WriteBatch interface.
 class WriteBatchInternal {
@@ -35,8 +46,13 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Insert the updates for the default column family into "memtable".
+  // Updates to other column families are skipped.
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  static Status InsertInto(const WriteBatch* batch,
+                           ColumnFamilyMemTables* memtables);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -8,6 +8,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "util/logging.h"
+#include "util/testutil.h"
 
 namespace leveldb {
 
@@ -37,11 +38,36 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeRangeDeletion:
+        // Range tombstones are not kept with the point entries.
+        state.append("Unexpected(");
+        state.append(ikey.user_key.ToString());
+        state.append(")");
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter->key(), &ikey) ||
+          ikey.type != kTypeRangeDeletion) {
+        ADD_FAILURE() << "bad range tombstone";
+        continue;
+      }
+      state.append("DeleteRange(");
+      state.append(ikey.user_key.ToString());
+      state.append(", ");
+      state.append(iter->value().ToString());
+      state.append(")@");
+      state.append(NumberToString(ikey.sequence));
+      count++;
+    }
+    delete iter;
+  }
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -72,6 +98,33 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("c"));
+  batch.Delete(Slice("box"));
+  batch.DeleteRange(Slice("x"), Slice("z"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(4, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Delete(box)@102"
+      "Put(foo, bar)@100"
+      "DeleteRange(a, c)@101"
+      "DeleteRange(x, z)@103",
+      PrintContents(&batch));
+
+  // A truncated end key is a parse error.
+  Slice contents = WriteBatchInternal::Contents(&batch);
+  WriteBatchInternal::SetContents(&batch,
+                                  Slice(contents.data(), contents.size() - 1));
+  ASSERT_EQ(
+      "Delete(box)@102"
+      "Put(foo, bar)@100"
+      "DeleteRange(a, c)@101"
+      "ParseError()",
+      PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -110,6 +163,85 @@ TEST(WriteBatchTest, Append) {
       "Put(b, vb)@201"
       "Delete(foo)@203",
       PrintContents(&b1));
+  b2.Clear();
+  b2.DeleteRange("c", "d");
+  b1.Append(b2);
+  ASSERT_EQ(5, WriteBatchInternal::Count(&b1));
+  ASSERT_EQ(
+      "Put(a, va)@200"
+      "Put(b, vb)@202"
+      "Put(b, vb)@201"
+      "Delete(foo)@203"
+      "DeleteRange(c, d)@204",
+      PrintContents(&b1));
+}
+
+namespace {
+
+class FakeColumnFamily : public ColumnFamilyHandle {
+ public:
+  explicit FakeColumnFamily(uint32_t id) : name_("family"), id_(id) {}
+
+  const std::string& GetName() const override { return name_; }
+  uint32_t GetID() const override { return id_; }
+
+ private:
+  const std::string name_;
+  const uint32_t id_;
+};
+
+// Knows nothing of column families.
+class DefaultFamilyRecorder : public WriteBatch::Handler {
+ public:
+  void Put(const Slice& key, const Slice& value) override {
+    log_ += "Put(" + key.ToString() + ")";
+  }
+  void Delete(const Slice& key) override {
+    log_ += "Delete(" + key.ToString() + ")";
+  }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    log_ += "DeleteRange(" + begin.ToString() + ")";
+  }
+
+  std::string log_;
+};
+
+}  // namespace
+
+TEST(WriteBatchTest, ColumnFamilyUpdatesNeedColumnFamilyHandler) {
+  FakeColumnFamily default_family(0);
+  FakeColumnFamily family(1);
+
+  // Updates of the default family reach the plain methods.
+  WriteBatch batch;
+  batch.Put(&default_family, "a", "va");
+  batch.Delete(&default_family, "b");
+  batch.DeleteRange(&default_family, "c", "d");
+  DefaultFamilyRecorder recorder;
+  ASSERT_LEVELDB_OK(batch.Iterate(&recorder));
+  ASSERT_EQ("Put(a)Delete(b)DeleteRange(c)", recorder.log_);
+
+  // An update of another family stops the iteration instead of being
+  // applied to the default family.
+  WriteBatch put_batch;
+  put_batch.Put("a", "va");
+  put_batch.Put(&family, "b", "vb");
+  put_batch.Put("c", "vc");
+  recorder.log_.clear();
+  ASSERT_TRUE(put_batch.Iterate(&recorder).IsInvalidArgument());
+  ASSERT_EQ("Put(a)", recorder.log_);
+
+  WriteBatch delete_batch;
+  delete_batch.Delete(&family, "b");
+  recorder.log_.clear();
+  ASSERT_TRUE(delete_batch.Iterate(&recorder).IsInvalidArgument());
+  ASSERT_EQ("", recorder.log_);
+
+  WriteBatch delete_range_batch;
+  delete_range_batch.DeleteRange(&family, "b", "c");
+  recorder.log_.clear();
+  ASSERT_TRUE(delete_range_batch.Iterate(&recorder).IsInvalidArgument());
+  ASSERT_EQ("", recorder.log_);
 }
 
 TEST(WriteBatchTest, ApproximateSize) {
@@ -127,6 +259,10 @@ TEST(WriteBatchTest, ApproximateSize) {
   batch.Delete(Slice("box"));
   size_t post_delete_size = batch.ApproximateSize();
   ASSERT_LT(two_keys_size, post_delete_size);
+
+  batch.DeleteRange(Slice("c"), Slice("d"));
+  size_t post_delete_range_size = batch.ApproximateSize();
+  ASSERT_LT(post_delete_size, post_delete_range_size);
 }
 
 }  // namespace leveldb
@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+// How much the rate changes each time the debt grows or shrinks.
+static const double kSlowdownRatio = 0.8;
+
+// Credit does not accumulate beyond this much time at the current rate,
+// so that a pause between writes does not allow a burst.
+static const uint64_t kMaxCreditMicros = 1000;
+
+const uint64_t WriteController::kMinDelayedWriteRate;
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : max_rate_(std::max(max_delayed_write_rate, kMinDelayedWriteRate)),
+      reason_(kNotDelayed),
+      last_score_(0),
+      base_rate_(max_rate_),
+      rate_(max_rate_),
+      credit_(0),
+      last_refill_micros_(0) {}
+
+void WriteController::Update(double compaction_score, int level0_files) {
+  DelayReason reason = kNotDelayed;
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    reason = kLevel0Slowdown;
+  } else if (compaction_score >= config::kSlowdownCompactionScore) {
+    reason = kCompactionDebt;
+  }
+
+  if (reason == kNotDelayed) {
+    reason_ = kNotDelayed;
+    last_score_ = compaction_score;
+    return;
+  }
+
+  if (reason_ == kNotDelayed) {
+    // Start delaying at the highest rate, with an empty bucket.
+    base_rate_ = max_rate_;
+    credit_ = 0;
+    last_refill_micros_ = 0;
+  } else if (compaction_score > last_score_) {
+    base_rate_ = std::max<uint64_t>(base_rate_ * kSlowdownRatio,
+                                    kMinDelayedWriteRate);
+  } else if (compaction_score < last_score_) {
+    base_rate_ = std::min<uint64_t>(base_rate_ / kSlowdownRatio, max_rate_);
+  }
+  reason_ = reason;
+  last_score_ = compaction_score;
+
+  // Writes stop at kL0_StopWritesTrigger level-0 files, so slow them down
+  // in proportion as level-0 gets closer to it.
+  rate_ = base_rate_;
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    const int room = std::max(config::kL0_StopWritesTrigger - level0_files, 1);
+    rate_ = base_rate_ * room /
+            (config::kL0_StopWritesTrigger -
+             config::kL0_SlowdownWritesTrigger + 1);
+  }
+  rate_ = std::max(rate_, kMinDelayedWriteRate);
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (!IsDelayed()) {
+    return 0;
+  }
+  if (last_refill_micros_ == 0) {
+    last_refill_micros_ = now_micros;
+  }
+  if (now_micros > last_refill_micros_) {
+    const uint64_t elapsed =
+        std::min(now_micros - last_refill_micros_, kMaxCreditMicros);
+    credit_ = std::min(credit_ + rate_ * (elapsed / 1e6),
+                       rate_ * (kMaxCreditMicros / 1e6));
+    last_refill_micros_ = now_micros;
+  }
+  if (num_bytes <= credit_) {
+    credit_ -= num_bytes;
+    return 0;
+  }
+
+  // Wait until the bucket has refilled the missing bytes, after the delays
+  // already handed out.  The bytes are spent by this write, so the bucket
+  // only fills up again after that.
+  const double missing = num_bytes - credit_;
+  credit_ = 0;
+  last_refill_micros_ = std::max(now_micros, last_refill_micros_) +
+                        static_cast<uint64_t>(missing * 1e6 / rate_);
+  return last_refill_micros_ - now_micros;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+// Paces writes while compactions fall behind.  Once the compaction debt
+// crosses the slowdown thresholds, writes draw from a token bucket whose
+// rate drops while the debt keeps growing, recovers while the debt
+// shrinks, and is scaled down further as level-0 approaches the point at
+// which writes stop.  This replaces a stop-the-world pause by a gradual
+// backpressure.
+//
+// Not thread-safe: the DB calls it with its mutex held.
+class WriteController {
+ public:
+  // Why writes are delayed, if they are.
+  enum DelayReason { kNotDelayed, kLevel0Slowdown, kCompactionDebt };
+
+  // Writes are never delayed below this rate, in bytes per second.
+  static const uint64_t kMinDelayedWriteRate = 16 * 1024;
+
+  // "max_delayed_write_rate" is the rate, in bytes per second, at which a
+  // delay starts.
+  explicit WriteController(uint64_t max_delayed_write_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Report the state of the compactions: the highest compaction score
+  // computed by VersionSet::Finalize() and the highest number of level-0
+  // files, over all column families.
+  void Update(double compaction_score, int level0_files);
+
+  DelayReason delay_reason() const { return reason_; }
+  bool IsDelayed() const { return reason_ != kNotDelayed; }
+
+  // The current rate of delayed writes in bytes per second.
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  // Return the number of microseconds a write of "num_bytes" bytes issued
+  // at "now_micros" should wait.  Zero unless IsDelayed().
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+ private:
+  const uint64_t max_rate_;
+  DelayReason reason_;
+  double last_score_;  // Compaction score at the last Update()
+  uint64_t base_rate_;  // Rate adapted to the trend of the debt
+  uint64_t rate_;       // base_rate_ scaled for level-0
+
+  // Token bucket: bytes that may be written without delay, as of
+  // last_refill_micros_.
+  double credit_;
+  uint64_t last_refill_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
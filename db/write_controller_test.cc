@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "db/dbformat.h"
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static const uint64_t kRate = 1000000;  // 1MB/s: one byte per microsecond
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(kRate);
+  controller.Update(1.5, config::kL0_SlowdownWritesTrigger - 1);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1000, 1 << 20));
+}
+
+TEST(WriteControllerTest, DelayReason) {
+  WriteController controller(kRate);
+  controller.Update(config::kSlowdownCompactionScore, 0);
+  ASSERT_EQ(WriteController::kCompactionDebt, controller.delay_reason());
+  controller.Update(config::kSlowdownCompactionScore,
+                    config::kL0_SlowdownWritesTrigger);
+  ASSERT_EQ(WriteController::kLevel0Slowdown, controller.delay_reason());
+  controller.Update(0.5, 1);
+  ASSERT_EQ(WriteController::kNotDelayed, controller.delay_reason());
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(kRate);
+  controller.Update(config::kSlowdownCompactionScore, 0);
+  ASSERT_EQ(kRate, controller.delayed_write_rate());
+
+  // The bucket starts empty.
+  ASSERT_EQ(1000, controller.GetDelay(5000, 1000));
+  // The next write queues up behind the first one.
+  ASSERT_EQ(3000, controller.GetDelay(5000, 2000));
+  // Writes that keep to the rate are not delayed.
+  ASSERT_EQ(0, controller.GetDelay(8500, 500));
+  ASSERT_EQ(0, controller.GetDelay(9000, 500));
+  // An idle period only builds up a bounded credit.
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1000));
+  ASSERT_LT(0, controller.GetDelay(1000000, 1000));
+}
+
+TEST(WriteControllerTest, RateFollowsDebt) {
+  WriteController controller(kRate);
+  double score = config::kSlowdownCompactionScore;
+  controller.Update(score, 0);
+  uint64_t rate = controller.delayed_write_rate();
+
+  // The rate drops while the debt grows...
+  for (int i = 0; i < 5; i++) {
+    score += 0.1;
+    controller.Update(score, 0);
+    ASSERT_LT(controller.delayed_write_rate(), rate);
+    rate = controller.delayed_write_rate();
+  }
+  // ...stays while it holds...
+  controller.Update(score, 0);
+  ASSERT_EQ(rate, controller.delayed_write_rate());
+  // ...and recovers up to the initial rate while it shrinks.
+  for (int i = 0; i < 20; i++) {
+    score -= 0.01;
+    controller.Update(score, 0);
+    ASSERT_GE(controller.delayed_write_rate(), rate);
+    rate = controller.delayed_write_rate();
+  }
+  ASSERT_EQ(kRate, rate);
+
+  // The rate never drops below the minimum.
+  for (int i = 0; i < 100; i++) {
+    score += 1;
+    controller.Update(score, 0);
+  }
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+}
+
+TEST(WriteControllerTest, Level0SlowsDownMore) {
+  WriteController controller(kRate);
+  uint64_t rate = kRate;
+  for (int files = config::kL0_SlowdownWritesTrigger;
+       files < config::kL0_StopWritesTrigger; files++) {
+    // Same debt, more level-0 files.
+    controller.Update(config::kSlowdownCompactionScore, files);
+    ASSERT_EQ(WriteController::kLevel0Slowdown, controller.delay_reason());
+    ASSERT_LT(controller.delayed_write_rate(), rate);
+    rate = controller.delayed_write_rate();
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,16 +10,19 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with a least-recently-used, a
+// scan-resistant and a CLOCK eviction policy are provided.  Clients may
+// use their own implementations if they want something more
+// sophisticated (like a custom eviction policy, variable cache sizing,
+// etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <stdint.h>
 
+#include <atomic>
+
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
 
@@ -28,8 +31,31 @@ namespace leveldb {
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
-LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
+// of Cache uses a least-recently-used eviction policy.  The entries are
+// spread over 2^num_shard_bits independently locked shards by the hash of
+// their keys, and each shard gets an equal part of the capacity.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits = 4);
+
+// Create a new cache with a fixed size capacity, sharded as above, that
+// uses the scan-resistant 2Q eviction policy: a new entry must be used
+// again before it is protected from eviction by entries that are used
+// once, such as the blocks read by a long scan.  Only a quarter of the
+// capacity is given to entries that have not been used again yet.
+LEVELDB_EXPORT Cache* New2QCache(size_t capacity, int num_shard_bits = 4);
+
+// Create a new cache with a fixed size capacity, sharded as above, whose
+// lookups do not lock: they find entries in a concurrent hash table and
+// take references with atomic operations.  Insertions still lock their
+// shard.  Recency is approximated with the CLOCK algorithm, so that an
+// entry is never moved by a lookup.
+//
+// Each shard has a fixed-size table with room for twice
+// capacity / estimated_entry_charge entries.  If the entries are much
+// smaller than "estimated_entry_charge", fewer of them are cached than the
+// capacity allows; if they are much larger, the table wastes memory.  For
+// a block cache, Options::block_size is a good estimate.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits = 4,
+                                    size_t estimated_entry_charge = 4096);
 
 class LEVELDB_EXPORT Cache {
  public:
@@ -106,6 +132,18 @@ class LEVELDB_EXPORT Cache {
   Rep* rep_;
 };
 
+// Counts the lookups of data blocks in Options::block_cache and, on a
+// miss there, in Options::compressed_block_cache.  May be shared by
+// several DBs and updated concurrently.
+struct LEVELDB_EXPORT BlockCacheStats {
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> compressed_hits{0};
+  std::atomic<uint64_t> compressed_misses{0};
+  // Blocks evicted from block_cache and inserted into compressed_block_cache.
+  std::atomic<uint64_t> demotions{0};
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -8,9 +8,13 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <string>
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_index.h"
 
 namespace leveldb {
 
@@ -31,6 +35,37 @@ class LEVELDB_EXPORT Snapshot {
   virtual ~Snapshot();
 };
 
+// Name of the column family that every DB has.  DB methods that do not
+// take a ColumnFamilyHandle operate on this family.
+LEVELDB_EXPORT extern const char kDefaultColumnFamilyName[];
+
+// Handle to a column family of an open DB: an independent keyspace with
+// its own memtables, table files and storage options.  Handles are owned
+// by the DB and remain valid until the DB is deleted.
+class LEVELDB_EXPORT ColumnFamilyHandle {
+ public:
+  virtual const std::string& GetName() const = 0;
+  virtual uint32_t GetID() const = 0;
+
+ protected:
+  virtual ~ColumnFamilyHandle();
+};
+
+// Names a column family and the options used to store its data.  Only
+// the options that describe storage apply per family: comparator,
+// write_buffer_size, max_file_size, max_open_files, block_cache,
+// block_size, block_restart_interval, compression, filter_policy,
+// with_hashmap and secondary_indexes.  The remaining options are taken
+// from the options the DB is opened with.
+struct LEVELDB_EXPORT ColumnFamilyDescriptor {
+  ColumnFamilyDescriptor() : name(kDefaultColumnFamilyName) {}
+  ColumnFamilyDescriptor(const std::string& name, const Options& options)
+      : name(name), options(options) {}
+
+  std::string name;
+  Options options;
+};
+
 // A range of keys
 struct LEVELDB_EXPORT Range {
   Range() = default;
@@ -40,6 +75,38 @@ struct LEVELDB_EXPORT Range {
   Slice limit;  // Not included in the range
 };
 
+// Describes the entry that answered a DB::Get() call and the work done to
+// find it.  Only filled in when the caller passes one to Get(), so plain
+// lookups pay nothing for it.
+struct LEVELDB_EXPORT LookupTrace {
+  enum Source {
+    kNone,               // No entry for the key was found
+    kMemTable,           // The active memtable
+    kImmutableMemTable,  // The memtable being compacted
+    kTable               // A table file; see level and file_number
+  };
+
+  // Return a human-readable one-line summary of this trace.
+  std::string ToString() const;
+
+  Source source = kNone;
+  uint64_t sequence = 0;  // Sequence number of the entry
+  bool deleted = false;   // True iff the entry is a deletion marker
+
+  // Location of the entry.  Only meaningful if source == kTable.
+  int level = -1;
+  uint64_t file_number = 0;
+  uint64_t block_offset = 0;  // File offset of the data block
+  bool from_row_cache = false;  // If so, block_offset is unknown (zero)
+
+  // Table file work done by the lookup, including files that did not
+  // contain the key.
+  int files_probed = 0;       // Table files consulted
+  int filter_rejections = 0;  // Files skipped by the filter policy
+  int block_cache_hits = 0;   // Data blocks served from the block cache
+  int row_cache_hits = 0;     // Files answered by Options::row_cache
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -53,6 +120,15 @@ class LEVELDB_EXPORT DB {
   static Status Open(const Options& options, const std::string& name,
                      DB** dbptr);
 
+  // Open the database with the specified "name" and the column families
+  // listed in "column_families".  Every column family stored in the
+  // database must be listed; the default column family may be omitted
+  // and always uses "options".  On success stores in (*handles)[i] the
+  // handle of column_families[i] and behaves like Open() above.
+  static Status Open(const Options& options, const std::string& name,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+
   DB() = default;
 
   DB(const DB&) = delete;
@@ -72,6 +148,16 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for the keys in [begin,end).
+  // Returns OK on success, and a non-OK status on error.  The range is
+  // recorded as a single tombstone, so the cost does not depend on the
+  // number of keys it covers; the covered entries are reclaimed by
+  // compactions, which drop table files lying entirely in the range.
+  // Not supported for column families with secondary indexes.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +173,27 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Same as Get(options, key, value), but if "trace" is non-null also
+  // describe in *trace the entry that determined the result and how it
+  // was found.  trace->source is kNone iff no entry for "key" exists at
+  // the read snapshot.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     std::string* value, LookupTrace* trace) = 0;
+
+  // Look up every key of "keys" as Get() does, all as of the same
+  // snapshot.  On return (*values)[i] and (*statuses)[i] hold the result
+  // for keys[i]; (*values)[i] is meaningful only if (*statuses)[i] is OK.
+  //
+  // Cheaper than a Get() per key: the keys are looked up in sorted
+  // order, and the keys that fall in the same table share the reads of
+  // its index block and of each of its data blocks.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses) = 0;
+
+  // Same as Get(), but also store in *position a human-readable
+  // description of the entry that was found and where it lives.
   virtual Status GetWithPosition(const ReadOptions& options, const Slice& key,
                                 std::string* value, std::string* position) = 0;
 
@@ -149,20 +256,68 @@ class LEVELDB_EXPORT DB {
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
-  // 创建ColumnFamily
-  virtual Status CreateColumnFamily(std::string cf_name, ColumnFamilyHandle& cf) = 0;
-
-  virtual Status Put(const WriteOptions& options, ColumnFamilyHandle& cf, const Slice& key,
+  // Add the records of the table files at "paths", written with a
+  // TableFileWriter (see leveldb/table_file_writer.h) using the DB's
+  // comparator, as if they were written by one atomic write.  The files
+  // must not overlap one another.  Each one is copied into the DB and
+  // placed directly at the deepest level of the LSM tree that keeps it
+  // above all the older data it overlaps, so that no compaction has to
+  // rewrite it first.  The files at "paths" are left in place.
+  virtual Status IngestExternalFiles(const std::vector<std::string>& paths) = 0;
+
+  // Create a column family named "name" that stores its data according
+  // to "options" (see ColumnFamilyDescriptor) and store its handle in
+  // *handle.  Returns a non-OK status if the family already exists.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) = 0;
+
+  // Return the handle of the default column family.
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const = 0;
+
+  // Same as the methods above, but operate on "column_family".  A
+  // WriteBatch may also update several column families atomically.
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
                      const Slice& value) = 0;
-
-  virtual Status Get(const ReadOptions& options, ColumnFamilyHandle& cf,const Slice& key,
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const Slice& key) = 0;
+  virtual Status DeleteRange(const WriteOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const Slice& begin, const Slice& end) = 0;
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
                      std::string* value) = 0;
-
-  virtual Iterator* NewColumnFamilyIterator(const ReadOptions& options, ColumnFamilyHandle &cf) = 0;
-
-  virtual Status PutWithIndex(const WriteOptions& options, const Slice& key, const Slice& value) = 0;
-
-  virtual Iterator* NewIndexIterator(const ReadOptions& options) = 0;                  
+  virtual void MultiGet(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses) = 0;
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) = 0;
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value) = 0;
+  virtual void GetApproximateSizes(ColumnFamilyHandle* column_family,
+                                   const Range* range, int n,
+                                   uint64_t* sizes) = 0;
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end) = 0;
+  virtual Status IngestExternalFiles(ColumnFamilyHandle* column_family,
+                                     const std::vector<std::string>& paths) = 0;
+
+  // Return an iterator over the records of "column_family" in the order
+  // of their keys in its secondary index named "index_name" (see
+  // Options::secondary_indexes).  The iterate bounds of "options", if
+  // any, are index keys.  The records are read from a consistent
+  // snapshot, in batches.  If the family has no such index, the result
+  // has a non-OK status.
+  //
+  // Caller should delete the iterator when it is no longer needed.
+  // The returned iterator should be deleted before this db is deleted.
+  virtual IndexIterator* NewIndexIterator(const ReadOptions& options,
+                                          ColumnFamilyHandle* column_family,
+                                          const Slice& index_name) = 0;
 };
 
 // Destroy the contents of the specified database.
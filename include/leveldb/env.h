@@ -198,6 +198,24 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Background work runs on one pool of threads per priority.  Work
+  // scheduled at kHigh never waits behind work scheduled at kLow.
+  // Schedule() uses the kLow pool.
+  enum Priority { kLow, kHigh };
+
+  // Same as Schedule(), but "(*function)(arg)" runs on the pool of
+  // threads for "pri".
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority pri);
+
+  // Grow the pool of threads for "pri" to at least "n" threads.  Pools
+  // start with one thread and never shrink.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int n, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -385,6 +403,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority p) override {
+    return target_->ScheduleWithPriority(f, a, p);
+  }
+  void SetBackgroundThreads(int n, Priority p) override {
+    return target_->SetBackgroundThreads(n, p);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
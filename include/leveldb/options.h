@@ -7,15 +7,20 @@
 
 #include <stddef.h>
 #include <string>
+#include <vector>
 #include "leveldb/export.h"
 
 namespace leveldb {
 
+struct BlockCacheStats;
 class Cache;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class RateLimiter;
+class SecondaryIndex;
+class Slice;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -29,6 +34,23 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// How the filters that Options::filter_policy creates for a table are laid
+// out in it.
+enum FilterLayout {
+  // One filter for each 2KB of data block offsets, all of which are kept
+  // in memory while the table is open.  Older versions of leveldb only
+  // use this layout, and ignore the filters of the others.
+  kBlockBasedFilter = 0x0,
+  // One filter for the whole table, kept in memory while the table is
+  // open.  A lookup consults it before searching the index block.
+  kFullFilter = 0x1,
+  // One filter for each partition of the table of about
+  // Options::filter_partition_keys keys, and an index of the partitions.
+  // Only the index is kept in memory; the partitions are read like data
+  // blocks, through Options::block_cache.
+  kPartitionedFilter = 0x2
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -36,7 +58,6 @@ struct LEVELDB_EXPORT Options {
 
   bool display_kv = false;
 
-  bool with_hashmap = false;
   // -------------------
   // Parameters that affect behavior
 
@@ -84,6 +105,52 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of compactions that may run at the same time, each on
+  // its own background thread of the Env's low priority pool.  Compactions
+  // that run concurrently never share input files or overlap in the key
+  // range they write.  Memtables are flushed separately, on the Env's high
+  // priority pool.
+  int max_background_compactions = 1;
+
+  // Maximum number of threads that work on one compaction.  A compaction
+  // with a large input, such as one of many level-0 files, is split into
+  // up to this many key ranges of about the same size, each merged on a
+  // thread of its own into its own output files.
+  int max_subcompactions = 1;
+
+  // Rate, in bytes per second, at which writes are let through once
+  // compactions fall behind.  The DB lowers it further while the backlog
+  // of compactions keeps growing, and stops writes altogether when
+  // level-0 has too many files.
+  size_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // If non-null, flushes and compactions ask this limiter before every
+  // write to a table file, and compactions also before every block they
+  // read (see leveldb/rate_limiter.h).  Flushes are served before
+  // compactions.  User reads and log writes are not limited.  The same
+  // limiter may be shared by several DBs to bound their combined I/O.
+  RateLimiter* rate_limiter = nullptr;
+
+  // If true, each memtable also keeps a hash index from user key to its
+  // newest entry, so point lookups that hit (or miss) the memtable avoid a
+  // skiplist search.  The index costs a few words per distinct key in the
+  // write buffer and slightly slows down writes.
+  bool with_hashmap = false;
+
+  // If true, the writers whose batches are committed together as one log
+  // record insert them into the memtable in parallel, each on its own
+  // thread, instead of the first writer inserting all of them.  This helps
+  // workloads with many concurrent writers.  Memtables with a hash index
+  // (see with_hashmap) are always written by a single thread.
+  bool allow_concurrent_memtable_write = false;
+
+  // If true, a group of writes leaves the log to the next group as soon as
+  // its log record is written, and is applied to the memtables while the
+  // next group writes the log.  Writes still become visible in the order
+  // they are logged.  This raises the throughput of many concurrent
+  // writers, especially of sync writes.
+  bool enable_pipelined_write = false;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -96,6 +163,32 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, blocks evicted from block_cache are compressed (with
+  // Snappy, if available) and kept in this cache, and a block that misses
+  // in block_cache is looked up here before it is read from the file.  A
+  // block found here moves back to block_cache.  The charge of an entry is
+  // its compressed size.  Ignored if it is block_cache itself.  Must
+  // outlive block_cache.
+  //
+  // An evicted block is compressed by the read that evicted it, after it
+  // is done with block_cache, so the compression adds to the latency of
+  // that read but does not hold up other readers of block_cache.  Blocks
+  // of closed tables are not demoted.
+  Cache* compressed_block_cache = nullptr;
+
+  // If non-null, the hits and misses of data block lookups in block_cache
+  // and compressed_block_cache are counted here.
+  BlockCacheStats* block_cache_stats = nullptr;
+
+  // If non-null, point lookups cache the newest entry of a key in a table
+  // file (its value, or the fact that it is deleted) in this cache, keyed
+  // by file number and key, and later lookups of the key in that file are
+  // answered from it without reading the table.  Since table files never
+  // change, entries of obsolete files are simply never looked up again
+  // and age out.  The charge of an entry is the size of its key and value.
+  // May be shared by several DBs.
+  Cache* row_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -107,6 +200,13 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, each data block of the tables of a DB gets a hash index from
+  // the user keys to their restart intervals, which lets a point lookup
+  // skip the binary search over the restart points.  It costs about 1.33
+  // bytes per key.  Older versions of leveldb cannot read the tables that
+  // are written with it, but tables written without it stay readable.
+  bool data_block_hash_index = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -143,6 +243,25 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // Layout of the filters of the tables that are written.  Tables written
+  // with any layout can be read.  Older versions of leveldb read tables
+  // with the other layouts without their filters, so the default is the
+  // layout they understand.
+  FilterLayout filter_layout = kBlockBasedFilter;
+
+  // Approximate number of keys per filter partition with
+  // kPartitionedFilter.  Partitions end at data block boundaries.
+  int filter_partition_keys = 4096;
+
+  // Secondary indexes to maintain over the records of the column family
+  // (see leveldb/secondary_index.h).  Each index stores its entries in a
+  // column family named "__index/<family name>/<index name>", which is
+  // created, and filled from the existing records, the first time the
+  // index is supplied.  Once created, an index must be supplied every
+  // time the database is opened.  The indexes must remain live while
+  // the database is open.
+  std::vector<const SecondaryIndex*> secondary_indexes;
 };
 
 // Options that control read operations
@@ -162,6 +281,19 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If non-null, DB iterators created with these options only yield
+  // keys that are >= *iterate_lower_bound and < *iterate_upper_bound,
+  // and never read table files or blocks that lie entirely outside the
+  // bounds.  Table iterators use the bounds (compared with the table's
+  // comparator) only to skip such blocks.  The bounds must remain live
+  // until the iterator is deleted.  Point lookups ignore them.
+  const Slice* iterate_lower_bound = nullptr;
+  const Slice* iterate_upper_bound = nullptr;
+
+  // If true, blocks read from table files are charged to
+  // Options::rate_limiter at low priority.  Set by compactions.
+  bool rate_limited = false;
 };
 
 // Options that control write operations
@@ -185,17 +317,6 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
-struct ColumnFamilyHandle{
-  ColumnFamilyHandle(std::string cf_name):cf_name_(cf_name+"_"){}
-  std::string GetPrefix() const {
-    return cf_name_;
-  }
-  int GetPrefixSize() const {
-    return cf_name_.size();
-  }
-  std::string cf_name_;
-};
-
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which the DB writes and reads files in
+// the background, so that flushes and compactions do not saturate the
+// device and slow down user reads and writes.  One RateLimiter may be
+// shared by several DBs (see Options::rate_limiter) to bound their
+// combined background I/O.
+//
+// Requests carry an Env::Priority: flushes request at Env::kHigh and are
+// served before compactions, which request at Env::kLow.  User reads and
+// log writes are never limited.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  // Requires that no request is pending.
+  virtual ~RateLimiter();
+
+  // Block until "bytes" bytes of I/O at priority "pri" may proceed.
+  // Safe to call concurrently from multiple threads.
+  virtual void Request(int64_t bytes, Env::Priority pri) = 0;
+
+  // Return the number of bytes that may pass per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the number of bytes requested so far at priority "pri".
+  virtual int64_t GetTotalBytesThrough(Env::Priority pri) const = 0;
+};
+
+// Return a new rate limiter that lets through "bytes_per_second" bytes per
+// second over all priorities.  Requests are granted every
+// "refill_period_micros" microseconds; shorter periods smooth the I/O but
+// wake up waiting threads more often.  Waiting flushes are normally served
+// before waiting compactions, but one refill in "fairness" serves
+// compactions first so that they are not starved.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t bytes_per_second, int64_t refill_period_micros = 100 * 1000,
+    int32_t fairness = 10);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
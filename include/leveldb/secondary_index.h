@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A secondary index orders the records of a column family by a key that
+// a user-supplied SecondaryIndex extracts from each record, so that the
+// records whose index keys fall in a range can be found without scanning
+// the whole column family.
+//
+// The entries of an index are kept in a column family of their own and
+// are maintained by the DB: every write to an indexed column family
+// updates its index entries in the same atomic batch, including the
+// removal of stale entries when a record is overwritten or deleted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_INDEX_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_INDEX_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT SecondaryIndex {
+ public:
+  virtual ~SecondaryIndex();
+
+  // Return the name of this index.  The names of the indexes of a
+  // column family must be distinct, and an index must keep its name and
+  // its extraction rule for as long as the database exists.
+  virtual const char* Name() const = 0;
+
+  // If the record (key, value) belongs in the index, store its index key
+  // in *index_key and return true.  Otherwise return false.  Index keys
+  // may be arbitrary byte strings and are ordered bytewise.
+  //
+  // Must be deterministic and thread-safe.
+  virtual bool Extract(const Slice& key, const Slice& value,
+                       std::string* index_key) const = 0;
+};
+
+// Iterates over the records of a column family in the order of their
+// index keys.  key() is the index key of the current record, value() is
+// its value and primary_key() is its key.  Records with equal index keys
+// are ordered by primary key.  Seek() takes an index key.
+class LEVELDB_EXPORT IndexIterator : public Iterator {
+ public:
+  IndexIterator() = default;
+
+  // Return the key of the record at the current position.
+  // REQUIRES: Valid()
+  virtual Slice primary_key() const = 0;
+};
+
+// Return an empty index iterator with the specified status.
+LEVELDB_EXPORT IndexIterator* NewErrorIndexIterator(const Status& status);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_INDEX_H_
@@ -75,10 +75,6 @@ class LEVELDB_EXPORT Status {
   // Returns the string "OK" for success.
   std::string ToString() const;
 
-  void SetMsg(std::string value){msg = value;}
-
-  std::string GetMsg() const {return msg;};
-
  private:
   enum Code {
     kOk = 0,
@@ -102,7 +98,6 @@ class LEVELDB_EXPORT Status {
   //    state_[4]    == code
   //    state_[5..]  == message
   const char* state_;
-  std::string msg;
 };
 
 inline Status::Status(const Status& rhs) {
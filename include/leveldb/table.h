@@ -9,12 +9,14 @@
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
+#include "leveldb/options.h"
 
 namespace leveldb {
 
 class Block;
 class BlockHandle;
 class Footer;
+struct LookupTrace;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
@@ -50,6 +52,11 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones added with
+  // TableBuilder::AddRangeTombstone(), or nullptr if there are none.
+  // The iterator must be deleted before the table.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -63,18 +70,50 @@ class LEVELDB_EXPORT Table {
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // Same as above, but increments trace->block_cache_hits if the block
+  // was found in the block cache.  "trace" may be null.  If "point_lookup"
+  // is true, the iterator is only good for looking up internal keys, and
+  // uses the hash index of the block if it has one.
+  static Iterator* BlockReader(void*, const ReadOptions&, const Slice&,
+                               LookupTrace* trace, bool point_lookup);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // that key is not present, or if the hash index of the data block says
+  // that no entry there has the user key of "key".  If "trace" is
+  // non-null, records the filter rejection, block offset and block cache
+  // hit in *trace.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
-
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+                                           const Slice& v),
+                     LookupTrace* trace);
+
+  // Same as calling InternalGet(options, keys[i], args[i], handle_result,
+  // nullptr) for each i in [0,n-1], but each data block is read at most
+  // once.  REQUIRES: keys are sorted by the table comparator.
+  Status InternalMultiGet(const ReadOptions&, const Slice* keys,
+                          void* const* args, size_t n,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
+  // Returns false if the full filter or the filter partition of "key"
+  // says that key is not present.  Does not consult filters of the
+  // kBlockBasedFilter layout, which depend on the data block of the key.
+  bool FilterMayMatch(const ReadOptions&, const Slice& key);
+  bool PartitionMayMatch(const ReadOptions&, const BlockHandle& handle,
+                         const Slice& key);
+
+  // Returns the largest sequence number not above "snapshot" of the
+  // range tombstones that cover "user_key", or zero if there is none.
+  // Tombstones are found by binary search in a list fragmented at open.
+  uint64_t MaxCoveringTombstoneSequence(const Slice& user_key,
+                                        uint64_t snapshot) const;
+
+  Status ReadMeta(const Footer& footer);
+  Status BuildRangeTombstoneList();
+  void ReadFilter(const Slice& filter_handle_value, FilterLayout layout);
 
   Rep* const rep_;
 };
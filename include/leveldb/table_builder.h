@@ -52,6 +52,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table.  "key" is the start of the
+  // deleted range and "value" its end; they are stored in a meta block
+  // of their own rather than among the entries added by Add().
+  // REQUIRES: key is after any previously added range tombstone key
+  // according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// TableFileWriter writes a table file outside of any DB, which may then be
+// added to a DB in one step with DB::IngestExternalFiles().  This is much
+// faster than writing the same records through DB::Write() for bulk loads,
+// since the records are neither logged nor rewritten by compactions.
+//
+// Example:
+//   leveldb::TableFileWriter writer(options);
+//   leveldb::Status s = writer.Open("/tmp/bulk.ldb");
+//   for (...; s.ok(); ...) s = writer.Put(key, value);
+//   if (s.ok()) s = writer.Finish();
+//   if (s.ok()) s = db->IngestExternalFiles({"/tmp/bulk.ldb"});
+//
+// A TableFileWriter is not thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_FILE_WRITER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT TableFileWriter {
+ public:
+  // Create a writer of tables for a DB (or column family) opened with
+  // "options".  The comparator and filter policy must be the ones of
+  // that DB; the other table options, such as block_size and compression,
+  // are taken from "options" as well.
+  explicit TableFileWriter(const Options& options);
+
+  TableFileWriter(const TableFileWriter&) = delete;
+  TableFileWriter& operator=(const TableFileWriter&) = delete;
+
+  // Abandons and closes the file if Finish() was not called.  The file
+  // is not deleted.
+  ~TableFileWriter();
+
+  // Create the file "fname" (replacing any existing file) to write the
+  // table into.
+  // REQUIRES: Open() has not been called yet.
+  Status Open(const std::string& fname);
+
+  // Add a record that maps "key" to "value", or that deletes "key".
+  // Returns InvalidArgument unless "key" comes after every key added
+  // before according to the comparator.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Finish writing the table, then sync and close the file.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Finish();
+
+  // Number of records added so far.
+  uint64_t NumEntries() const;
+
+  // Size of the file written so far.  Once Finish() succeeded, this is
+  // the size of the final file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_FILE_WRITER_H_
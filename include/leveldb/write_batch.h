@@ -13,6 +13,9 @@
 //    batch.Put("key", "v2");
 //    batch.Put("key", "v3");
 //
+// A range deletion erases the keys in [begin,end) that were written
+// before it, including those written earlier in the same batch.
+//
 // Multiple threads can invoke const methods on a WriteBatch without
 // external synchronization, but if any of the threads may call a
 // non-const method, all threads accessing the same WriteBatch must use
@@ -21,6 +24,8 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
+
 #include <string>
 
 #include "leveldb/export.h"
@@ -28,6 +33,7 @@
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class LEVELDB_EXPORT WriteBatch {
@@ -37,6 +43,19 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    virtual void DeleteRange(const Slice& begin, const Slice& end) = 0;
+
+    // Called for updates to column families other than the default one.
+    // A non-OK status stops Iterate(), which returns it.  The default
+    // implementations forward updates of the default family (id 0) to
+    // Put(), Delete() and DeleteRange() and return InvalidArgument for
+    // any other family, so that a handler that does not know about
+    // column families never applies their updates to the default one.
+    virtual Status PutCF(uint32_t column_family_id, const Slice& key,
+                         const Slice& value);
+    virtual Status DeleteCF(uint32_t column_family_id, const Slice& key);
+    virtual Status DeleteRangeCF(uint32_t column_family_id,
+                                 const Slice& begin, const Slice& end);
   };
 
   WriteBatch();
@@ -53,6 +72,18 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in [begin,end), according to the
+  // comparator of the database.  Does nothing if begin >= end.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Same as above, but for the specified column family.  All updates in
+  // a batch are applied atomically, even if they span column families.
+  void Put(ColumnFamilyHandle* column_family, const Slice& key,
+           const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void DeleteRange(ColumnFamilyHandle* column_family, const Slice& begin,
+                   const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
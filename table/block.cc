@@ -13,29 +13,46 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t trailer_offset = size_ - sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + trailer_offset);
+  if (num_restarts_ & kBlockHashIndexFlag) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (trailer_offset < sizeof(uint16_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    trailer_offset -= sizeof(uint16_t);
+    num_hash_buckets_ = static_cast<uint8_t>(data_[trailer_offset]) |
+                        (static_cast<uint8_t>(data_[trailer_offset + 1]) << 8);
+    if (num_hash_buckets_ == 0 || num_hash_buckets_ > trailer_offset) {
+      size_ = 0;
+      return;
+    }
+    trailer_offset -= num_hash_buckets_;
+    hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + trailer_offset);
+  }
+  size_t max_restarts_allowed = trailer_offset / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = trailer_offset - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -80,6 +97,8 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const uint8_t* const hash_buckets_;  // Hash index to use, or nullptr
+  uint16_t const num_hash_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +133,14 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* hash_buckets,
+       uint16_t num_hash_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_hash_buckets_(num_hash_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +184,10 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    if (hash_buckets_ != nullptr && SeekWithHashIndex(target)) {
+      return;
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -214,6 +240,45 @@ class Block::Iter : public Iterator {
   }
 
  private:
+  // Looks up the user key of "target" in the hash index and, if it names
+  // one restart interval, seeks to the first entry >= target in it.
+  // Returns false if the restart interval is not known.
+  bool SeekWithHashIndex(const Slice& target) {
+    if (target.size() < 8) {
+      return false;
+    }
+    const uint8_t bucket =
+        hash_buckets_[Hash(target.data(), target.size() - 8, 0) %
+                      num_hash_buckets_];
+    if (bucket == kHashBucketCollision) {
+      return false;
+    }
+    if (bucket == kHashBucketEmpty) {
+      // No entry has the user key of target.
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return true;
+    }
+    if (bucket >= num_restarts_) {
+      CorruptionError();
+      return true;
+    }
+
+    // All entries with the user key of target are in this restart
+    // interval, so a lookup need not look past it.
+    SeekToRestartPoint(bucket);
+    while (ParseNextKey() && restart_index_ == bucket) {
+      if (Compare(key_, target) >= 0) {
+        return true;
+      }
+    }
+    if (Valid()) {
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+    }
+    return true;
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -256,11 +321,23 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
+    return NewEmptyIterator();
+  } else {
+    return new Iter(comparator, data_, restart_offset_, num_restarts_, nullptr,
+                    0);
+  }
+}
+
+Iterator* Block::NewPointLookupIterator(const Comparator* comparator) {
+  if (size_ < sizeof(uint32_t)) {
+    return NewErrorIterator(Status::Corruption("bad block contents"));
+  }
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts_,
+                    hash_buckets_, num_hash_buckets_);
   }
 }
 
@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 #include "leveldb/iterator.h"
+#include "leveldb/slice.h"
 
 namespace leveldb {
 
@@ -26,17 +27,25 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
+  Slice contents() const { return Slice(data_, size_); }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Returns an iterator for a point lookup of an internal key.  If the
+  // block has a hash index, Seek(target) may leave the iterator invalid or
+  // at an entry that is not the first one >= target when the block has no
+  // entry >= target with the user key of target.
+  Iterator* NewPointLookupIterator(const Comparator* comparator);
+
  private:
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;
   size_t size_;
-  uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  uint32_t restart_offset_;      // Offset in data_ of restart array
+  uint32_t num_restarts_;        // Number of entries in restart array
+  const uint8_t* hash_buckets_;  // Hash index, or nullptr if none
+  uint16_t num_hash_buckets_;
+  bool owned_;  // Block owns data_[]
 };
 
 }  // namespace leveldb
@@ -25,6 +25,19 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A data block of internal keys may also have a hash index, which lets a
+// point lookup go straight to the restart interval holding its user key.
+// The trailer then has the form:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint16
+//     num_restarts | kBlockHashIndexFlag: uint32
+// The user key of every entry is hashed to one of the buckets, which holds
+// the index of the restart interval of the entry.  A bucket that no key
+// hashes to holds kHashBucketEmpty, and one that keys of several restart
+// intervals hash to holds kHashBucketCollision.  Blocks with more than
+// kMaxHashIndexedRestarts restart points are written without the index.
 
 #include "table/block_builder.h"
 
@@ -34,12 +47,21 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+// Buckets per user key in a hash index.
+static const double kHashBucketsPerKey = 1.33;
+
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      hash_index_(hash_index) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -51,12 +73,23 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hashed_keys_.clear();
+}
+
+static size_t NumHashBuckets(size_t num_keys) {
+  // An odd number of buckets spreads keys better than a power of two.
+  return std::min<size_t>(
+      static_cast<size_t>(num_keys * kHashBucketsPerKey) | 1, 0xffff);
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  size_t estimate = buffer_.size() +                       // Raw data buffer
+                    restarts_.size() * sizeof(uint32_t) +  // Restart array
+                    sizeof(uint32_t);  // Restart array length
+  if (hash_index_) {
+    estimate += NumHashBuckets(hashed_keys_.size()) + sizeof(uint16_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -64,7 +97,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (hash_index_ && !hashed_keys_.empty() &&
+      restarts_.size() <= kMaxHashIndexedRestarts) {
+    const size_t num_buckets = NumHashBuckets(hashed_keys_.size());
+    std::string buckets(num_buckets, static_cast<char>(kHashBucketEmpty));
+    for (const auto& hashed_key : hashed_keys_) {
+      char& bucket = buckets[hashed_key.first % num_buckets];
+      const uint8_t restart_index = hashed_key.second;
+      if (static_cast<uint8_t>(bucket) == kHashBucketEmpty) {
+        bucket = static_cast<char>(restart_index);
+      } else if (static_cast<uint8_t>(bucket) != restart_index) {
+        bucket = static_cast<char>(kHashBucketCollision);
+      }
+    }
+    buffer_.append(buckets);
+    buffer_.push_back(static_cast<char>(num_buckets & 0xff));
+    buffer_.push_back(static_cast<char>(num_buckets >> 8));
+    num_restarts |= kBlockHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -103,6 +155,13 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   last_key_.append(key.data() + shared, non_shared);
   assert(Slice(last_key_) == key);
   counter_++;
+
+  if (hash_index_) {
+    // The user key is the internal key without its 8-byte tag.
+    assert(key.size() >= 8);
+    hashed_keys_.emplace_back(Hash(key.data(), key.size() - 8, 0),
+                              restarts_.size() - 1);
+  }
 }
 
 }  // namespace leveldb
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -17,7 +18,10 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true, the keys must be internal keys, and Finish()
+  // appends an index from the hash of their user keys to the restart
+  // intervals holding them.  See Block::NewIterator().
+  explicit BlockBuilder(const Options* options, bool hash_index = false);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -48,6 +52,11 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  // Hash of the user key and restart index of each entry added so far,
+  // if the block gets a hash index.
+  const bool hash_index_;
+  std::vector<std::pair<uint32_t, uint32_t>> hashed_keys_;
 };
 
 }  // namespace leveldb
@@ -4,6 +4,8 @@
 
 #include "table/filter_block.h"
 
+#include <algorithm>
+
 #include "leveldb/filter_policy.h"
 #include "util/coding.h"
 
@@ -74,6 +76,59 @@ void FilterBlockBuilder::GenerateFilter() {
   start_.clear();
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy,
+                                               int keys_per_partition)
+    : policy_(policy),
+      keys_per_partition_(std::max(keys_per_partition, 0)) {}
+
+void FullFilterBlockBuilder::StartBlock() {
+  if (keys_per_partition_ > 0 && start_.size() >= keys_per_partition_) {
+    GenerateFilter();
+  }
+}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+void FullFilterBlockBuilder::Finish() {
+  if (!start_.empty()) {
+    GenerateFilter();
+  }
+  filter_offsets_.push_back(result_.size());
+}
+
+Slice FullFilterBlockBuilder::filter(size_t i) const {
+  assert(i + 1 < filter_offsets_.size());
+  return Slice(result_.data() + filter_offsets_[i],
+               filter_offsets_[i + 1] - filter_offsets_[i]);
+}
+
+void FullFilterBlockBuilder::GenerateFilter() {
+  const size_t num_keys = start_.size();
+  assert(num_keys > 0);
+
+  // Make list of keys from flattened key structure
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+
+  // Generate filter for current set of keys and append to result_.  The
+  // policy may modify tmp_keys_, so take the last key first.
+  last_keys_.push_back(tmp_keys_[num_keys - 1].ToString());
+  filter_offsets_.push_back(result_.size());
+  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+}
+
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
                                      const Slice& contents)
     : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
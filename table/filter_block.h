@@ -50,6 +50,46 @@ class FilterBlockBuilder {
   std::vector<uint32_t> filter_offsets_;
 };
 
+// A FullFilterBlockBuilder constructs the filters of a table with the
+// kFullFilter or kPartitionedFilter layout: one filter over all the keys
+// of the table, or one over the keys of each partition of it.  A
+// partition ends at the first data block boundary after it has at least
+// "keys_per_partition" keys; if that is zero, the table is one partition.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      (StartBlock | AddKey)* Finish
+class FullFilterBlockBuilder {
+ public:
+  FullFilterBlockBuilder(const FilterPolicy*, int keys_per_partition);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  // Called when a new data block starts.
+  void StartBlock();
+  void AddKey(const Slice& key);
+  void Finish();
+
+  // REQUIRES: Finish() has been called.
+  size_t num_partitions() const { return last_keys_.size(); }
+  // The filter of the i-th partition.
+  Slice filter(size_t i) const;
+  // The last key added to the i-th partition.
+  Slice last_key(size_t i) const { return last_keys_[i]; }
+
+ private:
+  void GenerateFilter();
+
+  const FilterPolicy* policy_;
+  const size_t keys_per_partition_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+  std::string result_;           // Filters computed so far
+  std::vector<size_t> filter_offsets_;  // Starting index in result_
+  std::vector<std::string> last_keys_;
+};
+
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
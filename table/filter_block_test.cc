@@ -119,6 +119,61 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilter) {
+  FullFilterBlockBuilder builder(&policy_, 0);
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.StartBlock();
+  builder.AddKey("foo");
+  builder.Finish();
+  ASSERT_EQ(1, builder.num_partitions());
+  ASSERT_EQ("foo", builder.last_key(0).ToString());
+  Slice filter = builder.filter(0);
+  ASSERT_TRUE(policy_.KeyMayMatch("bar", filter));
+  ASSERT_TRUE(policy_.KeyMayMatch("box", filter));
+  ASSERT_TRUE(policy_.KeyMayMatch("foo", filter));
+  ASSERT_TRUE(!policy_.KeyMayMatch("hello", filter));
+}
+
+TEST_F(FilterBlockTest, EmptyFullFilter) {
+  FullFilterBlockBuilder builder(&policy_, 2);
+  builder.StartBlock();
+  builder.Finish();
+  ASSERT_EQ(0, builder.num_partitions());
+}
+
+TEST_F(FilterBlockTest, PartitionedFilter) {
+  FullFilterBlockBuilder builder(&policy_, 2);
+  builder.AddKey("a");
+  builder.StartBlock();  // Too few keys to end the partition
+  builder.AddKey("b");
+  builder.AddKey("c");
+  builder.StartBlock();
+  builder.StartBlock();  // Nothing to end
+  builder.AddKey("d");
+  builder.AddKey("e");
+  builder.AddKey("f");
+  builder.AddKey("g");
+  builder.StartBlock();
+  builder.AddKey("h");
+  builder.Finish();
+
+  ASSERT_EQ(3, builder.num_partitions());
+  ASSERT_EQ("c", builder.last_key(0).ToString());
+  ASSERT_EQ("g", builder.last_key(1).ToString());
+  ASSERT_EQ("h", builder.last_key(2).ToString());
+
+  ASSERT_TRUE(policy_.KeyMayMatch("a", builder.filter(0)));
+  ASSERT_TRUE(policy_.KeyMayMatch("c", builder.filter(0)));
+  ASSERT_TRUE(!policy_.KeyMayMatch("d", builder.filter(0)));
+  ASSERT_TRUE(policy_.KeyMayMatch("d", builder.filter(1)));
+  ASSERT_TRUE(policy_.KeyMayMatch("g", builder.filter(1)));
+  ASSERT_TRUE(!policy_.KeyMayMatch("c", builder.filter(1)));
+  ASSERT_TRUE(!policy_.KeyMayMatch("h", builder.filter(1)));
+  ASSERT_TRUE(policy_.KeyMayMatch("h", builder.filter(2)));
+  ASSERT_EQ(4, builder.filter(2).size());  // One hash per key
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -79,6 +79,12 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Layout of the optional hash index of a block; see block_builder.cc.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kHashBucketEmpty = 255;
+static const uint8_t kHashBucketCollision = 254;
+static const uint32_t kMaxHashIndexedRestarts = 254;
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
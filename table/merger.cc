@@ -4,6 +4,8 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -22,6 +24,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -32,24 +35,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void Next() override {
@@ -72,10 +75,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    ReplaceTop();
   }
 
   void Prev() override {
@@ -101,10 +107,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    ReplaceTop();
   }
 
   Slice key() const override {
@@ -132,47 +141,85 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Returns true iff child "a" comes before child "b" in the current
+  // direction.  Ties are broken by position so that equal keys are
+  // yielded in the order of the children (reversed when moving back).
+  bool Before(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Rebuild heap_ from the valid children and make current_ its top.
+  void BuildHeap();
+
+  // Restore the heap order after the top child has moved, dropping it
+  // if it became invalid, and make current_ the new top.
+  void ReplaceTop();
+
+  void SiftDown(size_t i);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
   Direction direction_;
+
+  // The valid children ordered as a binary heap whose top is the child
+  // that comes first in direction_, so that moving the iterator costs
+  // O(log n) key comparisons rather than O(n).  Keys are compared through
+  // the IteratorWrapper's cached copy.
+  std::vector<IteratorWrapper*> heap_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::ReplaceTop() {
+  assert(!heap_.empty() && heap_[0] == current_);
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty()) {
+    SiftDown(0);
+    current_ = heap_[0];
+  } else {
+    current_ = nullptr;
+  }
+}
+
+void MergingIterator::SiftDown(size_t i) {
+  const size_t n = heap_.size();
+  IteratorWrapper* const child = heap_[i];
+  while (true) {
+    size_t first = 2 * i + 1;
+    if (first >= n) {
+      break;
+    }
+    if (first + 1 < n && Before(heap_[first + 1], heap_[first])) {
+      first++;
+    }
+    if (!Before(heap_[first], child)) {
+      break;
     }
+    heap_[i] = heap_[first];
+    i = first;
   }
-  current_ = largest;
+  heap_[i] = child;
 }
 }  // namespace
 
@@ -0,0 +1,163 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+
+// An iterator over a sorted vector of keys whose values name the vector.
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(const std::vector<std::string>& keys, const std::string& name)
+      : keys_(keys), name_(name), pos_(keys_.size()) {}
+
+  bool Valid() const override { return pos_ < keys_.size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_.empty() ? keys_.size() : keys_.size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target.ToString()) -
+           keys_.begin();
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? keys_.size() : pos_ - 1;
+  }
+  Slice key() const override { return keys_[pos_]; }
+  Slice value() const override { return name_; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const std::vector<std::string> keys_;
+  const std::string name_;
+  size_t pos_;
+};
+
+}  // namespace
+
+class MergerTest : public testing::Test {
+ public:
+  // Build a merging iterator over "n" random children and fill
+  // expected_ with their merged contents.  Unless "unique", children
+  // draw from few distinct keys so that they often share a key.
+  Iterator* NewRandomMerge(Random* rnd, int n, bool unique) {
+    std::vector<Iterator*> children;
+    std::set<std::string> used;
+    expected_.clear();
+    for (int i = 0; i < n; i++) {
+      std::vector<std::string> keys;
+      const int count = rnd->Uniform(50);
+      for (int j = 0; j < count; j++) {
+        std::string key = test::RandomKey(rnd, 2);
+        if (!unique || used.insert(key).second) {
+          keys.push_back(key);
+        }
+      }
+      std::sort(keys.begin(), keys.end());
+      const std::string name(1, 'a' + i);
+      for (const std::string& k : keys) {
+        expected_.push_back(k + ":" + name);
+      }
+      children.push_back(new VectorIterator(keys, name));
+    }
+    // Equal keys are yielded in the order of the children.
+    std::stable_sort(expected_.begin(), expected_.end(),
+                     [](const std::string& a, const std::string& b) {
+                       return a.substr(0, 2) < b.substr(0, 2);
+                     });
+    return NewMergingIterator(BytewiseComparator(), children.data(), n);
+  }
+
+  static std::string Entry(Iterator* iter) {
+    return iter->key().ToString() + ":" + iter->value().ToString();
+  }
+
+  std::vector<std::string> expected_;
+};
+
+TEST_F(MergerTest, Empty) {
+  Iterator* iter = NewMergingIterator(BytewiseComparator(), nullptr, 0);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST_F(MergerTest, ForwardAndBackward) {
+  Random rnd(301);
+  for (int n = 1; n <= 20; n++) {
+    Iterator* iter = NewRandomMerge(&rnd, n, false);
+    std::vector<std::string> forward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.push_back(Entry(iter));
+    }
+    ASSERT_EQ(expected_, forward);
+
+    std::vector<std::string> backward;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      backward.push_back(Entry(iter));
+    }
+    std::reverse(backward.begin(), backward.end());
+    ASSERT_EQ(expected_.size(), backward.size());
+    for (size_t i = 0; i < backward.size(); i++) {
+      // Equal keys may be yielded in another order when moving back.
+      ASSERT_EQ(expected_[i].substr(0, 2), backward[i].substr(0, 2));
+    }
+    delete iter;
+  }
+}
+
+TEST_F(MergerTest, SeekAndSwitchDirections) {
+  Random rnd(test::RandomSeed());
+  for (int n = 1; n <= 20; n++) {
+    Iterator* iter = NewRandomMerge(&rnd, n, true);
+    for (int trial = 0; trial < 20; trial++) {
+      const std::string target = test::RandomKey(&rnd, 2);
+      iter->Seek(target);
+      size_t pos = std::lower_bound(expected_.begin(), expected_.end(),
+                                    target) -
+                   expected_.begin();
+      for (int step = 0; step < 50; step++) {
+        if (pos >= expected_.size()) {
+          ASSERT_TRUE(!iter->Valid());
+          break;
+        }
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(expected_[pos], Entry(iter));
+        if (rnd.OneIn(3)) {
+          iter->Prev();
+          pos = (pos == 0) ? expected_.size() : pos - 1;
+        } else {
+          iter->Next();
+          pos++;
+        }
+      }
+    }
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -4,35 +4,143 @@
 
 #include "leveldb/table.h"
 
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
+#include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/rate_limiter.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
 
 namespace leveldb {
 
+// Encode "block" as the value of a compressed_block_cache entry: a
+// CompressionType byte followed by the block, Snappy-compressed unless
+// that is unavailable or saves less than 12.5%.
+static std::string* CompressBlock(const Slice& block) {
+  std::string* entry = new std::string;
+  std::string compressed;
+  if (port::Snappy_Compress(block.data(), block.size(), &compressed) &&
+      compressed.size() < block.size() - (block.size() / 8u)) {
+    entry->reserve(1 + compressed.size());
+    entry->push_back(kSnappyCompression);
+    entry->append(compressed);
+  } else {
+    entry->reserve(1 + block.size());
+    entry->push_back(kNoCompression);
+    entry->append(block.data(), block.size());
+  }
+  return entry;
+}
+
+static void DeleteCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// Where the blocks of a table go when they are evicted from block_cache.
+// Shared by the table and its blocks there, which may outlive it: once
+// the table is closed, its blocks are dropped instead, so closing a table,
+// or the DB, does not fill compressed_block_cache with blocks that are
+// never read again.
+class DemotionTarget {
+ public:
+  DemotionTarget(Cache* cache, uint64_t cache_id, BlockCacheStats* stats)
+      : cache_(cache), cache_id_(cache_id), stats_(stats) {}
+
+  DemotionTarget(const DemotionTarget&) = delete;
+  DemotionTarget& operator=(const DemotionTarget&) = delete;
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  // Called when the table is closed.  Waits for demotions in progress.
+  void Close() {
+    MutexLock l(&mu_);
+    closed_.store(true, std::memory_order_relaxed);
+  }
+
+  bool closed() const { return closed_.load(std::memory_order_relaxed); }
+
+  // Insert a compressed copy of "block", at "offset" in the table, into
+  // the compressed cache, unless the table is closed.
+  void Demote(const Slice& block, uint64_t offset) {
+    MutexLock l(&mu_);
+    if (closed()) {
+      return;
+    }
+    char key[16];
+    EncodeFixed64(key, cache_id_);
+    EncodeFixed64(key + 8, offset);
+    std::string* entry = CompressBlock(block);
+    cache_->Release(cache_->Insert(Slice(key, sizeof(key)), entry,
+                                   entry->size(), &DeleteCompressedBlock));
+    if (stats_ != nullptr) {
+      stats_->demotions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  ~DemotionTarget() = default;
+
+  Cache* const cache_;
+  const uint64_t cache_id_;
+  BlockCacheStats* const stats_;
+  std::atomic<int> refs_{1};
+  port::Mutex mu_;  // Held while demoting, so that Close() can wait
+  std::atomic<bool> closed_{false};
+};
+
 struct Table::Rep {
   ~Rep() {
+    if (demotion_target != nullptr) {
+      demotion_target->Close();
+      demotion_target->Unref();
+    }
     delete filter;
     delete[] filter_data;
+    delete filter_index;
     delete index_block;
+    delete range_del_list;
+    delete range_del_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
-  FilterBlockReader* filter;
+  Cache* compressed_cache;  // nullptr unless demoting from block_cache
+  uint64_t compressed_cache_id;
+  DemotionTarget* demotion_target;  // nullptr unless demoting
+  FilterBlockReader* filter;        // With kBlockBasedFilter
   const char* filter_data;
+  bool has_full_filter;
+  Slice full_filter;    // With kFullFilter
+  Block* filter_index;  // With kPartitionedFilter: partition handles
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;  // nullptr if the table has no range tombstones
+  // The tombstones of range_del_block, fragmented for point lookups.
+  // nullptr if there are none or the table is not a DB table.
+  FragmentedRangeTombstoneList* range_del_list;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -72,20 +180,36 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->compressed_cache = nullptr;
+    rep->compressed_cache_id = 0;
+    rep->demotion_target = nullptr;
+    if (options.block_cache != nullptr &&
+        options.compressed_block_cache != nullptr &&
+        options.compressed_block_cache != options.block_cache) {
+      rep->compressed_cache = options.compressed_block_cache;
+      rep->compressed_cache_id = rep->compressed_cache->NewId();
+      rep->demotion_target =
+          new DemotionTarget(rep->compressed_cache, rep->compressed_cache_id,
+                             options.block_cache_stats);
+    }
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->has_full_filter = false;
+    rep->filter_index = nullptr;
+    rep->range_del_block = nullptr;
+    rep->range_del_list = nullptr;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -95,22 +219,50 @@ void Table::ReadMeta(const Footer& footer) {
   BlockContents contents;
   if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
     // Do not propagate errors since meta info is not needed for operation
-    return;
+    return Status::OK();
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    // The table has filters of at most one of the layouts.
+    const FilterLayout layouts[] = {kFullFilter, kPartitionedFilter,
+                                    kBlockBasedFilter};
+    const char* prefixes[] = {"fullfilter.", "partitionedfilter.", "filter."};
+    for (int i = 0; i < 3; i++) {
+      std::string key = prefixes[i];
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), layouts[i]);
+        break;
+      }
+    }
+  }
+
+  // Unlike the filter, the range tombstones are needed for correct
+  // reads, so failing to load them fails the open.
+  Status s;
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    Slice v = iter->value();
+    BlockHandle handle;
+    BlockContents range_del_contents;
+    s = handle.DecodeFrom(&v);
+    if (s.ok()) {
+      s = ReadBlock(rep_->file, opt, handle, &range_del_contents);
+    }
+    if (s.ok()) {
+      rep_->range_del_block = new Block(range_del_contents);
+      s = BuildRangeTombstoneList();
+    }
   }
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, FilterLayout layout) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -127,10 +279,20 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  if (layout == kPartitionedFilter) {
+    rep_->filter_index = new Block(block);
+    return;
+  }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  if (layout == kFullFilter) {
+    rep_->has_full_filter = true;
+    rep_->full_filter = block.data;
+  } else {
+    rep_->filter =
+        new FilterBlockReader(rep_->options.filter_policy, block.data);
+  }
 }
 
 Table::~Table() { delete rep_; }
@@ -144,16 +306,216 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+// Inverse of CompressBlock().  Returns false if "entry" is corrupted.
+static bool UncompressBlock(const Slice& entry, BlockContents* result) {
+  if (entry.empty()) {
+    return false;
+  }
+  const char* data = entry.data() + 1;
+  const size_t n = entry.size() - 1;
+  char* buf;
+  size_t length;
+  switch (entry[0]) {
+    case kNoCompression:
+      buf = new char[n];
+      memcpy(buf, data, n);
+      length = n;
+      break;
+    case kSnappyCompression:
+      if (!port::Snappy_GetUncompressedLength(data, n, &length)) {
+        return false;
+      }
+      buf = new char[length];
+      if (!port::Snappy_Uncompress(data, n, buf)) {
+        delete[] buf;
+        return false;
+      }
+      break;
+    default:
+      return false;
+  }
+  result->data = Slice(buf, length);
+  result->heap_allocated = true;
+  result->cachable = true;
+  return true;
+}
+
+// A block in the block cache of a table with a compressed_block_cache.
+// Blocks leave the block cache through their deleter, which is also what
+// runs when they are evicted, and this one moves them down a tier.
+//
+// Deleters may run with a lock of the cache held, e.g. when Insert()
+// evicts entries, so the deleter only queues the block, and the thread
+// that inserted or released it compresses and demotes the queued blocks
+// once the cache returns.
+class DemotableBlock : public Block {
+ public:
+  DemotableBlock(const BlockContents& contents, DemotionTarget* target,
+                 uint64_t offset)
+      : Block(contents), target_(target), offset_(offset) {
+    target_->Ref();
+  }
+
+  ~DemotableBlock() { target_->Unref(); }
+
+  bool table_closed() const { return target_->closed(); }
+
+  void Demote() const {
+    if (size() != 0) {  // Else corrupted
+      target_->Demote(contents(), offset_);
+    }
+  }
+
+ private:
+  DemotionTarget* const target_;
+  const uint64_t offset_;
+};
+
+// The blocks evicted from block caches that are waiting to be demoted.
+struct PendingDemotions {
+  port::Mutex mu;
+  std::vector<DemotableBlock*> blocks GUARDED_BY(mu);
+  std::atomic<bool> empty{true};  // Lets DemotePendingBlocks() skip mu
+};
+
+static PendingDemotions* Pending() {
+  static NoDestructor<PendingDemotions> pending;
+  return pending.get();
+}
+
+static void DemoteCachedBlock(const Slice& key, void* value) {
+  DemotableBlock* block =
+      static_cast<DemotableBlock*>(reinterpret_cast<Block*>(value));
+  if (block->table_closed()) {
+    delete block;
+    return;
+  }
+  PendingDemotions* pending = Pending();
+  MutexLock l(&pending->mu);
+  pending->blocks.push_back(block);
+  pending->empty.store(false, std::memory_order_release);
+}
+
+// Demotes the queued blocks.  REQUIRES: no cache lock is held.
+static void DemotePendingBlocks() {
+  PendingDemotions* pending = Pending();
+  if (pending->empty.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::vector<DemotableBlock*> blocks;
+  {
+    MutexLock l(&pending->mu);
+    blocks.swap(pending->blocks);
+    pending->empty.store(true, std::memory_order_relaxed);
+  }
+  for (DemotableBlock* block : blocks) {
+    block->Demote();
+    delete block;
+  }
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+// Like ReleaseBlock(), for a cache whose evicted blocks are demoted.  The
+// last release of a block that was evicted while in use queues it.
+static void ReleaseDemotableBlock(void* arg, void* h) {
+  ReleaseBlock(arg, h);
+  DemotePendingBlocks();
+}
+
+// Ask the table's rate limiter, if any, for the bytes of the block at
+// "handle" before reading it for a rate limited (i.e. compaction) read.
+static void ChargeRateLimiter(const Options& table_options,
+                              const ReadOptions& options,
+                              const BlockHandle& handle) {
+  if (options.rate_limited && table_options.rate_limiter != nullptr) {
+    table_options.rate_limiter->Request(handle.size() + kBlockTrailerSize,
+                                        Env::kLow);
+  }
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  Slice* filter = reinterpret_cast<Slice*>(value);
+  delete[] filter->data();
+  delete filter;
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options, const Slice& key) {
+  if (rep_->has_full_filter) {
+    return rep_->options.filter_policy->KeyMayMatch(key, rep_->full_filter);
+  }
+  if (rep_->filter_index == nullptr) {
+    return true;
+  }
+
+  Iterator* iter = rep_->filter_index->NewIterator(rep_->options.comparator);
+  iter->Seek(key);
+  bool may_match = true;  // Errors are treated as potential matches
+  if (!iter->Valid()) {
+    // The key is past the last key of the table, unless the index is
+    // corrupt.
+    may_match = !iter->status().ok();
+  } else {
+    Slice input = iter->value();
+    BlockHandle handle;
+    if (handle.DecodeFrom(&input).ok()) {
+      may_match = PartitionMayMatch(options, handle, key);
+    }
+  }
+  delete iter;
+  return may_match;
+}
+
+bool Table::PartitionMayMatch(const ReadOptions& options,
+                              const BlockHandle& handle, const Slice& key) {
+  const FilterPolicy* policy = rep_->options.filter_policy;
+
+  // Partitions are cached like data blocks, keyed by their offset.
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      const bool may_match = policy->KeyMayMatch(
+          key, *reinterpret_cast<Slice*>(block_cache->Value(cache_handle)));
+      block_cache->Release(cache_handle);
+      return may_match;
+    }
+  }
+
+  BlockContents contents;
+  ChargeRateLimiter(rep_->options, options, handle);
+  if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+    return true;
+  }
+  const bool may_match = policy->KeyMayMatch(key, contents.data);
+  if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+    block_cache->Release(block_cache->Insert(cache_key, new Slice(contents.data),
+                                             contents.data.size(),
+                                             &DeleteCachedFilter));
+  } else if (contents.heap_allocated) {
+    delete[] contents.data.data();
+  }
+  return may_match;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
+  return BlockReader(arg, options, index_value, nullptr, false);
+}
+
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value, LookupTrace* trace,
+                             bool point_lookup) {
   Table* table = reinterpret_cast<Table*>(arg);
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = nullptr;
@@ -168,6 +530,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   if (s.ok()) {
     BlockContents contents;
     if (block_cache != nullptr) {
+      BlockCacheStats* stats = table->rep_->options.block_cache_stats;
+      Cache* compressed_cache = table->rep_->compressed_cache;
       char cache_key_buffer[16];
       EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
@@ -175,17 +539,63 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        if (trace != nullptr) trace->block_cache_hits++;
+        if (stats != nullptr) {
+          stats->hits.fetch_add(1, std::memory_order_relaxed);
+        }
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        if (stats != nullptr) {
+          stats->misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool found = false;
+        if (compressed_cache != nullptr) {
+          char compressed_key_buffer[16];
+          EncodeFixed64(compressed_key_buffer,
+                        table->rep_->compressed_cache_id);
+          EncodeFixed64(compressed_key_buffer + 8, handle.offset());
+          Slice compressed_key(compressed_key_buffer,
+                               sizeof(compressed_key_buffer));
+          Cache::Handle* compressed_handle =
+              compressed_cache->Lookup(compressed_key);
+          if (compressed_handle != nullptr) {
+            found = UncompressBlock(
+                *reinterpret_cast<std::string*>(
+                    compressed_cache->Value(compressed_handle)),
+                &contents);
+            compressed_cache->Release(compressed_handle);
+            if (found && options.fill_cache) {
+              // The block moves up to block_cache, and comes back down
+              // when it is evicted from there.
+              compressed_cache->Erase(compressed_key);
+            }
+          }
+          if (stats != nullptr) {
+            (found ? stats->compressed_hits : stats->compressed_misses)
+                .fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        if (!found) {
+          ChargeRateLimiter(table->rep_->options, options, handle);
+          s = ReadBlock(table->rep_->file, options, handle, &contents);
+        }
         if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
+          if (!contents.cachable || !options.fill_cache) {
+            block = new Block(contents);
+          } else if (compressed_cache != nullptr) {
+            block = new DemotableBlock(contents, table->rep_->demotion_target,
+                                       handle.offset());
+            cache_handle = block_cache->Insert(key, block, block->size(),
+                                               &DemoteCachedBlock);
+            DemotePendingBlocks();
+          } else {
+            block = new Block(contents);
             cache_handle = block_cache->Insert(key, block, block->size(),
                                                &DeleteCachedBlock);
           }
         }
       }
     } else {
+      ChargeRateLimiter(table->rep_->options, options, handle);
       s = ReadBlock(table->rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
@@ -195,11 +605,16 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    const Comparator* comparator = table->rep_->options.comparator;
+    iter = point_lookup ? block->NewPointLookupIterator(comparator)
+                        : block->NewIterator(comparator);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+      iter->RegisterCleanup(table->rep_->demotion_target != nullptr
+                                ? &ReleaseDemotableBlock
+                                : &ReleaseBlock,
+                            block_cache, cache_handle);
     }
   } else {
     iter = NewErrorIterator(s);
@@ -210,12 +625,19 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      &Table::BlockReader, const_cast<Table*>(this), options,
+      rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&),
+                          LookupTrace* trace) {
+  if (!FilterMayMatch(options, k)) {
+    if (trace != nullptr) trace->filter_rejections++;
+    return Status::OK();
+  }
+
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
@@ -226,8 +648,16 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
+      if (trace != nullptr) trace->filter_rejections++;
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      if (trace != nullptr) {
+        Slice input = iiter->value();
+        if (handle.DecodeFrom(&input).ok()) {
+          trace->block_offset = handle.offset();
+        }
+      }
+      Iterator* block_iter = BlockReader(this, options, iiter->value(), trace,
+                                        /*point_lookup=*/true);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
@@ -243,6 +673,98 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+Status Table::BuildRangeTombstoneList() {
+  // Only DB tables have range tombstones, and the DB opens them with its
+  // internal key comparator.  Other clients, such as the table dumper,
+  // only read the tombstones through NewRangeTombstoneIterator().
+  const Comparator* cmp = rep_->options.comparator;
+  if (strcmp(cmp->Name(), "leveldb.InternalKeyComparator") != 0) {
+    return Status::OK();
+  }
+  const Comparator* ucmp =
+      static_cast<const InternalKeyComparator*>(cmp)->user_comparator();
+  Iterator* iter = rep_->range_del_block->NewIterator(cmp);
+  rep_->range_del_list = new FragmentedRangeTombstoneList(ucmp, iter);
+  delete iter;
+  return rep_->range_del_list->status();
+}
+
+uint64_t Table::MaxCoveringTombstoneSequence(const Slice& user_key,
+                                             uint64_t snapshot) const {
+  if (rep_->range_del_list == nullptr) {
+    return 0;
+  }
+  return rep_->range_del_list->MaxCoveringSequence(user_key, snapshot);
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, const Slice* keys,
+                               void* const* args, size_t n,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  Iterator* iiter = rep_->index_block->NewIterator(cmp);
+  std::vector<size_t> candidates;
+  size_t i = 0;
+  while (i < n && s.ok()) {
+    iiter->Seek(keys[i]);
+    if (!iiter->Valid()) {
+      break;  // The remaining keys are past the end of the table
+    }
+
+    // keys[i,end) all seek into the block of this index entry.
+    size_t end = i + 1;
+    while (end < n && cmp->Compare(keys[end], iiter->key()) <= 0) {
+      end++;
+    }
+
+    // Consult the filter for all of them before reading the block.
+    candidates.clear();
+    Slice handle_value = iiter->value();
+    FilterBlockReader* filter = rep_->filter;
+    BlockHandle handle;
+    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok()) {
+      for (size_t j = i; j < end; j++) {
+        if (filter->KeyMayMatch(handle.offset(), keys[j])) {
+          candidates.push_back(j);
+        }
+      }
+    } else {
+      for (size_t j = i; j < end; j++) {
+        if (FilterMayMatch(options, keys[j])) {
+          candidates.push_back(j);
+        }
+      }
+    }
+
+    if (!candidates.empty()) {
+      Iterator* block_iter = BlockReader(this, options, iiter->value(),
+                                         nullptr, /*point_lookup=*/true);
+      for (size_t j : candidates) {
+        block_iter->Seek(keys[j]);
+        if (block_iter->Valid()) {
+          (*handle_result)(args[j], block_iter->key(), block_iter->value());
+        }
+      }
+      s = block_iter->status();
+      delete block_iter;
+    }
+    i = end;
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
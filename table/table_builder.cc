@@ -5,6 +5,8 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <string.h>
+
 #include <iostream>
 
 #include "leveldb/comparator.h"
@@ -20,19 +22,38 @@
 
 namespace leveldb {
 
+// Data blocks only get a hash index when their keys are internal keys,
+// from whose user keys it is built.
+static bool HasInternalKeys(const Options& options) {
+  return strcmp(options.comparator->Name(), "leveldb.InternalKeyComparator") ==
+         0;
+}
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options,
+                   opt.data_block_hash_index && HasInternalKeys(opt)),
         index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr ||
+                             opt.filter_layout != kBlockBasedFilter
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
+        full_filter_block(
+            opt.filter_policy == nullptr ||
+                    opt.filter_layout == kBlockBasedFilter
+                ? nullptr
+                : new FullFilterBlockBuilder(
+                      opt.filter_policy,
+                      opt.filter_layout == kPartitionedFilter
+                          ? opt.filter_partition_keys
+                          : 0)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -44,10 +65,12 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -74,6 +97,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
   delete rep_;
 }
 
@@ -84,6 +108,10 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.filter_layout != rep_->options.filter_layout) {
+    return Status::InvalidArgument(
+        "changing filter layout while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -113,6 +141,9 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -124,6 +155,13 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -138,6 +176,9 @@ void TableBuilder::Flush() {
   if (r->filter_block != nullptr) {
     r->filter_block->StartBlock(r->offset);
   }
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->StartBlock();
+  }
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
@@ -204,7 +245,8 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
@@ -212,18 +254,69 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
+  // Write the full filter, or the filter partitions and their index
+  const char* filter_prefix = "filter.";
+  if (r->full_filter_block != nullptr) {
+    FullFilterBlockBuilder* builder = r->full_filter_block;
+    builder->Finish();
+    if (builder->num_partitions() == 0) {
+      // No keys, so there is nothing a filter could rule out.
+      filter_prefix = nullptr;
+    } else if (r->options.filter_layout == kFullFilter) {
+      assert(builder->num_partitions() == 1);
+      filter_prefix = "fullfilter.";
+      if (ok()) {
+        WriteRawBlock(builder->filter(0), kNoCompression,
+                      &filter_block_handle);
+      }
+    } else {
+      // Each partition is indexed by its last key, which is >= the keys
+      // of the partition and < the keys of the next one.
+      filter_prefix = "partitionedfilter.";
+      BlockBuilder partition_index(&r->index_block_options);
+      for (size_t i = 0; ok() && i < builder->num_partitions(); i++) {
+        BlockHandle partition_handle;
+        WriteRawBlock(builder->filter(i), kNoCompression, &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        partition_index.Add(builder->last_key(i), handle_encoding);
+      }
+      if (ok()) {
+        WriteBlock(&partition_index, &filter_block_handle);
+      }
+    }
+  }
+
+  // Write range tombstone block
+  const bool has_range_deletions = !r->range_del_block.empty();
+  if (ok() && has_range_deletions) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // The metaindex is searched with a bytewise comparator, and may hold
+    // several keys, so build it with one too.
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (r->options.filter_policy != nullptr && filter_prefix != nullptr) {
+      // Add mapping from "filter.Name" (or "fullfilter.Name" or
+      // "partitionedfilter.Name") to location of filter data
+      std::string key = filter_prefix;
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
 
+    if (has_range_deletions) {
+      // Add mapping from "rangedel" to location of the range tombstones
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
+    }
+
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
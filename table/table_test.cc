@@ -11,6 +11,7 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -18,6 +19,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -237,6 +239,10 @@ class TableConstructor : public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
@@ -755,6 +761,138 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   return result;
 }
 
+// Seeks every user key of "block" and some that are not in it with a
+// point lookup iterator and a plain one, at snapshots that see all, some
+// or none of the versions of the key.  The point lookup must find the
+// same entry whenever the plain seek finds one of the user key.  Returns
+// the number of seeks that the point lookup iterator answered without
+// looking at any entry.
+static int CheckPointLookups(const InternalKeyComparator& cmp, Block* block,
+                             int num_user_keys) {
+  Iterator* plain = block->NewIterator(&cmp);
+  Iterator* lookup = block->NewPointLookupIterator(&cmp);
+  const SequenceNumber snapshots[] = {7, 8, 9, 10, kMaxSequenceNumber};
+  int skipped = 0;
+  for (int i = 0; i < 2 * num_user_keys + 1; i++) {
+    char user_key[10];
+    std::snprintf(user_key, sizeof(user_key), "k%04d", i);
+    for (SequenceNumber snapshot : snapshots) {
+      InternalKey target(user_key, snapshot, kValueTypeForSeek);
+      plain->Seek(target.Encode());
+      lookup->Seek(target.Encode());
+      const bool plain_found =
+          plain->Valid() && ExtractUserKey(plain->key()) == user_key;
+      const bool lookup_found =
+          lookup->Valid() && ExtractUserKey(lookup->key()) == user_key;
+      EXPECT_EQ(plain_found, lookup_found) << user_key << "@" << snapshot;
+      if (plain_found && lookup_found) {
+        EXPECT_EQ(plain->key().ToString(), lookup->key().ToString());
+        EXPECT_EQ(plain->value().ToString(), lookup->value().ToString());
+      }
+      if (plain->Valid() && !lookup->Valid()) {
+        skipped++;
+      }
+    }
+  }
+  EXPECT_LEVELDB_OK(plain->status());
+  EXPECT_LEVELDB_OK(lookup->status());
+  delete plain;
+  delete lookup;
+  return skipped;
+}
+
+// Builds a block with the even user keys below 2 * num_user_keys, the
+// i-th of them with (i % 3) + 1 versions.
+static std::string BuildVersionedBlock(const Options& options, bool hash_index,
+                                       int num_user_keys) {
+  BlockBuilder builder(&options, hash_index);
+  for (int i = 0; i < num_user_keys; i++) {
+    char user_key[10];
+    std::snprintf(user_key, sizeof(user_key), "k%04d", 2 * i);
+    for (int v = 0; v <= i % 3; v++) {
+      InternalKey key(user_key, 10 - v, kTypeValue);
+      builder.Add(key.Encode(), std::string(user_key) + "@" +
+                                    std::to_string(10 - v));
+    }
+  }
+  return builder.Finish().ToString();
+}
+
+static bool HasHashIndex(const std::string& block_data) {
+  return (DecodeFixed32(block_data.data() + block_data.size() - 4) &
+          kBlockHashIndexFlag) != 0;
+}
+
+TEST(BlockTest, HashIndexPointLookup) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 4;
+
+  for (bool hash_index : {false, true}) {
+    std::string data = BuildVersionedBlock(options, hash_index, 200);
+    ASSERT_EQ(hash_index, HasHashIndex(data));
+    BlockContents contents;
+    contents.data = data;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+    const int skipped = CheckPointLookups(cmp, &block, 200);
+    if (hash_index) {
+      // Most of the user keys that are not in the block hash to a bucket
+      // that no key of the block does.
+      ASSERT_GT(skipped, 100);
+    } else {
+      ASSERT_EQ(0, skipped);
+    }
+
+    // A plain iterator sees the same entries either way.
+    Iterator* iter = block.NewIterator(&cmp);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(399, count);
+    delete iter;
+  }
+}
+
+TEST(BlockTest, HashIndexSkippedForManyRestarts) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 1;
+
+  std::string data = BuildVersionedBlock(options, true, 300);
+  ASSERT_FALSE(HasHashIndex(data));
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  ASSERT_EQ(0, CheckPointLookups(cmp, &block, 300));
+}
+
+TEST(BlockTest, HashIndexCorruption) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  std::string data = BuildVersionedBlock(options, true, 20);
+  ASSERT_TRUE(HasHashIndex(data));
+
+  // A bucket count larger than the block is detected when it is opened.
+  std::string bad = data;
+  bad[bad.size() - 6] = '\xff';
+  bad[bad.size() - 5] = '\xff';
+  BlockContents contents;
+  contents.data = bad;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewPointLookupIterator(&cmp);
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+}
+
 TEST(TableTest, ApproximateOffsetOfPlain) {
   TableConstructor c(BytewiseComparator());
   c.Add("k01", "hello");
@@ -826,6 +964,125 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+TEST(TableTest, IterateBounds) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%02d", i);
+    c.Add(key, std::string(100, 'x'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1;  // One key per block
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  Slice lower("k20"), upper("k50");
+  ReadOptions read_options;
+  read_options.iterate_lower_bound = &lower;
+  read_options.iterate_upper_bound = &upper;
+  Iterator* iter = c.NewIterator(read_options);
+
+  // Iteration stops in the block that straddles a bound.  Table
+  // iterators do not filter the keys of that block, so "k50" is yielded.
+  iter->SeekToFirst();
+  ASSERT_EQ("k20", iter->key().ToString());
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) count++;
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(31, count);
+
+  iter->SeekToLast();
+  ASSERT_EQ("k49", iter->key().ToString());
+  count = 0;
+  for (; iter->Valid(); iter->Prev()) count++;
+  ASSERT_EQ(30, count);
+
+  iter->Seek("k60");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST(TableTest, CompressedBlockCache) {
+  StringSink sink;
+  Options options;
+  options.block_size = 1;  // One key per block
+  options.compression = kNoCompression;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 100; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%02d", i);
+    builder.Add(key, std::string(1000, 'a' + i % 26));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+  StringSource source(sink.contents());
+
+  // The block cache has room for two blocks.
+  Cache* block_cache = NewLRUCache(2500, 0);
+  Cache* compressed_cache = NewLRUCache(1 << 20, 0);
+  BlockCacheStats stats;
+  Options table_options;
+  table_options.block_cache = block_cache;
+  table_options.compressed_block_cache = compressed_cache;
+  table_options.block_cache_stats = &stats;
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(table_options, &source, sink.contents().size(), &table));
+
+  auto scan = [table]() {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      EXPECT_EQ(std::string(1000, 'a' + i % 26), iter->value().ToString());
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    return i;
+  };
+
+  // The first scan reads every block from the file, and demotes all but
+  // the last ones it cached.
+  ASSERT_EQ(100, scan());
+  ASSERT_EQ(0, stats.hits.load());
+  ASSERT_EQ(100, stats.misses.load());
+  ASSERT_EQ(0, stats.compressed_hits.load());
+  ASSERT_EQ(100, stats.compressed_misses.load());
+  const uint64_t demoted = stats.demotions.load();
+  ASSERT_GE(demoted, 97);
+  ASSERT_LE(demoted, 99);
+  if (SnappyCompressionSupported()) {
+    // A run of one character compresses to almost nothing.
+    ASSERT_LT(compressed_cache->TotalCharge(), demoted * 100);
+  } else {
+    ASSERT_GT(compressed_cache->TotalCharge(), demoted * 1000);
+  }
+
+  // The second scan finds every block in the compressed cache, including
+  // the last ones once it evicts them from the block cache.
+  ASSERT_EQ(100, scan());
+  ASSERT_EQ(200, stats.misses.load());
+  ASSERT_EQ(100, stats.compressed_hits.load());
+  ASSERT_EQ(100, stats.compressed_misses.load());
+  ASSERT_EQ(demoted + 100, stats.demotions.load());
+
+  // Promoted blocks leave the compressed cache, so each block is in one
+  // tier only.
+  ASSERT_LE(block_cache->TotalCharge() + compressed_cache->TotalCharge(),
+            100 * (1000 + 100));
+
+  // The blocks of a closed table are dropped, not demoted, when they leave
+  // the block cache.
+  ASSERT_GT(block_cache->TotalCharge(), 0);
+  delete table;
+  block_cache->Prune();
+  ASSERT_EQ(0, block_cache->TotalCharge());
+  ASSERT_EQ(demoted + 100, stats.demotions.load());
+
+  delete block_cache;
+  delete compressed_cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
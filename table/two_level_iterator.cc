@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -18,7 +19,8 @@ typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   const Comparator* comparator);
 
   ~TwoLevelIterator() override;
 
@@ -57,9 +59,26 @@ class TwoLevelIterator : public Iterator {
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
 
+  // Returns true iff the blocks after the current index entry only hold
+  // keys >= options_.iterate_upper_bound.
+  bool PastUpperBound() const {
+    return options_.iterate_upper_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_upper_bound) >= 0;
+  }
+
+  // Returns true iff the block of the current index entry only holds
+  // keys < options_.iterate_lower_bound.
+  bool BeforeLowerBound() const {
+    return options_.iterate_lower_bound != nullptr &&
+           comparator_->Compare(index_iter_.key(),
+                                *options_.iterate_lower_bound) < 0;
+  }
+
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Comparator* const comparator_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -70,16 +89,24 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   const Comparator* comparator)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      comparator_(comparator),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
 TwoLevelIterator::~TwoLevelIterator() = default;
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  if (options_.iterate_upper_bound != nullptr &&
+      comparator_->Compare(target, *options_.iterate_upper_bound) >= 0) {
+    // Every key at or after target is out of bounds.
+    SetDataIterator(nullptr);
+    return;
+  }
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
@@ -87,6 +114,10 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  if (options_.iterate_lower_bound != nullptr) {
+    Seek(*options_.iterate_lower_bound);
+    return;
+  }
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
@@ -94,9 +125,31 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
-  index_iter_.SeekToLast();
-  InitDataBlock();
-  if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+  if (options_.iterate_upper_bound == nullptr) {
+    index_iter_.SeekToLast();
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+  } else {
+    // Position at the last key before the upper bound.  Only the block
+    // that may straddle the bound has to be read.
+    const Slice& bound = *options_.iterate_upper_bound;
+    index_iter_.Seek(bound);
+    if (!index_iter_.Valid()) {
+      index_iter_.SeekToLast();
+      InitDataBlock();
+      if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+    } else {
+      InitDataBlock();
+      if (data_iter_.iter() != nullptr) {
+        data_iter_.Seek(bound);
+        if (data_iter_.Valid()) {
+          data_iter_.Prev();
+        } else {
+          data_iter_.SeekToLast();
+        }
+      }
+    }
+  }
   SkipEmptyDataBlocksBackward();
 }
 
@@ -115,7 +168,7 @@ void TwoLevelIterator::Prev() {
 void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() || PastUpperBound()) {
       SetDataIterator(nullptr);
       return;
     }
@@ -133,6 +186,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (index_iter_.Valid() && BeforeLowerBound()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -164,8 +221,10 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              const Comparator* comparator) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator);
 }
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,11 +21,16 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// "comparator" orders the keys of index_iter, each of which must be >=
+// every key of its block and < every key of the next block.  It is used
+// to skip the blocks that lie entirely outside options.iterate_lower_bound
+// and options.iterate_upper_bound.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options, const Comparator* comparator);
 
 }  // namespace leveldb
 
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "leveldb/db.h"
+#include "leveldb/secondary_index.h"
 #include "sys/time.h"
 #include "map"
 #include "unordered_map"
@@ -177,8 +178,10 @@ TEST(ColumnFamily, read){
   Status status = DB::Open(op, "testdb_cf", &db);
   assert(status.ok());
 
-  ColumnFamilyHandle cf1("test1");
-  ColumnFamilyHandle cf2("test2");
+  ColumnFamilyHandle* cf1;
+  ColumnFamilyHandle* cf2;
+  ASSERT_TRUE(db->CreateColumnFamily(Options(), "test1", &cf1).ok());
+  ASSERT_TRUE(db->CreateColumnFamily(Options(), "test2", &cf2).ok());
 
   db->Put(WriteOptions(), cf1, "123", "123");
   db->Put(WriteOptions(), cf2, "321", "321");
@@ -200,6 +203,7 @@ TEST(ColumnFamily, read){
 #if SHOW_DATA
   std::cout<<value<<"\n";
 #endif
+  delete db;
 }
 
 TEST(ColumnFamily, iterator){
@@ -209,8 +213,10 @@ TEST(ColumnFamily, iterator){
   Status status = DB::Open(op, "testdb_cf2", &db);
   assert(status.ok());
 
-  ColumnFamilyHandle cf1("test1");
-  ColumnFamilyHandle cf2("test2");
+  ColumnFamilyHandle* cf1;
+  ColumnFamilyHandle* cf2;
+  ASSERT_TRUE(db->CreateColumnFamily(Options(), "test1", &cf1).ok());
+  ASSERT_TRUE(db->CreateColumnFamily(Options(), "test2", &cf2).ok());
 
   for(int i=0;i<10;i++){
     db->Put(WriteOptions(), cf1, std::to_string(i), std::to_string(i));
@@ -219,7 +225,7 @@ TEST(ColumnFamily, iterator){
     db->Put(WriteOptions(), cf2, std::to_string(i), std::to_string(i));
   }
 
-  Iterator* iter1 = db->NewColumnFamilyIterator(ReadOptions(), cf1);
+  Iterator* iter1 = db->NewIterator(ReadOptions(), cf1);
   iter1->SeekToFirst();
   ASSERT_EQ(Slice("0").ToString(), iter1->key().ToString());
 
@@ -231,7 +237,7 @@ TEST(ColumnFamily, iterator){
 #endif
   delete iter1;
 
-  Iterator* iter2 = db->NewColumnFamilyIterator(ReadOptions(), cf2);
+  Iterator* iter2 = db->NewIterator(ReadOptions(), cf2);
   iter2->SeekToFirst();
   ASSERT_EQ(Slice("10"), iter2->key());
 
@@ -243,9 +249,10 @@ TEST(ColumnFamily, iterator){
 #endif
   delete iter2;
 
+  // Column families do not show up in the default column family.
   Iterator* it = db->NewIterator(ReadOptions());
   it->SeekToFirst();
-  ASSERT_EQ(Slice("test1_0").ToString(), it->key().ToString());
+  ASSERT_FALSE(it->Valid());
 
 #if SHOW_DATA
   for(;it->Valid();it->Next()){
@@ -256,57 +263,75 @@ TEST(ColumnFamily, iterator){
   delete db;
 }
 
-TEST(Index, PutWithIndex){
+// Indexes the records by their values, which are integers, zero-padded
+// so that the index keys sort numerically.
+class GradeIndex : public SecondaryIndex {
+ public:
+  const char* Name() const override { return "grade"; }
+  bool Extract(const Slice& key, const Slice& value,
+               std::string* index_key) const override {
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%08d", atoi(value.ToString().c_str()));
+    index_key->assign(buf);
+    return true;
+  }
+};
+
+static GradeIndex grade_index;
+
+TEST(Index, Put){
   DB *db = nullptr;
   Options op;
   op.create_if_missing = true;
+  op.secondary_indexes.push_back(&grade_index);
   Status status = DB::Open(op, "testdb_idx", &db);
   assert(status.ok());
 
-  ColumnFamilyHandle cf_record("Record");
-  ColumnFamilyHandle cf_index("Index");
-
-  db->PutWithIndex(WriteOptions(), "1", "111");
+  db->Put(WriteOptions(), "1", "111");
 
   std::string value;
-  Status s = db->Get(ReadOptions(), cf_record, "1", &value);
-  ASSERT_FALSE(s.ok());
-  s = db->Get(ReadOptions(), cf_record, "00000001", &value);
-  ASSERT_TRUE(s.ok());
-  ASSERT_EQ("00000111", value);
-  s = db->Get(ReadOptions(), cf_index, "00000111_00000001", &value);
+  Status s = db->Get(ReadOptions(), "1", &value);
   ASSERT_TRUE(s.ok());
-}
-
-TEST(Index, GetIntPos){
-  ASSERT_EQ(IndexIterator::GetIntPos("0000", 4), 3);
-  ASSERT_EQ(IndexIterator::GetIntPos("100", 3), 0);
-  ASSERT_EQ(IndexIterator::GetIntPos("00000100", 8), 5);
+  ASSERT_EQ("111", value);
+
+  IndexIterator* idx_iter =
+      db->NewIndexIterator(ReadOptions(), db->DefaultColumnFamily(), "grade");
+  idx_iter->Seek("00000111");
+  ASSERT_TRUE(idx_iter->Valid());
+  ASSERT_EQ("00000111", idx_iter->key().ToString());
+  ASSERT_EQ("1", idx_iter->primary_key().ToString());
+  ASSERT_EQ("111", idx_iter->value().ToString());
+  delete idx_iter;
+  delete db;
 }
 
 TEST(Index, Iterator){
   DB *db = nullptr;
   Options op;
   op.create_if_missing = true;
+  op.secondary_indexes.push_back(&grade_index);
   Status status = DB::Open(op, "testdb_idx_iter", &db);
   assert(status.ok());
   for (int i = 0; i < 10; i++)
   {
-    db->PutWithIndex(WriteOptions(), std::to_string(i), std::to_string(100-i));
+    db->Put(WriteOptions(), std::to_string(i), std::to_string(100-i));
   }
 
-  Iterator* idx_iter = db->NewIndexIterator(ReadOptions());
+  IndexIterator* idx_iter =
+      db->NewIndexIterator(ReadOptions(), db->DefaultColumnFamily(), "grade");
   idx_iter->SeekToFirst();
   for(int i=0;i<10;i++){
   #if SHOW_DATA
-    std::cout<<idx_iter->key().ToString()<<","<<idx_iter->value().ToString()<<" ";
+    std::cout<<idx_iter->key().ToString()<<","<<idx_iter->primary_key().ToString()<<" ";
   #endif
-    // ASSERT_GT(last, idx_iter->value().ToString());
-    // last = idx_iter->value().ToString();
-    ASSERT_EQ(idx_iter->key().ToString(), std::to_string(91+i));
-    ASSERT_EQ(idx_iter->value().ToString(), std::to_string(9-i));
+    char grade[9];
+    snprintf(grade, sizeof(grade), "%08d", 91+i);
+    ASSERT_EQ(idx_iter->key().ToString(), grade);
+    ASSERT_EQ(idx_iter->value().ToString(), std::to_string(91+i));
+    ASSERT_EQ(idx_iter->primary_key().ToString(), std::to_string(9-i));
     idx_iter->Next();
   }
+  ASSERT_FALSE(idx_iter->Valid());
   delete idx_iter;
   delete db;
 }
@@ -318,6 +343,7 @@ TEST(Index, GetGrade){
   DB *db = nullptr;
   Options op;
   op.create_if_missing = true;
+  op.secondary_indexes.push_back(&grade_index);
   Status status = DB::Open(op, "exp_grade", &db);
   assert(status.ok());
 
@@ -336,7 +362,7 @@ TEST(Index, GetGrade){
       break;
     }
 #endif
-    db->PutWithIndex(WriteOptions(), std::to_string(a), std::to_string(b));
+    db->Put(WriteOptions(), std::to_string(a), std::to_string(b));
   }
   std::cout<<i<<" read finished in "<<GetUnixTimeUs()-start<<"us\n";
   fclose(stdin);
@@ -349,18 +375,20 @@ TEST(Index, scan){
   DB *db = nullptr;
   Options op;
   op.create_if_missing = true;
+  op.secondary_indexes.push_back(&grade_index);
   Status status = DB::Open(op, "exp_grade", &db);
   assert(status.ok());
   
-  std::string start = "600";
-  std::string end = "700";
+  std::string start = "00000600";
+  std::string end = "00000700";
 
-  Iterator* iter = db->NewIndexIterator(ReadOptions());
+  IndexIterator* iter =
+      db->NewIndexIterator(ReadOptions(), db->DefaultColumnFamily(), "grade");
   iter->Seek(start);
-  ASSERT_EQ(iter->key().ToString(), "600");
-  ASSERT_EQ(iter->value().ToString(), "111");
+  ASSERT_EQ(iter->key().ToString(), "00000600");
+  ASSERT_EQ(iter->primary_key().ToString(), "111");
 #if SHOW_DATA
-  std::cout<<iter->key().ToString()<<" "<<iter->value().ToString()<<"\n";
+  std::cout<<iter->key().ToString()<<" "<<iter->primary_key().ToString()<<"\n";
 #endif
 
   int cnt = 0;
@@ -376,15 +404,15 @@ TEST(Index, scan){
   std::cout<<cnt<<" Iteration with index finished in "<<GetUnixTimeUs()-iter_start<<"us\n";
 
   cnt = 0;
-  iter = db->NewColumnFamilyIterator(ReadOptions(), *(new ColumnFamilyHandle("Record")));
-  iter->SeekToFirst();
-  ASSERT_EQ(iter->key().ToString(), "00000001");
+  Iterator* it = db->NewIterator(ReadOptions());
   iter_start = GetUnixTimeUs();
-  for(;iter->Valid();iter->Next()){
-    if(iter->value().ToString()<="00000700" && iter->value().ToString()>="00000600"){
+  for(it->SeekToFirst();it->Valid();it->Next()){
+    int grade = atoi(it->value().ToString().c_str());
+    if(grade<=700 && grade>=600){
       cnt++;
     }
   }
+  delete it;
   ASSERT_EQ(cnt, 663755);
   std::cout<<cnt<<" Iteration without index finished in "<<GetUnixTimeUs()-iter_start<<"us\n";
 }
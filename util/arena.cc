@@ -4,14 +4,44 @@
 
 #include "util/arena.h"
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
+static const int kNumShards = 8;
+
+static const int kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+static_assert((kAlign & (kAlign - 1)) == 0,
+              "Pointer size should be a power of 2");
+
+struct Arena::ConcurrentState {
+  struct Shard {
+    port::Mutex mu;
+    char* alloc_ptr GUARDED_BY(mu) = nullptr;
+    size_t alloc_bytes_remaining GUARDED_BY(mu) = 0;
+  };
+
+  port::Mutex blocks_mu;  // Guards Arena::blocks_
+  Shard shards[kNumShards];
+};
 
 Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    : alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      concurrent_(nullptr),
+      memory_usage_(0) {}
+
+Arena::Arena(bool concurrent) : Arena() {
+  if (concurrent) {
+    concurrent_ = new ConcurrentState;
+  }
+}
 
 Arena::~Arena() {
+  delete concurrent_;
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
@@ -36,11 +66,11 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
-  static_assert((align & (align - 1)) == 0,
-                "Pointer size should be a power of 2");
-  size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
-  size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+  if (concurrent_ != nullptr) {
+    return AllocateConcurrently(bytes, true);
+  }
+  size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (kAlign - 1);
+  size_t slop = (current_mod == 0 ? 0 : kAlign - current_mod);
   size_t needed = bytes + slop;
   char* result;
   if (needed <= alloc_bytes_remaining_) {
@@ -51,13 +81,52 @@ char* Arena::AllocateAligned(size_t bytes) {
     // AllocateFallback always returned aligned memory
     result = AllocateFallback(bytes);
   }
-  assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+  assert((reinterpret_cast<uintptr_t>(result) & (kAlign - 1)) == 0);
+  return result;
+}
+
+char* Arena::AllocateConcurrently(size_t bytes, bool aligned) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // Same policy as AllocateFallback(): big objects get their own block.
+    return AllocateNewBlock(bytes);
+  }
+
+  // Threads are spread over the shards in the order they first allocate.
+  static std::atomic<uint32_t> next_shard(0);
+  static thread_local uint32_t shard_index =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+  ConcurrentState::Shard* shard = &concurrent_->shards[shard_index];
+
+  MutexLock l(&shard->mu);
+  size_t slop = 0;
+  if (aligned) {
+    size_t current_mod =
+        reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (kAlign - 1);
+    slop = (current_mod == 0 ? 0 : kAlign - current_mod);
+  }
+  if (bytes + slop > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the shard's current block.
+    shard->alloc_ptr = AllocateNewBlock(kBlockSize);
+    shard->alloc_bytes_remaining = kBlockSize;
+    slop = 0;
+  }
+  char* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += bytes + slop;
+  shard->alloc_bytes_remaining -= bytes + slop;
+  assert(!aligned ||
+         (reinterpret_cast<uintptr_t>(result) & (kAlign - 1)) == 0);
   return result;
 }
 
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  if (concurrent_ != nullptr) {
+    MutexLock l(&concurrent_->blocks_mu);
+    blocks_.push_back(result);
+  } else {
+    blocks_.push_back(result);
+  }
   memory_usage_.fetch_add(block_bytes + sizeof(char*),
                           std::memory_order_relaxed);
   return result;
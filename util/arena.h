@@ -17,6 +17,11 @@ class Arena {
  public:
   Arena();
 
+  // If "concurrent" is true, Allocate() and AllocateAligned() may be called
+  // from several threads at once.  Each thread then carves its allocations
+  // out of one of a few shards, so that threads rarely wait for each other.
+  explicit Arena(bool concurrent);
+
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
 
@@ -35,8 +40,11 @@ class Arena {
   }
 
  private:
+  struct ConcurrentState;
+
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateConcurrently(size_t bytes, bool aligned);
 
   // Allocation state
   char* alloc_ptr_;
@@ -45,6 +53,9 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // Shards and the lock for blocks_ in concurrent mode, otherwise null.
+  ConcurrentState* concurrent_;
+
   // Total memory usage of the arena.
   //
   // TODO(costan): This member is accessed via atomics, but the others are
@@ -57,6 +68,9 @@ inline char* Arena::Allocate(size_t bytes) {
   // 0-byte allocations, so we disallow them here (we don't need
   // them for our internal use).
   assert(bytes > 0);
+  if (concurrent_ != nullptr) {
+    return AllocateConcurrently(bytes, false);
+  }
   if (bytes <= alloc_bytes_remaining_) {
     char* result = alloc_ptr_;
     alloc_ptr_ += bytes;
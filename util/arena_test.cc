@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,6 +60,40 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Concurrent) {
+  const int kThreads = 4;
+  const int N = 20000;
+  Arena arena(true);
+  std::vector<std::pair<size_t, char*>> allocated[kThreads];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      Random rnd(301 + t);
+      for (int i = 0; i < N; i++) {
+        size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) + 1
+                                   : rnd.Uniform(100) + 1;
+        char* r = rnd.OneIn(2) ? arena.AllocateAligned(s) : arena.Allocate(s);
+        memset(r, t, s);
+        allocated[t].push_back(std::make_pair(s, r));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  size_t bytes = 0;
+  for (int t = 0; t < kThreads; t++) {
+    for (const auto& allocation : allocated[t]) {
+      // No other thread wrote over the allocation.
+      for (size_t b = 0; b < allocation.first; b++) {
+        ASSERT_EQ(t, allocation.second[b]);
+      }
+      bytes += allocation.first;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
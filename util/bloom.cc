@@ -7,6 +7,15 @@
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
+// The blocked bloom filter tests its probes with AVX2 when the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define LEVELDB_BLOOM_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define LEVELDB_BLOOM_HAVE_AVX2 0
+#endif
+
 namespace leveldb {
 
 namespace {
@@ -83,10 +92,159 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A blocked bloom filter sets and tests all the bits of a key in one
+// 64-byte line of the filter, so that a lookup touches one cache line
+// instead of k of them.  The filter is a sequence of lines followed by
+// the number of probes:
+//    lines: char[64 * num_lines]
+//    k: uint8
+// The line of a key is picked by the hash of the key, and its bits by
+// the top 9 bits of successive products of the hash with kProbeMul.
+// Packing the bits of a key in one line raises the false positive rate
+// at high bits per key, e.g. from 0.07% to 0.09% at 16 bits per key; at 10
+// bits per key it is about 1%, like that of BloomFilterPolicy.
+static const size_t kLineBytes = 64;
+static const uint32_t kProbeMul = 0x9e3779b9;
+
+static inline const char* LineOf(const char* lines, size_t num_lines,
+                                 uint32_t h) {
+  // Maps h to [0, num_lines) without a division.
+  return lines + ((static_cast<uint64_t>(h) * num_lines) >> 32) * kLineBytes;
+}
+
+static bool ProbeLine(const char* line, uint32_t h, size_t k) {
+  for (size_t i = 0; i < k; i++) {
+    h *= kProbeMul;
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+  }
+  return true;
+}
+
+#if LEVELDB_BLOOM_HAVE_AVX2
+static constexpr uint32_t ProbeMulPower(int n) {
+  return n == 0 ? 1 : kProbeMul * ProbeMulPower(n - 1);
+}
+
+// Same as ProbeLine(), but tests eight probes at a time.
+__attribute__((target("avx2"))) static bool ProbeLineAVX2(const char* line,
+                                                          uint32_t h,
+                                                          size_t k) {
+  const __m256i multipliers = _mm256_setr_epi32(
+      ProbeMulPower(1), ProbeMulPower(2), ProbeMulPower(3), ProbeMulPower(4),
+      ProbeMulPower(5), ProbeMulPower(6), ProbeMulPower(7), ProbeMulPower(8));
+  // The 32-bit words of the line hold bits [32 * i, 32 * i + 31] of it.
+  const __m256i lower =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+  const __m256i upper =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+  while (true) {
+    const __m256i hashes =
+        _mm256_mullo_epi32(_mm256_set1_epi32(h), multipliers);
+    const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+    const __m256i word_index = _mm256_srli_epi32(bitpos, 5);
+    // Pick each probed word from the lower or the upper half of the line,
+    // by bit 3 of its index.
+    const __m256i words = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(lower, word_index)),
+        _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(upper, word_index)),
+        _mm256_castsi256_ps(_mm256_slli_epi32(word_index, 28))));
+    const __m256i bits = _mm256_sllv_epi32(
+        _mm256_set1_epi32(1), _mm256_and_si256(bitpos, _mm256_set1_epi32(31)));
+    const __m256i missing = _mm256_cmpeq_epi32(_mm256_and_si256(words, bits),
+                                               _mm256_setzero_si256());
+    const int missing_mask =
+        _mm256_movemask_ps(_mm256_castsi256_ps(missing));
+    if (k <= 8) {
+      return (missing_mask & ((1 << k) - 1)) == 0;
+    }
+    if (missing_mask != 0) {
+      return false;
+    }
+    h *= ProbeMulPower(8);
+    k -= 8;
+  }
+}
+
+static bool HaveAVX2() {
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+}
+#endif  // LEVELDB_BLOOM_HAVE_AVX2
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    // We intentionally round down to reduce probing cost a little bit
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  const char* Name() const override { return "leveldb.BlockedBloomFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // Round the size up to whole lines, of which there is at least one.
+    const size_t bits = n * bits_per_key_;
+    size_t num_lines = (bits + kLineBytes * 8 - 1) / (kLineBytes * 8);
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* lines = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      uint32_t h = BloomHash(keys[i]);
+      char* line = const_cast<char*>(LineOf(lines, num_lines, h));
+      for (size_t j = 0; j < k_; j++) {
+        h *= kProbeMul;
+        const uint32_t bitpos = h >> 23;
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < 2) return false;
+    if ((len - 1) % kLineBytes != 0) {
+      // Not a filter of this policy.  Consider it a match.
+      return true;
+    }
+
+    // Use the encoded k so that we can read filters generated by
+    // bloom filters created using different parameters.
+    const char* lines = bloom_filter.data();
+    const size_t k = lines[len - 1];
+    if (k < 1 || k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const char* line = LineOf(lines, (len - 1) / kLineBytes, h);
+#if LEVELDB_BLOOM_HAVE_AVX2
+    if (HaveAVX2()) {
+      return ProbeLineAVX2(line, h, k);
+    }
+#endif  // LEVELDB_BLOOM_HAVE_AVX2
+    return ProbeLine(line, h, k);
+  }
+
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+};
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
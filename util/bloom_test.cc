@@ -19,7 +19,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -150,6 +151,110 @@ TEST_F(BloomTest, VaryingLengths) {
 
 // Different bits-per-byte
 
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  // Count number of filters that significantly exceed the false positive
+  // rate.  Keeping the bits of a key in one line makes the rate a little
+  // higher than that of a plain bloom filter.
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Whole lines of 64 bytes, and the number of probes.
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 64 + 1))
+        << length;
+    ASSERT_EQ(1, FilterSize() % 64) << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.025);  // Must not be over 2.5%
+    if (rate > 0.015)
+      mediocre_filters++;  // Allowed, but not too often
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+            mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+TEST_F(BlockedBloomTest, ManyProbes) {
+  // 30 bits per key need more probes than are tested at a time.
+  const FilterPolicy* policy = NewBlockedBloomFilterPolicy(30);
+  std::vector<std::string> keys;
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::string filter;
+  policy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                       &filter);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(policy->KeyMayMatch(Key(i, buffer), filter)) << i;
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (policy->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 10);
+  delete policy;
+}
+
+TEST_F(BlockedBloomTest, OtherFiltersMatch) {
+  // A filter that is not whole lines was not created by this policy, so
+  // it must not rule any key out.
+  const FilterPolicy* plain = NewBloomFilterPolicy(10);
+  const FilterPolicy* blocked = NewBlockedBloomFilterPolicy(10);
+  Slice key("hello");
+  std::string filter;
+  plain->CreateFilter(&key, 1, &filter);
+  ASSERT_TRUE(blocked->KeyMayMatch("hello", filter));
+  ASSERT_TRUE(blocked->KeyMayMatch("world", filter));
+  delete plain;
+  delete blocked;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
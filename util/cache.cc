@@ -5,6 +5,13 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <utility>
 
 #include "leveldb/cache.h"
 #include "port/port.h"
@@ -48,6 +55,7 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool protect;      // TwoQueueCache only: in the protected queue
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -149,6 +157,8 @@ class HandleTable {
 // A single shard of sharded cache.
 class LRUCache {
  public:
+  using Entry = LRUHandle;
+
   LRUCache();
   ~LRUCache();
 
@@ -277,6 +287,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->protect = false;
   e->refs = 1;  // for the returned handle.
   memcpy(e->key_data, key.data(), key.size());
 
@@ -332,12 +343,675 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// A single shard of a 2Q cache (Johnson and Shasha, VLDB '94).  New
+// entries are put on probation, in a FIFO queue that may hold a quarter of
+// the capacity while other entries compete for it.  An entry looked up
+// again while on probation, or inserted again while the key of an entry
+// recently evicted from probation is remembered, goes to the protected
+// queue, which is evicted in LRU order only once probation is within its
+// share.  A scan, whose blocks are each read once, thus evicts probation
+// entries only and leaves the frequently used ones alone.
+//
+// Entries in use are kept in a separate list as in LRUCache and return to
+// the tail of their queue when released.
+class TwoQueueCache {
+ public:
+  using Entry = LRUHandle;
+
+  TwoQueueCache();
+  ~TwoQueueCache();
+
+  // Separate from constructor so caller can easily make an array of them
+  void SetCapacity(size_t capacity) {
+    capacity_ = capacity;
+    probation_capacity_ = capacity / 4;
+    ghost_capacity_ = capacity / 2;
+  }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  void List_Remove(LRUHandle* e);
+  void List_Append(LRUHandle* list, LRUHandle* e);
+  void Ref(LRUHandle* e);
+  void Unref(LRUHandle* e);
+  void Protect(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Remember the key of an entry evicted from probation, by its hash.
+  void AddGhost(uint32_t hash, size_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+  size_t probation_capacity_;
+  size_t ghost_capacity_;
+
+  // mutex_ protects the following state.
+  mutable port::Mutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  size_t probation_usage_ GUARDED_BY(mutex_);
+
+  // Dummy heads of the queues.  list.next is the next entry to evict.
+  // Entries have refs==1 and in_cache==true.
+  LRUHandle probation_ GUARDED_BY(mutex_);
+  LRUHandle protected_ GUARDED_BY(mutex_);
+
+  // Dummy head of in-use list.
+  // Entries are in use by clients, and have refs >= 2 and in_cache==true.
+  LRUHandle in_use_ GUARDED_BY(mutex_);
+
+  HandleTable table_ GUARDED_BY(mutex_);
+
+  // Hashes and charges of the entries last evicted from probation, oldest
+  // first, with the number of times each hash occurs.
+  std::deque<std::pair<uint32_t, size_t>> ghost_ GUARDED_BY(mutex_);
+  std::unordered_map<uint32_t, int> ghost_hashes_ GUARDED_BY(mutex_);
+  size_t ghost_usage_ GUARDED_BY(mutex_);
+};
+
+TwoQueueCache::TwoQueueCache()
+    : capacity_(0),
+      probation_capacity_(0),
+      ghost_capacity_(0),
+      usage_(0),
+      probation_usage_(0),
+      ghost_usage_(0) {
+  // Make empty circular linked lists.
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
+  protected_.next = &protected_;
+  protected_.prev = &protected_;
+  in_use_.next = &in_use_;
+  in_use_.prev = &in_use_;
+}
+
+TwoQueueCache::~TwoQueueCache() {
+  assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
+  for (LRUHandle* list : {&probation_, &protected_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of the queues.
+      Unref(e);
+      e = next;
+    }
+  }
+}
+
+void TwoQueueCache::Ref(LRUHandle* e) {
+  if (e->refs == 1 && e->in_cache) {  // If in a queue, move to in_use_ list.
+    List_Remove(e);
+    List_Append(&in_use_, e);
+  }
+  e->refs++;
+}
+
+void TwoQueueCache::Unref(LRUHandle* e) {
+  assert(e->refs > 0);
+  e->refs--;
+  if (e->refs == 0) {  // Deallocate.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    free(e);
+  } else if (e->in_cache && e->refs == 1) {
+    // No longer in use; move to the tail of its queue.
+    List_Remove(e);
+    List_Append(e->protect ? &protected_ : &probation_, e);
+  }
+}
+
+void TwoQueueCache::List_Remove(LRUHandle* e) {
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+}
+
+void TwoQueueCache::List_Append(LRUHandle* list, LRUHandle* e) {
+  // Make "e" the last entry to evict by inserting just before *list
+  e->next = list;
+  e->prev = list->prev;
+  e->prev->next = e;
+  e->next->prev = e;
+}
+
+void TwoQueueCache::Protect(LRUHandle* e) {
+  if (!e->protect) {
+    e->protect = true;
+    probation_usage_ -= e->charge;
+  }
+}
+
+Cache::Handle* TwoQueueCache::Lookup(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  LRUHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    Protect(e);
+    Ref(e);
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void TwoQueueCache::Release(Cache::Handle* handle) {
+  MutexLock l(&mutex_);
+  Unref(reinterpret_cast<LRUHandle*>(handle));
+}
+
+void TwoQueueCache::AddGhost(uint32_t hash, size_t charge) {
+  ghost_.emplace_back(hash, charge);
+  ghost_hashes_[hash]++;
+  ghost_usage_ += charge;
+  while (ghost_usage_ > ghost_capacity_ && !ghost_.empty()) {
+    const std::pair<uint32_t, size_t> oldest = ghost_.front();
+    ghost_.pop_front();
+    ghost_usage_ -= oldest.second;
+    auto iter = ghost_hashes_.find(oldest.first);
+    if (--iter->second == 0) {
+      ghost_hashes_.erase(iter);
+    }
+  }
+}
+
+Cache::Handle* TwoQueueCache::Insert(const Slice& key, uint32_t hash,
+                                     void* value, size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value)) {
+  MutexLock l(&mutex_);
+
+  LRUHandle* e =
+      reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->in_cache = false;
+  e->protect = false;
+  e->refs = 1;  // for the returned handle.
+  memcpy(e->key_data, key.data(), key.size());
+
+  if (capacity_ > 0) {
+    // Replacing a protected entry, or one that was evicted from probation
+    // a short while ago, shows that its key is in steady use.
+    LRUHandle* old = table_.Lookup(key, hash);
+    e->protect = (old != nullptr && old->protect) ||
+                 ghost_hashes_.find(hash) != ghost_hashes_.end();
+    e->refs++;  // for the cache's reference.
+    e->in_cache = true;
+    List_Append(&in_use_, e);
+    usage_ += charge;
+    if (!e->protect) {
+      probation_usage_ += charge;
+    }
+    FinishErase(table_.Insert(e));
+  } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
+    // next is read by key() in an assert, so it must be initialized
+    e->next = nullptr;
+  }
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (probation_.next != &probation_ &&
+        (probation_usage_ > probation_capacity_ ||
+         protected_.next == &protected_)) {
+      old = probation_.next;
+      AddGhost(old->hash, old->charge);
+    } else if (protected_.next != &protected_) {
+      old = protected_.next;
+    } else {
+      break;  // Everything else is in use
+    }
+    assert(old->refs == 1);
+    bool erased = FinishErase(table_.Remove(old->key(), old->hash));
+    if (!erased) {  // to avoid unused variable when compiled NDEBUG
+      assert(erased);
+    }
+  }
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.  Return whether e != nullptr.
+bool TwoQueueCache::FinishErase(LRUHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    List_Remove(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+    if (!e->protect) {
+      probation_usage_ -= e->charge;
+    }
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void TwoQueueCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void TwoQueueCache::Prune() {
+  MutexLock l(&mutex_);
+  for (LRUHandle* list : {&probation_, &protected_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    }
+  }
+}
+
+// CLOCK cache implementation
+//
+// Lookups do not lock.  The entries of a shard live in the slots of a
+// fixed-size open-addressed table, and each slot has an atomic "meta" word
+// that packs the state of the slot, the CLOCK countdown of its entry and
+// the number of references to it held by clients.  A lookup takes its
+// reference with one compare-and-swap, which also resets the countdown, and
+// never moves the entry: the countdown stands in for the position in an
+// LRU list.  Insert(), Erase() and Prune() are serialized by the shard
+// mutex.  Insert() evicts by sweeping a clock hand over the table: an
+// unreferenced entry whose countdown is zero is evicted, and the countdown
+// of any other unreferenced entry is decremented.
+//
+// A slot is only reused once its entry is out of the table and no client
+// references it, and a lookup holds a reference before it reads the key, so
+// the key it compares is never freed under it.  Each slot also counts the
+// entries that were inserted past it on their probe sequence, which lets a
+// lookup stop at the first slot past which there are none.
+//
+// The states of a slot are:
+// - empty: free to be claimed by Insert().
+// - construction: owned by the one thread that is filling or freeing it.
+// - visible: holds an entry that lookups may find.
+// - invisible: holds an entry that was erased, replaced or evicted while
+//   clients still referenced it.  The last Release() frees it.
+struct ClockHandle {
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr uint64_t kConstruction = 1;
+  static constexpr uint64_t kVisible = 2;
+  static constexpr uint64_t kInvisible = 3;
+
+  // Layout of "meta": state in the top two bits, countdown in the next two,
+  // references in the rest.
+  static constexpr int kStateShift = 62;
+  static constexpr int kCountdownShift = 60;
+  static constexpr uint64_t kMaxCountdown = 3;
+  static constexpr uint64_t kRefsMask = (uint64_t{1} << kCountdownShift) - 1;
+
+  // Countdown of a new entry: it is evicted by the second sweep of the
+  // clock hand unless it is looked up.
+  static constexpr uint64_t kInitialCountdown = 1;
+
+  static uint64_t Meta(uint64_t state, uint64_t countdown, uint64_t refs) {
+    return (state << kStateShift) | (countdown << kCountdownShift) | refs;
+  }
+  static uint64_t State(uint64_t meta) { return meta >> kStateShift; }
+  static uint64_t Countdown(uint64_t meta) {
+    return (meta >> kCountdownShift) & kMaxCountdown;
+  }
+  static uint64_t Refs(uint64_t meta) { return meta & kRefsMask; }
+
+  std::atomic<uint64_t> meta{0};
+  // Read by lookups before they take a reference, to skip other entries.
+  std::atomic<uint32_t> hash{0};
+  // Number of entries in the table whose probe sequence passed this slot.
+  std::atomic<uint32_t> displacements{0};
+  void* value = nullptr;
+  void (*deleter)(const Slice&, void* value) = nullptr;
+  size_t charge = 0;
+  size_t key_length = 0;
+  char* key_data = nullptr;
+  // Allocated outside of the table because it was full, or because the
+  // capacity is zero.  Such an entry is invisible from the start.
+  bool standalone = false;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// A single shard of a CLOCK cache.
+class ClockCache {
+ public:
+  using Entry = ClockHandle;
+
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of them.
+  // The table gets room for twice capacity / estimated_entry_charge
+  // entries; if the entries are smaller than estimated, fewer of them are
+  // cached than the capacity allows.
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Returns the visible entry for "key", if any.
+  ClockHandle* FindLocked(const Slice& key, uint32_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Claims an empty slot for an entry with "hash", or returns nullptr if
+  // the table is full.
+  ClockHandle* ClaimSlotLocked(uint32_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Sweeps the clock hand until "charge" more fits in the capacity and the
+  // table is below its occupancy limit, or until all entries are in use.
+  void EvictLocked(size_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Removes a visible entry from the table, freeing it unless it is in use.
+  void EraseLocked(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Frees the entry of a slot in the construction state, owned by the
+  // caller, and empties the slot.
+  void Free(ClockHandle* e);
+
+  // Initialized before use.
+  size_t capacity_;
+  ClockHandle* table_;
+  size_t mask_;             // Number of slots minus one
+  size_t occupancy_limit_;  // Evict when this many slots are taken
+
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> occupancy_;  // Non-empty slots
+
+  // mutex_ serializes writers to the table.
+  port::Mutex mutex_;
+  size_t clock_hand_ GUARDED_BY(mutex_);
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      table_(nullptr),
+      mask_(0),
+      occupancy_limit_(0),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {}
+
+ClockCache::~ClockCache() {
+  for (size_t i = 0; table_ != nullptr && i <= mask_; i++) {
+    ClockHandle* e = &table_[i];
+    const uint64_t meta = e->meta.load(std::memory_order_acquire);
+    if (ClockHandle::State(meta) != ClockHandle::kEmpty) {
+      // Error if caller has an unreleased handle
+      assert(ClockHandle::State(meta) == ClockHandle::kVisible);
+      assert(ClockHandle::Refs(meta) == 0);
+      e->meta.store(ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+                    std::memory_order_relaxed);
+      Free(e);
+    }
+  }
+  delete[] table_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge) {
+  assert(table_ == nullptr);
+  capacity_ = capacity;
+  const size_t entries =
+      capacity / std::max<size_t>(estimated_entry_charge, 1) + 1;
+  size_t slots = 16;
+  while (slots < 2 * entries) {
+    slots *= 2;
+  }
+  table_ = new ClockHandle[slots];
+  mask_ = slots - 1;
+  occupancy_limit_ = slots / 4 * 3;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  size_t i = hash & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* e = &table_[i];
+    if (e->hash.load(std::memory_order_relaxed) == hash) {
+      uint64_t meta = e->meta.load(std::memory_order_relaxed);
+      while (ClockHandle::State(meta) == ClockHandle::kVisible) {
+        const uint64_t referenced =
+            ClockHandle::Meta(ClockHandle::kVisible, ClockHandle::kMaxCountdown,
+                              ClockHandle::Refs(meta) + 1);
+        if (e->meta.compare_exchange_weak(meta, referenced,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+          // The slot may have been reused for another key since its hash
+          // was read, but it cannot change while we hold the reference.
+          if (e->hash.load(std::memory_order_relaxed) == hash &&
+              e->key() == key) {
+            return reinterpret_cast<Cache::Handle*>(e);
+          }
+          Release(reinterpret_cast<Cache::Handle*>(e));
+          break;
+        }
+      }
+    }
+    if (e->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+    i = (i + 1) & mask_;
+  }
+  return nullptr;
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(handle);
+  const uint64_t old_meta = e->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(ClockHandle::Refs(old_meta) > 0);
+  if (ClockHandle::State(old_meta) == ClockHandle::kInvisible &&
+      ClockHandle::Refs(old_meta) == 1) {
+    // Dropped the last reference to an entry out of the table.  Nobody
+    // else touches an unreferenced invisible entry, so it is ours.
+    e->meta.store(ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+                  std::memory_order_relaxed);
+    Free(e);
+  }
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value)) {
+  MutexLock l(&mutex_);
+  ClockHandle* old = FindLocked(key, hash);
+  if (old != nullptr) {
+    EraseLocked(old);
+  }
+
+  ClockHandle* e = nullptr;
+  if (capacity_ > 0) {
+    EvictLocked(charge);
+    e = ClaimSlotLocked(hash);
+  }
+  if (e == nullptr) {
+    // Don't cache.  (capacity_==0 is supported and turns off caching.)
+    e = new ClockHandle;
+    e->standalone = true;
+  }
+  e->hash.store(hash, std::memory_order_relaxed);
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->key_data = new char[key.size()];
+  memcpy(e->key_data, key.data(), key.size());
+  if (e->standalone) {
+    e->meta.store(ClockHandle::Meta(ClockHandle::kInvisible, 0, 1),
+                  std::memory_order_relaxed);
+  } else {
+    usage_.fetch_add(charge, std::memory_order_relaxed);
+    // Publishes the fields above to lookups.
+    e->meta.store(ClockHandle::Meta(ClockHandle::kVisible,
+                                    ClockHandle::kInitialCountdown, 1),
+                  std::memory_order_release);
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* e = FindLocked(key, hash);
+  if (e != nullptr) {
+    EraseLocked(e);
+  }
+}
+
+void ClockCache::Prune() {
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i <= mask_; i++) {
+    ClockHandle* e = &table_[i];
+    uint64_t meta = e->meta.load(std::memory_order_relaxed);
+    if (ClockHandle::State(meta) == ClockHandle::kVisible &&
+        ClockHandle::Refs(meta) == 0 &&
+        e->meta.compare_exchange_strong(
+            meta, ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+            std::memory_order_acquire)) {
+      Free(e);
+    }
+  }
+}
+
+ClockHandle* ClockCache::FindLocked(const Slice& key, uint32_t hash) {
+  // Only writers, which hold mutex_, take an entry out of the visible
+  // state, so a visible entry can be read here without a reference.
+  size_t i = hash & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* e = &table_[i];
+    const uint64_t meta = e->meta.load(std::memory_order_acquire);
+    if (ClockHandle::State(meta) == ClockHandle::kVisible &&
+        e->hash.load(std::memory_order_relaxed) == hash && e->key() == key) {
+      return e;
+    }
+    if (e->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    i = (i + 1) & mask_;
+  }
+  return nullptr;
+}
+
+ClockHandle* ClockCache::ClaimSlotLocked(uint32_t hash) {
+  const size_t home = hash & mask_;
+  size_t i = home;
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* e = &table_[i];
+    uint64_t meta = ClockHandle::Meta(ClockHandle::kEmpty, 0, 0);
+    if (e->meta.compare_exchange_strong(
+            meta, ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+            std::memory_order_acquire)) {
+      occupancy_.fetch_add(1, std::memory_order_relaxed);
+      return e;
+    }
+    e->displacements.fetch_add(1, std::memory_order_release);
+    i = (i + 1) & mask_;
+  }
+  // Every slot is taken: undo the displacements.
+  for (size_t probes = 0; probes <= mask_; probes++) {
+    table_[(home + probes) & mask_].displacements.fetch_sub(
+        1, std::memory_order_relaxed);
+  }
+  return nullptr;
+}
+
+void ClockCache::EvictLocked(size_t charge) {
+  // Each full sweep decrements the countdown of every unreferenced entry,
+  // so an entry not looked up meanwhile is evicted within
+  // kMaxCountdown + 1 sweeps.  Give up after that many: the rest of the
+  // entries are in use.
+  const size_t max_steps = (ClockHandle::kMaxCountdown + 2) * (mask_ + 1);
+  for (size_t step = 0;
+       step < max_steps &&
+       (usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+        occupancy_.load(std::memory_order_relaxed) >= occupancy_limit_);
+       step++) {
+    ClockHandle* e = &table_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & mask_;
+    uint64_t meta = e->meta.load(std::memory_order_relaxed);
+    if (ClockHandle::State(meta) != ClockHandle::kVisible ||
+        ClockHandle::Refs(meta) != 0) {
+      continue;
+    }
+    const uint64_t countdown = ClockHandle::Countdown(meta);
+    if (countdown == 0) {
+      if (e->meta.compare_exchange_strong(
+              meta, ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+              std::memory_order_acquire)) {
+        Free(e);
+      }
+    } else {
+      // Fails if a lookup got there first, which is fine.
+      e->meta.compare_exchange_strong(
+          meta, ClockHandle::Meta(ClockHandle::kVisible, countdown - 1, 0),
+          std::memory_order_relaxed);
+    }
+  }
+}
+
+void ClockCache::EraseLocked(ClockHandle* e) {
+  uint64_t meta = e->meta.load(std::memory_order_relaxed);
+  while (ClockHandle::State(meta) == ClockHandle::kVisible) {
+    const uint64_t refs = ClockHandle::Refs(meta);
+    if (refs == 0) {
+      if (e->meta.compare_exchange_weak(
+              meta, ClockHandle::Meta(ClockHandle::kConstruction, 0, 0),
+              std::memory_order_acquire)) {
+        Free(e);
+        return;
+      }
+    } else if (e->meta.compare_exchange_weak(
+                   meta, ClockHandle::Meta(ClockHandle::kInvisible, 0, refs),
+                   std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+}
+
+void ClockCache::Free(ClockHandle* e) {
+  assert(ClockHandle::State(e->meta.load(std::memory_order_relaxed)) ==
+         ClockHandle::kConstruction);
+  (*e->deleter)(e->key(), e->value);
+  delete[] e->key_data;
+  if (e->standalone) {
+    delete e;
+    return;
+  }
+  usage_.fetch_sub(e->charge, std::memory_order_relaxed);
+  e->key_data = nullptr;
+  for (size_t i = e->hash.load(std::memory_order_relaxed) & mask_;
+       &table_[i] != e; i = (i + 1) & mask_) {
+    table_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  e->meta.store(ClockHandle::Meta(ClockHandle::kEmpty, 0, 0),
+                std::memory_order_release);
+}
+
+// Spreads the entries over 2^num_shard_bits shards by the hash of their
+// keys, each a "ShardType" with a mutex of its own and an equal part of the
+// capacity.  The handles of a shard are its "Entry" type, which must have
+// "hash" and "value" members.
+template <typename ShardType>
+class ShardedCache : public Cache {
+ private:
+  using Entry = typename ShardType::Entry;
+
+  const int num_shard_bits_;
+  ShardType* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -345,16 +1019,24 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
+  }
+  int NumShards() const { return 1 << num_shard_bits_; }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  // "shard_args" are passed on to the SetCapacity() of each shard.
+  template <typename... ShardArgs>
+  ShardedCache(size_t capacity, int num_shard_bits, ShardArgs... shard_args)
+      : num_shard_bits_(num_shard_bits),
+        shard_(new ShardType[1 << num_shard_bits]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (NumShards() - 1)) / NumShards();
+    for (int s = 0; s < NumShards(); s++) {
+      shard_[s].SetCapacity(per_shard, shard_args...);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedCache() override { delete[] shard_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
@@ -365,36 +1047,61 @@ class ShardedLRUCache : public Cache {
     return shard_[Shard(hash)].Lookup(key, hash);
   }
   void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+    Entry* e = reinterpret_cast<Entry*>(handle);
+    shard_[Shard(e->hash)].Release(handle);
   }
   void Erase(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
     shard_[Shard(hash)].Erase(key, hash);
   }
   void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<Entry*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
 };
 
+// Largest supported number of shard bits; more shards than this would
+// only waste memory.
+static const int kMaxNumShardBits = 16;
+
+int SanitizeNumShardBits(int num_shard_bits) {
+  if (num_shard_bits < 0) return 0;
+  if (num_shard_bits > kMaxNumShardBits) return kMaxNumShardBits;
+  return num_shard_bits;
+}
+
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<LRUCache>(capacity,
+                                    SanitizeNumShardBits(num_shard_bits));
+}
+
+Cache* New2QCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<TwoQueueCache>(capacity,
+                                         SanitizeNumShardBits(num_shard_bits));
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  return new ShardedCache<ClockCache>(capacity,
+                                      SanitizeNumShardBits(num_shard_bits),
+                                      estimated_entry_charge);
+}
 
 }  // namespace leveldb
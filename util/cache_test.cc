@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -64,7 +66,27 @@ class CacheTest : public testing::Test {
 };
 CacheTest* CacheTest::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+// Creates a cache of one of the implementations with the given capacity
+// and number of shard bits.
+using CacheFactory = Cache* (*)(size_t capacity, int num_shard_bits);
+
+static Cache* NewClockCacheOfSmallEntries(size_t capacity,
+                                          int num_shard_bits) {
+  return NewClockCache(capacity, num_shard_bits, 1);
+}
+
+// Runs the tests that a cache implementation must pass to replace the LRU
+// cache.
+class CachePolicyTest : public CacheTest,
+                        public testing::WithParamInterface<CacheFactory> {
+ public:
+  CachePolicyTest() {
+    delete cache_;
+    cache_ = GetParam()(kCacheSize, 4);
+  }
+};
+
+TEST_P(CachePolicyTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +109,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CachePolicyTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +128,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CachePolicyTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +153,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CachePolicyTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +172,7 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CachePolicyTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +189,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CachePolicyTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -194,13 +216,13 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CachePolicyTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CachePolicyTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +235,212 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CachePolicyTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = GetParam()(0, 4);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST_P(CachePolicyTest, ConcurrentUse) {
+  // Threads look up, insert and erase overlapping keys.  Whatever a lookup
+  // finds must be the value of its key, and every entry must be deleted
+  // exactly once.
+  static std::atomic<int> live_entries;
+  live_entries = 0;
+  struct Counter {
+    static void Deleter(const Slice& key, void* v) {
+      ASSERT_EQ(DecodeKey(key), DecodeValue(v) / 1000);
+      live_entries.fetch_sub(1);
+    }
+  };
+  const int kThreads = 4;
+  const int kKeys = 2 * kCacheSize;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = 0; i < 20000; i++) {
+        const int key = (i * 7919 + t * 104729) % kKeys;
+        Cache::Handle* h = cache_->Lookup(EncodeKey(key));
+        if (h != nullptr) {
+          ASSERT_EQ(key, DecodeValue(cache_->Value(h)) / 1000);
+          cache_->Release(h);
+        } else if (i % 16 == 0) {
+          cache_->Erase(EncodeKey(key));
+        } else {
+          live_entries.fetch_add(1);
+          cache_->Release(cache_->Insert(EncodeKey(key),
+                                         EncodeValue(key * 1000 + t), 1,
+                                         &Counter::Deleter));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // Each of the 16 shards may round its capacity up.
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCacheSize + 16));
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_EQ(0, live_entries.load());
+}
+
+// The 2Q cache is left out: unlike the others, it keeps an entry that was
+// never looked up while the entries that were are evicted, which
+// EvictionPolicy checks against.  See TwoQueueCacheTest instead.
+INSTANTIATE_TEST_SUITE_P(Policies, CachePolicyTest,
+                         testing::Values(&NewLRUCache,
+                                         &NewClockCacheOfSmallEntries));
+
+class TwoQueueCacheTest : public CacheTest {
+ public:
+  TwoQueueCacheTest() {
+    delete cache_;
+    cache_ = New2QCache(kCacheSize, 0);
+  }
+};
 
+TEST_F(TwoQueueCacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(2, deleted_keys_.size());
+}
+
+TEST_F(TwoQueueCacheTest, ScanResistance) {
+  // Entries used more than once survive a scan of many times the capacity,
+  // while the LRU policy keeps only the last entries of the scan.
+  auto hot_entries_after_scan = [this](Cache* cache) {
+    delete cache_;
+    cache_ = cache;
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+      EXPECT_EQ(1000 + i, Lookup(i));
+    }
+    for (int i = 0; i < 10 * kCacheSize; i++) {
+      Insert(10000 + i, i);
+    }
+    EXPECT_LE(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+    int hits = 0;
+    for (int i = 0; i < 100; i++) {
+      hits += (Lookup(i) == 1000 + i);
+    }
+    return hits;
+  };
+  ASSERT_EQ(0, hot_entries_after_scan(NewLRUCache(kCacheSize, 0)));
+  ASSERT_EQ(100, hot_entries_after_scan(New2QCache(kCacheSize, 0)));
+  ASSERT_EQ(-1, Lookup(10000));
+  ASSERT_EQ(10 * kCacheSize - 1, Lookup(10000 + 10 * kCacheSize - 1));
+}
+
+TEST_F(TwoQueueCacheTest, RecentlyEvictedKeysAreProtected) {
   Insert(1, 100);
+  for (int i = 0; i < kCacheSize + 10; i++) {
+    Insert(10000 + i, i);
+  }
   ASSERT_EQ(-1, Lookup(1));
+
+  // Inserted again shortly after its eviction, the entry is protected
+  // without being looked up.
+  Insert(1, 101);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(20000 + i, i);
+  }
+  ASSERT_EQ(101, Lookup(1));
+}
+
+TEST_F(TwoQueueCacheTest, EntriesArePinned) {
+  Cache::Handle* h = InsertAndReturnHandle(100, 101);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h)));
+  ASSERT_EQ(101, Lookup(100));
+  cache_->Release(h);
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+}
+
+TEST_F(TwoQueueCacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+  ASSERT_EQ(200, Lookup(2));
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+  ASSERT_EQ(1, cache_->TotalCharge());
+}
+
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 0, 1);
+  }
+};
+
+TEST_F(ClockCacheTest, LookedUpEntriesSurviveEviction) {
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000 + i);
+  }
+  // Entries that are looked up between insertions keep their countdown up
+  // and are passed over by the clock hand.
+  for (int i = 0; i < 10 * kCacheSize; i++) {
+    Insert(10000 + i, i);
+    ASSERT_EQ(1000 + i % 100, Lookup(i % 100));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+}
+
+TEST_F(ClockCacheTest, EntriesSmallerThanEstimated) {
+  // The table only has room for about twice the estimated number of
+  // entries.  Fewer entries are cached, but all of them can be found.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0, 10);
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000 + i);
+  }
+  int found = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    const int r = Lookup(i);
+    if (r >= 0) {
+      ASSERT_EQ(1000 + i, r);
+      found++;
+    }
+  }
+  ASSERT_GT(found, kCacheSize / 10);
+  ASSERT_LT(found, kCacheSize / 2);
+  ASSERT_EQ(found, cache_->TotalCharge());
+}
+
+TEST_F(ClockCacheTest, PinnedEntriesOverflowTheTable) {
+  // Once every slot holds an entry in use, new entries are not cached but
+  // their handles still work.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0, kCacheSize);
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < 100; i++) {
+    h.push_back(InsertAndReturnHandle(i, 1000 + i));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, DecodeValue(cache_->Value(h[i])));
+    cache_->Release(h[i]);
+  }
+  ASSERT_EQ(100, deleted_keys_.size() + cache_->TotalCharge());
 }
 
 }  // namespace leveldb
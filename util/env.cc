@@ -26,6 +26,12 @@ Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::ScheduleWithPriority(void (*function)(void*), void* arg, Priority) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int, Priority) {}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
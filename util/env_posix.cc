@@ -661,7 +661,21 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    background_pools_[kLow].Schedule(background_work_function,
+                                     background_work_arg);
+  }
+
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority pri) override {
+    background_pools_[pri].Schedule(background_work_function,
+                                    background_work_arg);
+  }
+
+  void SetBackgroundThreads(int n, Priority pri) override {
+    background_pools_[pri].SetMaxThreads(n);
+  }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -717,32 +731,56 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
+  // Runs the work items of one priority on a pool of detached threads.
+  // Threads are started as work arrives, up to the pool's maximum.
+  class BackgroundPool {
+   public:
+    BackgroundPool()
+        : background_work_cv_(&background_work_mutex_),
+          num_threads_(0),
+          idle_threads_(0),
+          max_threads_(1) {}
 
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
+    void Schedule(void (*background_work_function)(void* background_work_arg),
+                  void* background_work_arg);
 
-  // Stores the work item data in a Schedule() call.
-  //
-  // Instances are constructed on the thread calling Schedule() and used on the
-  // background thread.
-  //
-  // This structure is thread-safe beacuse it is immutable.
-  struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
+    void SetMaxThreads(int n);
 
-    void (*const function)(void*);
-    void* const arg;
-  };
+   private:
+    void BackgroundThreadMain();
+
+    static void BackgroundThreadEntryPoint(BackgroundPool* pool) {
+      pool->BackgroundThreadMain();
+    }
+
+    // Start another thread if queued work has no idle thread to run it.
+    void MaybeStartThread() EXCLUSIVE_LOCKS_REQUIRED(background_work_mutex_);
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+    // Stores the work item data in a Schedule() call.
+    //
+    // Instances are constructed on the thread calling Schedule() and used on
+    // the background thread.
+    //
+    // This structure is thread-safe beacuse it is immutable.
+    struct BackgroundWorkItem {
+      explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
+          : function(function), arg(arg) {}
+
+      void (*const function)(void*);
+      void* const arg;
+    };
+
+    port::Mutex background_work_mutex_;
+    port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
+    int num_threads_ GUARDED_BY(background_work_mutex_);
+    int idle_threads_ GUARDED_BY(background_work_mutex_);
+    int max_threads_ GUARDED_BY(background_work_mutex_);
+
+    std::queue<BackgroundWorkItem> background_work_queue_
+        GUARDED_BY(background_work_mutex_);
+  };
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  BackgroundPool background_pools_[2];  // Indexed by Priority
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -773,33 +811,41 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
+    : mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
-void PosixEnv::Schedule(
+void PosixEnv::BackgroundPool::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
   background_work_mutex_.Lock();
+  background_work_queue_.emplace(background_work_function, background_work_arg);
+  MaybeStartThread();
+  background_work_cv_.Signal();
+  background_work_mutex_.Unlock();
+}
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
+void PosixEnv::BackgroundPool::SetMaxThreads(int n) {
+  background_work_mutex_.Lock();
+  if (n > max_threads_) {
+    max_threads_ = n;
+    MaybeStartThread();
   }
+  background_work_mutex_.Unlock();
+}
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
+void PosixEnv::BackgroundPool::MaybeStartThread() {
+  background_work_mutex_.AssertHeld();
+  while (num_threads_ < max_threads_ &&
+         idle_threads_ < static_cast<int>(background_work_queue_.size())) {
+    ++num_threads_;
+    ++idle_threads_;  // Until it takes an item from the queue
+    std::thread background_thread(BackgroundPool::BackgroundThreadEntryPoint,
+                                  this);
+    background_thread.detach();
   }
-
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundPool::BackgroundThreadMain() {
   while (true) {
     background_work_mutex_.Lock();
 
@@ -812,9 +858,14 @@ void PosixEnv::BackgroundThreadMain() {
     auto background_work_function = background_work_queue_.front().function;
     void* background_work_arg = background_work_queue_.front().arg;
     background_work_queue_.pop();
+    --idle_threads_;
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
+
+    background_work_mutex_.Lock();
+    ++idle_threads_;
+    background_work_mutex_.Unlock();
   }
 }
 
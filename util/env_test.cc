@@ -134,6 +134,61 @@ TEST_F(EnvTest, RunMany) {
   }
 }
 
+TEST_F(EnvTest, ScheduleWithPriority) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool release_low = false;
+    bool low_done = false;
+    int high_running = 0;
+    int high_done = 0;
+  };
+
+  struct Callback {
+    static void RunLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->release_low) {
+        state->cvar.Wait();
+      }
+      state->low_done = true;
+      state->cvar.SignalAll();
+    }
+
+    // Each high priority callback waits for the other one to start, so
+    // both must run at the same time.
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_running++;
+      state->cvar.SignalAll();
+      while (state->high_running < 2) {
+        state->cvar.Wait();
+      }
+      state->high_done++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->SetBackgroundThreads(2, Env::kHigh);
+  env_->Schedule(&Callback::RunLow, &state);
+  env_->ScheduleWithPriority(&Callback::RunHigh, &state, Env::kHigh);
+  env_->ScheduleWithPriority(&Callback::RunHigh, &state, Env::kHigh);
+
+  // The high priority pool is not held up by the blocked low priority one.
+  MutexLock l(&state.mu);
+  while (state.high_done != 2) {
+    state.cvar.Wait();
+  }
+  ASSERT_TRUE(!state.low_done);
+  state.release_low = true;
+  state.cvar.SignalAll();
+  while (!state.low_done) {
+    state.cvar.Wait();
+  }
+}
+
 struct State {
   port::Mutex mu;
   port::CondVar cvar{&mu};
@@ -0,0 +1,334 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A binary fuse filter [Graf, Lemire 2022] is an xor filter: it stores an
+// f-bit fingerprint in each slot of an array, chosen so that the xor of the
+// three slots a key hashes to is the fingerprint of the key.  A key that
+// was not added matches with probability 2^-f.  The array has about 1.125
+// slots per key for large sets, so the filter takes about 1.125 * f bits
+// per key where a bloom filter with the same false positive rate takes
+// about 1.44 * f.  Small sets need relatively more slots, e.g. 1.4 per key
+// for 1000 keys and 1.9 for 100.
+//
+// The three slots of a key are in three consecutive segments of the
+// array.  They are found by "peeling": a slot that only one key hashes to
+// can be given to that key, which is then removed from its other slots,
+// and so on.  Peeling fails with a small probability, and the filter is
+// then built again with another seed.
+//
+// The filter is the bit-packed fingerprints followed by a trailer:
+//    fingerprints: char[(num_slots * f + 7) / 8 + 2]
+//    segment_count: fixed32
+//    segment_length_log2: uint8
+//    seed: fixed32
+//    f: uint8
+// where num_slots = (segment_count + 2) << segment_length_log2.  The last
+// two bytes of the fingerprints are padding, so that any fingerprint can
+// be read with a 3-byte load.  A filter without keys has no fingerprints
+// and a segment_count of 0.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const size_t kTrailerSize = 10;
+static const int kMaxFingerprintBits = 16;
+static const int kMaxSegmentLengthLog2 = 18;
+
+// Peeling fails for a few percent of small sets and practically never for
+// large ones, so running out of seeds is not expected.  If it happens
+// anyway, the filter is written with f = 0 and matches every key.
+static const uint32_t kMaxSeeds = 64;
+
+static uint64_t FuseHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0xbc9f1d34))
+          << 32) |
+         Hash(key.data(), key.size(), 0x5bd1e995);
+}
+
+// Scrambles a key's hash differently for every seed.  This is the
+// finalizer of MurmurHash3, which is a bijection, so distinct hashes stay
+// distinct.
+static uint64_t Mix(uint64_t h, uint32_t seed) {
+  h += seed * 0x9e3779b97f4a7c15ull;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Returns the high 64 bits of a * b.
+static uint64_t MulHi(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+  const uint64_t a_lo = static_cast<uint32_t>(a), a_hi = a >> 32;
+  const uint64_t b_lo = static_cast<uint32_t>(b), b_hi = b >> 32;
+  const uint64_t lo_lo = a_lo * b_lo;
+  const uint64_t hi_lo = a_hi * b_lo;
+  const uint64_t cross =
+      (lo_lo >> 32) + static_cast<uint32_t>(hi_lo) + a_lo * b_hi;
+  return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+static uint32_t Fingerprint(uint64_t h, int f) {
+  return static_cast<uint32_t>(h ^ (h >> 32)) & ((1u << f) - 1);
+}
+
+struct Layout {
+  uint32_t segment_count;
+  int segment_length_log2;
+
+  uint64_t NumSlots() const {
+    return (static_cast<uint64_t>(segment_count) + 2) << segment_length_log2;
+  }
+
+  // Stores the three slots of the (mixed) hash h in slots[0,2].  They are
+  // in consecutive segments, so they are distinct.
+  void Slots(uint64_t h, size_t* slots) const {
+    const uint64_t segment_length = uint64_t{1} << segment_length_log2;
+    const uint64_t mask = segment_length - 1;
+    const uint64_t first =
+        MulHi(h, static_cast<uint64_t>(segment_count) << segment_length_log2);
+    slots[0] = static_cast<size_t>(first);
+    slots[1] = static_cast<size_t>((first + segment_length) ^ ((h >> 18) & mask));
+    slots[2] = static_cast<size_t>((first + 2 * segment_length) ^ (h & mask));
+  }
+};
+
+// The segment length and the number of slots per key that make peeling
+// succeed with high probability, from the paper.
+static Layout ChooseLayout(size_t num_keys) {
+  Layout layout;
+  size_t capacity = 0;
+  if (num_keys < 2) {
+    layout.segment_length_log2 = 2;
+  } else {
+    const double n = static_cast<double>(num_keys);
+    layout.segment_length_log2 =
+        std::min(kMaxSegmentLengthLog2,
+                 static_cast<int>(std::floor(std::log(n) / std::log(3.33) +
+                                             2.25)));
+    const double size_factor =
+        std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log(n));
+    capacity = static_cast<size_t>(std::round(n * size_factor));
+  }
+  const size_t segment_length = size_t{1} << layout.segment_length_log2;
+  const size_t segments = (capacity + segment_length - 1) / segment_length;
+  layout.segment_count = segments > 2 ? segments - 2 : 1;
+  return layout;
+}
+
+static size_t FingerprintBytes(uint64_t num_slots, int f) {
+  return static_cast<size_t>((num_slots * f + 7) / 8 + 2);
+}
+
+static uint32_t ReadFingerprint(const char* array, size_t slot, int f) {
+  const size_t bit = slot * f;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(array) + bit / 8;
+  const uint32_t word = p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16);
+  return (word >> (bit % 8)) & ((1u << f) - 1);
+}
+
+static void AppendTrailer(const Layout& layout, uint32_t seed, int f,
+                          std::string* dst) {
+  PutFixed32(dst, layout.segment_count);
+  dst->push_back(static_cast<char>(layout.segment_length_log2));
+  PutFixed32(dst, seed);
+  dst->push_back(static_cast<char>(f));
+}
+
+// Finds a slot for each of the keys with the given (unmixed) hashes, with
+// "seed".  On success, returns true and stores the mixed hashes of the
+// keys in the order they were peeled in *peeled, and the position (0, 1
+// or 2) of the slot each was given in *positions.
+static bool Peel(const Layout& layout, const std::vector<uint64_t>& hashes,
+                 uint32_t seed, std::vector<uint64_t>* peeled,
+                 std::vector<uint8_t>* positions) {
+  // Each slot counts the keys in it, in the upper six bits, and keeps the
+  // xor of their positions in the lower two bits, and the xor of their
+  // hashes.  When one key is left, these are its position and hash.
+  const size_t num_slots = static_cast<size_t>(layout.NumSlots());
+  std::vector<uint8_t> counts(num_slots, 0);
+  std::vector<uint64_t> xors(num_slots, 0);
+  size_t slots[3];
+  for (uint64_t hash : hashes) {
+    const uint64_t h = Mix(hash, seed);
+    layout.Slots(h, slots);
+    for (int j = 0; j < 3; j++) {
+      uint8_t& count = counts[slots[j]];
+      count = (count + 4) ^ j;
+      if (count < 4) {
+        // More than 63 keys in a slot.
+        return false;
+      }
+      xors[slots[j]] ^= h;
+    }
+  }
+
+  std::vector<size_t> singles;
+  for (size_t i = 0; i < num_slots; i++) {
+    if ((counts[i] >> 2) == 1) singles.push_back(i);
+  }
+  peeled->clear();
+  peeled->reserve(hashes.size());
+  positions->clear();
+  positions->reserve(hashes.size());
+  while (!singles.empty()) {
+    const size_t slot = singles.back();
+    singles.pop_back();
+    if ((counts[slot] >> 2) != 1) {
+      // Its key was peeled through another slot.
+      continue;
+    }
+    const uint64_t h = xors[slot];
+    peeled->push_back(h);
+    positions->push_back(counts[slot] & 3);
+    layout.Slots(h, slots);
+    for (int j = 0; j < 3; j++) {
+      uint8_t& count = counts[slots[j]];
+      count = (count - 4) ^ j;
+      xors[slots[j]] ^= h;
+      if ((count >> 2) == 1) singles.push_back(slots[j]);
+    }
+  }
+  return peeled->size() == hashes.size();
+}
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  explicit BinaryFuseFilterPolicy(int bits_per_key) {
+    // A bloom filter with b bits per key has a false positive rate of
+    // about 2^(-0.69 * b) at best.  Round to the nearest.
+    f_ = static_cast<int>(bits_per_key * 0.69 + 0.5);  // 0.69 =~ ln(2)
+    if (f_ < 1) f_ = 1;
+    if (f_ > kMaxFingerprintBits) f_ = kMaxFingerprintBits;
+  }
+
+  const char* Name() const override { return "leveldb.BinaryFuseFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // A key may be added several times, but can only be placed once.  The
+    // keys are sorted, so the copies of a key are usually adjacent.  Other
+    // duplicates make peeling fail, and are removed after that.
+    std::vector<uint64_t> hashes;
+    hashes.reserve(n);
+    for (int i = 0; i < n; i++) {
+      const uint64_t hash = FuseHash(keys[i]);
+      if (hashes.empty() || hashes.back() != hash) {
+        hashes.push_back(hash);
+      }
+    }
+    size_t num_keys = hashes.size();
+    Layout layout = ChooseLayout(num_keys);
+    if (num_keys == 0) {
+      Layout empty = layout;
+      empty.segment_count = 0;
+      AppendTrailer(empty, 0, f_, dst);
+      return;
+    }
+
+    std::vector<uint64_t> peeled;
+    std::vector<uint8_t> positions;
+    uint32_t seed = 0;
+    bool deduplicated = false;
+    while (!Peel(layout, hashes, seed, &peeled, &positions)) {
+      if (++seed == kMaxSeeds) {
+        AppendTrailer(layout, 0, 0, dst);
+        return;
+      }
+      if (!deduplicated) {
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        deduplicated = true;
+        num_keys = hashes.size();
+        layout = ChooseLayout(num_keys);
+      }
+    }
+
+    // Assign the fingerprints in the reverse order of peeling, so that the
+    // other two slots of each key already have their final values.
+    const size_t num_slots = static_cast<size_t>(layout.NumSlots());
+    std::vector<uint16_t> fingerprints(num_slots, 0);
+    size_t slots[3];
+    for (size_t i = num_keys; i-- > 0;) {
+      const uint64_t h = peeled[i];
+      const int position = positions[i];
+      layout.Slots(h, slots);
+      fingerprints[slots[position]] =
+          Fingerprint(h, f_) ^ fingerprints[slots[(position + 1) % 3]] ^
+          fingerprints[slots[(position + 2) % 3]];
+    }
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + FingerprintBytes(num_slots, f_), 0);
+    uint8_t* array = reinterpret_cast<uint8_t*>(&(*dst)[init_size]);
+    for (size_t i = 0; i < num_slots; i++) {
+      const size_t bit = i * f_;
+      const uint32_t word = static_cast<uint32_t>(fingerprints[i])
+                            << (bit % 8);
+      array[bit / 8] |= static_cast<uint8_t>(word);
+      array[bit / 8 + 1] |= static_cast<uint8_t>(word >> 8);
+      array[bit / 8 + 2] |= static_cast<uint8_t>(word >> 16);
+    }
+    AppendTrailer(layout, seed, f_, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len < kTrailerSize) {
+      // Not a filter of this policy.  Consider it a match.
+      return true;
+    }
+    const char* trailer = filter.data() + len - kTrailerSize;
+    Layout layout;
+    layout.segment_count = DecodeFixed32(trailer);
+    layout.segment_length_log2 = static_cast<uint8_t>(trailer[4]);
+    const uint32_t seed = DecodeFixed32(trailer + 5);
+    const int f = static_cast<uint8_t>(trailer[9]);
+    if (f < 1 || f > kMaxFingerprintBits ||
+        layout.segment_length_log2 > kMaxSegmentLengthLog2) {
+      // Not a filter of this policy, or one that could not be built.
+      // Consider it a match.
+      return true;
+    }
+    if (layout.segment_count == 0) {
+      // Empty filter, unless it is not one of this policy.
+      return len != kTrailerSize;
+    }
+    if (len != kTrailerSize + FingerprintBytes(layout.NumSlots(), f)) {
+      return true;
+    }
+
+    const uint64_t h = Mix(FuseHash(key), seed);
+    size_t slots[3];
+    layout.Slots(h, slots);
+    const char* array = filter.data();
+    return (Fingerprint(h, f) ^ ReadFingerprint(array, slots[0], f) ^
+            ReadFingerprint(array, slots[1], f) ^
+            ReadFingerprint(array, slots[2], f)) == 0;
+  }
+
+ private:
+  int f_;  // Fingerprint bits
+};
+}  // namespace
+
+const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_key) {
+  return new BinaryFuseFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,225 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static const int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class FuseFilterTest : public testing::Test {
+ public:
+  FuseFilterTest() : policy_(NewBinaryFuseFilterPolicy(10)) {}
+
+  ~FuseFilterTest() { delete policy_; }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices(keys_.begin(), keys_.end());
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  double FalsePositiveRate() {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < 100000; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / 100000.0;
+  }
+
+ protected:
+  const FilterPolicy* policy_;
+  std::string filter_;
+
+ private:
+  std::vector<std::string> keys_;
+};
+
+TEST_F(FuseFilterTest, EmptyFilter) {
+  Build();
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(FuseFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(FuseFilterTest, SingleKey) {
+  Add("hello");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(FuseFilterTest, DuplicateKeys) {
+  // The same user key is added once for each of its versions.
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    Add(Key(i / 4, buffer));
+  }
+  Build();
+  for (int i = 0; i < 250; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << i;
+  }
+  ASSERT_LE(FalsePositiveRate(), 0.015);
+}
+
+TEST_F(FuseFilterTest, UnsortedDuplicateKeys) {
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    Add(Key(i % 250, buffer));
+  }
+  Build();
+  for (int i = 0; i < 250; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << i;
+  }
+  ASSERT_LE(FalsePositiveRate(), 0.015);
+  // Sized for the distinct keys.
+  ASSERT_LE(FilterSize(), 250 * 2.5 * 7 / 8 + 64);
+}
+
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else if (length < 10000) {
+    length += 1000;
+  } else {
+    length += 50000;
+  }
+  return length;
+}
+
+TEST_F(FuseFilterTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 200000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // 7-bit fingerprints in about 1.2 slots per key for many keys, and
+    // relatively more slots for few.
+    double slots_per_key = 2.5;
+    if (length >= 50000) {
+      slots_per_key = 1.25;
+    } else if (length >= 1000) {
+      slots_per_key = 1.45;
+    }
+    ASSERT_LE(FilterSize(),
+              static_cast<size_t>(length * slots_per_key * 7 / 8) + 64)
+        << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // 2^-7 =~ 0.78%
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.01) << length;
+  }
+}
+
+TEST_F(FuseFilterTest, FingerprintBits) {
+  char buffer[sizeof(int)];
+  for (int bits_per_key : {1, 5, 16, 23, 40}) {
+    const FilterPolicy* policy = NewBinaryFuseFilterPolicy(bits_per_key);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; i++) {
+      keys.push_back(Key(i, buffer).ToString());
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::string filter;
+    policy->CreateFilter(key_slices.data(),
+                         static_cast<int>(key_slices.size()), &filter);
+    for (int i = 0; i < 5000; i++) {
+      ASSERT_TRUE(policy->KeyMayMatch(Key(i, buffer), filter))
+          << bits_per_key << " " << i;
+    }
+    int false_positives = 0;
+    for (int i = 0; i < 100000; i++) {
+      if (policy->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+        false_positives++;
+      }
+    }
+    // Fingerprints of round(0.69 * bits_per_key) bits, at most 16.
+    int f = static_cast<int>(bits_per_key * 0.69 + 0.5);
+    if (f < 1) f = 1;
+    if (f > 16) f = 16;
+    ASSERT_LE(false_positives, 100000 * 1.5 / (1 << f) + 3) << bits_per_key;
+    delete policy;
+  }
+}
+
+TEST_F(FuseFilterTest, AppendsToExistingContents) {
+  Slice key("hello");
+  std::string filter = "prefix";
+  policy_->CreateFilter(&key, 1, &filter);
+  ASSERT_EQ("prefix", filter.substr(0, 6));
+  ASSERT_TRUE(
+      policy_->KeyMayMatch("hello", Slice(filter.data() + 6, filter.size() - 6)));
+}
+
+TEST_F(FuseFilterTest, OtherFiltersMatch) {
+  // A filter of another policy must not rule any key out.
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  Slice key("hello");
+  std::string filter;
+  bloom->CreateFilter(&key, 1, &filter);
+  ASSERT_TRUE(policy_->KeyMayMatch("hello", filter));
+  ASSERT_TRUE(policy_->KeyMayMatch("world", filter));
+  ASSERT_TRUE(policy_->KeyMayMatch("world", Slice("x")));
+  delete bloom;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
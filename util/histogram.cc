@@ -247,6 +247,9 @@ std::string Histogram::ToString() const {
   snprintf(buf, sizeof(buf), "Min: %.4f  Median: %.4f  Max: %.4f\n",
            (num_ == 0.0 ? 0.0 : min_), Median(), max_);
   r.append(buf);
+  snprintf(buf, sizeof(buf), "Percentiles: P75: %.4f  P99: %.4f  P99.9: %.4f\n",
+           Percentile(75.0), Percentile(99.0), Percentile(99.9));
+  r.append(buf);
   r.append("------------------------------------------------------\n");
   const double mult = 100.0 / num_;
   double sum = 0;
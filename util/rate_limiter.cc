@@ -0,0 +1,171 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+struct GenericRateLimiter::Req {
+  Req(int64_t bytes, port::Mutex* mu) : bytes(bytes), granted(false), cv(mu) {}
+
+  const int64_t bytes;
+  bool granted;
+  port::CondVar cv;
+};
+
+GenericRateLimiter::GenericRateLimiter(int64_t bytes_per_second,
+                                       int64_t refill_period_micros,
+                                       int32_t fairness, Env* env)
+    : bytes_per_second_(std::max<int64_t>(bytes_per_second, 1)),
+      refill_period_micros_(std::max<int64_t>(refill_period_micros, 1)),
+      refill_bytes_per_period_(std::max<int64_t>(
+          bytes_per_second_ * refill_period_micros_ / 1000000, 1)),
+      fairness_(std::max<int32_t>(fairness, 1)),
+      env_(env),
+      rnd_(301),
+      available_bytes_(0),
+      next_refill_micros_(env->NowMicros()),
+      leader_waiting_(false),
+      total_bytes_through_{0, 0} {}
+
+GenericRateLimiter::~GenericRateLimiter() {
+  MutexLock l(&mu_);
+  assert(queue_[Env::kLow].empty() && queue_[Env::kHigh].empty());
+}
+
+int64_t GenericRateLimiter::GetTotalBytesThrough(Env::Priority pri) const {
+  MutexLock l(&mu_);
+  return total_bytes_through_[pri];
+}
+
+void GenericRateLimiter::Request(int64_t bytes, Env::Priority pri) {
+  // A request may never need more than one refill.
+  while (bytes > 0) {
+    const int64_t chunk = std::min(bytes, refill_bytes_per_period_);
+    RequestChunk(chunk, pri);
+    bytes -= chunk;
+  }
+}
+
+void GenericRateLimiter::RequestChunk(int64_t bytes, Env::Priority pri) {
+  MutexLock l(&mu_);
+  total_bytes_through_[pri] += bytes;
+
+  if (queue_[Env::kLow].empty() && queue_[Env::kHigh].empty()) {
+    if (env_->NowMicros() >= next_refill_micros_) {
+      Refill();
+    }
+    if (bytes <= available_bytes_) {
+      available_bytes_ -= bytes;
+      return;
+    }
+  }
+
+  Req r(bytes, &mu_);
+  queue_[pri].push_back(&r);
+  while (!r.granted) {
+    if (leader_waiting_) {
+      r.cv.Wait();
+      continue;
+    }
+
+    // Sleep until the next refill and grant what it allows.
+    leader_waiting_ = true;
+    const uint64_t now = env_->NowMicros();
+    if (now < next_refill_micros_) {
+      mu_.Unlock();
+      env_->SleepForMicroseconds(static_cast<int>(next_refill_micros_ - now));
+      mu_.Lock();
+    }
+    Refill();
+    leader_waiting_ = false;
+
+    // Hand the wait for the next refill to a request still queued.
+    if (r.granted) {
+      for (Env::Priority p : {Env::kHigh, Env::kLow}) {
+        if (!queue_[p].empty()) {
+          queue_[p].front()->cv.Signal();
+          break;
+        }
+      }
+    }
+  }
+}
+
+void GenericRateLimiter::Refill() {
+  mu_.AssertHeld();
+  next_refill_micros_ = env_->NowMicros() + refill_period_micros_;
+  // Unused bytes do not carry over beyond one period, so that an idle
+  // period does not allow a burst.
+  available_bytes_ = std::min(available_bytes_ + refill_bytes_per_period_,
+                              refill_bytes_per_period_);
+
+  // Serve flushes first, except for an occasional refill that serves
+  // compactions first.
+  const bool low_first = rnd_.OneIn(fairness_);
+  const Env::Priority order[2] = {low_first ? Env::kLow : Env::kHigh,
+                                  low_first ? Env::kHigh : Env::kLow};
+  for (Env::Priority pri : order) {
+    std::deque<Req*>* queue = &queue_[pri];
+    while (!queue->empty()) {
+      Req* next = queue->front();
+      if (next->bytes > available_bytes_) {
+        // Requests are granted in order, so everything else waits too.
+        return;
+      }
+      available_bytes_ -= next->bytes;
+      queue->pop_front();
+      next->granted = true;
+      next->cv.Signal();
+    }
+  }
+}
+
+RateLimiter* NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_micros,
+                                   int32_t fairness) {
+  return new GenericRateLimiter(bytes_per_second, refill_period_micros,
+                                fairness, Env::Default());
+}
+
+namespace {
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* target, RateLimiter* limiter,
+                          Env::Priority pri)
+      : target_(target), limiter_(limiter), pri_(pri) {}
+
+  ~RateLimitedWritableFile() override { delete target_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(data.size(), pri_);
+    return target_->Append(data);
+  }
+  Status Close() override { return target_->Close(); }
+  Status Flush() override { return target_->Flush(); }
+  Status Sync() override { return target_->Sync(); }
+
+ private:
+  WritableFile* const target_;
+  RateLimiter* const limiter_;
+  const Env::Priority pri_;
+};
+
+}  // namespace
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* target,
+                                         RateLimiter* limiter,
+                                         Env::Priority pri) {
+  return new RateLimitedWritableFile(target, limiter, pri);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include <cstdint>
+#include <deque>
+
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+// Token bucket that is refilled with a fixed number of bytes every period.
+// A request that does not fit waits in the queue of its priority.  The
+// first waiter sleeps until the next refill and then grants the queued
+// requests in order, while the others wait on their condition variables.
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_micros,
+                     int32_t fairness, Env* env);
+
+  ~GenericRateLimiter() override;
+
+  void Request(int64_t bytes, Env::Priority pri) override;
+  int64_t GetBytesPerSecond() const override { return bytes_per_second_; }
+  int64_t GetTotalBytesThrough(Env::Priority pri) const override;
+
+  // Requests larger than this are split into several requests.
+  int64_t RefillBytesPerPeriod() const { return refill_bytes_per_period_; }
+
+ private:
+  struct Req;
+
+  void RequestChunk(int64_t bytes, Env::Priority pri);
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int64_t bytes_per_second_;
+  const int64_t refill_period_micros_;
+  const int64_t refill_bytes_per_period_;
+  const int32_t fairness_;
+  Env* const env_;
+
+  mutable port::Mutex mu_;
+  Random rnd_ GUARDED_BY(mu_);
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+  bool leader_waiting_ GUARDED_BY(mu_);  // A waiter sleeps until a refill
+  std::deque<Req*> queue_[2] GUARDED_BY(mu_);  // Indexed by Env::Priority
+  int64_t total_bytes_through_[2] GUARDED_BY(mu_);
+};
+
+// Return a file that asks "limiter" for every Append() to "target" at
+// priority "pri".  The result owns "target".
+WritableFile* NewRateLimitedWritableFile(WritableFile* target,
+                                         RateLimiter* limiter,
+                                         Env::Priority pri);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
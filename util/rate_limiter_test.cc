@@ -0,0 +1,102 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+static const int64_t kMB = 1024 * 1024;
+
+TEST(RateLimiterTest, Rate) {
+  // 1MB/s, refilled with 10KB every 10ms.
+  GenericRateLimiter limiter(kMB, 10 * 1000, 10, Env::Default());
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 100; i++) {
+    limiter.Request(4096, Env::kLow);
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+  // 400KB need 40 refills, the first of which happens right away.
+  ASSERT_GE(elapsed, 300 * 1000);
+  ASSERT_LE(elapsed, 2 * 1000 * 1000);
+  ASSERT_EQ(100 * 4096, limiter.GetTotalBytesThrough(Env::kLow));
+  ASSERT_EQ(0, limiter.GetTotalBytesThrough(Env::kHigh));
+}
+
+TEST(RateLimiterTest, LargeRequest) {
+  GenericRateLimiter limiter(kMB, 10 * 1000, 10, Env::Default());
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  // Larger than one refill, so it is split.
+  limiter.Request(20 * limiter.RefillBytesPerPeriod(), Env::kHigh);
+  const uint64_t elapsed = env->NowMicros() - start;
+  ASSERT_GE(elapsed, 150 * 1000);
+  ASSERT_EQ(20 * limiter.RefillBytesPerPeriod(),
+            limiter.GetTotalBytesThrough(Env::kHigh));
+}
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  // Never serve compactions first.
+  GenericRateLimiter limiter(kMB, 10 * 1000, 1 << 30, Env::Default());
+  const int64_t chunk = limiter.RefillBytesPerPeriod();
+  Env* env = Env::Default();
+  std::atomic<uint64_t> low_done(0), high_done(0);
+
+  // Keep the limiter busy so that both threads queue up.
+  limiter.Request(chunk, Env::kLow);
+  std::thread low([&] {
+    for (int i = 0; i < 20; i++) {
+      limiter.Request(chunk, Env::kLow);
+    }
+    low_done.store(env->NowMicros());
+  });
+  std::thread high([&] {
+    for (int i = 0; i < 20; i++) {
+      limiter.Request(chunk, Env::kHigh);
+    }
+    high_done.store(env->NowMicros());
+  });
+  low.join();
+  high.join();
+  ASSERT_LT(high_done.load(), low_done.load());
+}
+
+TEST(RateLimiterTest, Shared) {
+  const int kThreads = 4;
+  const int kRequests = 25;
+  GenericRateLimiter limiter(2 * kMB, 10 * 1000, 10, Env::Default());
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kRequests; i++) {
+        limiter.Request(4096, (t % 2 == 0) ? Env::kLow : Env::kHigh);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+  // 400KB over all threads at 2MB/s.
+  ASSERT_GE(elapsed, 150 * 1000);
+  ASSERT_EQ(kThreads * kRequests * 4096,
+            limiter.GetTotalBytesThrough(Env::kLow) +
+                limiter.GetTotalBytesThrough(Env::kHigh));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -36,6 +36,11 @@ TEST(Status, MoveConstructor) {
   }
 }
 
+TEST(Status, PointerSized) {
+  // OK statuses must stay free to create, copy and destroy.
+  ASSERT_EQ(sizeof(const char*), sizeof(Status));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
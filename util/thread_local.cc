@@ -0,0 +1,189 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <atomic>
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+// Every ThreadLocalPtr gets an id, which indexes the slots of each thread.
+// A thread's slots only grow, and only under mutex_, so the thread itself
+// may read them without the lock while Scrape() reads them with it.
+class ThreadLocalPtr::StaticMeta {
+ public:
+  StaticMeta() : next_id_(0) {
+    head_.prev = &head_;
+    head_.next = &head_;
+  }
+
+  uint32_t NewId(UnrefHandler handler) {
+    MutexLock l(&mutex_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = next_id_++;
+      handlers_.resize(next_id_);
+    }
+    handlers_[id] = handler;
+    return id;
+  }
+
+  void ReclaimId(uint32_t id) {
+    MutexLock l(&mutex_);
+    const UnrefHandler handler = handlers_[id];
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->slots.size()) {
+        void* ptr = t->slots[id].exchange(nullptr, std::memory_order_acquire);
+        if (ptr != nullptr && handler != nullptr) {
+          (*handler)(ptr);
+        }
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  // Return the calling thread's slot for "id", or null if it has none.
+  std::atomic<void*>* Find(uint32_t id) {
+    ThreadData* t = tls_data_;
+    if (t == nullptr || id >= t->slots.size()) {
+      return nullptr;
+    }
+    return &t->slots[id];
+  }
+
+  // Return the calling thread's slot for "id", creating it if needed.
+  std::atomic<void*>* Slot(uint32_t id) {
+    std::atomic<void*>* slot = Find(id);
+    if (slot == nullptr) {
+      ThreadData* t = ThisThreadData();
+      MutexLock l(&mutex_);
+      while (t->slots.size() <= id) {
+        t->slots.emplace_back(nullptr);
+      }
+      slot = &t->slots[id];
+    }
+    return slot;
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->slots.size()) {
+        void* ptr =
+            t->slots[id].exchange(replacement, std::memory_order_acquire);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+ private:
+  struct ThreadData {
+    // A deque does not move its elements when it grows.
+    std::deque<std::atomic<void*>> slots;
+    ThreadData* prev;
+    ThreadData* next;
+  };
+
+  // Hands the slots of an exiting thread to OnThreadExit().
+  struct ThreadDataHolder {
+    ~ThreadDataHolder() {
+      if (data != nullptr) {
+        Instance()->OnThreadExit(data);
+      }
+    }
+
+    ThreadData* data = nullptr;
+  };
+
+  ThreadData* ThisThreadData() {
+    if (tls_data_ == nullptr) {
+      static thread_local ThreadDataHolder holder;
+      ThreadData* t = new ThreadData;
+      {
+        MutexLock l(&mutex_);
+        t->next = &head_;
+        t->prev = head_.prev;
+        t->prev->next = t;
+        head_.prev = t;
+      }
+      holder.data = t;
+      tls_data_ = t;
+    }
+    return tls_data_;
+  }
+
+  void OnThreadExit(ThreadData* t) {
+    {
+      MutexLock l(&mutex_);
+      t->prev->next = t->next;
+      t->next->prev = t->prev;
+      for (uint32_t id = 0; id < t->slots.size(); id++) {
+        void* ptr = t->slots[id].load(std::memory_order_relaxed);
+        if (ptr != nullptr && handlers_[id] != nullptr) {
+          (*handlers_[id])(ptr);
+        }
+      }
+    }
+    tls_data_ = nullptr;
+    delete t;
+  }
+
+  static thread_local ThreadData* tls_data_;
+
+  port::Mutex mutex_;
+  ThreadData head_ GUARDED_BY(mutex_);  // Circular list of all threads
+  uint32_t next_id_ GUARDED_BY(mutex_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mutex_);
+  std::vector<UnrefHandler> handlers_ GUARDED_BY(mutex_);  // Indexed by id
+};
+
+thread_local ThreadLocalPtr::StaticMeta::ThreadData*
+    ThreadLocalPtr::StaticMeta::tls_data_ = nullptr;
+
+ThreadLocalPtr::StaticMeta* ThreadLocalPtr::Instance() {
+  // Never destroyed, since threads may exit after static destructors run.
+  static NoDestructor<StaticMeta> instance;
+  return instance.get();
+}
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Instance()->NewId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { Instance()->ReclaimId(id_); }
+
+void* ThreadLocalPtr::Get() const {
+  std::atomic<void*>* slot = Instance()->Find(id_);
+  return slot == nullptr ? nullptr : slot->load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Instance()->Slot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Instance()->Slot(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return Instance()->Slot(id_)->compare_exchange_strong(
+      *expected, ptr, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Instance()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
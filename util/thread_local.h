@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A ThreadLocalPtr holds one pointer per thread, initially null.  Unlike a
+// thread_local variable it can be a member of an object, and the owner can
+// collect the pointers of all threads with Scrape().
+//
+// Get(), Reset(), Swap() and CompareAndSwap() are meant for the fast path:
+// they do not take a lock once the calling thread has used some
+// ThreadLocalPtr before.
+class ThreadLocalPtr {
+ public:
+  // Called with a thread's non-null pointer when the thread exits or the
+  // ThreadLocalPtr is destroyed.  May be called while an internal lock is
+  // held, so it must not call into ThreadLocalPtr.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's pointer.
+  void* Get() const;
+
+  // Set the calling thread's pointer.
+  void Reset(void* ptr);
+
+  // Set the calling thread's pointer and return its previous value.
+  void* Swap(void* ptr);
+
+  // If the calling thread's pointer is *expected, set it to "ptr" and
+  // return true.  Otherwise store its value in *expected and return false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Replace the pointers of all threads that have used this ThreadLocalPtr
+  // with "replacement" and append the non-null previous values to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  class StaticMeta;
+
+  static StaticMeta* Instance();
+
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
@@ -0,0 +1,115 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+std::atomic<int> unref_count(0);
+
+void CountUnref(void* ptr) { unref_count.fetch_add(1); }
+
+}  // namespace
+
+TEST(ThreadLocalTest, PerThread) {
+  ThreadLocalPtr tls;
+  int a = 0, b = 0;
+  ASSERT_TRUE(tls.Get() == nullptr);
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+
+  std::thread t([&] {
+    ASSERT_TRUE(tls.Get() == nullptr);
+    ASSERT_TRUE(tls.Swap(&b) == nullptr);
+    ASSERT_EQ(&b, tls.Get());
+  });
+  t.join();
+  ASSERT_EQ(&a, tls.Get());
+
+  void* expected = &b;
+  ASSERT_TRUE(!tls.CompareAndSwap(&b, &expected));
+  ASSERT_EQ(&a, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(&b, &expected));
+  ASSERT_EQ(&b, tls.Get());
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  ThreadLocalPtr tls;
+  int values[4];
+  int replacement;
+  tls.Reset(&values[0]);
+  std::vector<std::thread> threads;
+  std::atomic<int> ready(0);
+  std::atomic<bool> done(false);
+  for (int i = 1; i < 4; i++) {
+    threads.emplace_back([&, i] {
+      tls.Reset(&values[i]);
+      ready.fetch_add(1);
+      while (!done.load()) {
+        std::this_thread::yield();
+      }
+      // The scraped pointer was replaced.
+      ASSERT_EQ(&replacement, tls.Get());
+    });
+  }
+  while (ready.load() < 3) {
+    std::this_thread::yield();
+  }
+
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, &replacement);
+  done.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  std::sort(ptrs.begin(), ptrs.end());
+  ASSERT_EQ(4, ptrs.size());
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(&values[i], ptrs[i]);
+  }
+  ASSERT_EQ(&replacement, tls.Get());
+}
+
+TEST(ThreadLocalTest, UnrefHandler) {
+  unref_count.store(0);
+  int value;
+  {
+    ThreadLocalPtr tls(&CountUnref);
+    std::thread t1([&] { tls.Reset(&value); });
+    t1.join();
+    ASSERT_EQ(1, unref_count.load());
+
+    // Threads that leave a null pointer are not reported.
+    std::thread t2([&] {
+      tls.Reset(&value);
+      tls.Reset(nullptr);
+    });
+    t2.join();
+    ASSERT_EQ(1, unref_count.load());
+
+    tls.Reset(&value);
+  }
+  // Destroying the ThreadLocalPtr reports the pointers still set.
+  ASSERT_EQ(2, unref_count.load());
+
+  // The id is reused with a clean slot.
+  ThreadLocalPtr tls2;
+  ASSERT_TRUE(tls2.Get() == nullptr);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}